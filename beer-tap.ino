@@ -15,35 +15,79 @@
 
 // Include configuration and modules
 #include <Arduino_MQTT_Client.h>
+#include <Attribute_Request.h>
+#include <HTTPClient.h>
 #include <Server_Side_RPC.h>
+#include <Shared_Attribute_Update.h>
 #include <ThingsBoard.h>
 #include <WiFi.h>
 #include <WiFiManager.h>  // WiFiManager by Tzapu - Install via Arduino Library Manager
+#include <sys/time.h>
+#include "src/attribute_publisher.h"
+#include "src/benchmark.h"
+#include "src/boot_timeline.h"
+#include "src/calibration_session.h"
 #include "src/config.h"
+#include "src/config_store.h"
 #include "src/config_validator.h"
 #include "src/constants.h"
+#include "src/control_loop.h"
+#include "src/hal.h"
+#include "src/keg_inventory.h"
 #include "src/led_controller.h"
+#include "src/local_endpoint.h"
+#include "src/logger.h"
 #include "src/network_manager.h"
+#include "src/order_queue.h"
+#include "src/ota_update.h"
+#include "src/perf_counters.h"
+#include "src/pour_ledger.h"
 #include "src/pour_system.h"
+#include "src/power_manager.h"
+#include "src/tap_controller.h"
+#include "src/wifi_fast_connect.h"
 
 // Initialize ThingsBoard client
 WiFiClient espClient;
 Arduino_MQTT_Client mqttClient(espClient);
-constexpr size_t MAX_RPC_SUBSCRIPTIONS = 4U;
-constexpr size_t MAX_RPC_RESPONSE = 256U;
+constexpr size_t MAX_RPC_SUBSCRIPTIONS = 13U;
+constexpr size_t MAX_RPC_RESPONSE = 512U;  // getConfig answers with a whole tap's configuration
 Server_Side_RPC<MAX_RPC_SUBSCRIPTIONS, MAX_RPC_RESPONSE> rpc;
-IAPI_Implementation *apis[1U] = {&rpc};
-ThingsBoard tb(mqttClient, 256U, 256U, 1024U, apis + 0U, apis + 1U);
+constexpr size_t MAX_FW_ATTRIBUTES = 5U;  // The fw_* shared attributes of an OTA package
+Shared_Attribute_Update<1U, MAX_FW_ATTRIBUTES> sharedAttributes;
+Attribute_Request<1U, MAX_FW_ATTRIBUTES> attributeRequest;
+IAPI_Implementation *apis[3U] = {&rpc, &sharedAttributes, &attributeRequest};
+ThingsBoard tb(mqttClient, MQTT_RECEIVE_BUFFER_SIZE, MQTT_SEND_BUFFER_SIZE, MQTT_MAX_STACK_SIZE,
+               apis + 0U, apis + 3U);
+
+// Firmware image chunks come from ThingsBoard's HTTP device API, see serviceOta()
+WiFiClient otaClient;
+uint8_t otaChunk[OTA_CHUNK_SIZE];
+bool fwAttributesWanted = false;  // Ask for the fw_* attributes on the next pass
+
+// LAN pour endpoint socket, see serveLocalRequests()
+WiFiUDP localUdp;
+bool localUdpStarted = false;
 
 // LED controller instance
 LEDController ledController;
 
+// Woken by submitted commands while the idle power mode stretches its period
+TaskHandle_t controlTaskHandle = nullptr;
+
 // WiFi Manager instance for dynamic WiFi configuration
 WiFiManager wifiManager;
 
 // Custom WiFiManager parameters
 WiFiManagerParameter *custom_tb_server = nullptr;
 
+// Taps with a pour in progress, from the control task's events
+uint32_t pouringTaps = 0;
+unsigned long lastPourCompleteMillis = 0;
+
+// Cup size shown on the dashboard, the order being poured or 0
+int dashboardCupSize[TAP_MAX_COUNT] = {};
+
 // Connection state tracking
 bool thingsBoardConnected = false;
 bool rpcSubscribed = false;
@@ -54,27 +98,207 @@ const unsigned long CONNECTION_TIMEOUT = 10000;        // 10 seconds timeout for
 // Helper macro for array size
 #define COUNT_OF(x) ((sizeof(x) / sizeof(0 [x])) / ((size_t)(!(sizeof(x) % sizeof(0 [x])))))
 
+// Everything one pour needs, from the pour RPC or one of the single-purpose RPCs wrapping it
+struct PourRequest {
+  uint8_t tap;
+  int volumeMl;      // 0 cancels the running pour, -1 when only the calibration changes
+  float mlPerPulse;  // 0 keeps the tap's calibration
+  String orderId;    // Empty when not given
+  bool waitForCup;   // The order starts only after confirmCup
+};
+
 // Forward declarations
+void processPourCommand(const JsonVariantConst &data, JsonDocument &response);
 void processCupSizeChange(const JsonVariantConst &data, JsonDocument &response);
 void processMlPerPulseChange(const JsonVariantConst &data, JsonDocument &response);
+void processCalibrationCurveChange(const JsonVariantConst &data, JsonDocument &response);
+void processFlowFaultThresholdsChange(const JsonVariantConst &data, JsonDocument &response);
 void processStopCommand(const JsonVariantConst &data, JsonDocument &response);
+void processConfirmCupCommand(const JsonVariantConst &data, JsonDocument &response);
+void processGetPerfStats(const JsonVariantConst &data, JsonDocument &response);
+void processGetConfig(const JsonVariantConst &data, JsonDocument &response);
+void processSetConfig(const JsonVariantConst &data, JsonDocument &response);
+void processCalibrateCommand(const JsonVariantConst &data, JsonDocument &response);
+void processSetKeg(const JsonVariantConst &data, JsonDocument &response);
 void processWiFiResetCommand(const JsonVariantConst &data, JsonDocument &response);
+void processFirmwareAttributes(const JsonObjectConst &data);
+void onFirmwareAttributesChanged(const JsonObjectConst &data);
+void onFirmwareRequestTimeout();
+bool parseTapRequest(const JsonVariantConst &data, uint8_t &tap, JsonVariantConst &value,
+                     JsonDocument &response);
+const char *validatePourRequest(const PourRequest &request);
+const char *runPourRequest(const PourRequest &request, OrderAdmission &admission);
+void setOrderResponse(const PourRequest &request, OrderAdmission admission,
+                      JsonDocument &response);
+void addAttributes();
+void publishAttributes();
+void setCupSize(uint8_t tap, int value);
+void markKegChanged(uint8_t tap);
+void markKegLevelChanged(uint8_t tap);
+size_t renderCupSize(uint8_t tap, char *buffer, size_t size);
+size_t renderOvershootModel(uint8_t tap, char *buffer, size_t size);
+size_t renderMlPerPulse(uint8_t tap, char *buffer, size_t size);
+size_t renderCalibrationCurve(uint8_t tap, char *buffer, size_t size);
+size_t renderFlowFaultThresholds(uint8_t tap, char *buffer, size_t size);
+size_t renderPourLimits(uint8_t tap, char *buffer, size_t size);
+size_t renderCalibrationHistory(uint8_t tap, char *buffer, size_t size);
+size_t renderServer(uint8_t tap, char *buffer, size_t size);
+size_t renderConfigVersion(uint8_t tap, char *buffer, size_t size);
+size_t renderKeg(uint8_t tap, char *buffer, size_t size);
+size_t renderKegRemaining(uint8_t tap, char *buffer, size_t size);
+size_t renderKegRemainingPct(uint8_t tap, char *buffer, size_t size);
+size_t renderKegPoursLeft(uint8_t tap, char *buffer, size_t size);
+size_t renderKegDispensed(uint8_t tap, char *buffer, size_t size);
+void sendFlowAlert(StopReason reason, uint8_t tap);
+void sendOrderQueueStatus(uint8_t tap);
+void recordKegPour(uint8_t tap, float actualMl);
+void reportOrderCompletion(uint8_t tap, const OrderCompletion &completion);
+void dispatchOrders();
+bool queueCalibrationPour(uint8_t tap);
+void recordCalibrationPour(uint8_t tap, const PourRecord &record);
+void finishCalibration(JsonDocument &response);
+void setCalibrationStatus(JsonDocument &response);
+uint32_t epochSeconds();
+void applyStoredConfig();
+const char *thingsBoardServer();
+void sendBootTimeline();
+void sendPerfStats();
+void serveLocalRequests();
+void runLocalCommand(const LocalCommand &command, char *result, size_t size);
+const char *resetReasonName();
+void publishPourRecord();
+void publishPourRecord(uint8_t tap);
+void drainPourLedger();
+void initializeSystem();
+void networkLoop();
+void handlePourEvents();
+void controlTask(void *param);
+void networkTask(void *param);
+void logTask(void *param);
+void wakeControlTask();
+void runBenchmarks();
+bool isPowerBusy();
+bool areTapsBusy();
+void serviceOta();
+size_t fetchOtaChunk(uint32_t index, uint8_t *buffer, size_t length);
+void sendFirmwareInfo();
+bool sendFirmwareState(FwState state);
 
 // RPC callback array
-const RPC_Callback callbacks[] = {{TB_SET_CUP_SIZE_RPC, processCupSizeChange},
-                                  {TB_SET_ML_PER_PULSE_RPC, processMlPerPulseChange},
-                                  {TB_STOP_POUR_RPC, processStopCommand},
-                                  {TB_RESET_WIFI_RPC, processWiFiResetCommand}};
+const RPC_Callback callbacks[] = {
+    {TB_POUR_RPC, processPourCommand},
+    {TB_SET_CUP_SIZE_RPC, processCupSizeChange},
+    {TB_SET_ML_PER_PULSE_RPC, processMlPerPulseChange},
+    {TB_SET_CALIBRATION_CURVE_RPC, processCalibrationCurveChange},
+    {TB_SET_FLOW_FAULT_THRESHOLDS_RPC, processFlowFaultThresholdsChange},
+    {TB_STOP_POUR_RPC, processStopCommand},
+    {TB_CONFIRM_CUP_RPC, processConfirmCupCommand},
+    {TB_GET_PERF_STATS_RPC, processGetPerfStats},
+    {TB_GET_CONFIG_RPC, processGetConfig},
+    {TB_SET_CONFIG_RPC, processSetConfig},
+    {TB_CALIBRATE_RPC, processCalibrateCommand},
+    {TB_SET_KEG_RPC, processSetKeg},
+    {TB_RESET_WIFI_RPC, processWiFiResetCommand}};
+
+// The fw_* attributes: a change only flags them, the whole set is then requested outside the
+// callback so an update that changed some of them is always seen complete
+constexpr const char *FW_ATTRIBUTES[MAX_FW_ATTRIBUTES] = {
+    TB_FW_TITLE_ATTR, TB_FW_VERSION_ATTR, TB_FW_SIZE_ATTR, TB_FW_CHECKSUM_ATTR,
+    TB_FW_CHECKSUM_ALGORITHM_ATTR};
+constexpr uint64_t FW_REQUEST_TIMEOUT_US = 10000000U;
+const Shared_Attribute_Callback<MAX_FW_ATTRIBUTES> fwChangedCallback(
+    &onFirmwareAttributesChanged, FW_ATTRIBUTES + 0U, FW_ATTRIBUTES + MAX_FW_ATTRIBUTES);
+const Attribute_Request_Callback<MAX_FW_ATTRIBUTES> fwRequestCallback(
+    &processFirmwareAttributes, FW_REQUEST_TIMEOUT_US, &onFirmwareRequestTimeout,
+    FW_ATTRIBUTES + 0U, FW_ATTRIBUTES + MAX_FW_ATTRIBUTES);
+
+// The Arduino core would confirm a new image as soon as it boots, OtaUpdate does that once the
+// image has reached ThingsBoard
+extern "C" bool verifyRollbackLater() { return true; }
 
 void setup() {
+#if BENCHMARK_MODE
+  // Prints the results and stops, the taps and the network are never started
+  runBenchmarks();
+  return;
+#endif
+  initializeSystem();
+
+  // Networking, ThingsBoard and the WiFi portal get their own core, so a stalled
+  // connection attempt can never delay the control task
+  xTaskCreatePinnedToCore(networkTask, "network", NETWORK_TASK_STACK, nullptr,
+                          NETWORK_TASK_PRIORITY, nullptr, NETWORK_TASK_CORE);
+}
+
+void loop() {
+  // All work happens in the pinned tasks started from setup()
+  vTaskDelete(nullptr);
+}
+
+void controlTask(void *param) {
+  // A tick that never returns resets the board, the relay drops back to closed on restart
+  hal::watchTask(WATCHDOG_TIMEOUT);
+  TickType_t lastWakeTime = xTaskGetTickCount();
+  for (;;) {
+    controlLoop.tick();
+    if (powerManager.isIdle()) {
+      // Nothing to pour, so only a command (or the heartbeat for the watchdog) needs a tick
+      ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(POWER_IDLE_CONTROL_PERIOD_MS));
+      controlLoop.resetPeriod();
+      lastWakeTime = xTaskGetTickCount();
+    } else {
+      vTaskDelayUntil(&lastWakeTime, pdMS_TO_TICKS(CONTROL_TASK_PERIOD_MS));
+    }
+  }
+}
+
+void wakeControlTask() {
+  if (controlTaskHandle != nullptr) {
+    xTaskNotifyGive(controlTaskHandle);
+  }
+}
+
+void networkTask(void *param) {
+  hal::watchTask(WATCHDOG_TIMEOUT);
+  for (;;) {
+    {
+      PerfTimer timer(PERF_NETWORK_LOOP);
+      networkLoop();
+    }
+    hal::feedWatchdog();
+    if (powerManager.isIdle() && espClient.available() == 0) {
+      // Returns as soon as MQTT data arrives, which the sleeping modem fetches at the next
+      // DTIM beacon, so an RPC is handled without waiting out a poll period
+      hal::waitForSocketData(espClient.fd(), POWER_IDLE_NETWORK_WAIT_MS);
+    } else {
+      vTaskDelay(pdMS_TO_TICKS(NETWORK_TASK_PERIOD_MS));
+    }
+  }
+}
+
+void logTask(void *param) {
+  for (;;) {
+    logger.drain();
+    vTaskDelay(pdMS_TO_TICKS(powerManager.isIdle() ? POWER_IDLE_NETWORK_WAIT_MS
+                                                   : LOG_DRAIN_PERIOD_MS));
+  }
+}
+
+void initializeSystem() {
   Serial.begin(115200);
   Serial.println();
+
+  // LOG_* lines wait in a ring buffer until this task gets the CPU, the pour path never
+  // blocks on the UART
+  xTaskCreatePinnedToCore(logTask, "log", LOG_TASK_STACK, nullptr, LOG_TASK_PRIORITY, nullptr,
+                          LOG_TASK_CORE);
   Serial.println("🍺 Smart Beer Tap System Starting...");
   Serial.println("=====================================");
 
   // Initialize LED controller first for visual feedback
   ledController.begin();
   ledController.setState(STATE_BOOTING);
+  bootTimeline.setResetReason(resetReasonName());
 
   // Validate configuration before proceeding
   if (!configValidator.validateConfiguration()) {
@@ -93,15 +317,50 @@ void setup() {
   Serial.println("");
   Serial.println("🚀 Starting hardware initialization...");
 
-  // Initialize pour system
-  pourSystem.init();
+  // Calibration, limits, learned models and the server override in one NVS read, before the
+  // taps load their overshoot models from it
+  configStore.begin();
+
+  // Counts the boots of a new firmware image, one that keeps restarting is rolled back here
+  otaUpdate.begin(FIRMWARE_VERSION, millis());
+  Serial.print("📦 Firmware ");
+  Serial.print(FIRMWARE_TITLE);
+  Serial.print(" ");
+  Serial.println(FIRMWARE_VERSION);
+
+  // Initialize the taps and start pour control on its own core at a fixed period
+  tapController.init();
+  applyStoredConfig();
+  addAttributes();
+  controlLoop.begin();
+  controlLoop.setWakeHandler(wakeControlTask);
+  xTaskCreatePinnedToCore(controlTask, "control", CONTROL_TASK_STACK, nullptr,
+                          CONTROL_TASK_PRIORITY, &controlTaskHandle, CONTROL_TASK_CORE);
+
+  // Full power until the taps have been quiet for POWER_IDLE_ENTER_MS, see isPowerBusy()
+  static const TapPins tapPins[] = TAP_PIN_TABLE;
+  uint8_t flowSensorPins[TAP_COUNT];
+  for (uint8_t tap = 0; tap < TAP_COUNT; tap++) {
+    flowSensorPins[tap] = tapPins[tap].flowSensorPin;
+  }
+  powerManager.begin(flowSensorPins, TAP_COUNT, POWER_IDLE_ENABLED);
+
+  // Pours made while ThingsBoard is unreachable are kept here until they are reported
+  pourLedger.begin();
+
+  // What is left in each keg, counted down by every finished pour
+  kegInventory.begin(tapController.getCount());
+
+#ifdef LOCAL_ENDPOINT_KEY
+  // Lets a kiosk on the LAN start pours without the cloud round-trip
+  localEndpoint.begin(LOCAL_ENDPOINT_KEY);
+#endif
 
   // Initialize network connectivity
   networkManager.init();
 
   // Configure WiFi Manager
   Serial.println("📡 Starting WiFi configuration...");
-  ledController.setState(STATE_WIFI_PORTAL_ACTIVE);
 
   // Configure WiFiManager settings
   wifiManager.setTimeout(WIFI_PORTAL_TIMEOUT);
@@ -131,23 +390,47 @@ void setup() {
     ledController.setState(STATE_WIFI_CONNECTING);
     Serial.println("📝 WiFi configuration saved, connecting...");
 
-    // Handle custom ThingsBoard server if provided
+    // Handle custom ThingsBoard server if provided, kept across restarts by the ConfigStore
     if (custom_tb_server != nullptr) {
       String customTbServer = custom_tb_server->getValue();
-      if (customTbServer.length() > 0 && customTbServer != THINGSBOARD_SERVER) {
-        Serial.print("📝 Custom ThingsBoard server configured: ");
-        Serial.println(customTbServer);
-        // Note: In production, you might want to save this to SPIFFS/LittleFS
+      if (customTbServer == THINGSBOARD_SERVER) {
+        customTbServer = "";
+      }
+      if (configStore.setServer(customTbServer.c_str())) {
+        configStore.flush();
+        if (customTbServer.length() > 0) {
+          Serial.print("📝 Custom ThingsBoard server configured: ");
+          Serial.println(customTbServer);
+        }
+      } else {
+        Serial.println("❌ Invalid ThingsBoard server, keeping the previous one");
       }
     }
   });
 
-  // Start WiFi Manager - will connect to saved network or start portal
-  if (wifiManager.autoConnect(WIFI_PORTAL_SSID, WIFI_PORTAL_PASSWORD)) {
+  bootTimeline.endPhase(BOOT_PHASE_HARDWARE);
+
+  // After a brownout or watchdog restart the last access point is almost always still there,
+  // so associate with it directly and only let WiFiManager scan (or open the portal) if not
+  ledController.setState(STATE_WIFI_CONNECTING);
+  bool wifiConnected = wifiFastConnect.connect(WIFI_FAST_CONNECT_TIMEOUT_MS);
+  bootTimeline.setFastConnect(wifiConnected);
+  if (!wifiConnected) {
+    ledController.setState(STATE_WIFI_PORTAL_ACTIVE);
+    // Start WiFi Manager - will connect to saved network or start portal
+    wifiConnected = wifiManager.autoConnect(WIFI_PORTAL_SSID, WIFI_PORTAL_PASSWORD);
+  }
+
+  if (wifiConnected) {
     Serial.println("✅ WiFi connected!");
     Serial.print("IP address: ");
     Serial.println(WiFi.localIP());
     ledController.setState(STATE_WIFI_CONNECTED);
+    bootTimeline.endPhase(BOOT_PHASE_WIFI);
+    wifiFastConnect.save();
+
+    // Wall clock for recorded pour samples, synced in the background
+    configTime(0, 0, NTP_SERVER);
   } else {
     Serial.println("❌ WiFi connection failed or timed out");
     ledController.setState(STATE_WIFI_FAILED);
@@ -168,28 +451,28 @@ void setup() {
   ledController.setState(STATE_SYSTEM_READY);
 }
 
-void loop() {
-  // Update LED controller
-  ledController.update();
-
+void networkLoop() {
   // Process WiFi Manager events (non-blocking)
   wifiManager.process();
 
   // If configuration is invalid, just wait
   if (!configValidator.isConfigValid()) {
     ledController.setState(STATE_CONFIG_ERROR);
-    delay(100);
     return;
   }
 
   // Handle ThingsBoard connection
   if (WiFi.status() == WL_CONNECTED) {
+    // Covers a connection made through the portal after setup() gave up
+    bootTimeline.endPhase(BOOT_PHASE_WIFI);
+
     if (!thingsBoardConnected) {
-      // Try to connect to ThingsBoard
-      if (millis() - lastConnectionAttempt > CONNECTION_RETRY_INTERVAL) {
+      // Try to connect to ThingsBoard, the first attempt right away
+      if (lastConnectionAttempt == 0 ||
+          millis() - lastConnectionAttempt > CONNECTION_RETRY_INTERVAL) {
         Serial.println("📡 Attempting to connect to ThingsBoard...");
         Serial.print("Server: ");
-        Serial.println(THINGSBOARD_SERVER);
+        Serial.println(thingsBoardServer());
         Serial.print("Token: ");
         Serial.println(String(THINGSBOARD_ACCESS_TOKEN).substring(0, 8) + "...");
 
@@ -202,13 +485,12 @@ void loop() {
 
         // Try connection with timeout
         while (millis() - connectionStart < CONNECTION_TIMEOUT) {
-          if (tb.connect(THINGSBOARD_SERVER, THINGSBOARD_ACCESS_TOKEN)) {
+          if (tb.connect(thingsBoardServer(), THINGSBOARD_ACCESS_TOKEN)) {
             connectionResult = true;
             break;
           }
-          delay(100);
-          // Feed watchdog during connection attempt
-          pourSystem.checkWatchdog();
+          hal::feedWatchdog();  // Each attempt is bounded, only a hung one should reset
+          delay(100);           // Only blocks this task, pour control keeps running
         }
 
         if (connectionResult) {
@@ -221,12 +503,27 @@ void loop() {
             Serial.println("✅ RPC subscriptions successful!");
             rpcSubscribed = true;
 
-            // Send initial attributes
-            tb.sendAttributeData(TB_CUP_SIZE_ATTR, 0);
-            tb.sendAttributeData(TB_ML_PER_PULSE_ATTR, pourSystem.getMlPerPulse());
+            // Every attribute, those ThingsBoard already has are dropped by publishAttributes()
+            attributePublisher.markAllChanged(millis());
+
+            // Firmware packages assigned while the tap was offline are picked up here
+            sendFirmwareInfo();
+            if (!sharedAttributes.Shared_Attributes_Subscribe(fwChangedCallback)) {
+              Serial.println("❌ Firmware attribute subscription failed!");
+            }
+            fwAttributesWanted = true;
+
+            // The tap can take orders from here on
+            bootTimeline.endPhase(BOOT_PHASE_THINGSBOARD);
+            if (bootTimeline.takeReport()) {
+              sendBootTimeline();
+            }
           } else {
             Serial.println("❌ RPC subscription failed!");
           }
+
+          // Remember this access point for a fast reconnect after the next restart
+          wifiFastConnect.save();
         } else {
           Serial.println("❌ ThingsBoard connection failed, retrying...");
           Serial.print("WiFi Status: ");
@@ -239,6 +536,7 @@ void loop() {
       }
     } else {
       // Already connected, run normal loop
+      PerfTimer timer(PERF_TB_LOOP);
       tb.loop();
     }
   } else {
@@ -248,37 +546,49 @@ void loop() {
     ledController.setState(STATE_WIFI_FAILED);
   }
 
-  // Check system watchdog
-  pourSystem.checkWatchdog();
-
   // Check network status and handle reconnections
   networkManager.handleWifiStatusChange();
 
-  // Update pour system (includes safety checks and pour logic)
-  pourSystem.update();
+  // Pour commands from the LAN work with or without ThingsBoard
+  serveLocalRequests();
 
-  // Handle pour state changes and LED updates
-  static bool lastPourState = false;
-  bool currentPourState = pourSystem.getIsPouring();
+  // Pour state changes from the control task
+  handlePourEvents();
+  dispatchOrders();
+  publishPourRecord();
+  drainPourLedger();
 
-  // Update pour LED status
-  if (currentPourState) {
-    ledController.setState(STATE_POURING);
-  } else if (lastPourState && !currentPourState) {
-    // Pour just completed - temporarily show completion
-    ledController.setTemporaryState(STATE_POUR_COMPLETE, 3000);
-  }
+  // Attributes changed by this pass, the RPCs it ran and the passes before it, in one message
+  publishAttributes();
 
-  // Send cup size reset to ThingsBoard when pour completes
-  if (thingsBoardConnected) {
-    if (lastPourState && !currentPourState) {
-      tb.sendAttributeData(TB_CUP_SIZE_ATTR, 0);
-      Serial.println("📱 Cup size reset to 0 after pour completion");
+  // Settings changed by RPCs and learned models, written once they stop changing and no tap
+  // is pouring
+  configStore.update(millis(), areTapsBusy());
+  kegInventory.update(millis());
+
+  // Firmware update chunks, between pours only
+  serviceOta();
+
+  // Low-power idle mode once nothing has needed full-rate polling for a while
+  powerManager.update(isPowerBusy(), millis());
+
+  // Report control loop jitter, which shows whether networking still disturbs pour control,
+  // the section latencies and heap of the last interval, and how many pour records were lost
+  static unsigned long lastJitterReport = 0;
+  if (thingsBoardConnected && millis() - lastJitterReport > JITTER_REPORT_INTERVAL) {
+    tb.sendTelemetryData(TB_CONTROL_JITTER_TELEMETRY, controlLoop.takeMaxJitterUs());
+    tb.sendTelemetryData(TB_CONTROL_OVERRUNS_TELEMETRY, controlLoop.getOverruns());
+    tb.sendTelemetryData(TB_ASLEEP_TELEMETRY, powerManager.takeAsleepMs(millis()));
+    uint32_t recordsDropped = 0;
+    for (uint8_t tap = 0; tap < tapController.getCount(); tap++) {
+      recordsDropped += tapController.getTap(tap).getRecorder().getDroppedRecords();
     }
+    tb.sendTelemetryData(TB_RECORDS_DROPPED_TELEMETRY, recordsDropped);
+    tb.sendTelemetryData(TB_LEDGER_DROPPED_TELEMETRY, pourLedger.getDroppedRecords());
+    sendPerfStats();
+    lastJitterReport = millis();
   }
 
-  lastPourState = currentPourState;
-
   // Check for WiFi reset via serial command
   if (Serial.available()) {
     String command = Serial.readStringUntil('\n');
@@ -287,65 +597,671 @@ void loop() {
       Serial.println("🔄 WiFi reset requested via serial");
       ledController.setTemporaryState(STATE_WIFI_PORTAL_ACTIVE, 2000);
       wifiManager.resetSettings();
+      wifiFastConnect.clear();
+      configStore.flush();
+      kegInventory.flush();
       Serial.println("📝 WiFi settings cleared, restarting...");
       delay(1000);
       ESP.restart();
+    } else if (command.equalsIgnoreCase("jitter")) {
+      Serial.print("⏱️ Control loop max jitter: ");
+      Serial.print(controlLoop.takeMaxJitterUs());
+      Serial.print("us, overruns: ");
+      Serial.println(controlLoop.getOverruns());
+    } else if (command.equalsIgnoreCase("perf")) {
+      char payload[TELEMETRY_CHUNK_SIZE];
+      if (perfCounters.toJson(payload, sizeof(payload)) > 0) {
+        Serial.println(payload);
+      }
     }
   }
+}
+
+void handlePourEvents() {
+  // The LED keeps pulsing until the last pouring tap finishes
+  PourEvent event;
+  TapSettings settings;
+  while (controlLoop.pollEvent(event)) {
+    switch (event.type) {
+      case EVENT_POUR_STARTED:
+        pouringTaps |= 1UL << event.tap;
+        ledController.setState(STATE_POURING);
+        orderQueues[event.tap].onPourStarted();
+        break;
 
-  // Small delay to prevent overwhelming the system
-  delay(100);
+      case EVENT_POUR_COMPLETE:
+        // Pour just completed - temporarily show completion
+        pouringTaps &= ~(1UL << event.tap);
+        lastPourCompleteMillis = millis();
+        if (pouringTaps == 0) {
+          ledController.setState(STATE_SYSTEM_READY);
+          ledController.setTemporaryState(STATE_POUR_COMPLETE, 3000);
+        }
+
+        // Cup size back to 0 on the dashboard
+        setCupSize(event.tap, 0);
+        sendFlowAlert((StopReason)event.extra, event.tap);
+
+        OrderCompletion completion;
+        if (orderQueues[event.tap].onPourComplete(event.value, (StopReason)event.extra, millis(),
+                                                  completion)) {
+          reportOrderCompletion(event.tap, completion);
+        }
+        break;
+
+      case EVENT_OVERSHOOT_MEASURED:
+        // Report the overshoot once the trailing pulses of a pour have been counted
+        if (thingsBoardConnected) {
+          char key[32];
+          tb.sendTelemetryData(tapKey(TB_OVERSHOOT_ML_TELEMETRY, event.tap, key, sizeof(key)),
+                               event.value);
+          tb.sendTelemetryData(tapKey(TB_VALVE_LATENCY_TELEMETRY, event.tap, key, sizeof(key)),
+                               event.extra);
+        }
+        attributePublisher.markChanged(renderOvershootModel, event.tap, millis());
+        break;
+
+      case EVENT_CALIBRATION_CHANGED:
+        controlLoop.readSettings(event.tap, settings);
+        configStore.setCalibrationCurve(event.tap, settings.calibration);
+        attributePublisher.markChanged(renderMlPerPulse, event.tap, millis());
+        attributePublisher.markChanged(renderCalibrationCurve, event.tap, millis());
+        break;
+
+      case EVENT_FLOW_FAULT_THRESHOLDS_CHANGED:
+        controlLoop.readSettings(event.tap, settings);
+        configStore.setFlowFaultThresholds(event.tap, settings.flowFaultThresholds);
+        attributePublisher.markChanged(renderFlowFaultThresholds, event.tap, millis());
+        break;
+
+      case EVENT_POUR_LIMITS_CHANGED:
+        controlLoop.readSettings(event.tap, settings);
+        configStore.setPourLimits(event.tap, settings.limits);
+        attributePublisher.markChanged(renderPourLimits, event.tap, millis());
+        break;
+
+      case EVENT_COMMAND_QUEUE_FULL:
+        LOG_WARN("⚠️ Pour command queue full, command dropped");
+        break;
+    }
+  }
 }
 
 // ThingsBoard RPC callback handlers
 
-void processCupSizeChange(const JsonVariantConst &data, JsonDocument &response) {
-  int value = data.as<int>();
-  Serial.print("📱 ThingsBoard received cup size: ");
-  Serial.print(value);
-  Serial.println("ml");
-  pourSystem.handleCupSizeChange(value);
+// A "tap" key, 0 when absent. False unless it is an int naming one of the taps; read as an int
+// first, since as<uint8_t>() would turn 256 or -1 into tap 0.
+bool readTap(const JsonVariantConst &field, uint8_t &tap) {
+  tap = 0;
+  if (field.isNull()) {
+    return true;
+  }
+  if (!field.is<int>()) {
+    return false;
+  }
+  int value = field.as<int>();
+  if (value < 0 || value >= tapController.getCount()) {
+    return false;
+  }
+  tap = (uint8_t)value;
+  return true;
+}
 
-  // Send attribute update to ThingsBoard
-  if (thingsBoardConnected) {
-    tb.sendAttributeData(TB_CUP_SIZE_ATTR, value);
-    Serial.println("📱 Cup size attribute sent to ThingsBoard: " + String(value) + "ml");
+// Tap parameters are either the bare value, which addresses tap 0, or {"tap": n, "value": ...}
+// where "tap" defaults to 0
+bool parseTapRequest(const JsonVariantConst &data, uint8_t &tap, JsonVariantConst &value,
+                     JsonDocument &response) {
+  tap = 0;
+  value = data;
+  if (!data["tap"].isNull() || !data["value"].isNull()) {
+    value = data["value"];
+    if (!readTap(data["tap"], tap)) {
+      response.set("invalid tap");
+      return false;
+    }
+  }
+  return true;
+}
+
+// Checks every field before anything is applied, returns the first invalid one or nullptr
+const char *validatePourRequest(const PourRequest &request) {
+  if (!tapController.isValid(request.tap)) {
+    return "tap";
+  }
+  if (request.volumeMl < -1 || (request.volumeMl == -1 && request.mlPerPulse == 0) ||
+      (request.volumeMl > 0 &&
+       (request.volumeMl < MIN_CUP_SIZE || request.volumeMl > MAX_CUP_SIZE))) {
+    return "volumeMl";
+  }
+  if (request.mlPerPulse != 0 &&
+      (request.mlPerPulse < MIN_ML_PER_PULSE || request.mlPerPulse > MAX_ML_PER_PULSE)) {
+    return "mlPerPulse";
+  }
+  if (!OrderQueue::isValidId(request.orderId.c_str())) {
+    return "orderId";
+  }
+  return nullptr;
+}
+
+// Applies a validated request. A volume queues an order, whose calibration measures that pour
+// only. Without a volume the tap's calibration changes right away, and volume 0 cancels the
+// running pour. Returns nullptr, "invalid", "queue full", "busy" or "calibrating".
+const char *runPourRequest(const PourRequest &request, OrderAdmission &admission) {
+  uint8_t tap = request.tap;
+  admission = ORDER_ACCEPTED;
+  if (request.volumeMl > 0) {
+    // The measuring jug is under the tap until the calibration run ends
+    if (calibrationSession.isActive(tap)) {
+      return "calibrating";
+    }
+    // Every cup is an order, so one that arrives mid-pour waits its turn instead of resetting
+    // the running pour. An id makes retries of the same order harmless.
+    admission = orderQueues[tap].enqueue(request.orderId.c_str(), request.volumeMl, millis(),
+                                         request.mlPerPulse, request.waitForCup);
+    if (admission == ORDER_INVALID) {
+      return "invalid";  // Only if the queue's checks drift from validatePourRequest()
+    }
+    if (admission == ORDER_QUEUE_FULL) {
+      LOG_WARN("⚠️ Tap %u order queue full, order rejected", tap);
+      return "queue full";
+    }
+    if (admission == ORDER_ACCEPTED && thingsBoardConnected) {
+      sendOrderQueueStatus(tap);
+    }
+    return nullptr;
+  }
+
+  if (request.mlPerPulse != 0 && !controlLoop.submit(tap, CMD_SET_ML_PER_PULSE,
+                                                     request.mlPerPulse)) {
+    return "busy";
+  }
+  if (request.volumeMl == 0) {
+    // Cancels the running pour, waiting orders stay queued
+    if (!controlLoop.submit(tap, CMD_SET_CUP_SIZE, 0)) {
+      return "busy";
+    }
+    setCupSize(tap, 0);
+  }
+  return nullptr;
+}
+
+void setOrderResponse(const PourRequest &request, OrderAdmission admission,
+                      JsonDocument &response) {
+  uint8_t position = 0;
+  OrderStatus status = ORDER_STATUS_QUEUED;
+  if (request.orderId.length() > 0) {
+    status = orderQueues[request.tap].getStatus(request.orderId.c_str(), position);
+    response["orderId"] = request.orderId;
+  }
+  response["status"] = orderStatusName(status);
+  response["position"] = position;
+  response["duplicate"] = admission == ORDER_DUPLICATE;
+}
+
+// {"tap", "orderId", "volumeMl", "mlPerPulse", "options": {"waitForCup"}} - a whole pour in one
+// message, everything but volumeMl optional. Validated in one pass before anything is applied
+// and answered with one object.
+void processPourCommand(const JsonVariantConst &data, JsonDocument &response) {
+  PerfTimer timer(PERF_RPC);
+  PourRequest request;
+  if (!readTap(data["tap"], request.tap)) {
+    LOG_ERROR("❌ Invalid pour request: tap");
+    response["error"] = "invalid";
+    response["field"] = "tap";
+    return;
+  }
+  request.volumeMl = data["volumeMl"].isNull() ? -1 : data["volumeMl"].as<int>();
+  request.mlPerPulse = data["mlPerPulse"].as<float>();
+  request.orderId = data["orderId"].isNull() ? String() : data["orderId"].as<String>();
+  request.waitForCup = data["options"]["waitForCup"].as<bool>();
+
+  const char *invalid = validatePourRequest(request);
+  if (invalid != nullptr) {
+    LOG_ERROR("❌ Invalid pour request: %s", invalid);
+    response["error"] = "invalid";
+    response["field"] = invalid;
+    return;
+  }
+  OrderAdmission admission;
+  const char *error = runPourRequest(request, admission);
+  if (error != nullptr) {
+    response["error"] = error;
+    return;
+  }
+
+  response["tap"] = request.tap;
+  if (request.volumeMl > 0) {
+    LOG_INFO("📱 Tap %u pour %dml, order '%s'", request.tap, request.volumeMl,
+             request.orderId.c_str());
+    setOrderResponse(request, admission, response);
+    response["queueDepth"] = orderQueues[request.tap].getDepth();
+  } else {
+    response["status"] = request.volumeMl == 0 ? "cancelled" : "calibrated";
+  }
+  if (request.mlPerPulse != 0) {
+    response["mlPerPulse"] = request.mlPerPulse;
   }
+}
+
+// setCupSize: a pour request with just the volume
+void processCupSizeChange(const JsonVariantConst &data, JsonDocument &response) {
+  PerfTimer timer(PERF_RPC);
+  uint8_t tap;
+  JsonVariantConst value;
+  if (!parseTapRequest(data, tap, value, response)) {
+    return;
+  }
+  PourRequest request;
+  request.tap = tap;
+  request.volumeMl = value.as<int>();
+  request.mlPerPulse = 0;
+  request.orderId = data["orderId"].isNull() ? String() : data["orderId"].as<String>();
+  request.waitForCup = false;
+  LOG_INFO("📱 ThingsBoard received cup size for tap %u: %dml", tap, request.volumeMl);
 
-  response.set(value);
+  if (validatePourRequest(request) != nullptr) {
+    LOG_ERROR("❌ Invalid order: %dml, id '%s'", request.volumeMl, request.orderId.c_str());
+    response.set("invalid");
+    return;
+  }
+  OrderAdmission admission;
+  const char *error = runPourRequest(request, admission);
+  if (error != nullptr) {
+    response.set(error);
+  } else if (request.volumeMl == 0 || request.orderId.length() == 0) {
+    response.set(request.volumeMl);
+  } else {
+    setOrderResponse(request, admission, response);
+  }
 }
 
+// setMlPerPulse: a pour request with just the calibration
 void processMlPerPulseChange(const JsonVariantConst &data, JsonDocument &response) {
-  float value = data.as<float>();
-  pourSystem.handleMlPerPulseChange(value);
+  PerfTimer timer(PERF_RPC);
+  uint8_t tap;
+  JsonVariantConst value;
+  if (!parseTapRequest(data, tap, value, response)) {
+    return;
+  }
+  PourRequest request;
+  request.tap = tap;
+  request.volumeMl = -1;
+  request.mlPerPulse = value.as<float>();
+  request.waitForCup = false;
 
-  // Send attribute update to ThingsBoard
-  if (thingsBoardConnected) {
-    tb.sendAttributeData(TB_ML_PER_PULSE_ATTR, value);
-    Serial.println("📱 ML per pulse attribute sent to ThingsBoard: " + String(value));
+  if (validatePourRequest(request) != nullptr) {
+    LOG_ERROR("❌ Invalid ml per pulse: %.2f", request.mlPerPulse);
+    response.set("invalid");
+    return;
+  }
+  OrderAdmission admission;
+  const char *error = runPourRequest(request, admission);
+  if (error != nullptr) {
+    response.set(error);
+    return;
+  }
+  // ThingsBoard gets the new calibration once the control task has applied it
+  response.set(request.mlPerPulse);
+}
+
+void processCalibrationCurveChange(const JsonVariantConst &data, JsonDocument &response) {
+  PerfTimer timer(PERF_RPC);
+  uint8_t tap;
+  JsonVariantConst request;
+  if (!parseTapRequest(data, tap, request, response)) {
+    return;
+  }
+
+  // [[intervalUs, mlPerPulse], ...] sorted by interval, a single pair for a flat calibration
+  CalibrationPoint points[CALIBRATION_MAX_POINTS];
+  size_t count = 0;
+  for (JsonVariantConst point : request.as<JsonArrayConst>()) {
+    if (count >= CALIBRATION_MAX_POINTS) {
+      response.set("too many points");
+      return;
+    }
+    points[count].intervalUs = point[0].as<uint32_t>();
+    points[count].ulPerPulse = microlitresPerPulse(point[1].as<float>());
+    count++;
   }
 
-  response.set(value);
+  CalibrationCurve curve;
+  if (!curve.set(points, count)) {
+    LOG_ERROR("❌ Invalid calibration curve (%u points)", (unsigned)count);
+    response.set("invalid");
+    return;
+  }
+  if (!controlLoop.submitCalibrationCurve(tap, curve)) {
+    response.set("busy");
+    return;
+  }
+  response.set(count);
+}
+
+void processFlowFaultThresholdsChange(const JsonVariantConst &data, JsonDocument &response) {
+  PerfTimer timer(PERF_RPC);
+  // The thresholds sit next to an optional "tap" key rather than under "value"
+  uint8_t tap;
+  if (!readTap(data["tap"], tap)) {
+    response.set("invalid tap");
+    return;
+  }
+
+  // Only the keys present are changed, 0 disables a check
+  TapSettings settings;
+  controlLoop.readSettings(tap, settings);
+  FlowFaultThresholds thresholds = settings.flowFaultThresholds;
+  if (!data["noFlowMs"].isNull()) {
+    thresholds.noFlowMs = data["noFlowMs"].as<uint32_t>();
+  }
+  if (!data["collapseRatio"].isNull()) {
+    thresholds.collapseRatio = data["collapseRatio"].as<float>();
+  }
+  if (!data["collapseMs"].isNull()) {
+    thresholds.collapseMs = data["collapseMs"].as<uint32_t>();
+  }
+  if (!data["foamCv"].isNull()) {
+    thresholds.foamCv = data["foamCv"].as<float>();
+  }
+
+  if (thresholds.collapseRatio < 0 || thresholds.collapseRatio >= 1 || thresholds.foamCv < 0) {
+    response.set("invalid");
+    return;
+  }
+  if (!controlLoop.submitFlowFaultThresholds(tap, thresholds)) {
+    response.set("busy");
+    return;
+  }
+  response.set("ok");
 }
 
 void processStopCommand(const JsonVariantConst &data, JsonDocument &response) {
-  int value = data.as<int>();
+  PerfTimer timer(PERF_RPC);
+  // A bare 1 stops every tap, {"tap": n, "value": 1} just that one
+  uint8_t tap = TAP_ALL;
+  JsonVariantConst request = data;
+  if (!data["tap"].isNull() && !parseTapRequest(data, tap, request, response)) {
+    return;
+  }
+
+  int value = request.as<int>();
   if (value == 1)  // Button pressed (only act on press, not release)
   {
-    pourSystem.emergencyStop();
+    if (!controlLoop.requestStop(tap)) {
+      response["error"] = "invalid";
+      return;
+    }
     // Flash error LED briefly to indicate emergency stop
     ledController.setTemporaryState(STATE_ERROR, 1000);
 
-    // Reset cup size display on dashboard
-    if (thingsBoardConnected) {
-      tb.sendAttributeData(TB_CUP_SIZE_ATTR, 0);
-      Serial.println("📱 Dashboard cup size reset to 0");
+    // Reset cup size display on dashboard, dropped when the stopped pour has already done it
+    for (uint8_t i = 0; i < tapController.getCount(); i++) {
+      if (tap == TAP_ALL || tap == i) {
+        setCupSize(i, 0);
+      }
     }
   }
   response.set("stopped");
 }
 
+void processConfirmCupCommand(const JsonVariantConst &data, JsonDocument &response) {
+  PerfTimer timer(PERF_RPC);
+  uint8_t tap;
+  JsonVariantConst request;
+  if (!parseTapRequest(data, tap, request, response)) {
+    return;
+  }
+  // Releases the next order after a pour that ended early, or before the cup swap delay is up
+  orderQueues[tap].confirmCup();
+  response.set(orderQueues[tap].getDepth());
+}
+
+void processGetPerfStats(const JsonVariantConst &data, JsonDocument &response) {
+  // Latency summary of every section since the last report, plus heap. {"section": name} adds
+  // that section's histogram as "buckets", bucket i counting durations of 2^i to 2^(i+1) us.
+  PerfTimer timer(PERF_RPC);
+  const char *requested = data["section"].as<const char *>();
+  PerfSection detailed = PERF_SECTION_COUNT;
+  if (requested != nullptr && !PerfCounters::parseSection(requested, detailed)) {
+    response.set("invalid section");
+    return;
+  }
+
+  for (uint8_t i = 0; i < PERF_SECTION_COUNT; i++) {
+    const PerfHistogram &histogram = perfCounters.get((PerfSection)i);
+    JsonObject stats = response[PerfCounters::sectionName((PerfSection)i)].to<JsonObject>();
+    stats["count"] = histogram.getCount();
+    stats["meanUs"] = histogram.getMeanUs();
+    stats["p99Us"] = histogram.getPercentileUs(99);
+    stats["maxUs"] = histogram.getMaxUs();
+    if (i == detailed) {
+      JsonArray buckets = stats["buckets"].to<JsonArray>();
+      for (uint8_t bucket = 0; bucket < PERF_HISTOGRAM_BUCKETS; bucket++) {
+        buckets.add(histogram.getBucket(bucket));
+      }
+    }
+  }
+  response["networkStalls"] = perfCounters.getStalls();
+  response["heapFree"] = hal::freeHeap();
+  response["heapMinFree"] = hal::minFreeHeap();
+  response["heapLargestBlock"] = hal::largestFreeBlock();
+}
+
+// One tap's configuration as applied, plus the state of the store. {"tap": n}, default 0.
+void processGetConfig(const JsonVariantConst &data, JsonDocument &response) {
+  PerfTimer timer(PERF_RPC);
+  uint8_t tap;
+  if (!readTap(data["tap"], tap)) {
+    response.set("invalid tap");
+    return;
+  }
+
+  char server[CONFIG_SERVER_MAX_LENGTH + 1];
+  configStore.getServer(server, sizeof(server));
+  response["version"] = configStore.getVersion();
+  response["loadedVersion"] = configStore.getLoadedVersion();
+  response["writes"] = configStore.getWrites();
+  response["pendingWrite"] = configStore.isDirty();
+  response["tbServer"] = server;
+  response["tap"] = tap;
+
+  TapSettings settings;
+  controlLoop.readSettings(tap, settings);
+  const CalibrationCurve &calibration = settings.calibration;
+  response["mlPerPulse"] = calibration.getNominalUlPerPulse() / 1000.0;
+  JsonArray curve = response["calibrationCurve"].to<JsonArray>();
+  for (size_t i = 0; i < calibration.getCount(); i++) {
+    JsonArray point = curve.add<JsonArray>();
+    point.add(calibration.getPoint(i).intervalUs);
+    point.add(calibration.getPoint(i).ulPerPulse / 1000.0);
+  }
+  const FlowFaultThresholds &thresholds = settings.flowFaultThresholds;
+  JsonObject faults = response["flowFaultThresholds"].to<JsonObject>();
+  faults["noFlowMs"] = thresholds.noFlowMs;
+  faults["collapseRatio"] = thresholds.collapseRatio;
+  faults["collapseMs"] = thresholds.collapseMs;
+  faults["foamCv"] = thresholds.foamCv;
+  response["maxPourTimeMs"] = settings.limits.maxPourTimeMs;
+  response["maxPourVolumeMl"] = settings.limits.maxPourVolumeMl;
+  response["overshootSamples"] = settings.overshoot.totalSamples;
+
+  // The full history goes out as the calibrationHistory attribute
+  CalibrationHistoryEntry history[CALIBRATION_HISTORY_SIZE];
+  size_t runs = configStore.getCalibrationHistory(tap, history, CALIBRATION_HISTORY_SIZE);
+  response["calibrationRuns"] = runs;
+  if (runs > 0) {
+    JsonArray last = response["lastCalibration"].to<JsonArray>();
+    last.add(history[runs - 1].epochSeconds);
+    last.add(history[runs - 1].ulPerPulse / 1000.0);
+    last.add(history[runs - 1].residualCentiPct / 100.0);
+  }
+}
+
+// {"tap", "maxPourTimeMs", "maxPourVolumeMl", "tbServer"}, any subset. The limits can only be
+// lowered below MAX_POUR_TIME and MAX_POUR_VOLUME. The server is used from the next
+// connection on, "" goes back to the one in config.h.
+void processSetConfig(const JsonVariantConst &data, JsonDocument &response) {
+  PerfTimer timer(PERF_RPC);
+  uint8_t tap;
+  if (!readTap(data["tap"], tap)) {
+    response.set("invalid tap");
+    return;
+  }
+
+  TapSettings settings;
+  controlLoop.readSettings(tap, settings);
+  PourLimits limits = settings.limits;
+  bool limitsGiven = !data["maxPourTimeMs"].isNull() || !data["maxPourVolumeMl"].isNull();
+  if (!data["maxPourTimeMs"].isNull()) {
+    limits.maxPourTimeMs = data["maxPourTimeMs"].as<uint32_t>();
+  }
+  if (!data["maxPourVolumeMl"].isNull()) {
+    uint32_t volumeMl = data["maxPourVolumeMl"].as<uint32_t>();
+    limits.maxPourVolumeMl = volumeMl <= MAX_POUR_VOLUME ? volumeMl : 0;
+  }
+  if (limitsGiven && !PourSystem::isValidPourLimits(limits)) {
+    response["error"] = "invalid";
+    response["field"] = "limits";
+    return;
+  }
+  const char *server = data["tbServer"].as<const char *>();
+  if (!data["tbServer"].isNull() && (server == nullptr || !ConfigStore::isValidServer(server))) {
+    response["error"] = "invalid";
+    response["field"] = "tbServer";
+    return;
+  }
+
+  // Stored once the control task has applied them, see EVENT_POUR_LIMITS_CHANGED
+  if (limitsGiven && !controlLoop.submit(tap, CMD_SET_POUR_LIMITS, limits.maxPourTimeMs,
+                                         limits.maxPourVolumeMl)) {
+    response["error"] = "busy";
+    return;
+  }
+  if (server != nullptr) {
+    configStore.setServer(server);
+    attributePublisher.markChanged(renderServer, TAP_ALL, millis());
+    attributePublisher.markChanged(renderConfigVersion, TAP_ALL, millis());
+  }
+  response["status"] = "ok";
+}
+
+// {"tap", "action", ...} - a guided calibration run, see CalibrationSession.
+//   start    {"volumeMl", "pours"} queues the first calibration pour, which waits for confirmCup
+//   measure  {"measuredMl"} records the volume in the jug, then queues the next pour or, after
+//            the last one, fits and commits the calibration if the residual is small enough
+//   fit      retries the commit of a complete run
+//   status   / cancel
+void processCalibrateCommand(const JsonVariantConst &data, JsonDocument &response) {
+  PerfTimer timer(PERF_RPC);
+  uint8_t tap;
+  if (!readTap(data["tap"], tap)) {
+    response.set("invalid tap");
+    return;
+  }
+  const char *action = data["action"].isNull() ? "status" : data["action"].as<const char *>();
+  if (action == nullptr) {
+    action = "";
+  }
+
+  if (strcmp(action, "start") == 0) {
+    if (calibrationSession.getState() != CALIBRATION_IDLE || orderQueues[tap].isBusy() ||
+        orderQueues[tap].getDepth() > 0) {
+      response["error"] = "busy";
+      setCalibrationStatus(response);
+      return;
+    }
+    uint8_t pours = data["pours"].isNull() ? CALIBRATION_DEFAULT_POURS : data["pours"].as<uint8_t>();
+    if (!calibrationSession.start(tap, data["volumeMl"].as<int>(), pours)) {
+      response["error"] = "invalid";
+      return;
+    }
+    if (!queueCalibrationPour(tap)) {
+      response["error"] = "queue full";
+      return;
+    }
+    LOG_INFO("📏 Tap %u calibration started: %u pours of %dml", tap, pours,
+             calibrationSession.getVolumeMl());
+  } else if (strcmp(action, "measure") == 0) {
+    if (!calibrationSession.isActive(tap) ||
+        !calibrationSession.addMeasurement(data["measuredMl"].as<float>())) {
+      response["error"] = "invalid";
+      setCalibrationStatus(response);
+      return;
+    }
+    if (calibrationSession.getState() == CALIBRATION_COMPLETE) {
+      finishCalibration(response);
+      return;
+    }
+    if (!queueCalibrationPour(tap)) {
+      response["error"] = "queue full";
+      setCalibrationStatus(response);
+      return;
+    }
+  } else if (strcmp(action, "fit") == 0) {
+    if (!calibrationSession.isActive(tap) ||
+        calibrationSession.getState() != CALIBRATION_COMPLETE) {
+      response["error"] = "invalid";
+      setCalibrationStatus(response);
+      return;
+    }
+    finishCalibration(response);
+    return;
+  } else if (strcmp(action, "cancel") == 0) {
+    if (calibrationSession.isActive(tap)) {
+      calibrationSession.cancel();
+      orderQueues[tap].clearWaiting();  // Only the next calibration pour can be waiting
+      LOG_INFO("📏 Tap %u calibration cancelled", tap);
+    }
+  } else if (strcmp(action, "status") != 0) {
+    response["error"] = "invalid action";
+    return;
+  }
+  setCalibrationStatus(response);
+}
+
+// {"tap", "sizeMl", "beerId", "dispensedMl", "alertPct": [20, 10]} - a new keg on the tap, all
+// but sizeMl optional. dispensedMl is for a keg that was already tapped elsewhere, alertPct
+// lists the remaining percentages that raise a kegLow alert (KEG_ALERT_DEFAULT_PCT if absent).
+void processSetKeg(const JsonVariantConst &data, JsonDocument &response) {
+  PerfTimer timer(PERF_RPC);
+  uint8_t tap;
+  if (!readTap(data["tap"], tap)) {
+    response.set("invalid tap");
+    return;
+  }
+  const char *beerId = data["beerId"].isNull() ? "" : data["beerId"].as<const char *>();
+  uint8_t alertPct[KEG_ALERT_LEVELS];
+  uint8_t alertCount = 0;
+  JsonArrayConst levels = data["alertPct"].as<JsonArrayConst>();
+  if (!data["alertPct"].isNull() && (levels.isNull() || levels.size() > KEG_ALERT_LEVELS)) {
+    response["error"] = "invalid";
+    response["field"] = "alertPct";
+    return;
+  }
+  for (JsonVariantConst level : levels) {
+    alertPct[alertCount++] = level.as<int>() >= 1 && level.as<int>() <= 99 ? level.as<int>() : 0;
+  }
+
+  const char *invalid = kegInventory.setKeg(tap, data["sizeMl"].as<uint32_t>(), beerId,
+                                            data["dispensedMl"].as<uint32_t>(), alertPct,
+                                            alertCount, epochSeconds());
+  if (invalid != nullptr && strcmp(invalid, "storage") == 0) {
+    response["error"] = "storage";
+    return;
+  }
+  if (invalid != nullptr) {
+    response["error"] = "invalid";
+    response["field"] = invalid;
+    return;
+  }
+  markKegChanged(tap);
+  response["tap"] = tap;
+  response["remainingMl"] = kegInventory.getRemainingMl(tap);
+  response["poursLeft"] = kegInventory.getPoursRemaining(tap);
+}
+
 void processWiFiResetCommand(const JsonVariantConst &data, JsonDocument &response) {
+  PerfTimer timer(PERF_RPC);
   int value = data.as<int>();
   if (value == 1)  // Button pressed (only act on press, not release)
   {
@@ -356,6 +1272,9 @@ void processWiFiResetCommand(const JsonVariantConst &data, JsonDocument &respons
 
     // Reset WiFi settings and restart
     wifiManager.resetSettings();
+    wifiFastConnect.clear();
+    configStore.flush();
+    kegInventory.flush();
     Serial.println("📝 WiFi settings cleared, restarting...");
 
     delay(1000);
@@ -363,3 +1282,781 @@ void processWiFiResetCommand(const JsonVariantConst &data, JsonDocument &respons
   }
   response.set("wifi_reset");
 }
+
+// Every client attribute, sent by publishAttributes() once marked changed
+void addAttributes() {
+  attributePublisher.add(TB_SERVER_ATTR, renderServer, TAP_ALL);
+  attributePublisher.add(TB_CONFIG_VERSION_ATTR, renderConfigVersion, TAP_ALL);
+  for (uint8_t tap = 0; tap < tapController.getCount(); tap++) {
+    attributePublisher.add(TB_CUP_SIZE_ATTR, renderCupSize, tap);
+    attributePublisher.add(TB_OVERSHOOT_MODEL_ATTR, renderOvershootModel, tap,
+                           ATTRIBUTE_MODEL_INTERVAL_MS);
+    attributePublisher.add(TB_ML_PER_PULSE_ATTR, renderMlPerPulse, tap);
+    attributePublisher.add(TB_CALIBRATION_CURVE_ATTR, renderCalibrationCurve, tap);
+    attributePublisher.add(TB_FLOW_FAULT_THRESHOLDS_ATTR, renderFlowFaultThresholds, tap);
+    attributePublisher.add(TB_POUR_LIMITS_ATTR, renderPourLimits, tap);
+    attributePublisher.add(TB_CALIBRATION_HISTORY_ATTR, renderCalibrationHistory, tap);
+    attributePublisher.add(TB_KEG_ATTR, renderKeg, tap);
+    attributePublisher.add(TB_KEG_REMAINING_ATTR, renderKegRemaining, tap);
+    attributePublisher.add(TB_KEG_REMAINING_PCT_ATTR, renderKegRemainingPct, tap);
+    attributePublisher.add(TB_KEG_POURS_LEFT_ATTR, renderKegPoursLeft, tap);
+    attributePublisher.add(TB_KEG_DISPENSED_ATTR, renderKegDispensed, tap);
+  }
+}
+
+// Marked attributes whose coalescing window has passed, one message each until none is due
+void publishAttributes() {
+  if (!thingsBoardConnected) {
+    return;  // Kept marked, connecting marks them all again anyway
+  }
+  static char payload[TELEMETRY_CHUNK_SIZE];
+  while (attributePublisher.takePayload(millis(), payload, sizeof(payload)) > 0) {
+    bool sent = tb.sendAttributeString(payload);
+    attributePublisher.onSent(sent, millis());
+    if (!sent) {
+      LOG_ERROR("❌ Attribute publish failed, retrying later");
+      break;
+    }
+  }
+}
+
+void setCupSize(uint8_t tap, int value) {
+  dashboardCupSize[tap] = value;
+  attributePublisher.markChanged(renderCupSize, tap, millis());
+}
+
+void markKegChanged(uint8_t tap) {
+  attributePublisher.markChanged(renderKeg, tap, millis());
+  markKegLevelChanged(tap);
+}
+
+void markKegLevelChanged(uint8_t tap) {
+  attributePublisher.markChanged(renderKegRemaining, tap, millis());
+  attributePublisher.markChanged(renderKegRemainingPct, tap, millis());
+  attributePublisher.markChanged(renderKegPoursLeft, tap, millis());
+  attributePublisher.markChanged(renderKegDispensed, tap, millis());
+}
+
+// Attribute values for AttributePublisher. The toJson() methods cut long values short, so
+// their output is copied to get snprintf's length when it does not fit.
+
+size_t renderCupSize(uint8_t tap, char *buffer, size_t size) {
+  return snprintf(buffer, size, "%d", dashboardCupSize[tap]);
+}
+
+size_t renderOvershootModel(uint8_t tap, char *buffer, size_t size) {
+  TapSettings settings;
+  controlLoop.readSettings(tap, settings);
+  char model[96];
+  OvershootModel::toJson(settings.overshoot, model, sizeof(model));
+  return snprintf(buffer, size, "%s", model);
+}
+
+size_t renderMlPerPulse(uint8_t tap, char *buffer, size_t size) {
+  TapSettings settings;
+  controlLoop.readSettings(tap, settings);
+  return snprintf(buffer, size, "%.3f", settings.calibration.getNominalUlPerPulse() / 1000.0);
+}
+
+size_t renderCalibrationCurve(uint8_t tap, char *buffer, size_t size) {
+  TapSettings settings;
+  controlLoop.readSettings(tap, settings);
+  char curve[160];
+  settings.calibration.toJson(curve, sizeof(curve));
+  return snprintf(buffer, size, "%s", curve);
+}
+
+size_t renderFlowFaultThresholds(uint8_t tap, char *buffer, size_t size) {
+  TapSettings settings;
+  controlLoop.readSettings(tap, settings);
+  char thresholds[128];
+  FlowFaultDetector::toJson(settings.flowFaultThresholds, thresholds, sizeof(thresholds));
+  return snprintf(buffer, size, "%s", thresholds);
+}
+
+size_t renderPourLimits(uint8_t tap, char *buffer, size_t size) {
+  TapSettings settings;
+  controlLoop.readSettings(tap, settings);
+  return snprintf(buffer, size, "{\"maxPourTimeMs\":%lu,\"maxPourVolumeMl\":%u}",
+                  (unsigned long)settings.limits.maxPourTimeMs, settings.limits.maxPourVolumeMl);
+}
+
+size_t renderCalibrationHistory(uint8_t tap, char *buffer, size_t size) {
+  char history[CALIBRATION_HISTORY_SIZE * 32];
+  configStore.historyToJson(tap, history, sizeof(history));
+  return snprintf(buffer, size, "%s", history);
+}
+
+size_t renderServer(uint8_t tap, char *buffer, size_t size) {
+  char server[CONFIG_SERVER_MAX_LENGTH + 1];
+  configStore.getServer(server, sizeof(server));
+  return snprintf(buffer, size, "\"%s\"", server);
+}
+
+size_t renderConfigVersion(uint8_t tap, char *buffer, size_t size) {
+  return snprintf(buffer, size, "%u", configStore.getVersion());
+}
+
+size_t renderKeg(uint8_t tap, char *buffer, size_t size) {
+  if (!kegInventory.isSet(tap)) {
+    return 0;
+  }
+  char keg[KEG_BEER_ID_MAX_LENGTH + 96];
+  kegInventory.settingsToJson(tap, keg, sizeof(keg));
+  return snprintf(buffer, size, "%s", keg);
+}
+
+size_t renderKegRemaining(uint8_t tap, char *buffer, size_t size) {
+  if (!kegInventory.isSet(tap)) {
+    return 0;
+  }
+  return snprintf(buffer, size, "%lu", (unsigned long)kegInventory.getRemainingMl(tap));
+}
+
+size_t renderKegRemainingPct(uint8_t tap, char *buffer, size_t size) {
+  if (!kegInventory.isSet(tap)) {
+    return 0;
+  }
+  return snprintf(buffer, size, "%u", kegInventory.getRemainingPct(tap));
+}
+
+size_t renderKegPoursLeft(uint8_t tap, char *buffer, size_t size) {
+  if (!kegInventory.isSet(tap)) {
+    return 0;
+  }
+  return snprintf(buffer, size, "%lu", (unsigned long)kegInventory.getPoursRemaining(tap));
+}
+
+size_t renderKegDispensed(uint8_t tap, char *buffer, size_t size) {
+  if (!kegInventory.isSet(tap)) {
+    return 0;
+  }
+  return snprintf(buffer, size, "%.1f", kegInventory.getDispensedMl(tap));
+}
+
+void publishPourRecord() {
+  for (uint8_t tap = 0; tap < tapController.getCount(); tap++) {
+    // Back-to-back pours can queue up while the network task was busy
+    while (tapController.getTap(tap).getRecorder().getCompleted() != nullptr) {
+      publishPourRecord(tap);
+    }
+  }
+}
+
+void publishPourRecord(uint8_t tap) {
+  PourSystem &pourSystem = tapController.getTap(tap);
+  PourRecorder &recorder = pourSystem.getRecorder();
+  const PourRecord *record = recorder.getCompleted();
+  if (record == nullptr) {
+    return;
+  }
+
+  // Samples carry their own timestamps, so they land on the chart where they were measured
+  uint64_t startEpochMs = 0;
+  uint64_t endEpochMs = 0;
+  struct timeval now;
+  gettimeofday(&now, nullptr);
+  if ((unsigned long)now.tv_sec > NTP_MIN_VALID_EPOCH) {
+    uint64_t nowEpochMs = (uint64_t)now.tv_sec * 1000 + now.tv_usec / 1000;
+    startEpochMs = nowEpochMs - (millis() - record->startMillis);
+    endEpochMs = startEpochMs + record->durationMs;
+  }
+
+  // The summary goes to flash first and reaches ThingsBoard through the ledger drain
+  LedgerEntry entry = pourLedger.makeEntry(*record, endEpochMs, record->ulPerPulse, tap);
+  if (!pourLedger.append(entry) && thingsBoardConnected) {
+    char summary[TELEMETRY_CHUNK_SIZE];
+    if (PourLedger::toTelemetryJson(&entry, 1, summary, sizeof(summary)) > 0) {
+      tb.sendTelemetryString(summary);
+    }
+  }
+
+  // The flow series is only worth sending live - it is not kept across an outage
+  size_t chunks = 0;
+  if (thingsBoardConnected) {
+    char key[32];
+    PourTelemetryWriter writer(*record, startEpochMs,
+                               tapKey(TB_FLOW_RATE_TELEMETRY, tap, key, sizeof(key)));
+    static char chunk[TELEMETRY_CHUNK_SIZE];
+    while (writer.nextChunk(chunk, sizeof(chunk)) > 0 && tb.sendTelemetryString(chunk)) {
+      chunks++;
+    }
+  }
+
+  LOG_INFO("📊 Tap %u pour %lu recorded: %u samples, %u messages sent", tap,
+           (unsigned long)entry.sequence, (unsigned)record->sampleCount, (unsigned)chunks);
+  recordKegPour(tap, record->actualMl);
+  if (calibrationSession.isActive(tap)) {
+    recordCalibrationPour(tap, *record);
+  }
+  recorder.releaseCompleted();
+}
+
+void drainPourLedger() {
+  static unsigned long lastFailure = 0;
+  if (!thingsBoardConnected || pourLedger.getPendingCount() == 0 ||
+      (lastFailure != 0 && millis() - lastFailure < LEDGER_RETRY_INTERVAL)) {
+    return;
+  }
+
+  // One batch per pass keeps the network task responsive while a backlog drains. Per-tap
+  // keys make entries longer, so a batch that does not fit one message is sent smaller.
+  static LedgerEntry entries[LEDGER_DRAIN_BATCH];
+  static char payload[TELEMETRY_CHUNK_SIZE];
+  LedgerPosition next;
+  for (size_t batch = LEDGER_DRAIN_BATCH; batch > 0; batch--) {
+    size_t count = pourLedger.readPending(entries, batch, next);
+    if (count == 0) {
+      break;
+    }
+    if (PourLedger::toTelemetryJson(entries, count, payload, sizeof(payload)) == 0) {
+      continue;
+    }
+    if (!tb.sendTelemetryString(payload)) {
+      break;
+    }
+    lastFailure = 0;
+    pourLedger.acknowledge(next);
+    return;
+  }
+  if (pourLedger.getPendingCount() > 0) {
+    LOG_ERROR("❌ Pour ledger publish failed, retrying later");
+    lastFailure = millis();
+  }
+}
+
+void sendFlowAlert(StopReason reason, uint8_t tap) {
+  const char *alert = nullptr;
+  if (reason == STOP_NO_FLOW || reason == STOP_FLOW_COLLAPSED) {
+    alert = "kegEmpty";
+  } else if (reason == STOP_FOAM) {
+    alert = "foam";
+  } else {
+    return;
+  }
+
+  LOG_WARN("🚨 Tap %u pour cut short: %s (%s)", tap, alert, stopReasonName(reason));
+  ledController.setTemporaryState(STATE_ERROR, 3000);
+  if (thingsBoardConnected) {
+    char alertKey[24];
+    char reasonKey[32];
+    char payload[112];
+    snprintf(payload, sizeof(payload), "{\"%s\":\"%s\",\"%s\":\"%s\"}",
+             tapKey(TB_ALERT_TELEMETRY, tap, alertKey, sizeof(alertKey)), alert,
+             tapKey(TB_ALERT_REASON_TELEMETRY, tap, reasonKey, sizeof(reasonKey)),
+             stopReasonName(reason));
+    tb.sendTelemetryString(payload);
+  }
+}
+
+void dispatchOrders() {
+  unsigned long now = millis();
+  for (uint8_t tap = 0; tap < tapController.getCount(); tap++) {
+    OrderQueue &orders = orderQueues[tap];
+    OrderCompletion completion;
+    if (orders.checkStartTimeout(now, completion)) {
+      LOG_WARN("⚠️ Tap %u order '%s' did not start a pour", tap, completion.order.id);
+      reportOrderCompletion(tap, completion);
+    }
+
+    // The order only leaves the queue once the control task has its cup size. Its calibration
+    // travels in the same command and only applies to this pour.
+    const PourOrder *order = orders.getDue(now);
+    if (order == nullptr) {
+      continue;
+    }
+    if (!controlLoop.submit(tap, CMD_SET_CUP_SIZE, order->cupSizeMl, order->mlPerPulse)) {
+      continue;
+    }
+    LOG_INFO("🍺 Tap %u pouring order '%s' (%dml) after %lums", tap, order->id,
+             order->cupSizeMl, now - order->queuedMillis);
+    setCupSize(tap, order->cupSizeMl);
+    orders.markDispatched(now);
+    if (thingsBoardConnected) {
+      sendOrderQueueStatus(tap);
+    }
+  }
+}
+
+// Calibration pours are ordinary orders that wait for confirmCup, so the tech can put the
+// measuring jug under the tap first. They carry no id. A pour that cannot be queued cancels the
+// run, which would otherwise wait for it forever; the status then reads idle.
+bool queueCalibrationPour(uint8_t tap) {
+  OrderAdmission admission =
+      orderQueues[tap].enqueue("", calibrationSession.getVolumeMl(), millis(), 0, true);
+  if (admission != ORDER_ACCEPTED) {
+    LOG_ERROR("❌ Tap %u calibration pour could not be queued, calibration cancelled", tap);
+    calibrationSession.cancel();
+    return false;
+  }
+  if (thingsBoardConnected) {
+    sendOrderQueueStatus(tap);
+  }
+  return true;
+}
+
+// Settled pour on a tap under calibration. Pours cut short by a fault or by hand say little
+// about the sensor and are poured again.
+void recordCalibrationPour(uint8_t tap, const PourRecord &record) {
+  if (calibrationSession.getState() != CALIBRATION_POURING) {
+    return;
+  }
+  if (record.stopReason == STOP_TARGET_REACHED &&
+      calibrationSession.addPour(record.pulses, record.durationMs)) {
+    LOG_INFO("📏 Tap %u calibration pour %u/%u: %lu pulses, measure the jug", tap,
+             calibrationSession.getSampleCount() + 1, calibrationSession.getPours(),
+             (unsigned long)record.pulses);
+    return;
+  }
+  LOG_WARN("⚠️ Tap %u calibration pour ended early (%s), pouring it again", tap,
+           stopReasonName(record.stopReason));
+  queueCalibrationPour(tap);
+}
+
+// Fits the complete run and commits it when the residual is small enough. The curve reaches
+// the ConfigStore through EVENT_CALIBRATION_CHANGED once the control task has applied it.
+void finishCalibration(JsonDocument &response) {
+  uint8_t tap = calibrationSession.getTap();
+  CalibrationFit fit;
+  if (!calibrationSession.fit(fit)) {
+    LOG_ERROR("❌ Tap %u calibration fit out of range", tap);
+    calibrationSession.cancel();
+    response["error"] = "out of range";
+    return;
+  }
+  response["tap"] = tap;
+  response["mlPerPulse"] = fit.curve.getNominalUlPerPulse() / 1000.0;
+  response["points"] = fit.curve.getCount();
+  response["residualMl"] = fit.residualMl;
+  response["residualPct"] = fit.residualPct;
+  response["pours"] = fit.pours;
+  if (!fit.acceptable) {
+    LOG_WARN("⚠️ Tap %u calibration rejected: residual %.2f%%", tap, fit.residualPct);
+    calibrationSession.cancel();
+    response["status"] = "rejected";
+    return;
+  }
+  if (!controlLoop.submitCalibrationCurve(tap, fit.curve)) {
+    response["error"] = "busy";  // The run stays complete, "fit" retries
+    return;
+  }
+
+  CalibrationHistoryEntry entry;
+  memset(&entry, 0, sizeof(entry));
+  entry.epochSeconds = epochSeconds();
+  entry.ulPerPulse = fit.curve.getNominalUlPerPulse();
+  entry.residualCentiPct = (uint16_t)(fit.residualPct * 100 + 0.5f);
+  entry.pours = fit.pours;
+  entry.points = fit.curve.getCount();
+  configStore.addCalibrationHistory(tap, entry);
+  attributePublisher.markChanged(renderCalibrationHistory, tap, millis());
+  LOG_INFO("✅ Tap %u calibration committed: %.3fml/pulse, %u point(s), residual %.2f%%", tap,
+           entry.ulPerPulse / 1000.0, entry.points, fit.residualPct);
+  calibrationSession.cancel();
+  response["status"] = "committed";
+}
+
+void setCalibrationStatus(JsonDocument &response) {
+  response["state"] = calibrationStateName(calibrationSession.getState());
+  if (calibrationSession.getState() != CALIBRATION_IDLE) {
+    response["tap"] = calibrationSession.getTap();
+    response["volumeMl"] = calibrationSession.getVolumeMl();
+    response["measured"] = calibrationSession.getSampleCount();
+    response["pours"] = calibrationSession.getPours();
+  }
+}
+
+// Counts a finished pour against the tap's keg. Each alert level is reported once per keg, the
+// remaining volume only once it has moved by KEG_REPORT_DELTA_ML.
+void recordKegPour(uint8_t tap, float actualMl) {
+  uint8_t crossed = kegInventory.recordPour(tap, actualMl, millis());
+  if (crossed > 0) {
+    LOG_WARN("🛢️ Tap %u keg below %u%%: %lu ml left, about %lu pours", tap, crossed,
+             (unsigned long)kegInventory.getRemainingMl(tap),
+             (unsigned long)kegInventory.getPoursRemaining(tap));
+    if (thingsBoardConnected) {
+      char alertKey[24];
+      char levelKey[32];
+      char payload[96];
+      snprintf(payload, sizeof(payload), "{\"%s\":\"kegLow\",\"%s\":%u}",
+               tapKey(TB_ALERT_TELEMETRY, tap, alertKey, sizeof(alertKey)),
+               tapKey(TB_KEG_LOW_PCT_TELEMETRY, tap, levelKey, sizeof(levelKey)), crossed);
+      tb.sendTelemetryString(payload);
+    }
+  }
+  if (kegInventory.needsReport(tap)) {
+    kegInventory.markReported(tap);  // Delivered by the publisher from here
+    markKegLevelChanged(tap);
+  }
+}
+
+void sendOrderQueueStatus(uint8_t tap) {
+  OrderQueue &orders = orderQueues[tap];
+  char depthKey[32];
+  char waitKey[32];
+  char payload[112];
+  snprintf(payload, sizeof(payload), "{\"%s\":%u,\"%s\":%lu}",
+           tapKey(TB_ORDER_QUEUE_DEPTH_TELEMETRY, tap, depthKey, sizeof(depthKey)),
+           orders.getDepth(),
+           tapKey(TB_ORDER_OLDEST_WAIT_TELEMETRY, tap, waitKey, sizeof(waitKey)),
+           orders.getOldestWaitMs(millis()));
+  tb.sendTelemetryString(payload);
+}
+
+void reportOrderCompletion(uint8_t tap, const OrderCompletion &completion) {
+  LOG_INFO("✅ Tap %u order '%s' %s, %.1fml in %lums", tap, completion.order.id,
+           stopReasonName(completion.reason), completion.actualMl, completion.totalMs);
+  if (!thingsBoardConnected) {
+    return;
+  }
+  char payload[256];
+  if (OrderQueue::completionToJson(completion, tap, payload, sizeof(payload)) > 0) {
+    tb.sendTelemetryString(payload);
+  }
+  sendOrderQueueStatus(tap);
+}
+
+// Serves signed requests from the kiosk, see LocalEndpoint. Accepted commands run through the
+// RPC handlers, so validation, order queueing and reporting are the same as over ThingsBoard.
+void serveLocalRequests() {
+  if (!localEndpoint.isEnabled() || WiFi.status() != WL_CONNECTED) {
+    return;
+  }
+  if (!localUdpStarted) {
+    localUdpStarted = localUdp.begin(LOCAL_ENDPOINT_PORT) == 1;
+    if (localUdpStarted) {
+      LOG_INFO("📡 LAN pour endpoint listening on UDP port %d", LOCAL_ENDPOINT_PORT);
+    }
+    return;
+  }
+
+  for (int i = 0; i < LOCAL_REQUESTS_PER_PASS && localUdp.parsePacket() > 0; i++) {
+    char datagram[LOCAL_DATAGRAM_MAX + 1];
+    int length = localUdp.read((uint8_t *)datagram, sizeof(datagram));
+    if (length <= 0) {
+      continue;
+    }
+
+    LocalCommand command;
+    LocalRequestStatus status = localEndpoint.parse(datagram, length, command);
+    char message[LOCAL_DATAGRAM_MAX];
+    if (status == LOCAL_ACCEPTED) {
+      char result[96];
+      runLocalCommand(command, result, sizeof(result));
+      snprintf(message, sizeof(message), "%llu %s", (unsigned long long)command.counter, result);
+      if (thingsBoardConnected) {
+        tb.sendTelemetryData(TB_LOCAL_COMMAND_TELEMETRY, localCommandName(command.type));
+        tb.sendTelemetryData(TB_LOCAL_RESULT_TELEMETRY, result);
+      }
+    } else {
+      // Counter 0, the request's own counter cannot be trusted
+      LOG_WARN("⚠️ LAN request rejected: %s", localRequestStatusName(status));
+      snprintf(message, sizeof(message), "0 %s", localRequestStatusName(status));
+      if (thingsBoardConnected) {
+        tb.sendTelemetryData(TB_LOCAL_REJECTED_TELEMETRY, localRequestStatusName(status));
+      }
+    }
+
+    char reply[LOCAL_DATAGRAM_MAX + 2 * SHA256_DIGEST_SIZE + 2];
+    size_t replyLength = localEndpoint.sign(message, reply, sizeof(reply));
+    if (replyLength > 0) {
+      localUdp.beginPacket(localUdp.remoteIP(), localUdp.remotePort());
+      localUdp.write((const uint8_t *)reply, replyLength);
+      localUdp.endPacket();
+    }
+  }
+}
+
+void runLocalCommand(const LocalCommand &command, char *result, size_t size) {
+  JsonDocument request;
+  JsonDocument response;
+  request["tap"] = command.tap;
+  switch (command.type) {
+    case LOCAL_POUR:
+      request["value"] = (int)command.value;
+      if (command.orderId[0] != '\0') {
+        request["orderId"] = command.orderId;
+      }
+      processCupSizeChange(request.as<JsonVariantConst>(), response);
+      break;
+    case LOCAL_STOP:
+      request["value"] = 1;
+      processStopCommand(request.as<JsonVariantConst>(), response);
+      break;
+    case LOCAL_CALIBRATE:
+      request["value"] = command.value;
+      processMlPerPulseChange(request.as<JsonVariantConst>(), response);
+      break;
+  }
+  if (serializeJson(response, result, size) == 0) {
+    snprintf(result, size, "null");
+  }
+}
+
+void sendPerfStats() {
+  char payload[TELEMETRY_CHUNK_SIZE];
+  if (perfCounters.toJson(payload, sizeof(payload)) > 0) {
+    tb.sendTelemetryString(payload);
+  }
+  perfCounters.reset();  // Each report covers one interval
+}
+
+void sendBootTimeline() {
+  char payload[192];
+  if (bootTimeline.toJson(payload, sizeof(payload)) > 0) {
+    Serial.print("⏱️ Boot timeline: ");
+    Serial.println(payload);
+    tb.sendTelemetryString(payload);
+  }
+}
+
+// Anything the idle power mode would slow down: a pour or an order on any tap, a calibration
+// run, a firmware download, or no ThingsBoard connection to wait on. Settling and publishing a
+// pour take far less than POWER_IDLE_ENTER_MS after its order completes.
+bool isPowerBusy() {
+  if (!thingsBoardConnected || !rpcSubscribed ||
+      calibrationSession.getState() != CALIBRATION_IDLE ||
+      otaUpdate.getState() == OTA_DOWNLOADING || otaUpdate.getState() == OTA_INSTALLED) {
+    return true;
+  }
+  for (uint8_t tap = 0; tap < tapController.getCount(); tap++) {
+    if (orderQueues[tap].isBusy() || orderQueues[tap].getDepth() > 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Before the control task starts, so the taps can be set directly
+void applyStoredConfig() {
+  for (uint8_t tap = 0; tap < tapController.getCount(); tap++) {
+    PourSystem &pourSystem = tapController.getTap(tap);
+    CalibrationCurve curve;
+    if (configStore.getCalibrationCurve(tap, curve)) {
+      pourSystem.setCalibrationCurve(curve);
+    }
+    FlowFaultThresholds thresholds;
+    if (configStore.getFlowFaultThresholds(tap, thresholds)) {
+      pourSystem.setFlowFaultThresholds(thresholds);
+    }
+    PourLimits limits;
+    if (configStore.getPourLimits(tap, limits)) {
+      pourSystem.setPourLimits(limits);
+    }
+  }
+}
+
+#if BENCHMARK_MODE
+// An RPC handler as ThingsBoard calls it, with the request already parsed
+struct RpcBench {
+  void (*handler)(const JsonVariantConst &data, JsonDocument &response);
+  JsonDocument request;
+};
+
+void clearBenchOrders(void *context) { orderQueues[0].clearWaiting(); }
+
+void runRpcBench(void *context) {
+  RpcBench &bench = *static_cast<RpcBench *>(context);
+  JsonDocument response;
+  bench.handler(bench.request.as<JsonVariantConst>(), response);
+}
+
+// The src/ cases plus the RPC handlers, one JSON line each on Serial; see src/benchmark.h
+void runBenchmarks() {
+  Serial.begin(115200);
+  Serial.println();
+  configStore.begin();
+
+  static BenchRunner runner("esp32");
+  addControlBenchmarks(runner);
+
+  // Nothing dispatches orders here, so every call queues one until setup empties the queue
+  static RpcBench pour = {processPourCommand};
+  deserializeJson(pour.request, "{\"tap\":0,\"volumeMl\":330,\"mlPerPulse\":2.25}");
+  runner.add({"rpc/pour", clearBenchOrders, runRpcBench, &pour, ORDER_QUEUE_CAPACITY});
+  static RpcBench perfStats = {processGetPerfStats};
+  deserializeJson(perfStats.request, "{\"section\":\"rpc\"}");
+  runner.add({"rpc/getPerfStats", nullptr, runRpcBench, &perfStats, 16});
+  static RpcBench config = {processGetConfig};
+  deserializeJson(config.request, "{\"tap\":0}");
+  runner.add({"rpc/getConfig", nullptr, runRpcBench, &config, 16});
+
+  char line[256];
+  if (runner.headerToJson(line, sizeof(line)) > 0) {
+    Serial.println(line);
+  }
+  for (uint8_t i = 0; i < runner.getCount(); i++) {
+    BenchResult result;
+    runner.run(i, BENCH_MIN_OPS, result);
+    if (BenchRunner::resultToJson(result, line, sizeof(line)) > 0) {
+      Serial.println(line);
+    }
+  }
+}
+#endif
+
+// The override from the WiFi portal or setConfig, else the one in config.h
+const char *thingsBoardServer() {
+  static char server[CONFIG_SERVER_MAX_LENGTH + 1];
+  configStore.getServer(server, sizeof(server));
+  return server[0] != '\0' ? server : THINGSBOARD_SERVER;
+}
+
+// 0 until NTP has synced
+uint32_t epochSeconds() {
+  struct timeval now;
+  gettimeofday(&now, nullptr);
+  return (unsigned long)now.tv_sec > NTP_MIN_VALID_EPOCH ? (uint32_t)now.tv_sec : 0;
+}
+
+const char *resetReasonName() {
+  switch (esp_reset_reason()) {
+    case ESP_RST_POWERON:
+      return "powerOn";
+    case ESP_RST_SW:
+      return "software";
+    case ESP_RST_PANIC:
+      return "panic";
+    case ESP_RST_INT_WDT:
+    case ESP_RST_TASK_WDT:
+    case ESP_RST_WDT:
+      return "watchdog";
+    case ESP_RST_BROWNOUT:
+      return "brownout";
+    case ESP_RST_DEEPSLEEP:
+      return "deepSleep";
+    default:
+      return "other";
+  }
+}
+
+// A pour, an order or a calibration run, or trailing flow still being counted. Flash writes
+// stall the control task's core, so no firmware chunk or configuration is written and no update
+// restart happens until the taps are idle. Pours only start from this task, so none can begin
+// mid-write.
+bool areTapsBusy() {
+  if (pouringTaps != 0 || calibrationSession.getState() != CALIBRATION_IDLE ||
+      millis() - lastPourCompleteMillis < OTA_POUR_QUIET_MS) {
+    return true;
+  }
+  for (uint8_t tap = 0; tap < tapController.getCount(); tap++) {
+    if (orderQueues[tap].isBusy() || orderQueues[tap].getDepth() > 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// One step of a firmware update per pass: the health check of a new image, at most one chunk,
+// the fw_state reports, and the restart into an installed image once the taps are idle
+void serviceOta() {
+  otaUpdate.checkHealth(thingsBoardConnected && rpcSubscribed, millis());
+  if (!thingsBoardConnected) {
+    return;
+  }
+
+  if (fwAttributesWanted && attributeRequest.Shared_Attributes_Request(fwRequestCallback)) {
+    fwAttributesWanted = false;
+  }
+
+  bool busy = areTapsBusy();
+  uint32_t index;
+  uint32_t length;
+  if (otaUpdate.nextChunk(busy, millis(), index, length)) {
+    size_t received = fetchOtaChunk(index, otaChunk, length);
+    hal::feedWatchdog();  // Connect and read each have their own timeout
+    if (received == length) {
+      otaUpdate.onChunk(otaChunk, received, millis());
+    } else {
+      otaUpdate.onChunkFailed(millis());
+    }
+  }
+
+  while (otaUpdate.needsReport()) {
+    FwState state = otaUpdate.getReportState();
+    if (!sendFirmwareState(state)) {
+      break;
+    }
+    otaUpdate.markReported(state);
+  }
+
+  if (otaUpdate.shouldRestart(busy) && !otaUpdate.needsReport()) {
+    Serial.println("🔄 Restarting into the new firmware...");
+    configStore.flush();
+    kegInventory.flush();
+    delay(500);  // Lets the UPDATING report leave
+    hal::restart();
+  }
+}
+
+// GET /api/v1/<token>/firmware?title=&version=&size=&chunk= from ThingsBoard's HTTP device API.
+// Returns the bytes read, length unless the request failed.
+size_t fetchOtaChunk(uint32_t index, uint8_t *buffer, size_t length) {
+  char url[224];
+  snprintf(url, sizeof(url),
+           "http://%s:%u/api/v1/%s/firmware?title=%s&version=%s&size=%u&chunk=%lu",
+           thingsBoardServer(), OTA_HTTP_PORT, THINGSBOARD_ACCESS_TOKEN, FIRMWARE_TITLE,
+           otaUpdate.getVersion(), OTA_CHUNK_SIZE, (unsigned long)index);
+  HTTPClient http;
+  http.setConnectTimeout(OTA_HTTP_TIMEOUT_MS);
+  http.setTimeout(OTA_HTTP_TIMEOUT_MS);
+  if (!http.begin(otaClient, url)) {
+    return 0;
+  }
+
+  size_t received = 0;
+  int status = http.GET();
+  if (status == HTTP_CODE_OK) {
+    WiFiClient *stream = http.getStreamPtr();
+    unsigned long start = millis();
+    while (received < length && millis() - start < OTA_HTTP_TIMEOUT_MS) {
+      int available = stream->available();
+      if (available > 0) {
+        received += stream->read(buffer + received, min((size_t)available, length - received));
+      } else if (!http.connected()) {
+        break;
+      } else {
+        delay(1);
+      }
+    }
+  } else {
+    LOG_WARN("⚠️ Firmware chunk %lu: HTTP %d", (unsigned long)index, status);
+  }
+  http.end();
+  return received;
+}
+
+void sendFirmwareInfo() {
+  char payload[112];
+  snprintf(payload, sizeof(payload), "{\"%s\":\"%s\",\"%s\":\"%s\"}",
+           TB_CURRENT_FW_TITLE_TELEMETRY, FIRMWARE_TITLE, TB_CURRENT_FW_VERSION_TELEMETRY,
+           FIRMWARE_VERSION);
+  tb.sendTelemetryString(payload);
+}
+
+bool sendFirmwareState(FwState state) {
+  char payload[128];
+  if (state == FW_FAILED) {
+    snprintf(payload, sizeof(payload), "{\"%s\":\"%s\",\"%s\":\"%s\"}",
+             TB_FW_STATE_TELEMETRY, OtaUpdate::fwStateName(state), TB_FW_ERROR_TELEMETRY,
+             otaUpdate.getError() != nullptr ? otaUpdate.getError() : "");
+  } else {
+    snprintf(payload, sizeof(payload), "{\"%s\":\"%s\"}", TB_FW_STATE_TELEMETRY,
+             OtaUpdate::fwStateName(state));
+  }
+  return tb.sendTelemetryString(payload);
+}
+
+// Runs inside tb.loop(), so it only hands the package over, the download runs in serviceOta()
+void processFirmwareAttributes(const JsonObjectConst &data) {
+  otaUpdate.offer(data[TB_FW_TITLE_ATTR] | "", data[TB_FW_VERSION_ATTR] | "",
+                  data[TB_FW_SIZE_ATTR] | 0UL, data[TB_FW_CHECKSUM_ATTR] | "",
+                  data[TB_FW_CHECKSUM_ALGORITHM_ATTR] | "");
+}
+
+void onFirmwareAttributesChanged(const JsonObjectConst &data) { fwAttributesWanted = true; }
+
+void onFirmwareRequestTimeout() {
+  LOG_WARN("⚠️ No answer to the firmware attribute request");
+  fwAttributesWanted = true;
+}
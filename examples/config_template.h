@@ -18,6 +18,10 @@
   "YOUR_THINGSBOARD_SERVER_HERE"  // e.g., "demo.thingsboard.io" or "your-instance.com"
 #define THINGSBOARD_ACCESS_TOKEN "YOUR_ACCESS_TOKEN_HERE"  // e.g., "your-device-access-token"
 
+// Optional: shared key for pour commands sent straight from a kiosk on the same LAN
+// (16-64 characters, see examples/local_pour.py). Leave commented out to disable.
+// #define LOCAL_ENDPOINT_KEY "REPLACE_WITH_A_LONG_RANDOM_SECRET"
+
 
 // ========================================
 // SETUP INSTRUCTIONS
@@ -0,0 +1,62 @@
+#!/usr/bin/env python3
+"""Send a pour, stop or calibrate command to a beer tap over the LAN.
+
+The tap must be built with LOCAL_ENDPOINT_KEY in src/config.h. Requests are signed with
+HMAC-SHA256 and carry an increasing counter (Unix time in ms), see src/local_endpoint.h.
+
+    examples/local_pour.py --host 192.168.1.50 --key "$TAP_KEY" pour 300 --order A1B2
+    examples/local_pour.py --host 192.168.1.50 --key "$TAP_KEY" stop
+    examples/local_pour.py --host 192.168.1.50 --key "$TAP_KEY" calibrate 2.25 --tap 1
+"""
+
+import argparse
+import hashlib
+import hmac
+import socket
+import sys
+import time
+
+PORT = 4210  # LOCAL_ENDPOINT_PORT
+
+
+def sign(key, message):
+    mac = hmac.new(key.encode(), message.encode(), hashlib.sha256).hexdigest()
+    return f"{message} {mac}"
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--host", required=True)
+    parser.add_argument("--port", type=int, default=PORT)
+    parser.add_argument("--key", required=True)
+    parser.add_argument("--tap", type=int, default=0)
+    parser.add_argument("--order", default="", help="order id, makes retries harmless")
+    parser.add_argument("--timeout", type=float, default=1.0)
+    parser.add_argument("command", choices=["pour", "stop", "calibrate"])
+    parser.add_argument("value", nargs="?", default="1")
+    args = parser.parse_args()
+
+    counter = int(time.time() * 1000)
+    message = f"{counter} {args.command} {args.tap} {args.value}"
+    if args.order:
+        message += f" {args.order}"
+
+    with socket.socket(socket.AF_INET, socket.SOCK_DGRAM) as sock:
+        sock.settimeout(args.timeout)
+        sock.sendto(sign(args.key, message).encode(), (args.host, args.port))
+        try:
+            reply = sock.recv(512).decode()
+        except socket.timeout:
+            sys.exit("no reply")
+
+    body, _, _ = reply.rpartition(" ")
+    if not hmac.compare_digest(sign(args.key, body), reply):
+        sys.exit(f"reply not signed with this key: {reply}")
+    reply_counter, _, result = body.partition(" ")
+    if reply_counter != str(counter):
+        sys.exit(f"rejected: {result}")
+    print(result)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,112 @@
+#include "flow_simulator.h"
+#include <Arduino.h>
+#include "hal_host.h"
+
+// Flow below this fraction of peak counts as stopped
+static const float FLOW_CUTOFF_FRACTION = 0.01;
+
+FlowSimulator::FlowSimulator(uint8_t relayPin, uint8_t sensorPin, const FlowProfile& profile,
+                             uint32_t seed) {
+  this->relayPin = relayPin;
+  this->sensorPin = sensorPin;
+  this->profile = profile;
+  rngState = seed ? seed : 1;
+  commandedOpen = false;
+  commandMicros = 0;
+  flowMlPerSec = 0;
+  flowAtCloseMlPerSec = 0;
+  kegDispensedMl = 0;
+  resetPour();
+}
+
+void FlowSimulator::resetPour() {
+  dispensedMl = 0;
+  sensorAccumulatorMl = 0;
+  nextPulseMl = drawPulseVolume();
+  pulses = 0;
+  lastPulseMicros = 0;
+}
+
+bool FlowSimulator::isKegEmpty() const {
+  return profile.kegRemainingMl > 0 && kegDispensedMl >= profile.kegRemainingMl;
+}
+
+float FlowSimulator::randomGaussian() {
+  // xorshift64 + Box-Muller keeps runs reproducible for a given seed
+  float u[2];
+  for (int i = 0; i < 2; i++) {
+    rngState ^= rngState << 13;
+    rngState ^= rngState >> 7;
+    rngState ^= rngState << 17;
+    u[i] = ((rngState >> 11) + 1.0) / 9007199254740993.0;
+  }
+  return sqrtf(-2.0 * logf(u[0])) * cosf(2.0 * M_PI * u[1]);
+}
+
+float FlowSimulator::sensorMlPerPulseAt(const FlowProfile& profile, float flowMlPerSec) {
+  if (profile.sensorSlipFlowMlPerSec <= 0 || flowMlPerSec >= profile.sensorSlipFlowMlPerSec) {
+    return profile.sensorMlPerPulse;
+  }
+  float slip = 1.0 - flowMlPerSec / profile.sensorSlipFlowMlPerSec;
+  return profile.sensorMlPerPulse * (1.0 + profile.sensorSlipGain * slip);
+}
+
+float FlowSimulator::drawPulseVolume() {
+  float mlPerPulse = sensorMlPerPulseAt(profile, flowMlPerSec);
+  bool foaming = profile.foamAfterMl > 0 && kegDispensedMl >= profile.foamAfterMl;
+  float jitterPercent = foaming ? profile.foamJitterPercent : profile.jitterPercent;
+  float volume = mlPerPulse * (1.0 + randomGaussian() * jitterPercent / 100);
+  return volume > mlPerPulse * 0.1 ? volume : mlPerPulse * 0.1;
+}
+
+void FlowSimulator::tick(unsigned long us) {
+  unsigned long long now = halhost::nowMicros();
+
+  // Relay HIGH keeps the valve closed, see PourSystem::setRelay()
+  bool relayOpen = halhost::pinLevel(relayPin) == LOW;
+  if (relayOpen != commandedOpen) {
+    commandedOpen = relayOpen;
+    commandMicros = now;
+    if (!relayOpen) {
+      flowAtCloseMlPerSec = flowMlPerSec;
+    }
+  }
+
+  float sinceCommandMs = (now - commandMicros) / 1000.0;
+  if (isKegEmpty()) {
+    flowMlPerSec = 0;
+  } else if (commandedOpen) {
+    float openMs = sinceCommandMs - profile.valveOpenLagMs;
+    if (openMs <= 0) {
+      flowMlPerSec = 0;
+    } else if (openMs < profile.rampUpMs) {
+      flowMlPerSec = profile.peakFlowMlPerSec * openMs / profile.rampUpMs;
+    } else {
+      flowMlPerSec = profile.peakFlowMlPerSec;
+    }
+    flowAtCloseMlPerSec = flowMlPerSec;
+  } else if (sinceCommandMs < profile.valveCloseLagMs) {
+    flowMlPerSec = flowAtCloseMlPerSec;  // Solenoid has not moved yet
+  } else {
+    float drainingMs = sinceCommandMs - profile.valveCloseLagMs;
+    flowMlPerSec = profile.drainMs > 0
+                       ? flowAtCloseMlPerSec * expf(-drainingMs / (float)profile.drainMs)
+                       : 0;
+    if (flowMlPerSec < profile.peakFlowMlPerSec * FLOW_CUTOFF_FRACTION) {
+      flowMlPerSec = 0;
+    }
+  }
+
+  float volume = flowMlPerSec * us / 1000000.0;
+  dispensedMl += volume;
+  kegDispensedMl += volume;
+  sensorAccumulatorMl += volume;
+
+  while (sensorAccumulatorMl >= nextPulseMl) {
+    sensorAccumulatorMl -= nextPulseMl;
+    nextPulseMl = drawPulseVolume();
+    pulses++;
+    lastPulseMicros = now;
+    halhost::raiseEdge(sensorPin, RISING);
+  }
+}
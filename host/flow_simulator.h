@@ -0,0 +1,64 @@
+#ifndef FLOW_SIMULATOR_H
+#define FLOW_SIMULATOR_H
+
+#include <stdint.h>
+
+// Physical behaviour of one tap: valve, beer line, keg and flow sensor
+struct FlowProfile {
+  float peakFlowMlPerSec;         // Steady flow with the valve fully open
+  unsigned long rampUpMs;         // Linear ramp from valve open to peak flow
+  unsigned long valveOpenLagMs;   // Solenoid delay after the relay opens
+  unsigned long valveCloseLagMs;  // Solenoid delay after the relay closes
+  unsigned long drainMs;          // Time constant of the line draining after close
+  float sensorMlPerPulse;         // True sensor calibration, may differ from the configured one
+  float jitterPercent;            // Standard deviation of the volume per pulse
+  float kegRemainingMl;           // Flow stops when this runs out, 0 = unlimited
+  float sensorSlipFlowMlPerSec;   // Below this flow the rotor slips, 0 = linear sensor
+  float sensorSlipGain;           // Extra volume per pulse as the flow approaches zero
+  float foamAfterMl;              // Keg volume after which the line foams, 0 = never
+  float foamJitterPercent;        // Volume per pulse scatter once it foams
+};
+
+// Simulated flow sensor driven by the relay pin of the host HAL.
+// Each tick integrates the flow and raises a RISING edge on the sensor pin for every
+// pulse the sensor would emit, which runs the pulse counter ISR exactly like hardware.
+class FlowSimulator {
+ private:
+  uint8_t relayPin;
+  uint8_t sensorPin;
+  FlowProfile profile;
+  uint64_t rngState;
+
+  bool commandedOpen;
+  unsigned long long commandMicros;  // When the relay last changed
+  float flowMlPerSec;
+  float flowAtCloseMlPerSec;
+  float dispensedMl;
+  float kegDispensedMl;
+  float sensorAccumulatorMl;
+  float nextPulseMl;
+  unsigned long pulses;
+  unsigned long long lastPulseMicros;
+
+  float randomGaussian();
+  float drawPulseVolume();
+
+ public:
+  FlowSimulator(uint8_t relayPin, uint8_t sensorPin, const FlowProfile& profile, uint32_t seed);
+
+  void tick(unsigned long us);
+  void resetPour();  // Clears per-pour totals, keeps keg level
+
+  float getDispensedMl() const { return dispensedMl; }
+  float getFlowRate() const { return flowMlPerSec; }
+  unsigned long getPulses() const { return pulses; }
+  unsigned long long getLastPulseMicros() const { return lastPulseMicros; }
+  bool isValveCommandedOpen() const { return commandedOpen; }
+  bool isFlowing() const { return flowMlPerSec > 0; }
+  bool isKegEmpty() const;
+
+  // True volume per pulse of a sensor with this profile at the given flow, without jitter
+  static float sensorMlPerPulseAt(const FlowProfile& profile, float flowMlPerSec);
+};
+
+#endif  // FLOW_SIMULATOR_H
@@ -0,0 +1,296 @@
+#include "hal_host.h"
+#include <Arduino.h>
+#include <chrono>
+#include <vector>
+
+HardwareSerial Serial;
+
+namespace {
+
+const int PIN_COUNT = 64;
+const int TIMER_COUNT = 8;
+
+struct PinState {
+  uint8_t mode;
+  int level;
+  hal::InterruptHandler handler;
+  void* handlerArg;
+  int interruptMode;
+};
+
+struct TimerState {
+  hal::TimerHandler handler;
+  void* arg;
+  bool armed;
+  unsigned long long dueMicros;
+};
+
+unsigned long long clockMicros = 0;
+PinState pins[PIN_COUNT];
+TimerState timers[TIMER_COUNT];
+int timerCount = 0;
+bool networkConnected = true;
+bool restarted = false;
+bool lowPowerMode = false;
+bool wakePin[PIN_COUNT];
+bool wakePinActivity = false;
+
+// Images start with the ESP32 image magic byte, anything else is rejected by otaEnd()
+const uint8_t IMAGE_MAGIC = 0xE9;
+std::vector<uint8_t> otaBuffer;
+uint32_t otaExpectedSize = 0;
+bool otaWriting = false;
+bool otaSelected = false;
+bool otaRunningNew = false;  // Booted the written image
+bool otaConfirmed = false;
+bool otaRollbackDone = false;
+
+}  // namespace
+
+namespace halhost {
+
+void reset() {
+  clockMicros = 0;
+  memset(pins, 0, sizeof(pins));
+  for (int i = 0; i < timerCount; i++) {
+    timers[i].armed = false;
+  }
+  networkConnected = true;
+  restarted = false;
+  lowPowerMode = false;
+  memset(wakePin, 0, sizeof(wakePin));
+  wakePinActivity = false;
+  otaBuffer.clear();
+  otaExpectedSize = 0;
+  otaWriting = false;
+  otaSelected = false;
+  otaRunningNew = false;
+  otaConfirmed = false;
+  otaRollbackDone = false;
+}
+
+void advanceMicros(unsigned long us) {
+  unsigned long long target = clockMicros + us;
+  // Fire due timers in order, each at its own due time, so handlers that re-arm see the
+  // same clock they would on hardware
+  while (true) {
+    TimerState* next = nullptr;
+    for (int i = 0; i < timerCount; i++) {
+      if (timers[i].armed && timers[i].dueMicros <= target &&
+          (next == nullptr || timers[i].dueMicros < next->dueMicros)) {
+        next = &timers[i];
+      }
+    }
+    if (next == nullptr) {
+      break;
+    }
+    if (next->dueMicros > clockMicros) {
+      clockMicros = next->dueMicros;
+    }
+    next->armed = false;
+    next->handler(next->arg);
+  }
+  clockMicros = target;
+}
+
+unsigned long long nowMicros() { return clockMicros; }
+
+int pinLevel(uint8_t pin) { return pin < PIN_COUNT ? pins[pin].level : LOW; }
+
+void setInputLevel(uint8_t pin, int level) {
+  if (pin < PIN_COUNT) {
+    pins[pin].level = level;
+  }
+}
+
+void raiseEdge(uint8_t pin, int edge) {
+  if (pin >= PIN_COUNT) {
+    return;
+  }
+  PinState& state = pins[pin];
+  state.level = (edge == FALLING) ? LOW : HIGH;
+  if (lowPowerMode && wakePin[pin]) {
+    wakePinActivity = true;
+  }
+  if (state.handler != nullptr && (state.interruptMode == edge || state.interruptMode == CHANGE)) {
+    state.handler(state.handlerArg);
+  }
+}
+
+void setNetworkConnected(bool connected) { networkConnected = connected; }
+
+bool restartRequested() { return restarted; }
+
+bool isLowPowerMode() { return lowPowerMode; }
+
+const uint8_t* otaImage(size_t& length) {
+  length = otaBuffer.size();
+  return otaBuffer.data();
+}
+
+bool otaImageSelected() { return otaSelected; }
+
+void bootOtaImage() {
+  if (otaSelected) {
+    otaSelected = false;
+    otaRunningNew = true;
+    otaConfirmed = false;
+  }
+  restarted = false;
+}
+
+bool otaRunningUnconfirmed() { return otaRunningNew && !otaConfirmed; }
+
+bool otaRolledBack() { return otaRollbackDone; }
+
+}  // namespace halhost
+
+namespace hal {
+
+void pinMode(uint8_t pin, uint8_t mode) {
+  if (pin < PIN_COUNT) {
+    pins[pin].mode = mode;
+    if (mode == INPUT_PULLUP) {
+      pins[pin].level = HIGH;
+    }
+  }
+}
+
+void digitalWrite(uint8_t pin, uint8_t value) {
+  if (pin < PIN_COUNT) {
+    pins[pin].level = value ? HIGH : LOW;
+  }
+}
+
+int digitalRead(uint8_t pin) { return halhost::pinLevel(pin); }
+
+void attachInterrupt(uint8_t pin, InterruptHandler handler, void* arg, int mode) {
+  if (pin < PIN_COUNT) {
+    pins[pin].handler = handler;
+    pins[pin].handlerArg = arg;
+    pins[pin].interruptMode = mode;
+  }
+}
+
+void detachInterrupt(uint8_t pin) {
+  if (pin < PIN_COUNT) {
+    pins[pin].handler = nullptr;
+  }
+}
+
+unsigned long millis() { return (unsigned long)(clockMicros / 1000); }
+
+unsigned long micros() { return (unsigned long)clockMicros; }
+
+void delay(unsigned long ms) { halhost::advanceMicros(ms * 1000UL); }
+
+// Real time, not the simulated clock, so section timings show what the pour logic costs on the
+// host CPU
+uint32_t cycleCount() {
+  return (uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+uint32_t cyclesPerMicrosecond() { return 1000; }
+
+TimerHandle createTimer(TimerHandler handler, void* arg, const char* name) {
+  (void)name;
+  if (timerCount >= TIMER_COUNT) {
+    return nullptr;
+  }
+  TimerState& timer = timers[timerCount++];
+  timer.handler = handler;
+  timer.arg = arg;
+  timer.armed = false;
+  return &timer;
+}
+
+void startTimer(TimerHandle timer, unsigned long delayUs) {
+  TimerState* state = static_cast<TimerState*>(timer);
+  state->armed = true;
+  state->dueMicros = clockMicros + delayUs;
+}
+
+void stopTimer(TimerHandle timer) { static_cast<TimerState*>(timer)->armed = false; }
+
+void restart() { restarted = true; }
+
+bool otaBegin(uint32_t size) {
+  otaBuffer.clear();
+  otaExpectedSize = size;
+  otaWriting = true;
+  otaSelected = false;
+  return true;
+}
+
+bool otaWrite(const uint8_t* data, size_t length) {
+  if (!otaWriting || (otaExpectedSize > 0 && otaBuffer.size() + length > otaExpectedSize)) {
+    return false;
+  }
+  otaBuffer.insert(otaBuffer.end(), data, data + length);
+  return true;
+}
+
+bool otaEnd() {
+  otaWriting = false;
+  otaSelected = !otaBuffer.empty() && otaBuffer[0] == IMAGE_MAGIC &&
+                (otaExpectedSize == 0 || otaBuffer.size() == otaExpectedSize);
+  return otaSelected;
+}
+
+void otaAbort() {
+  otaWriting = false;
+  otaBuffer.clear();
+}
+
+void otaMarkValid() { otaConfirmed = otaRunningNew; }
+
+bool otaRollback() {
+  if (!otaRunningNew) {
+    return false;
+  }
+  otaRunningNew = false;
+  otaRollbackDone = true;
+  restarted = true;
+  return true;
+}
+
+void watchTask(unsigned long timeoutMs) { (void)timeoutMs; }
+
+void feedWatchdog() {}
+
+uint32_t freeHeap() { return 0; }
+
+uint32_t minFreeHeap() { return 0; }
+
+uint32_t largestFreeBlock() { return 0; }
+
+bool isNetworkConnected() { return networkConnected; }
+
+void reconnectNetwork() {}
+
+// No sockets on the host
+bool waitForSocketData(int socket, unsigned long timeoutMs) {
+  halhost::advanceMicros(timeoutMs * 1000UL);
+  return false;
+}
+
+// Modem sleep and wake pins only, the simulator has no light sleep to report
+bool setLowPowerMode(bool enabled, const uint8_t* wakePins, uint8_t count) {
+  lowPowerMode = enabled;
+  for (uint8_t i = 0; i < count; i++) {
+    if (wakePins[i] < PIN_COUNT) {
+      wakePin[wakePins[i]] = enabled;
+    }
+  }
+  return false;
+}
+
+bool takeWakePinActivity() {
+  bool activity = wakePinActivity;
+  wakePinActivity = false;
+  return activity;
+}
+
+}  // namespace hal
@@ -0,0 +1,39 @@
+#ifndef HAL_HOST_H
+#define HAL_HOST_H
+
+#include "../src/hal.h"
+
+// Simulator-side controls for the host HAL implementation.
+// Time only moves when the simulator advances it, so runs are deterministic. HAL timers fire
+// from advanceMicros() at their due time.
+namespace halhost {
+
+void reset();
+
+// Simulated clock
+void advanceMicros(unsigned long us);
+unsigned long long nowMicros();
+
+// GPIO as seen by the simulated hardware
+int pinLevel(uint8_t pin);
+void setInputLevel(uint8_t pin, int level);
+
+// Raise an edge on an input pin, running the attached handler if the mode matches
+void raiseEdge(uint8_t pin, int edge);
+
+// Network and system state
+void setNetworkConnected(bool connected);
+bool restartRequested();
+bool isLowPowerMode();
+
+// Firmware updates: the image hal::otaEnd() selected for the next boot, kept in memory.
+// bootOtaImage() restarts into it; the image then runs unconfirmed until hal::otaMarkValid().
+const uint8_t* otaImage(size_t& length);
+bool otaImageSelected();
+void bootOtaImage();
+bool otaRunningUnconfirmed();
+bool otaRolledBack();
+
+}  // namespace halhost
+
+#endif  // HAL_HOST_H
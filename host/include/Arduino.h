@@ -0,0 +1,118 @@
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+// Minimal Arduino core stand-in for building src/ on Linux.
+// Only the language-level pieces live here (String, Serial, constants, ISR/spinlock
+// macros); hardware access goes through hal.h and is implemented by host/hal_host.cpp.
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+#define HIGH 0x1
+#define LOW 0x0
+
+#define INPUT 0x01
+#define OUTPUT 0x03
+#define INPUT_PULLUP 0x05
+
+#define RISING 0x01
+#define FALLING 0x02
+#define CHANGE 0x03
+
+#define IRAM_ATTR
+
+// Single-threaded simulator - critical sections are no-ops
+typedef int portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED 0
+#define portENTER_CRITICAL(mux) (void)(mux)
+#define portEXIT_CRITICAL(mux) (void)(mux)
+#define portENTER_CRITICAL_ISR(mux) (void)(mux)
+#define portEXIT_CRITICAL_ISR(mux) (void)(mux)
+
+class String {
+ private:
+  std::string value;
+
+ public:
+  String() {}
+  String(const char* text) : value(text != nullptr ? text : "") {}
+  String(const std::string& text) : value(text) {}
+  String(char c) : value(1, c) {}
+  String(int number) : value(std::to_string(number)) {}
+  String(unsigned int number) : value(std::to_string(number)) {}
+  String(long number) : value(std::to_string(number)) {}
+  String(unsigned long number) : value(std::to_string(number)) {}
+  String(float number, unsigned int decimals = 2) : String((double)number, decimals) {}
+  String(double number, unsigned int decimals = 2) {
+    char buffer[48];
+    snprintf(buffer, sizeof(buffer), "%.*f", decimals, number);
+    value = buffer;
+  }
+
+  const char* c_str() const { return value.c_str(); }
+  unsigned int length() const { return value.length(); }
+
+  String& operator+=(const String& other) {
+    value += other.value;
+    return *this;
+  }
+  friend String operator+(const String& left, const String& right) {
+    return String(left.value + right.value);
+  }
+  friend String operator+(const char* left, const String& right) {
+    return String(std::string(left) + right.value);
+  }
+  friend String operator+(const String& left, const char* right) {
+    return String(left.value + right);
+  }
+  bool operator==(const String& other) const { return value == other.value; }
+  bool operator!=(const String& other) const { return value != other.value; }
+
+  int indexOf(const char* text) const {
+    size_t position = value.find(text);
+    return position == std::string::npos ? -1 : (int)position;
+  }
+  bool endsWith(const char* text) const {
+    size_t length = strlen(text);
+    return value.size() >= length && value.compare(value.size() - length, length, text) == 0;
+  }
+  String substring(unsigned int from, unsigned int to) const {
+    return String(value.substr(from, to - from));
+  }
+};
+
+// Writes to stdout when enabled; the simulator keeps it quiet unless --verbose is given
+class HardwareSerial {
+ public:
+  bool enabled = false;
+
+  void begin(unsigned long baud) {}
+  size_t print(const String& text) { return write(text.c_str()); }
+  size_t print(const char* text) { return write(text); }
+  size_t print(int number) { return print(String(number)); }
+  size_t print(unsigned int number) { return print(String(number)); }
+  size_t print(long number) { return print(String(number)); }
+  size_t print(unsigned long number) { return print(String(number)); }
+  size_t print(double number) { return print(String(number)); }
+  template <typename T>
+  size_t println(const T& value) {
+    return print(value) + println();
+  }
+  size_t println() { return write("\n"); }
+
+ private:
+  size_t write(const char* text) {
+    if (!enabled) {
+      return 0;
+    }
+    return fputs(text, stdout) >= 0 ? strlen(text) : 0;
+  }
+};
+
+extern HardwareSerial Serial;
+
+#endif  // HOST_ARDUINO_H
@@ -0,0 +1,122 @@
+#ifndef HOST_LITTLEFS_H
+#define HOST_LITTLEFS_H
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <memory>
+#include <string>
+#include "Arduino.h"
+
+// LittleFS stand-in backed by a directory on the host. Only the calls used by the
+// firmware are provided; paths are mapped below root().
+namespace fs {
+
+class File {
+ private:
+  std::shared_ptr<FILE> file;
+  std::shared_ptr<DIR> dir;  // Set instead of file for a directory
+  std::string path;          // Host path
+  std::string fileName;      // Name within its directory, as the 2.x core reports it
+
+ public:
+  File() {}
+  File(FILE* handle, const std::string& hostPath) : path(hostPath) {
+    if (handle != nullptr) {
+      file.reset(handle, fclose);
+    }
+    fileName = path.substr(path.find_last_of('/') + 1);
+  }
+  File(DIR* handle, const std::string& hostPath) : path(hostPath) {
+    if (handle != nullptr) {
+      dir.reset(handle, closedir);
+    }
+    fileName = path.substr(path.find_last_of('/') + 1);
+  }
+
+  operator bool() const { return file != nullptr || dir != nullptr; }
+  bool isDirectory() const { return dir != nullptr; }
+  const char* name() const { return fileName.c_str(); }
+
+  // Next regular file of a directory, opened for reading
+  File openNextFile() {
+    while (dir != nullptr) {
+      struct dirent* entry = readdir(dir.get());
+      if (entry == nullptr) {
+        break;
+      }
+      std::string entryPath = path + "/" + entry->d_name;
+      struct stat info;
+      if (stat(entryPath.c_str(), &info) == 0 && S_ISREG(info.st_mode)) {
+        return File(fopen(entryPath.c_str(), "rb"), entryPath);
+      }
+    }
+    return File();
+  }
+
+  size_t read(uint8_t* buffer, size_t length) { return fread(buffer, 1, length, file.get()); }
+  size_t write(const uint8_t* buffer, size_t length) {
+    return fwrite(buffer, 1, length, file.get());
+  }
+  bool seek(uint32_t position) { return fseek(file.get(), position, SEEK_SET) == 0; }
+  size_t size() {
+    struct stat info;
+    fflush(file.get());
+    return fstat(fileno(file.get()), &info) == 0 ? info.st_size : 0;
+  }
+  void flush() { fflush(file.get()); }
+  void close() {
+    file.reset();
+    dir.reset();
+  }
+};
+
+class LittleFSFS {
+ private:
+  std::string hostPath(const char* path) const { return root() + path; }
+
+ public:
+  // Survives between runs like flash would, LITTLEFS_ROOT picks another location
+  static std::string root() {
+    const char* path = getenv("LITTLEFS_ROOT");
+    return path != nullptr ? path : "/tmp/beer-tap-littlefs";
+  }
+
+  bool begin(bool formatOnFail = false) {
+    return ::mkdir(root().c_str(), 0755) == 0 || access(root().c_str(), F_OK) == 0;
+  }
+  bool exists(const char* path) const { return access(hostPath(path).c_str(), F_OK) == 0; }
+  bool mkdir(const char* path) { return ::mkdir(hostPath(path).c_str(), 0755) == 0; }
+  bool remove(const char* path) { return ::unlink(hostPath(path).c_str()) == 0; }
+  bool rename(const char* from, const char* to) {
+    return ::rename(hostPath(from).c_str(), hostPath(to).c_str()) == 0;
+  }
+
+  File open(const char* path, const char* mode = "r") {
+    // Arduino's "r" / "w" / "a" are binary on the ESP32
+    std::string hostMode = std::string(mode) + "b";
+    struct stat info;
+    if (stat(hostPath(path).c_str(), &info) == 0 && S_ISDIR(info.st_mode)) {
+      return File(opendir(hostPath(path).c_str()), hostPath(path));
+    }
+    return File(fopen(hostPath(path).c_str(), hostMode.c_str()), hostPath(path));
+  }
+
+  // Wipes the filesystem - lets the simulator start from a factory-fresh device
+  void format() {
+    std::string command = "rm -rf '" + root() + "'";
+    if (system(command.c_str()) == 0) {
+      begin();
+    }
+  }
+};
+
+}  // namespace fs
+
+using fs::File;
+
+inline fs::LittleFSFS LittleFS;
+
+#endif  // HOST_LITTLEFS_H
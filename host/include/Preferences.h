@@ -0,0 +1,61 @@
+#ifndef HOST_PREFERENCES_H
+#define HOST_PREFERENCES_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include "Arduino.h"
+
+// In-memory NVS stand-in. Contents live for the lifetime of the process, so a
+// simulated reboot (new objects, same process) sees what was stored before it.
+class Preferences {
+ private:
+  std::string ns;
+  bool readOnly = false;
+  bool open = false;
+
+  static std::map<std::string, std::vector<uint8_t> >& storage() {
+    static std::map<std::string, std::vector<uint8_t> > values;
+    return values;
+  }
+  std::string keyFor(const char* key) const { return ns + "/" + key; }
+
+ public:
+  bool begin(const char* name, bool readOnly = false) {
+    ns = name;
+    this->readOnly = readOnly;
+    open = true;
+    return true;
+  }
+  void end() { open = false; }
+
+  size_t putBytes(const char* key, const void* value, size_t length) {
+    if (!open || readOnly) {
+      return 0;
+    }
+    const uint8_t* bytes = static_cast<const uint8_t*>(value);
+    storage()[keyFor(key)] = std::vector<uint8_t>(bytes, bytes + length);
+    return length;
+  }
+
+  size_t getBytesLength(const char* key) {
+    auto it = storage().find(keyFor(key));
+    return it == storage().end() ? 0 : it->second.size();
+  }
+
+  size_t getBytes(const char* key, void* buffer, size_t maxLength) {
+    auto it = storage().find(keyFor(key));
+    if (!open || it == storage().end() || it->second.size() > maxLength) {
+      return 0;
+    }
+    memcpy(buffer, it->second.data(), it->second.size());
+    return it->second.size();
+  }
+
+  bool remove(const char* key) { return storage().erase(keyFor(key)) > 0; }
+
+  // Wipes every namespace - lets the simulator start from a factory-fresh device
+  static void clearAll() { storage().clear(); }
+};
+
+#endif  // HOST_PREFERENCES_H
@@ -0,0 +1,24 @@
+#include "local_client.h"
+#include <stdio.h>
+#include "../src/sha256.h"
+
+LocalClient::LocalClient(const std::string& key, uint64_t firstCounter)
+    : key(key), counter(firstCounter) {}
+
+std::string LocalClient::request(const char* command, int tap, float value, const char* orderId) {
+  char message[160];
+  snprintf(message, sizeof(message), "%llu %s %d %g%s%s", (unsigned long long)counter++, command,
+           tap, value, orderId[0] != '\0' ? " " : "", orderId);
+
+  uint8_t mac[SHA256_DIGEST_SIZE];
+  hmacSha256(reinterpret_cast<const uint8_t*>(key.data()), key.size(), message, strlen(message),
+             mac);
+  std::string line = message;
+  line += ' ';
+  for (int i = 0; i < SHA256_DIGEST_SIZE; i++) {
+    char hex[3];
+    snprintf(hex, sizeof(hex), "%02x", mac[i]);
+    line += hex;
+  }
+  return line;
+}
@@ -0,0 +1,21 @@
+#ifndef LOCAL_CLIENT_H
+#define LOCAL_CLIENT_H
+
+#include <stdint.h>
+#include <string>
+
+// Stand-in for the kiosk that sends pour commands to the LAN endpoint (see LocalEndpoint).
+// Formats and signs request lines the way examples/local_pour.py does, with its own counter.
+class LocalClient {
+ private:
+  std::string key;
+  uint64_t counter;
+
+ public:
+  LocalClient(const std::string& key, uint64_t firstCounter);
+
+  // "<counter> <command> <tap> <value> [orderId] <mac>"
+  std::string request(const char* command, int tap, float value, const char* orderId = "");
+};
+
+#endif  // LOCAL_CLIENT_H
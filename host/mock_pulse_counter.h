@@ -0,0 +1,81 @@
+#ifndef MOCK_PULSE_COUNTER_H
+#define MOCK_PULSE_COUNTER_H
+
+#include "../src/pulse_counter.h"
+#include "../src/spsc_queue.h"
+
+// Host-side stand-in for the pulse counter backends.
+// Pulses are injected by the caller and the threshold callback fires synchronously,
+// exactly like the ISR backend would on the pulse that reaches it.
+class MockPulseCounter : public PulseCounter {
+ private:
+  unsigned long count;
+  unsigned long threshold;
+  bool thresholdFired;
+  ThresholdCallback callback;
+  void* callbackArg;
+  SpscQueue<uint32_t, PULSE_TIMESTAMP_BUFFER_SIZE> timestamps;
+  uint32_t droppedTimestamps;
+
+  void checkThreshold() {
+    if (threshold > 0 && !thresholdFired && count >= threshold) {
+      thresholdFired = true;
+      if (callback != nullptr) {
+        callback(callbackArg);
+      }
+    }
+  }
+
+ public:
+  MockPulseCounter()
+      : count(0),
+        threshold(0),
+        thresholdFired(false),
+        callback(nullptr),
+        callbackArg(nullptr),
+        droppedTimestamps(0) {}
+
+  bool begin(uint8_t pin, ThresholdCallback callback, void* callbackArg) override {
+    this->callback = callback;
+    this->callbackArg = callbackArg;
+    return true;
+  }
+
+  unsigned long getCount() override { return count; }
+
+  bool readPulseTimestamp(uint32_t& timestampUs) override { return timestamps.pop(timestampUs); }
+  uint32_t getDroppedTimestamps() const override { return droppedTimestamps; }
+
+  void reset() override {
+    count = 0;
+    threshold = 0;
+    thresholdFired = false;
+  }
+
+  void setThreshold(unsigned long count) override {
+    threshold = count;
+    thresholdFired = false;
+    checkThreshold();
+  }
+
+  // Simulates pulses arriving on the flow sensor pin
+  void pulse(unsigned long pulses = 1) {
+    for (unsigned long i = 0; i < pulses; i++) {
+      count++;
+      checkThreshold();
+    }
+  }
+
+  // Simulates a single pulse with a timestamp, as the ISR backend records it
+  void pulseAt(uint32_t timestampUs) {
+    if (!timestamps.push(timestampUs)) {
+      droppedTimestamps++;
+    }
+    pulse();
+  }
+
+  unsigned long getThreshold() const { return threshold; }
+  bool hasThresholdFired() const { return thresholdFired; }
+};
+
+#endif  // MOCK_PULSE_COUNTER_H
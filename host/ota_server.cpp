@@ -0,0 +1,76 @@
+#include "ota_server.h"
+#include <stdio.h>
+#include <zlib.h>
+#include "../src/sha256.h"
+
+OtaServer::OtaServer() : failEvery(0), requests(0), failures(0) {}
+
+void OtaServer::publish(const std::string& title, const std::string& version,
+                        const std::vector<uint8_t>& image, bool compress) {
+  this->title = title;
+  this->version = version;
+  package = image;
+  if (compress) {
+    uLongf length = compressBound(image.size());
+    package.resize(length);
+    compress2(package.data(), &length, image.data(), image.size(), Z_BEST_COMPRESSION);
+    package.resize(length);
+  }
+
+  uint8_t digest[SHA256_DIGEST_SIZE];
+  Sha256 sha;
+  sha.update(package.data(), package.size());
+  sha.finish(digest);
+  checksum.clear();
+  for (int i = 0; i < SHA256_DIGEST_SIZE; i++) {
+    char hex[3];
+    snprintf(hex, sizeof(hex), "%02x", digest[i]);
+    checksum += hex;
+  }
+}
+
+void OtaServer::corrupt(size_t offset) {
+  if (offset < package.size()) {
+    package[offset] ^= 0x20;
+  }
+}
+
+int OtaServer::getChunk(const std::string& title, const std::string& version, uint32_t size,
+                        uint32_t chunk, std::vector<uint8_t>& body) {
+  body.clear();
+  requests++;
+  if (failEvery > 0 && requests % failEvery == 0) {
+    failures++;
+    return 503;
+  }
+  if (title != this->title || version != this->version || size == 0) {
+    return 404;
+  }
+  uint64_t start = (uint64_t)chunk * size;
+  if (start >= package.size()) {
+    return 200;  // Past the end, an empty body
+  }
+  uint64_t end = start + size < package.size() ? start + size : package.size();
+  body.assign(package.begin() + start, package.begin() + end);
+  return 200;
+}
+
+std::vector<uint8_t> makeFirmwareImage(size_t size, uint32_t seed) {
+  std::vector<uint8_t> image(size);
+  uint32_t random = seed;
+  uint32_t words[64];
+  for (uint32_t& word : words) {
+    random = random * 1103515245 + 12345;
+    word = random;
+  }
+  for (size_t i = 0; i < size; i += 4) {
+    random = random * 1103515245 + 12345;
+    // Mostly a small vocabulary of instructions, now and then a literal
+    uint32_t word = (random >> 24) < 40 ? random : words[(random >> 16) % 64];
+    for (size_t b = 0; b < 4 && i + b < size; b++) {
+      image[i + b] = word >> (8 * b);
+    }
+  }
+  image[0] = 0xE9;
+  return image;
+}
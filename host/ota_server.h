@@ -0,0 +1,51 @@
+#ifndef OTA_SERVER_H
+#define OTA_SERVER_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Stand-in for ThingsBoard's firmware updates (see OtaUpdate): holds one OTA package, gives its
+// fw_* shared attributes and serves it in chunks the way the HTTP device API does for
+// GET /api/v1/<token>/firmware?title=&version=&size=&chunk=. Failed requests and a package
+// that does not match its checksum can be injected.
+class OtaServer {
+ private:
+  std::string title;
+  std::string version;
+  std::vector<uint8_t> package;  // As served
+  std::string checksum;          // SHA-256 of the package as uploaded, hex
+  int failEvery;
+  int requests;
+  int failures;
+
+ public:
+  OtaServer();
+
+  // Uploads an image, as a zlib stream when compress is set
+  void publish(const std::string& title, const std::string& version,
+               const std::vector<uint8_t>& image, bool compress);
+
+  // Flips a byte of what is served, after the checksum was taken
+  void corrupt(size_t offset);
+
+  // Every nth request answers 503, 0 = none
+  void setFailEvery(int n) { failEvery = n; }
+
+  const std::string& getTitle() const { return title; }
+  const std::string& getVersion() const { return version; }
+  uint32_t getSize() const { return package.size(); }
+  const std::string& getChecksum() const { return checksum; }
+  int getRequests() const { return requests; }
+  int getFailures() const { return failures; }
+
+  // Returns the HTTP status and fills body with chunk number chunk of size bytes
+  int getChunk(const std::string& title, const std::string& version, uint32_t size,
+               uint32_t chunk, std::vector<uint8_t>& body);
+};
+
+// A firmware-like image: the ESP32 image magic, then code-like words that compress about as
+// well as a real application
+std::vector<uint8_t> makeFirmwareImage(size_t size, uint32_t seed);
+
+#endif  // OTA_SERVER_H
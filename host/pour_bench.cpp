@@ -0,0 +1,82 @@
+// Host-side microbenchmarks of the control hot paths, see src/benchmark.h.
+// Prints one JSON object per line: a header, then one result per case.
+//
+//   pour_bench                    run every case
+//   pour_bench update safety      run the cases whose name contains any of the words
+//   pour_bench --ops N            operations per case (default BENCH_MIN_OPS)
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include <atomic>
+#include <new>
+#include <string>
+#include <vector>
+#include "../src/benchmark.h"
+#include "../src/config_store.h"
+#include "hal_host.h"
+
+// Every operator new in the process, which covers the std::string and container allocations
+// the host stand-ins make in place of the Arduino core's heap calls
+static std::atomic<uint32_t> allocationCount(0);
+
+void* operator new(size_t size) {
+  allocationCount++;
+  void* memory = malloc(size != 0 ? size : 1);
+  if (memory == nullptr) {
+    throw std::bad_alloc();
+  }
+  return memory;
+}
+
+void* operator new[](size_t size) { return operator new(size); }
+void operator delete(void* memory) noexcept { free(memory); }
+void operator delete[](void* memory) noexcept { free(memory); }
+void operator delete(void* memory, size_t) noexcept { free(memory); }
+void operator delete[](void* memory, size_t) noexcept { free(memory); }
+
+static uint32_t countAllocations() { return allocationCount.load(); }
+
+int main(int argc, char** argv) {
+  uint32_t minOps = BENCH_MIN_OPS;
+  std::vector<std::string> filters;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--ops" && i + 1 < argc) {
+      minOps = strtoul(argv[++i], nullptr, 10);
+    } else if (arg == "--help" || arg[0] == '-') {
+      fprintf(stderr, "usage: %s [--ops N] [name filter ...]\n", argv[0]);
+      return arg == "--help" ? 0 : 1;
+    } else {
+      filters.push_back(arg);
+    }
+  }
+
+  halhost::reset();
+  Preferences::clearAll();
+  configStore.begin();
+  Serial.enabled = false;  // Log lines from the cases would break the JSON output
+
+  BenchRunner runner("host");
+  runner.setAllocationCounter(countAllocations);
+  addControlBenchmarks(runner);
+
+  char line[256];
+  if (runner.headerToJson(line, sizeof(line)) > 0) {
+    printf("%s\n", line);
+  }
+  for (uint8_t i = 0; i < runner.getCount(); i++) {
+    bool selected = filters.empty();
+    for (const std::string& filter : filters) {
+      selected = selected || strstr(runner.get(i).name, filter.c_str()) != nullptr;
+    }
+    if (!selected) {
+      continue;
+    }
+    BenchResult result;
+    runner.run(i, minOps, result);
+    if (BenchRunner::resultToJson(result, line, sizeof(line)) > 0) {
+      printf("%s\n", line);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,1078 @@
+// Host-side pour simulator.
+// Runs the real ControlLoop, TapController, PourSystem and IsrPulseCounter from src/ against
+// FlowSimulator and reports overpour, time-to-stop and safety trips for a set of pour scenarios.
+//
+//   pour_sim                      run all built-in scenarios
+//   pour_sim nominal slow-valve   run selected scenarios
+//   pour_sim --file my.ini        replay scenarios from a file (see README)
+//   pour_sim --list | --verbose | --seed N | --pours N
+//   pour_sim --check              exit 1 if a scenario exceeds LATE_PULSE_BOUND
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include <string>
+#include <vector>
+#include "../src/attribute_publisher.h"
+#include "../src/calibration_session.h"
+#include "../src/config_store.h"
+#include "../src/constants.h"
+#include "../src/control_loop.h"
+#include "../src/isr_pulse_counter.h"
+#include "../src/keg_inventory.h"
+#include "../src/local_endpoint.h"
+#include "../src/logger.h"
+#include "../src/ota_update.h"
+#include "../src/perf_counters.h"
+#include "../src/pour_system.h"
+#include "../src/power_manager.h"
+#include "../src/tap_controller.h"
+#include "flow_simulator.h"
+#include "hal_host.h"
+#include "local_client.h"
+#include "ota_server.h"
+
+static const unsigned long TICK_US = 100;
+static const unsigned long POUR_GUARD_MS = MAX_POUR_TIME + 30000;  // Give up on a stuck pour
+static const unsigned long IDLE_BETWEEN_POURS_MS = 2000;
+
+// --check: the ISR closes the valve on the threshold pulse itself, so no pulse should be counted
+// past it by the time the relay is seen closed. One pulse of slack for a pulse that lands in the
+// same simulator step.
+static const long LATE_PULSE_BOUND = 1;
+
+struct Scenario {
+  std::string name;
+  FlowProfile flow;
+  int cupSizeMl;
+  int pours;
+  float mlPerPulse;             // Calibration configured on the device
+  unsigned long loopPeriodMs;   // Control task period
+  unsigned long stallAfterMs;   // Start of a main-loop stall, relative to valve open
+  unsigned long stallMs;        // Length of the stall, 0 = none
+  bool matchedCurve;            // Upload a calibration curve that matches the sensor
+  int taps;                     // Taps pouring at the same time, each with its own sensor
+  bool lanTrigger;              // Start pours with signed LAN requests, see LocalEndpoint
+  int calibrationPours;         // Calibration run before the scenario's pours, 0 = none
+  bool rpcLatency;              // Idle before every pour and time the RPC to valve open
+  bool powerIdle;               // With the idle power mode enabled
+  unsigned long dtimMs;         // AP beacon interval times DTIM period
+  bool kegTracking;             // Keg of keg_ml set on every tap, see KegInventory
+  bool otaUpdate;               // Firmware update offered before the first pour, see OtaUpdate
+  bool attributeReports;        // Client attributes sent through AttributePublisher
+};
+
+struct PourResult {
+  float dispensedMl;
+  float overpourMl;
+  float stopTimeMs;  // Relay close command until the last sensor pulse
+  long latePulses;   // Pulses past the armed threshold when the relay closed
+  bool tripped;      // Closed by a safety check instead of the target
+  StopReason stopReason;
+  int recordSamples;  // Flow samples in the published pour record
+  int recordChunks;   // Telemetry messages needed to publish them
+  uint32_t recordPulses;
+  uint32_t recordDurationMs;
+  float rpcLatencyMs;  // RPC arrival until the relay opened
+  uint8_t kegAlertPct;  // Low-keg alert level this pour crossed, 0 = none
+  bool kegReported;     // Remaining volume moved enough to be sent
+};
+
+// Per-tap totals over all pours of a scenario
+struct TapStats {
+  float overpourSum, overpourMax, overpourMin;
+  float stopTimeSum, stopTimeMax;
+  long latePulsesMax;
+  int trips;
+};
+
+// One simulated board: every tap has its own pulse counter, relay, sensor and keg
+struct Bench {
+  int count;
+  IsrPulseCounter counters[TAP_MAX_COUNT];
+  PourSystem taps[TAP_MAX_COUNT];
+  std::vector<FlowSimulator> flows;
+};
+
+static const FlowProfile NOMINAL_FLOW = {40.0, 300, 20, 50, 150, 2.222, 2.0, 0, 0, 0, 0, 0};
+
+static std::vector<Scenario> builtinScenarios() {
+  std::vector<Scenario> scenarios;
+
+  Scenario nominal = {
+      "nominal", NOMINAL_FLOW, 300, 10, 2.222, CONTROL_TASK_PERIOD_MS, 0, 0, false, 1, false, 0,
+      false, false, 102, false, false, false};
+  scenarios.push_back(nominal);
+
+  // Control loop starved while the pour finishes, like the old single loop() during a
+  // tb.connect retry - the ISR stop has to carry the pour on its own
+  Scenario stall = nominal;
+  stall.name = "reconnect-stall";
+  stall.stallAfterMs = 5000;
+  stall.stallMs = 10000;
+  scenarios.push_back(stall);
+
+  Scenario slowValve = nominal;
+  slowValve.name = "slow-valve";
+  slowValve.flow.valveCloseLagMs = 250;
+  slowValve.flow.drainMs = 400;
+  slowValve.pours = 20;
+  scenarios.push_back(slowValve);
+
+  Scenario trickle = nominal;
+  trickle.name = "trickle";
+  trickle.flow.peakFlowMlPerSec = 8.0;
+  trickle.cupSizeMl = 100;
+  scenarios.push_back(trickle);
+
+  Scenario jitter = nominal;
+  jitter.name = "jittery-sensor";
+  jitter.flow.jitterPercent = 15.0;
+  scenarios.push_back(jitter);
+
+  // Sensor that gives more volume per pulse at low flow, against the flat calibration and
+  // against a curve measured for it
+  Scenario slip = trickle;
+  slip.name = "slipping-sensor";
+  slip.flow.sensorSlipFlowMlPerSec = 30.0;
+  slip.flow.sensorSlipGain = 0.25;
+  scenarios.push_back(slip);
+
+  Scenario slipCurve = slip;
+  slipCurve.name = "slipping-sensor-curve";
+  slipCurve.matchedCurve = true;
+  scenarios.push_back(slipCurve);
+
+  Scenario kegEmpty = nominal;
+  kegEmpty.name = "keg-empty";
+  kegEmpty.flow.kegRemainingMl = 450;
+  kegEmpty.pours = 2;
+  scenarios.push_back(kegEmpty);
+
+  Scenario foam = nominal;
+  foam.name = "foaming-keg";
+  foam.flow.foamAfterMl = 400;
+  foam.flow.foamJitterPercent = 80.0;
+  foam.pours = 2;
+  scenarios.push_back(foam);
+
+  // A full board pouring on every tap at once from one control task
+  Scenario eightTaps = nominal;
+  eightTaps.name = "eight-taps";
+  eightTaps.taps = TAP_MAX_COUNT;
+  eightTaps.pours = 5;
+  scenarios.push_back(eightTaps);
+
+  // Every pour started by the kiosk over the LAN, each request followed by a replayed and a
+  // tampered copy that the endpoint has to turn away
+  Scenario lanTrigger = nominal;
+  lanTrigger.name = "lan-trigger";
+  lanTrigger.lanTrigger = true;
+  lanTrigger.pours = 5;
+  scenarios.push_back(lanTrigger);
+
+  // Sensor reading 6% low against the configured calibration, fixed by a calibration run with
+  // the simulated jug as the measurement before the regular pours
+  Scenario calibration = nominal;
+  calibration.name = "calibration-run";
+  calibration.flow.sensorMlPerPulse = 2.35;
+  calibration.calibrationPours = CALIBRATION_DEFAULT_POURS;
+  scenarios.push_back(calibration);
+
+  // Every pour requested after a long quiet spell, once at full power and once with the idle
+  // power mode, to compare RPC-to-valve-open latency
+  Scenario rpcLatency = nominal;
+  rpcLatency.name = "rpc-latency";
+  rpcLatency.rpcLatency = true;
+  rpcLatency.pours = 5;
+  scenarios.push_back(rpcLatency);
+
+  Scenario idleWake = rpcLatency;
+  idleWake.name = "idle-wake";
+  idleWake.powerIdle = true;
+  scenarios.push_back(idleWake);
+
+  // A 20 l keg poured until it runs dry, counted down from the pour records the way the
+  // network task does
+  Scenario kegInventory = nominal;
+  kegInventory.name = "keg-inventory";
+  kegInventory.flow.kegRemainingMl = 20000;
+  kegInventory.cupSizeMl = 500;
+  kegInventory.pours = 42;
+  kegInventory.kegTracking = true;
+  scenarios.push_back(kegInventory);
+
+  // A compressed firmware image offered just before the first pour. The download has to wait
+  // out every pour and ride out failed requests; then a package that fails its checksum and an
+  // image that never reaches ThingsBoard.
+  Scenario otaScenario = nominal;
+  otaScenario.name = "ota-update";
+  otaScenario.otaUpdate = true;
+  scenarios.push_back(otaScenario);
+
+  // The client attributes a pour changes, with a stop from the dashboard after every pour, sent
+  // through the publisher and counted against one message per change as they used to go out
+  Scenario attributeReports = kegInventory;
+  attributeReports.name = "attribute-reports";
+  attributeReports.pours = 20;
+  attributeReports.attributeReports = true;
+  scenarios.push_back(attributeReports);
+
+  return scenarios;
+}
+
+static bool setScenarioValue(Scenario& scenario, const std::string& key, const std::string& value) {
+  double number = atof(value.c_str());
+  if (key == "cup") scenario.cupSizeMl = (int)number;
+  else if (key == "pours") scenario.pours = (int)number;
+  else if (key == "ml_per_pulse") scenario.mlPerPulse = number;
+  else if (key == "loop_ms") scenario.loopPeriodMs = number;
+  else if (key == "stall_after_ms") scenario.stallAfterMs = number;
+  else if (key == "stall_ms") scenario.stallMs = number;
+  else if (key == "flow") scenario.flow.peakFlowMlPerSec = number;
+  else if (key == "ramp_ms") scenario.flow.rampUpMs = number;
+  else if (key == "open_lag_ms") scenario.flow.valveOpenLagMs = number;
+  else if (key == "close_lag_ms") scenario.flow.valveCloseLagMs = number;
+  else if (key == "drain_ms") scenario.flow.drainMs = number;
+  else if (key == "sensor_ml_per_pulse") scenario.flow.sensorMlPerPulse = number;
+  else if (key == "jitter_pct") scenario.flow.jitterPercent = number;
+  else if (key == "keg_ml") scenario.flow.kegRemainingMl = number;
+  else if (key == "sensor_slip_flow") scenario.flow.sensorSlipFlowMlPerSec = number;
+  else if (key == "sensor_slip_gain") scenario.flow.sensorSlipGain = number;
+  else if (key == "foam_after_ml") scenario.flow.foamAfterMl = number;
+  else if (key == "foam_jitter_pct") scenario.flow.foamJitterPercent = number;
+  else if (key == "matched_curve") scenario.matchedCurve = number != 0;
+  else if (key == "taps" && number >= 1 && number <= TAP_MAX_COUNT) scenario.taps = (int)number;
+  else if (key == "lan_trigger") scenario.lanTrigger = number != 0;
+  else if (key == "calibrate") scenario.calibrationPours = (int)number;
+  else if (key == "rpc_latency") scenario.rpcLatency = number != 0;
+  else if (key == "power_idle") scenario.powerIdle = scenario.rpcLatency = number != 0;
+  else if (key == "dtim_ms" && number >= 1) scenario.dtimMs = number;
+  else if (key == "keg_tracking") scenario.kegTracking = number != 0;
+  else if (key == "ota_update") scenario.otaUpdate = number != 0;
+  else if (key == "attribute_reports") scenario.attributeReports = number != 0;
+  else return false;
+  return true;
+}
+
+static std::string trim(const std::string& text) {
+  size_t start = text.find_first_not_of(" \t\r\n");
+  size_t end = text.find_last_not_of(" \t\r\n");
+  return start == std::string::npos ? "" : text.substr(start, end - start + 1);
+}
+
+// INI-style file: "[name]" starts a scenario based on "nominal", "key = value" overrides it
+static bool loadScenarioFile(const char* path, std::vector<Scenario>& scenarios) {
+  FILE* file = fopen(path, "r");
+  if (file == nullptr) {
+    fprintf(stderr, "Cannot open scenario file %s\n", path);
+    return false;
+  }
+
+  char line[256];
+  int lineNumber = 0;
+  Scenario* current = nullptr;
+  while (fgets(line, sizeof(line), file) != nullptr) {
+    lineNumber++;
+    std::string text = trim(line);
+    if (text.empty() || text[0] == '#') {
+      continue;
+    }
+    if (text[0] == '[' && text[text.size() - 1] == ']') {
+      scenarios.push_back(builtinScenarios()[0]);
+      current = &scenarios.back();
+      current->name = text.substr(1, text.size() - 2);
+      continue;
+    }
+    size_t equals = text.find('=');
+    if (current == nullptr || equals == std::string::npos ||
+        !setScenarioValue(*current, trim(text.substr(0, equals)), trim(text.substr(equals + 1)))) {
+      fprintf(stderr, "%s:%d: cannot parse '%s'\n", path, lineNumber, text.c_str());
+      fclose(file);
+      return false;
+    }
+  }
+  fclose(file);
+  return true;
+}
+
+// Client attributes of a scenario, marked where the firmware marks them and published by a
+// network pass every NETWORK_TASK_PERIOD_MS. Each mark is also counted as the message the
+// firmware sent for it before the publisher.
+struct AttributeRun {
+  const ControlLoop* control;
+  int cupSizeMl[TAP_MAX_COUNT];  // As on the dashboard
+  unsigned long long nextPassMicros;
+  int directMessages;  // One per change
+  int messages;        // Sent by the publisher
+  size_t bytes;
+  int rpcChanges;  // Made by the stop RPC, each sent from inside its handler before
+};
+static AttributeRun* attributeRun = nullptr;
+
+static size_t renderCupSize(uint8_t tap, char* buffer, size_t size) {
+  return snprintf(buffer, size, "%d", attributeRun->cupSizeMl[tap]);
+}
+
+static size_t renderOvershootModel(uint8_t tap, char* buffer, size_t size) {
+  TapSettings settings;
+  attributeRun->control->readSettings(tap, settings);
+  char model[96];
+  OvershootModel::toJson(settings.overshoot, model, sizeof(model));
+  return snprintf(buffer, size, "%s", model);
+}
+
+static size_t renderKegRemaining(uint8_t tap, char* buffer, size_t size) {
+  return snprintf(buffer, size, "%lu", (unsigned long)kegInventory.getRemainingMl(tap));
+}
+
+static size_t renderKegPoursLeft(uint8_t tap, char* buffer, size_t size) {
+  return snprintf(buffer, size, "%lu", (unsigned long)kegInventory.getPoursRemaining(tap));
+}
+
+static void setCupSize(int tap, int cupSizeMl) {
+  if (attributeRun == nullptr) {
+    return;
+  }
+  attributeRun->cupSizeMl[tap] = cupSizeMl;
+  attributePublisher.markChanged(renderCupSize, tap, hal::millis());
+  attributeRun->directMessages++;
+}
+
+// The attribute updates of handlePourEvents()
+static void onPourEvent(const PourEvent& event) {
+  if (attributeRun == nullptr) {
+    return;
+  }
+  if (event.type == EVENT_POUR_COMPLETE) {
+    setCupSize(event.tap, 0);
+  } else if (event.type == EVENT_OVERSHOOT_MEASURED) {
+    attributePublisher.markChanged(renderOvershootModel, event.tap, hal::millis());
+    attributeRun->directMessages++;
+  }
+}
+
+static void attributeNetworkPass() {
+  if (attributeRun == nullptr || halhost::nowMicros() < attributeRun->nextPassMicros) {
+    return;
+  }
+  char payload[TELEMETRY_CHUNK_SIZE];
+  size_t length;
+  while ((length = attributePublisher.takePayload(hal::millis(), payload, sizeof(payload))) > 0) {
+    attributePublisher.onSent(true, hal::millis());
+    attributeRun->messages++;
+    attributeRun->bytes += length;
+  }
+  attributeRun->nextPassMicros = halhost::nowMicros() + NETWORK_TASK_PERIOD_MS * 1000ULL;
+}
+
+static void tickControl(ControlLoop& control) {
+  control.tick();
+
+  // Only the attribute updates consume events on the host, drain them so the queue never fills
+  PourEvent event;
+  while (control.pollEvent(event)) {
+    onPourEvent(event);
+  }
+
+  // Stands in for the firmware's log task
+  logger.drain();
+}
+
+// Firmware update running in the background of a scenario. The network task makes a pass every
+// NETWORK_TASK_PERIOD_MS, a chunk request adds OTA_REQUEST_MS to it.
+static const unsigned long OTA_REQUEST_MS = 60;
+static const size_t OTA_IMAGE_SIZE = 640 * 1024;
+static const int OTA_FAIL_EVERY = 10;  // Server answers every 10th request with a 503
+
+struct OtaRun {
+  OtaServer server;
+  unsigned long long nextPassMicros;
+  bool healthy;  // The new image reaches ThingsBoard
+  int chunks;
+  int chunksWhilePouring;
+  int pour;  // Current pour, 1-based
+  bool pausedThisPour;
+  int pausedPours;
+  int restartPour;  // Pour after which the restart was requested, 0 = none
+  bool restartWhilePouring;
+  std::string states;  // fw_state reports in the order they were sent
+};
+static OtaRun* otaRun = nullptr;
+
+static bool anyValveOpen(const Bench& bench) {
+  for (int i = 0; i < bench.count; i++) {
+    if (halhost::pinLevel(bench.taps[i].getRelayPin()) == LOW) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// One network task pass of the firmware update, as in the firmware's serviceOta()
+static void otaNetworkPass(const Bench& bench) {
+  if (otaRun == nullptr || halhost::nowMicros() < otaRun->nextPassMicros) {
+    return;
+  }
+  unsigned long long passUs = NETWORK_TASK_PERIOD_MS * 1000ULL;
+  bool busy = false;
+  for (int i = 0; i < bench.count; i++) {
+    busy = busy || bench.taps[i].getIsPouring() || bench.taps[i].getIsSettling();
+  }
+
+  otaUpdate.checkHealth(otaRun->healthy, hal::millis());
+  uint32_t index;
+  uint32_t length;
+  if (otaUpdate.nextChunk(busy, hal::millis(), index, length)) {
+    std::vector<uint8_t> body;
+    if (otaRun->server.getChunk(FIRMWARE_TITLE, otaUpdate.getVersion(), OTA_CHUNK_SIZE, index,
+                                body) == 200) {
+      otaRun->chunksWhilePouring += anyValveOpen(bench) ? 1 : 0;
+      otaUpdate.onChunk(body.data(), body.size(), hal::millis());
+      otaRun->chunks++;
+    } else {
+      otaUpdate.onChunkFailed(hal::millis());
+    }
+    passUs += OTA_REQUEST_MS * 1000ULL;
+  } else if (busy && otaUpdate.getState() == OTA_DOWNLOADING) {
+    otaRun->pausedThisPour = true;
+  }
+
+  while (otaUpdate.needsReport()) {
+    FwState state = otaUpdate.getReportState();
+    otaRun->states += (otaRun->states.empty() ? "" : " > ") +
+                      std::string(OtaUpdate::fwStateName(state));
+    otaUpdate.markReported(state);
+  }
+  if (otaUpdate.shouldRestart(busy) && !halhost::restartRequested()) {
+    otaRun->restartWhilePouring = anyValveOpen(bench);
+    otaRun->restartPour = otaRun->pour;
+    hal::restart();
+  }
+  otaRun->nextPassMicros = halhost::nowMicros() + passUs;
+}
+
+static void offerOtaPackage(const OtaServer& server) {
+  otaUpdate.offer(server.getTitle().c_str(), server.getVersion().c_str(), server.getSize(),
+                  server.getChecksum().c_str(), "SHA256");
+}
+
+static void runFor(unsigned long ms, Bench& bench, ControlLoop& control, const Scenario& scenario,
+                   unsigned long long& nextUpdate) {
+  unsigned long long end = halhost::nowMicros() + (unsigned long long)ms * 1000;
+  while (halhost::nowMicros() < end) {
+    halhost::advanceMicros(TICK_US);
+    for (int i = 0; i < bench.count; i++) {
+      bench.flows[i].tick(TICK_US);
+    }
+    if (halhost::nowMicros() >= nextUpdate) {
+      tickControl(control);
+      nextUpdate += (unsigned long long)scenario.loopPeriodMs * 1000;
+    }
+    otaNetworkPass(bench);
+    attributeNetworkPass();
+  }
+}
+
+// Set by ControlLoop::submit() like the firmware's task notification
+static bool controlWoken = false;
+static void onControlWake() { controlWoken = true; }
+static uint32_t rpcRandom = 1;
+
+// Idles the bench until the pour RPC arrives, then hands it over the way the two tasks would.
+// The network task picks it up on its next pass; in the idle power mode it is blocked on the
+// socket instead and runs as soon as the sleeping modem has fetched the frame at the next DTIM
+// beacon. The control task applies it on its next tick; when idle, the submitted command wakes
+// it. Returns arrival to relay open in ms.
+static float deliverPourRpc(const Scenario& scenario, Bench& bench, ControlLoop& control) {
+  unsigned long long start = halhost::nowMicros();
+  rpcRandom = rpcRandom * 1103515245 + 12345;
+  unsigned long long arrival =
+      start + (POWER_IDLE_ENTER_MS + 5000 + (rpcRandom >> 8) % 10000) * 1000ULL;
+  unsigned long long beaconUs = scenario.dtimMs * 1000ULL;
+  unsigned long long received = 0;
+  unsigned long long nextNetwork = start;
+  unsigned long long nextControl = start;
+  bool networkWaiting = false;  // Blocked on the socket, idle mode
+  bool controlWaiting = false;  // Waiting for a notification, idle mode
+  bool submitted = false;
+  controlWoken = false;
+
+  while (halhost::pinLevel(bench.taps[0].getRelayPin()) != LOW &&
+         halhost::nowMicros() < arrival + 5000000ULL) {
+    halhost::advanceMicros(TICK_US);
+    for (int i = 0; i < bench.count; i++) {
+      bench.flows[i].tick(TICK_US);
+    }
+    unsigned long long now = halhost::nowMicros();
+    if (now >= arrival && received == 0) {
+      received = halhost::isLowPowerMode() ? (arrival + beaconUs - 1) / beaconUs * beaconUs
+                                           : arrival;
+    }
+
+    bool dataReady = received != 0 && now >= received && !submitted;
+    if (now >= nextNetwork || (networkWaiting && dataReady)) {
+      if (dataReady) {
+        for (int i = 0; i < bench.count; i++) {
+          control.submit(i, CMD_SET_CUP_SIZE, scenario.cupSizeMl);
+        }
+        submitted = true;
+      }
+      powerManager.update(submitted, hal::millis());  // A queued order keeps full power
+      networkWaiting = powerManager.isIdle();
+      nextNetwork =
+          now + (networkWaiting ? POWER_IDLE_NETWORK_WAIT_MS : NETWORK_TASK_PERIOD_MS) * 1000ULL;
+    }
+
+    if (now >= nextControl || (controlWaiting && controlWoken)) {
+      controlWoken = false;
+      tickControl(control);
+      controlWaiting = powerManager.isIdle();
+      nextControl =
+          now + (controlWaiting ? POWER_IDLE_CONTROL_PERIOD_MS : scenario.loopPeriodMs) * 1000ULL;
+    }
+  }
+  return received != 0 ? (halhost::nowMicros() - arrival) / 1000.0 : -1;
+}
+
+// Shared by the simulated kiosk and the simulated tap
+static const char* LAN_KEY = "host-simulator-lan-key";
+static int lanRequests[LOCAL_REPLAYED + 1];
+
+// Starts a pour the way the network task would, from the LAN when the scenario asks for it
+static void startPour(const Scenario& scenario, ControlLoop& control, LocalClient& kiosk,
+                      int tap) {
+  setCupSize(tap, scenario.cupSizeMl);  // As dispatchOrders() does
+  if (!scenario.lanTrigger) {
+    control.submit(tap, CMD_SET_CUP_SIZE, scenario.cupSizeMl);
+    return;
+  }
+  std::string request = kiosk.request("pour", tap, scenario.cupSizeMl);
+  std::string tampered = request;
+  tampered[request.find(" pour ") + 8] = '9';  // Cup size, past "pour <tap> "
+  const std::string attempts[] = {request, request, tampered};
+  for (const std::string& attempt : attempts) {
+    LocalCommand command;
+    LocalRequestStatus status = localEndpoint.parse(attempt.c_str(), attempt.size(), command);
+    lanRequests[status]++;
+    if (status == LOCAL_ACCEPTED && command.type == LOCAL_POUR) {
+      control.submit(command.tap, CMD_SET_CUP_SIZE, command.value);
+    }
+  }
+}
+
+// Pours one cup on every tap at once and fills one result per tap
+static void runPour(const Scenario& scenario, Bench& bench, ControlLoop& control,
+                    LocalClient& kiosk, PourResult* results) {
+  unsigned long long closeMicros[TAP_MAX_COUNT] = {};
+  unsigned long armedBefore[TAP_MAX_COUNT] = {};
+  bool opened[TAP_MAX_COUNT] = {};
+  bool closed[TAP_MAX_COUNT] = {};
+  for (int i = 0; i < bench.count; i++) {
+    results[i] = PourResult();
+    bench.flows[i].resetPour();
+    if (!scenario.rpcLatency) {
+      startPour(scenario, control, kiosk, i);
+    }
+  }
+  if (scenario.rpcLatency) {
+    results[0].rpcLatencyMs = deliverPourRpc(scenario, bench, control);
+  }
+
+  unsigned long long start = halhost::nowMicros();
+  unsigned long long nextUpdate = start;
+
+  while (halhost::nowMicros() - start < (unsigned long long)POUR_GUARD_MS * 1000) {
+    halhost::advanceMicros(TICK_US);
+    for (int i = 0; i < bench.count; i++) {
+      armedBefore[i] = bench.taps[i].getArmedPulseThreshold();
+      bench.flows[i].tick(TICK_US);  // May run the pulse ISR, which can close the relay
+    }
+
+    unsigned long long now = halhost::nowMicros();
+    unsigned long long sinceStart = (now - start) / 1000;
+    bool stalled = scenario.stallMs > 0 && sinceStart >= scenario.stallAfterMs &&
+                   sinceStart < scenario.stallAfterMs + scenario.stallMs;
+    if (now >= nextUpdate) {
+      if (!stalled) {
+        tickControl(control);
+      }
+      nextUpdate += (unsigned long long)scenario.loopPeriodMs * 1000;
+    }
+    otaNetworkPass(bench);
+    attributeNetworkPass();
+
+    bool finished = true;
+    for (int i = 0; i < bench.count; i++) {
+      bool relayOpen = halhost::pinLevel(bench.taps[i].getRelayPin()) == LOW;
+      if (relayOpen) {
+        opened[i] = true;
+      } else if (opened[i] && !closed[i]) {
+        closed[i] = true;
+        closeMicros[i] = now;
+        unsigned long count = bench.counters[i].getCount();
+        if (armedBefore[i] > 0 && count >= armedBefore[i]) {
+          results[i].latePulses = (long)count - (long)armedBefore[i];
+        }
+      }
+      finished = finished && closed[i] && !bench.taps[i].getIsSettling() &&
+                 !bench.flows[i].isFlowing();
+    }
+    if (finished) {
+      break;
+    }
+  }
+
+  // The dashboard's stop button, pressed once the cup is full
+  for (int i = 0; attributeRun != nullptr && i < bench.count; i++) {
+    setCupSize(i, 0);
+    attributeRun->rpcChanges++;
+  }
+
+  kegInventory.update(hal::millis());
+  for (int i = 0; i < bench.count; i++) {
+    const FlowSimulator& flow = bench.flows[i];
+    results[i].dispensedMl = flow.getDispensedMl();
+    results[i].overpourMl = results[i].dispensedMl - scenario.cupSizeMl;
+    if (closed[i] && flow.getLastPulseMicros() > closeMicros[i]) {
+      results[i].stopTimeMs = (flow.getLastPulseMicros() - closeMicros[i]) / 1000.0;
+    }
+  }
+
+  runFor(IDLE_BETWEEN_POURS_MS, bench, control, scenario, nextUpdate);
+  for (int i = 0; i < bench.count; i++) {
+    PourSystem& tap = bench.taps[i];
+    results[i].stopReason = tap.getLastStopReason();
+    results[i].tripped = results[i].stopReason != STOP_TARGET_REACHED;
+
+    // Publish the pour record the way the network task does, into a throwaway buffer
+    PourRecorder& recorder = tap.getRecorder();
+    if (const PourRecord* record = recorder.getCompleted()) {
+      PourTelemetryWriter writer(*record, 1700000000000ULL);
+      char chunk[TELEMETRY_CHUNK_SIZE];
+      while (writer.nextChunk(chunk, sizeof(chunk)) > 0) {
+        results[i].recordChunks++;
+      }
+      results[i].recordSamples = record->sampleCount;
+      results[i].recordPulses = record->pulses;
+      results[i].recordDurationMs = record->durationMs;
+      if (scenario.kegTracking) {
+        results[i].kegAlertPct = kegInventory.recordPour(i, record->actualMl, hal::millis());
+        results[i].kegReported = kegInventory.needsReport(i);
+        if (results[i].kegReported) {
+          kegInventory.markReported(i);
+          if (attributeRun != nullptr) {
+            attributePublisher.markChanged(renderKegRemaining, i, hal::millis());
+            attributePublisher.markChanged(renderKegPoursLeft, i, hal::millis());
+            attributeRun->directMessages++;
+          }
+        }
+      }
+      recorder.releaseCompleted();
+    }
+  }
+}
+
+// What a calibration run on the bench would produce for the simulated sensor
+static CalibrationCurve measuredCurve(const FlowProfile& profile) {
+  CalibrationPoint points[CALIBRATION_MAX_POINTS];
+  float flow = profile.peakFlowMlPerSec > 40.0 ? profile.peakFlowMlPerSec : 40.0;
+  for (int i = 0; i < CALIBRATION_MAX_POINTS; i++, flow /= 2) {
+    float mlPerPulse = FlowSimulator::sensorMlPerPulseAt(profile, flow);
+    points[i].intervalUs = (uint32_t)(mlPerPulse / flow * 1000000.0);
+    points[i].ulPerPulse = microlitresPerPulse(mlPerPulse);
+  }
+  CalibrationCurve curve;
+  curve.set(points, CALIBRATION_MAX_POINTS);
+  return curve;
+}
+
+// Pours the scenario's cup on every tap, measures each one with the simulated jug and commits
+// the fit the way the calibrate RPC does
+static void runCalibration(const Scenario& scenario, Bench& bench, ControlLoop& control,
+                           LocalClient& kiosk) {
+  CalibrationSession sessions[TAP_MAX_COUNT];
+  for (int t = 0; t < bench.count; t++) {
+    sessions[t].start(t, scenario.cupSizeMl, scenario.calibrationPours);
+  }
+  for (int i = 0; i < scenario.calibrationPours; i++) {
+    PourResult results[TAP_MAX_COUNT];
+    runPour(scenario, bench, control, kiosk, results);
+    for (int t = 0; t < bench.count; t++) {
+      if (sessions[t].addPour(results[t].recordPulses, results[t].recordDurationMs)) {
+        sessions[t].addMeasurement(results[t].dispensedMl);
+      }
+    }
+  }
+
+  for (int t = 0; t < bench.count; t++) {
+    CalibrationFit fit;
+    if (!sessions[t].fit(fit)) {
+      printf("  calibration tap %d: no fit after %d pours\n", t, sessions[t].getSampleCount());
+      continue;
+    }
+    if (fit.acceptable) {
+      control.submitCalibrationCurve(t, fit.curve);
+      tickControl(control);
+    }
+    printf("  calibration tap %d: %d pours, %.3f ml/pulse in %u point(s) (sensor %.3f), "
+           "residual %.2fml (%.2f%%), %s\n",
+           t, fit.pours, fit.curve.getNominalUlPerPulse() / 1000.0,
+           (unsigned)fit.curve.getCount(), scenario.flow.sensorMlPerPulse, fit.residualMl,
+           fit.residualPct, fit.acceptable ? "committed" : "rejected");
+  }
+}
+
+static void runOtaUntilSettled(const Scenario& scenario, Bench& bench, ControlLoop& control) {
+  unsigned long long nextUpdate = halhost::nowMicros();
+  for (int i = 0; i < 300 && otaUpdate.getState() == OTA_DOWNLOADING; i++) {
+    runFor(1000, bench, control, scenario, nextUpdate);
+  }
+  runFor(100, bench, control, scenario, nextUpdate);  // Sends the last reports
+}
+
+// After the scenario's pours: lets the download finish, restarts into the new image and passes
+// its health check. Then a package corrupted on the server, and an image that never reaches
+// ThingsBoard and has to be rolled back.
+static void finishOtaUpdate(const Scenario& scenario, Bench& bench, ControlLoop& control,
+                            OtaRun& ota, const std::vector<uint8_t>& image) {
+  runOtaUntilSettled(scenario, bench, control);
+  int requests = ota.server.getRequests();
+  int failures = ota.server.getFailures();
+  size_t length;
+  const uint8_t* installed = halhost::otaImage(length);
+  bool matches = length == image.size() && memcmp(installed, image.data(), length) == 0;
+  std::string restart = "never";
+  if (halhost::restartRequested()) {
+    restart = ota.restartPour > scenario.pours ? "after the last pour"
+                                                : "after pour " + std::to_string(ota.restartPour);
+    restart += ota.restartWhilePouring ? " WHILE POURING" : "";
+  }
+  halhost::bootOtaImage();
+  otaUpdate.begin(ota.server.getVersion().c_str(), hal::millis());
+  runOtaUntilSettled(scenario, bench, control);
+  printf("  ota: %s, %lu-byte image as a %lu-byte zlib package in %d chunks, %d of %d requests "
+         "failed and were retried\n",
+         ota.server.getVersion().c_str(), (unsigned long)image.size(),
+         (unsigned long)ota.server.getSize(), ota.chunks, failures, requests);
+  printf("  ota: paused through %d pours, %d chunks written while pouring, image %s, restart %s\n",
+         ota.pausedPours, ota.chunksWhilePouring, matches ? "intact" : "DIFFERS", restart.c_str());
+  printf("  ota: fw_state %s, %s\n", ota.states.c_str(),
+         halhost::otaRunningUnconfirmed() ? "NOT CONFIRMED" : "confirmed");
+
+  // One byte changed after the checksum was taken, in a plain image only the checksum can tell
+  ota.states.clear();
+  ota.server.setFailEvery(0);
+  ota.server.publish(FIRMWARE_TITLE, "1.2.0", image, false);
+  ota.server.corrupt(image.size() / 2);
+  offerOtaPackage(ota.server);
+  runOtaUntilSettled(scenario, bench, control);
+  std::string corrupt = ota.states + " (" + (otaUpdate.getError() ? otaUpdate.getError() : "") +
+                        ")" + (halhost::otaImageSelected() ? ", SELECTED FOR BOOT" : "");
+
+  // Installs, but never connects: rolled back, reported by the previous image, not taken again
+  ota.states.clear();
+  ota.server.publish(FIRMWARE_TITLE, "1.3.0", image, true);
+  offerOtaPackage(ota.server);
+  runOtaUntilSettled(scenario, bench, control);
+  std::string previous = otaUpdate.getRunningVersion();
+  halhost::bootOtaImage();
+  otaUpdate.begin(ota.server.getVersion().c_str(), hal::millis());
+  ota.healthy = false;
+  unsigned long long nextUpdate = halhost::nowMicros();
+  runFor(OTA_HEALTH_TIMEOUT_MS + 1000, bench, control, scenario, nextUpdate);
+  bool rolledBack = halhost::otaRolledBack() && halhost::restartRequested();
+  otaUpdate.begin(previous.c_str(), hal::millis());
+  ota.healthy = true;
+  runOtaUntilSettled(scenario, bench, control);
+  std::string unhealthy = ota.states + " (" +
+                          (otaUpdate.getError() ? otaUpdate.getError() : "") + ")";
+  offerOtaPackage(ota.server);
+  bool offeredAgain = otaUpdate.getState() != OTA_IDLE;
+  printf("  ota: corrupt 1.2.0 %s; unhealthy 1.3.0 %s, %s, offered again: %s\n",
+         corrupt.c_str(), rolledBack ? "rolled back" : "NOT ROLLED BACK", unhealthy.c_str(),
+         offeredAgain ? "DOWNLOADING" : "ignored");
+}
+
+static long runScenario(const Scenario& scenario, uint32_t seed) {
+  halhost::reset();
+  Preferences::clearAll();  // Every scenario starts with an untrained tap
+  configStore.begin();
+  kegInventory.begin(scenario.taps);
+  perfCounters.reset();  // Host time spent in ControlLoop::tick(), see hal::cycleCount()
+  localEndpoint.begin(LAN_KEY);
+  LocalClient kiosk(LAN_KEY, 1700000000000ULL);
+  memset(lanRequests, 0, sizeof(lanRequests));
+
+  Bench bench;
+  bench.count = scenario.taps;
+  PulseCounter* counters[TAP_MAX_COUNT];
+  TapPins pins[TAP_MAX_COUNT];
+  for (int i = 0; i < bench.count; i++) {
+    counters[i] = &bench.counters[i];
+    pins[i].relayPin = RELAY_PIN + i;
+    pins[i].flowSensorPin = FLOW_SENSOR_PIN + i;
+  }
+  TapController controller(bench.taps, bench.count);
+  controller.init(counters, pins);
+  ControlLoop control(controller);
+  control.begin();
+  control.setWakeHandler(onControlWake);
+  uint8_t flowSensorPins[TAP_MAX_COUNT];
+  for (int i = 0; i < bench.count; i++) {
+    flowSensorPins[i] = pins[i].flowSensorPin;
+  }
+  powerManager.begin(flowSensorPins, bench.count, scenario.powerIdle);
+  rpcRandom = seed;
+  float latencySum = 0;
+  float latencyMax = 0;
+  for (int i = 0; i < bench.count; i++) {
+    bench.taps[i].handleMlPerPulseChange(scenario.mlPerPulse);
+    if (scenario.matchedCurve) {
+      control.submitCalibrationCurve(i, measuredCurve(scenario.flow));
+      tickControl(control);
+    }
+    bench.flows.push_back(
+        FlowSimulator(pins[i].relayPin, pins[i].flowSensorPin, scenario.flow, seed + i));
+  }
+
+  if (scenario.calibrationPours > 0) {
+    runCalibration(scenario, bench, control, kiosk);
+  }
+  for (int i = 0; scenario.kegTracking && i < bench.count; i++) {
+    kegInventory.setKeg(i, scenario.flow.kegRemainingMl, "sim-lager", 0, nullptr, 0, 0);
+  }
+  OtaRun ota = OtaRun();
+  std::vector<uint8_t> otaImage;
+  if (scenario.otaUpdate) {
+    otaUpdate.begin(FIRMWARE_VERSION, hal::millis());
+    otaImage = makeFirmwareImage(OTA_IMAGE_SIZE, seed);
+    ota.server.publish(FIRMWARE_TITLE, "1.1.0", otaImage, true);
+    ota.server.setFailEvery(OTA_FAIL_EVERY);
+    ota.healthy = true;
+    otaRun = &ota;
+    offerOtaPackage(ota.server);
+  }
+  AttributeRun attributes = AttributeRun();
+  int initialMessages = 0;
+  size_t initialBytes = 0;
+  if (scenario.attributeReports) {
+    attributes.control = &control;
+    attributeRun = &attributes;
+    attributePublisher.begin();
+    for (int i = 0; i < bench.count; i++) {
+      attributePublisher.add(TB_CUP_SIZE_ATTR, renderCupSize, i);
+      attributePublisher.add(TB_OVERSHOOT_MODEL_ATTR, renderOvershootModel, i,
+                             ATTRIBUTE_MODEL_INTERVAL_MS);
+      attributePublisher.add(TB_KEG_REMAINING_ATTR, renderKegRemaining, i);
+      attributePublisher.add(TB_KEG_POURS_LEFT_ATTR, renderKegPoursLeft, i);
+    }
+    // Everything once on connect, not counted against the pours
+    attributePublisher.markAllChanged(hal::millis());
+    halhost::advanceMicros(ATTRIBUTE_COALESCE_MS * 1000ULL);
+    attributeNetworkPass();
+    initialMessages = attributes.messages;
+    initialBytes = attributes.bytes;
+  }
+  std::string kegAlerts;
+  int kegReports = 0;
+  int kegDryPour = 0;
+  float kegDispensedMl = 0;
+  uint32_t kegLeftWhenDry = 0;
+
+  TapStats stats[TAP_MAX_COUNT];
+  for (int t = 0; t < bench.count; t++) {
+    stats[t] = {0, -1e9, 1e9, 0, 0, 0, 0};
+  }
+
+  for (int i = 0; i < scenario.pours; i++) {
+    PourResult results[TAP_MAX_COUNT];
+    ota.pour = i + 1;
+    ota.pausedThisPour = false;
+    runPour(scenario, bench, control, kiosk, results);
+    ota.pausedPours += ota.pausedThisPour ? 1 : 0;
+    for (int t = 0; t < bench.count; t++) {
+      const PourResult& result = results[t];
+      if (Serial.enabled) {
+        printf("  pour %2d", i + 1);
+        if (bench.count > 1) {
+          printf(" tap %d", t);
+        }
+        printf(": %.1fml dispensed, %+.1fml, stop %.0fms, late %ld, %s, %d samples in "
+               "%d messages%s\n",
+               result.dispensedMl, result.overpourMl, result.stopTimeMs, result.latePulses,
+               stopReasonName(result.stopReason), result.recordSamples, result.recordChunks,
+               result.tripped ? ", SAFETY TRIP" : "");
+      }
+      TapStats& tap = stats[t];
+      tap.overpourSum += result.overpourMl;
+      tap.overpourMax = result.overpourMl > tap.overpourMax ? result.overpourMl : tap.overpourMax;
+      tap.overpourMin = result.overpourMl < tap.overpourMin ? result.overpourMl : tap.overpourMin;
+      tap.stopTimeSum += result.stopTimeMs;
+      tap.stopTimeMax = result.stopTimeMs > tap.stopTimeMax ? result.stopTimeMs : tap.stopTimeMax;
+      tap.latePulsesMax =
+          result.latePulses > tap.latePulsesMax ? result.latePulses : tap.latePulsesMax;
+      tap.trips += result.tripped ? 1 : 0;
+    }
+    if (results[0].kegAlertPct > 0) {
+      kegAlerts += (kegAlerts.empty() ? "" : ", ") + std::to_string(results[0].kegAlertPct) +
+                   "% at pour " + std::to_string(i + 1);
+    }
+    kegReports += results[0].kegReported ? 1 : 0;
+    kegDispensedMl += results[0].dispensedMl;
+    if (kegDryPour == 0 && (results[0].stopReason == STOP_NO_FLOW ||
+                            results[0].stopReason == STOP_FLOW_COLLAPSED)) {
+      kegDryPour = i + 1;
+      kegLeftWhenDry = kegInventory.getRemainingMl(0);
+    }
+    latencySum += results[0].rpcLatencyMs;
+    latencyMax = results[0].rpcLatencyMs > latencyMax ? results[0].rpcLatencyMs : latencyMax;
+  }
+
+  // One row per tap, named scenario/tap on multi-tap boards
+  for (int t = 0; t < bench.count; t++) {
+    std::string name = scenario.name;
+    if (bench.count > 1) {
+      name += "/" + std::to_string(t);
+    }
+    const TapStats& tap = stats[t];
+    printf("%-22s %5d %6d %+9.1f %+9.1f %+9.1f %8.0f %8.0f %6ld %5d %9.1f\n", name.c_str(),
+           scenario.pours, scenario.cupSizeMl, tap.overpourSum / scenario.pours, tap.overpourMin,
+           tap.overpourMax, tap.stopTimeSum / scenario.pours, tap.stopTimeMax, tap.latePulsesMax,
+           tap.trips, bench.taps[t].getOvershootModel().getLatencyMs());
+  }
+  const PerfHistogram& tick = perfCounters.get(PERF_CONTROL_TICK);
+  if (bench.count > 1 && tick.getCount() > 0) {
+    printf("  %d taps: control tick host time mean %luus, p99 %luus, max %luus over %lu ticks\n",
+           bench.count, (unsigned long)tick.getMeanUs(), (unsigned long)tick.getPercentileUs(99),
+           (unsigned long)tick.getMaxUs(), (unsigned long)tick.getCount());
+  }
+  if (scenario.rpcLatency) {
+    unsigned long elapsedMs = hal::millis();
+    printf("  rpc to valve open: mean %.1fms, max %.1fms; idle mode %lu times, %.0f%% of %lus\n",
+           latencySum / scenario.pours, latencyMax, (unsigned long)powerManager.getIdleEntries(),
+           100.0 * powerManager.takeAsleepMs(elapsedMs) / elapsedMs, elapsedMs / 1000);
+  }
+  if (scenario.kegTracking) {
+    float countedMl = kegInventory.getDispensedMl(0);
+    uint32_t writes = kegInventory.getWrites();
+    kegInventory.flush();
+    kegInventory.begin(bench.count);  // As after a restart
+    std::string dry = "did not run dry";
+    if (kegDryPour > 0) {
+      dry = std::to_string(kegLeftWhenDry) + "ml left by the count when it ran dry at pour " +
+            std::to_string(kegDryPour);
+    }
+    printf("  keg: %.0fml counted for %.0fml dispensed, %s, %luml after a restart\n", countedMl,
+           kegDispensedMl, dry.c_str(), (unsigned long)kegInventory.getRemainingMl(0));
+    printf("  keg alerts: %s; %d level reports, %lu level writes\n",
+           kegAlerts.empty() ? "none" : kegAlerts.c_str(), kegReports, (unsigned long)writes);
+  }
+  if (scenario.attributeReports) {
+    // Long enough for the rate-limited overshoot model of the last pour
+    unsigned long long nextUpdate = halhost::nowMicros();
+    runFor(ATTRIBUTE_MODEL_INTERVAL_MS, bench, control, scenario, nextUpdate);
+    int changes = attributes.directMessages;
+    int messages = attributes.messages - initialMessages;
+    size_t bytes = attributes.bytes - initialBytes;
+    uint32_t unchanged = attributePublisher.getUnchanged();
+
+    // A reconnect marks everything again, ThingsBoard already has all of it
+    attributePublisher.markAllChanged(hal::millis());
+    runFor(ATTRIBUTE_COALESCE_MS, bench, control, scenario, nextUpdate);
+    int reconnectMessages = attributes.messages - initialMessages - messages;
+    printf("  attributes: %d changes in %d messages sent one by one, %d messages (%.1f per pour, "
+           "%.0f bytes each) through the publisher; %lu unchanged values dropped\n",
+           changes, changes, messages, (float)messages / scenario.pours,
+           messages > 0 ? (float)bytes / messages : 0.0f,
+           (unsigned long)unchanged);
+    printf("  attributes: %d stop RPC changes, sent from the handler before, now marked only; "
+           "reconnect: %lu values already sent dropped, %d message(s) for the rest\n",
+           attributes.rpcChanges, (unsigned long)(attributePublisher.getUnchanged() - unchanged),
+           reconnectMessages);
+    attributeRun = nullptr;
+  }
+  if (scenario.otaUpdate) {
+    ota.pour = scenario.pours + 1;
+    finishOtaUpdate(scenario, bench, control, ota, otaImage);
+    otaRun = nullptr;
+  }
+  if (scenario.lanTrigger) {
+    printf("  LAN requests: %d accepted, %d replayed, %d bad MAC, %d malformed\n",
+           lanRequests[LOCAL_ACCEPTED], lanRequests[LOCAL_REPLAYED], lanRequests[LOCAL_BAD_MAC],
+           lanRequests[LOCAL_MALFORMED]);
+  }
+
+  long latePulsesMax = 0;
+  for (int t = 0; t < bench.count; t++) {
+    latePulsesMax = stats[t].latePulsesMax > latePulsesMax ? stats[t].latePulsesMax : latePulsesMax;
+  }
+  return latePulsesMax;
+}
+
+int main(int argc, char** argv) {
+  std::vector<Scenario> available = builtinScenarios();
+  std::vector<std::string> selected;
+  uint32_t seed = 1;
+  int poursOverride = 0;
+  bool check = false;
+  bool failed = false;
+
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--verbose") {
+      Serial.enabled = true;
+    } else if (arg == "--check") {
+      check = true;
+    } else if (arg == "--seed" && i + 1 < argc) {
+      seed = strtoul(argv[++i], nullptr, 10);
+    } else if (arg == "--pours" && i + 1 < argc) {
+      poursOverride = atoi(argv[++i]);
+    } else if (arg == "--file" && i + 1 < argc) {
+      std::vector<Scenario> loaded;
+      if (!loadScenarioFile(argv[++i], loaded)) {
+        return 1;
+      }
+      for (const Scenario& scenario : loaded) {
+        available.push_back(scenario);
+        selected.push_back(scenario.name);
+      }
+    } else if (arg == "--list") {
+      for (const Scenario& scenario : available) {
+        printf("%s\n", scenario.name.c_str());
+      }
+      return 0;
+    } else if (arg[0] == '-') {
+      fprintf(stderr,
+              "usage: %s [--list] [--verbose] [--check] [--seed N] [--pours N] [--file F] "
+              "[name...]\n",
+              argv[0]);
+      return 1;
+    } else {
+      selected.push_back(arg);
+    }
+  }
+
+  printf("%-22s %5s %6s %9s %9s %9s %8s %8s %6s %5s %9s\n", "scenario", "pours", "cup_ml",
+         "over_avg", "over_min", "over_max", "stop_avg", "stop_max", "late", "trips", "latency");
+
+  for (const Scenario& scenario : available) {
+    bool run = selected.empty();
+    for (const std::string& name : selected) {
+      run = run || name == scenario.name;
+    }
+    if (!run) {
+      continue;
+    }
+    Scenario configured = scenario;
+    if (poursOverride > 0) {
+      configured.pours = poursOverride;
+    }
+    long latePulses = runScenario(configured, seed);
+    if (check && latePulses > LATE_PULSE_BOUND) {
+      fprintf(stderr, "❌ %s: %ld pulses past the stop threshold, bound is %ld\n",
+              configured.name.c_str(), latePulses, LATE_PULSE_BOUND);
+      failed = true;
+    }
+  }
+  return failed ? 1 : 0;
+}
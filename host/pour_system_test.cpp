@@ -0,0 +1,351 @@
+// Host-side checks of PourSystem.
+// The bounded-stop checks raise edges on the simulated flow sensor pin through the real
+// IsrPulseCounter; the rest inject pulses through MockPulseCounter: target arming, the ISR
+// stop, counts past the 16-bit PCNT range and an order's calibration. Either way update() is
+// held back the way a blocked control loop would hold it, so every assertion sees exactly the
+// count the pour logic saw.
+//
+//   pour_system_test              run every check, exit 1 if any failed
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include "../src/config_store.h"
+#include "../src/control_loop.h"
+#include "../src/constants.h"
+#include "../src/isr_pulse_counter.h"
+#include "../src/local_endpoint.h"
+#include "../src/pour_system.h"
+#include "../src/tap_controller.h"
+#include "hal_host.h"
+#include "mock_pulse_counter.h"
+
+// The ISR closes the valve on the target pulse itself. One pulse of slack, for a pulse that
+// lands while the relay is switching.
+static const unsigned long LATE_PULSE_BOUND = 1;
+
+static const TapPins TEST_PINS = {RELAY_PIN, FLOW_SENSOR_PIN};
+
+static int checks = 0;
+static int failures = 0;
+
+#define CHECK(condition)                                                       \
+  do {                                                                         \
+    checks++;                                                                  \
+    if (!(condition)) {                                                        \
+      failures++;                                                              \
+      printf("  FAILED %s:%d: %s\n", __FILE__, __LINE__, #condition);          \
+    }                                                                          \
+  } while (0)
+
+static bool valveOpen() { return halhost::pinLevel(TEST_PINS.relayPin) == LOW; }
+
+// A fresh tap on an untrained device, calibrated to mlPerPulse
+static void setUp(PourSystem& tap, PulseCounter& counter, float mlPerPulse) {
+  halhost::reset();
+  Preferences::clearAll();
+  configStore.begin();
+  tap.init(counter, TEST_PINS, 0);
+  tap.handleMlPerPulseChange(mlPerPulse);
+}
+
+// The same, with cupSizeMl set and the pour started
+static void startPour(PourSystem& tap, PulseCounter& counter, float mlPerPulse, int cupSizeMl) {
+  setUp(tap, counter, mlPerPulse);
+  tap.handleCupSizeChange(cupSizeMl);
+  tap.update();
+}
+
+// Pulses until the relay is seen closed, without running update() in between
+static unsigned long pulsesUntilClosed(unsigned long maxPulses) {
+  unsigned long pulses = 0;
+  while (valveOpen() && pulses < maxPulses) {
+    halhost::advanceMicros(5000);
+    halhost::raiseEdge(TEST_PINS.flowSensorPin, RISING);
+    pulses++;
+  }
+  return pulses;
+}
+
+static void testBoundedStop() {
+  printf("bounded stop\n");
+  const float calibrations[] = {MIN_ML_PER_PULSE, 1.0f, DEFAULT_ML_PER_PULSE, 3.3f,
+                                MAX_ML_PER_PULSE};
+  const int cups[] = {MIN_CUP_SIZE, 200, 330, 500, 1000, MAX_CUP_SIZE};
+  for (float mlPerPulse : calibrations) {
+    for (int cupSizeMl : cups) {
+      IsrPulseCounter counter;
+      PourSystem tap;
+      startPour(tap, counter, mlPerPulse, cupSizeMl);
+      CHECK(tap.getIsPouring());
+      CHECK(valveOpen());
+      unsigned long target = tap.getTargetPulseCount();
+      CHECK(target == (unsigned long)ceilf(cupSizeMl / mlPerPulse));
+
+      unsigned long pulses = pulsesUntilClosed(target + 100);
+      CHECK(!valveOpen());
+      CHECK(pulses >= target);
+      CHECK(pulses - target <= LATE_PULSE_BOUND);
+    }
+  }
+}
+
+static void testStopWhileLoopBlocked() {
+  printf("stop while loop() is blocked\n");
+  IsrPulseCounter counter;
+  PourSystem tap;
+  startPour(tap, counter, 2.0f, 300);
+
+  // A reconnect keeps loop() away for 10s, the ISR still closes on pulse 150
+  for (int i = 0; i < 149; i++) {
+    halhost::raiseEdge(TEST_PINS.flowSensorPin, RISING);
+  }
+  CHECK(valveOpen());
+  halhost::advanceMicros(10000000UL);
+  halhost::raiseEdge(TEST_PINS.flowSensorPin, RISING);
+  CHECK(!valveOpen());
+
+  // Pulses from the draining line keep it closed
+  for (int i = 0; i < 5; i++) {
+    halhost::raiseEdge(TEST_PINS.flowSensorPin, RISING);
+  }
+  CHECK(!valveOpen());
+
+  // update() only does the bookkeeping and does not start another pour
+  tap.update();
+  CHECK(!tap.getIsPouring());
+  CHECK(tap.getCurrentCupSize() == 0);
+  CHECK(tap.getTargetPulseCount() == 0);
+  tap.update();
+  CHECK(!valveOpen());
+}
+
+static void testCancelClearsTarget() {
+  printf("cancel clears the target\n");
+  IsrPulseCounter counter;
+  PourSystem tap;
+  startPour(tap, counter, 2.0f, 300);
+  tap.handleCupSizeChange(0);
+  CHECK(!valveOpen());
+  CHECK(tap.getTargetPulseCount() == 0);
+  tap.update();
+  CHECK(!tap.getIsPouring());
+  CHECK(!valveOpen());
+}
+
+static void testTargetArming() {
+  printf("target arming\n");
+  MockPulseCounter counter;
+  PourSystem tap;
+  setUp(tap, counter, 2.0f);
+
+  tap.handleCupSizeChange(300);
+  CHECK(!valveOpen());
+  CHECK(counter.getThreshold() == 0);  // Armed only when the valve opens
+  tap.update();
+  CHECK(tap.getIsPouring());
+  CHECK(valveOpen());
+  CHECK(tap.getTargetPulseCount() == 150);
+  CHECK(counter.getThreshold() == tap.getArmedPulseThreshold());
+  CHECK(counter.getThreshold() == 150);  // Nothing learned yet, no overshoot compensation
+}
+
+static void testThresholdCallback() {
+  printf("threshold callback\n");
+  MockPulseCounter counter;
+  PourSystem tap;
+  startPour(tap, counter, 2.0f, 300);
+
+  counter.pulse(149);
+  CHECK(!counter.hasThresholdFired());
+  CHECK(valveOpen());
+
+  // The callback closes the valve on the threshold pulse, before update() runs
+  counter.pulse();
+  CHECK(counter.hasThresholdFired());
+  CHECK(!valveOpen());
+  CHECK(tap.getIsPouring());
+
+  tap.update();
+  CHECK(!tap.getIsPouring());
+  CHECK(tap.getIsSettling());
+
+  // Trailing pulses are overshoot, the model learns them once the line has settled
+  counter.pulse(3);
+  halhost::advanceMicros((OVERSHOOT_SETTLE_MS + 10) * 1000UL);
+  tap.update();
+  CHECK(!tap.getIsSettling());
+  CHECK(tap.getOvershootModel().getTotalSamples() == 1);
+  CHECK(tap.getOvershootModel().getLastOvershootPulses() == 3);
+  CHECK(counter.getThreshold() == 0);
+}
+
+static void testCountPast16Bits() {
+  printf("count past 16 bits\n");
+  MockPulseCounter counter;
+  PourSystem tap;
+  startPour(tap, counter, MIN_ML_PER_PULSE, MAX_CUP_SIZE);
+  CHECK(tap.getTargetPulseCount() == MAX_CUP_SIZE / MIN_ML_PER_PULSE);
+
+  // A runaway sensor with the stop threshold lost: the count must not wrap at 65536 and
+  // slip back under the limits, the sanity check stops the pour
+  counter.setThreshold(0);
+  counter.pulse(70000);
+  CHECK(counter.getCount() == 70000);
+  CHECK(valveOpen());
+  tap.update();
+  CHECK(!tap.getIsPouring());
+  CHECK(!valveOpen());
+}
+
+static void testOrderCalibration() {
+  printf("order calibration\n");
+  MockPulseCounter counter;
+  PourSystem tap;
+  setUp(tap, counter, 2.0f);
+
+  // Measured with the order's calibration...
+  tap.handleCupSizeChange(300, 3.0f);
+  tap.update();
+  CHECK(tap.getTargetPulseCount() == 100);
+  CHECK(tap.getMlPerPulse() == 2.0f);  // Stored calibration untouched
+  counter.pulse(100);
+  tap.update();
+  halhost::advanceMicros((OVERSHOOT_SETTLE_MS + 10) * 1000UL);
+  tap.update();
+
+  // ...which is gone for the next one
+  tap.handleCupSizeChange(300);
+  tap.update();
+  CHECK(tap.getTargetPulseCount() == 150);
+}
+
+static void testStopWithQueuedPour() {
+  printf("stop with a queued pour\n");
+  halhost::reset();
+  Preferences::clearAll();
+  configStore.begin();
+  MockPulseCounter counter;
+  PourSystem taps[1];
+  PulseCounter* counters[] = {&counter};
+  TapController controller(taps, 1);
+  controller.init(counters, &TEST_PINS);
+  ControlLoop control(controller);
+  control.begin();
+  taps[0].handleMlPerPulseChange(2.0f);
+
+  // Both land before the same tick: the stop cancels the pour before its valve opens
+  control.submit(0, CMD_SET_CUP_SIZE, 300);
+  control.requestStop(0);
+  control.tick();
+  CHECK(!valveOpen());
+  CHECK(!taps[0].getIsPouring());
+  CHECK(taps[0].getCurrentCupSize() == 0);
+  CHECK(taps[0].getTargetPulseCount() == 0);
+  CHECK(taps[0].getLastStopReason() == STOP_EMERGENCY);
+
+  bool reported = false;
+  PourEvent event;
+  while (control.pollEvent(event)) {
+    CHECK(event.type != EVENT_POUR_STARTED);
+    reported = reported || (event.type == EVENT_POUR_COMPLETE && event.extra == STOP_EMERGENCY);
+  }
+  CHECK(reported);
+
+  for (int i = 0; i < 10; i++) {
+    control.tick();
+    CHECK(!valveOpen());
+  }
+}
+
+static void testBackToBackRecords() {
+  printf("back-to-back pour records\n");
+  PourRecorder recorder;
+
+  // The network task is busy while several pours finish: every one is kept, oldest first
+  for (int i = 0; i < POUR_RECORD_QUEUE_SIZE + 1; i++) {
+    recorder.begin(100 + i, 2000, i * 1000);
+    recorder.stop(i * 1000 + 500, STOP_TARGET_REACHED);
+    recorder.finish(100 + i, 50);
+  }
+  CHECK(recorder.getDroppedRecords() == 1);
+  for (int i = 0; i < POUR_RECORD_QUEUE_SIZE; i++) {
+    const PourRecord* record = recorder.getCompleted();
+    CHECK(record != nullptr && record->targetMl == 100 + i);
+    recorder.releaseCompleted();
+  }
+  CHECK(recorder.getCompleted() == nullptr);
+}
+
+static void testConfigWriteCadence() {
+  printf("config write cadence\n");
+  halhost::reset();
+  Preferences::clearAll();
+  configStore.begin();
+  OvershootState state = {};
+
+  // A learned model alone waits for the long delay, and for the taps to be idle
+  configStore.setOvershootModel(0, state);
+  halhost::advanceMicros((CONFIG_WRITE_MAX_DELAY_MS + 10) * 1000UL);
+  configStore.update(hal::millis(), false);
+  CHECK(configStore.getWrites() == 0);
+  halhost::advanceMicros(CONFIG_MODEL_WRITE_DELAY_MS * 1000UL);
+  configStore.update(hal::millis(), true);
+  CHECK(configStore.getWrites() == 0);
+  configStore.update(hal::millis(), false);
+  CHECK(configStore.getWrites() == 1);
+
+  // A setting is written after the debounce, the model changed since rides along
+  PourLimits limits = {60000, 1000};
+  configStore.setPourLimits(0, limits);
+  configStore.setOvershootModel(0, state);
+  halhost::advanceMicros((CONFIG_WRITE_DEBOUNCE_MS + 10) * 1000UL);
+  configStore.update(hal::millis(), true);
+  CHECK(configStore.isDirty());
+  configStore.update(hal::millis(), false);
+  CHECK(configStore.getWrites() == 2);
+  CHECK(!configStore.isDirty());
+}
+
+// A signed "pour" request with the given counter, as the kiosk would send it
+static LocalRequestStatus sendLan(LocalEndpoint& endpoint, uint64_t counter) {
+  char message[64];
+  char datagram[LOCAL_DATAGRAM_MAX + 1];
+  snprintf(message, sizeof(message), "%llu pour 0 300", (unsigned long long)counter);
+  size_t length = endpoint.sign(message, datagram, sizeof(datagram));
+  LocalCommand command;
+  return endpoint.parse(datagram, length, command);
+}
+
+static void testLanCounterMark() {
+  printf("LAN counter high-water mark\n");
+  Preferences::clearAll();
+  const char* key = "0123456789abcdef";
+  LocalEndpoint endpoint;
+  endpoint.begin(key);
+  CHECK(sendLan(endpoint, 5000) == LOCAL_ACCEPTED);
+  CHECK(sendLan(endpoint, 5000) == LOCAL_REPLAYED);
+  CHECK(sendLan(endpoint, 5001) == LOCAL_ACCEPTED);
+
+  // After a restart every counter up to the persisted mark counts as used
+  LocalEndpoint restarted;
+  restarted.begin(key);
+  CHECK(sendLan(restarted, 5002) == LOCAL_REPLAYED);
+  CHECK(sendLan(restarted, 5000 + LOCAL_COUNTER_RESERVE) == LOCAL_REPLAYED);
+  CHECK(sendLan(restarted, 5001 + LOCAL_COUNTER_RESERVE) == LOCAL_ACCEPTED);
+}
+
+int main() {
+  testBoundedStop();
+  testStopWhileLoopBlocked();
+  testCancelClearsTarget();
+  testTargetArming();
+  testThresholdCallback();
+  testCountPast16Bits();
+  testOrderCalibration();
+  testStopWithQueuedPour();
+  testBackToBackRecords();
+  testConfigWriteCadence();
+  testLanCounterMark();
+  printf("pour_system_test: %d checks, %d failed\n", checks, failures);
+  return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,146 @@
+#include "attribute_publisher.h"
+#include "crc32.h"
+#include "logger.h"
+#include "tap_controller.h"
+
+// Global instance
+AttributePublisher attributePublisher;
+
+AttributePublisher::AttributePublisher() { begin(); }
+
+void AttributePublisher::begin() {
+  memset(entries, 0, sizeof(entries));
+  count = 0;
+  messages = 0;
+  unchanged = 0;
+}
+
+bool AttributePublisher::add(const char* key, AttributeRenderer render, uint8_t tap,
+                             unsigned long minIntervalMs) {
+  if (count >= ATTRIBUTE_MAX_KEYS) {
+    LOG_ERROR("❌ No room for attribute %s", key);
+    return false;
+  }
+  Entry& entry = entries[count++];
+  memset(&entry, 0, sizeof(entry));
+  entry.key = key;
+  entry.render = render;
+  entry.tap = tap;
+  entry.minIntervalMs = minIntervalMs;
+  return true;
+}
+
+void AttributePublisher::markChanged(AttributeRenderer render, uint8_t tap,
+                                     unsigned long nowMillis) {
+  for (uint8_t i = 0; i < count; i++) {
+    Entry& entry = entries[i];
+    if (entry.render != render || (tap != TAP_ALL && entry.tap != tap)) {
+      continue;
+    }
+    if (!entry.changed) {
+      entry.changed = true;
+      entry.changedMillis = nowMillis;
+    }
+  }
+}
+
+void AttributePublisher::markAllChanged(unsigned long nowMillis) {
+  for (uint8_t i = 0; i < count; i++) {
+    markChanged(entries[i].render, entries[i].tap, nowMillis);
+  }
+}
+
+bool AttributePublisher::isAllowed(const Entry& entry, unsigned long nowMillis) const {
+  return !entry.reported || nowMillis - entry.sentMillis >= entry.minIntervalMs;
+}
+
+size_t AttributePublisher::takePayload(unsigned long nowMillis, char* buffer, size_t size) {
+  // Nothing goes out before the oldest change has waited out the window
+  bool due = false;
+  for (uint8_t i = 0; i < count && !due; i++) {
+    const Entry& entry = entries[i];
+    due = entry.changed && nowMillis - entry.changedMillis >= ATTRIBUTE_COALESCE_MS &&
+          isAllowed(entry, nowMillis);
+  }
+  if (!due || size < 3) {
+    return 0;
+  }
+
+  // Every changed attribute its rate limit allows, "{" + "}" and the terminator kept free
+  size_t used = 0;
+  buffer[used++] = '{';
+  for (uint8_t i = 0; i < count; i++) {
+    Entry& entry = entries[i];
+    if (!entry.changed || !isAllowed(entry, nowMillis)) {
+      continue;
+    }
+    char key[40];
+    const char* name =
+        entry.tap == TAP_ALL ? entry.key : tapKey(entry.key, entry.tap, key, sizeof(key));
+    size_t room = size - 1 - used;
+    size_t prefix = snprintf(buffer + used, room, "%s\"%s\":", used > 1 ? "," : "", name);
+    size_t length = 0;
+    if (prefix < room) {
+      length = entry.render(entry.tap, buffer + used + prefix, room - prefix);
+      if (length == 0) {
+        entry.changed = false;  // Nothing to report, like the keg of a tap without one
+        continue;
+      }
+    }
+    if (prefix >= room || length >= room - prefix) {
+      if (used == 1) {
+        LOG_ERROR("❌ Attribute %s does not fit an attribute message, dropped", name);
+        entry.changed = false;
+      }
+      continue;  // Comes with the next message
+    }
+
+    uint32_t crc = crc32(buffer + used + prefix, length);
+    if (entry.reported && crc == entry.sentCrc) {
+      entry.changed = false;
+      unchanged++;
+      continue;
+    }
+    entry.sending = true;
+    entry.sendingCrc = crc;
+    used += prefix + length;
+  }
+  if (used == 1) {
+    return 0;  // Every value was the one already sent
+  }
+  buffer[used++] = '}';
+  buffer[used] = '\0';
+  return used;
+}
+
+void AttributePublisher::onSent(bool sent, unsigned long nowMillis) {
+  bool any = false;
+  for (uint8_t i = 0; i < count; i++) {
+    Entry& entry = entries[i];
+    if (!entry.sending) {
+      continue;
+    }
+    entry.sending = false;
+    any = true;
+    if (sent) {
+      entry.changed = false;
+      entry.reported = true;
+      entry.sentCrc = entry.sendingCrc;
+      entry.sentMillis = nowMillis;
+    } else {
+      entry.changedMillis = nowMillis;  // Tried again after another window
+    }
+  }
+  if (sent && any) {
+    messages++;
+  }
+}
+
+bool AttributePublisher::hasPending() const {
+  for (uint8_t i = 0; i < count; i++) {
+    if (entries[i].changed) {
+      return true;
+    }
+  }
+  return false;
+}
@@ -0,0 +1,79 @@
+#ifndef ATTRIBUTE_PUBLISHER_H
+#define ATTRIBUTE_PUBLISHER_H
+
+#include <Arduino.h>
+#include "constants.h"
+
+// Writes the current value of one attribute of a tap as JSON (a number, a quoted string, an
+// object...) and returns its length, snprintf style: size or more when it did not fit, 0 when
+// there is nothing to report
+typedef size_t (*AttributeRenderer)(uint8_t tap, char* buffer, size_t size);
+
+// Client attributes, reported by exception. Code that changes a value only marks it with
+// markChanged(); the network task then collects every marked attribute into one JSON message
+// per pass with takePayload() and sends it. Values are rendered when the message is built, so
+// several changes of one attribute are one send of its latest value.
+//
+// - A message goes out once the oldest change is ATTRIBUTE_COALESCE_MS old, so the attributes
+//   a pour changes within a moment of each other (cup size, keg level, model) share one.
+// - A value equal to the last one sent is dropped; the comparison uses a CRC-32 of the JSON,
+//   not a copy of it.
+// - An attribute added with a minimum interval is held back until that much has passed since
+//   its last send, then rides along with the next message.
+//
+// RPC callbacks only mark, nothing is sent from inside tb.loop(). Only used from the network
+// task.
+class AttributePublisher {
+ private:
+  struct Entry {
+    const char* key;  // Base key, tapKey() adds the tap suffix; TAP_ALL = used as it is
+    AttributeRenderer render;
+    uint8_t tap;
+    bool changed;
+    bool sending;   // In the payload of the last takePayload()
+    bool reported;  // sentCrc is valid
+    uint32_t sentCrc;
+    uint32_t sendingCrc;
+    unsigned long changedMillis;  // First change since the last send
+    unsigned long sentMillis;
+    unsigned long minIntervalMs;
+  };
+
+  Entry entries[ATTRIBUTE_MAX_KEYS];
+  uint8_t count;
+  uint32_t messages;
+  uint32_t unchanged;  // Values dropped because they had been sent already
+
+  bool isAllowed(const Entry& entry, unsigned long nowMillis) const;
+
+ public:
+  AttributePublisher();
+
+  // Forgets every attribute and what was sent, before they are added
+  void begin();
+
+  // Registers the attribute key of tap, rendered by render. key must outlive the publisher.
+  // False when the table is full.
+  bool add(const char* key, AttributeRenderer render, uint8_t tap,
+           unsigned long minIntervalMs = 0);
+
+  // Marks the attribute(s) of render for tap (TAP_ALL: of every tap) to be sent
+  void markChanged(AttributeRenderer render, uint8_t tap, unsigned long nowMillis);
+
+  // Every attribute, after a (re)connect. Values ThingsBoard already has are still dropped.
+  void markAllChanged(unsigned long nowMillis);
+
+  // The next attribute message, 0 when nothing is due. Every call must be followed by
+  // onSent(); attributes that did not fit come with the next call.
+  size_t takePayload(unsigned long nowMillis, char* buffer, size_t size);
+  void onSent(bool sent, unsigned long nowMillis);
+
+  bool hasPending() const;
+  uint32_t getMessages() const { return messages; }
+  uint32_t getUnchanged() const { return unchanged; }
+};
+
+// Global instance
+extern AttributePublisher attributePublisher;
+
+#endif  // ATTRIBUTE_PUBLISHER_H
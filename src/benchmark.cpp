@@ -0,0 +1,248 @@
+#include "benchmark.h"
+#include "calibration_curve.h"
+#include "control_loop.h"
+#include "hal.h"
+#include "led_controller.h"
+#include "local_endpoint.h"
+#include "order_queue.h"
+#include "pour_system.h"
+#include "spsc_queue.h"
+#include "tap_controller.h"
+
+static_assert(BENCH_RELAY_PIN != RELAY_PIN && BENCH_FLOW_SENSOR_PIN != FLOW_SENSOR_PIN,
+              "The benchmark must not drive a real tap");
+
+BenchRunner::BenchRunner(const char* target) : count(0), target(target), allocations(nullptr) {
+  memset(cases, 0, sizeof(cases));
+}
+
+bool BenchRunner::add(const BenchCase& benchCase) {
+  if (count >= BENCH_MAX_CASES || benchCase.run == nullptr || benchCase.batchSize == 0) {
+    return false;
+  }
+  cases[count++] = benchCase;
+  return true;
+}
+
+void BenchRunner::run(uint8_t index, uint32_t minOps, BenchResult& result) {
+  const BenchCase& bench = cases[index];
+  uint64_t cycles = 0;
+  uint32_t allocated = 0;
+  uint32_t ops = 0;
+
+  for (bool warmUp = true; warmUp || ops < minOps; warmUp = false) {
+    if (bench.setup != nullptr) {
+      bench.setup(bench.context);
+    }
+    uint32_t allocationsBefore = allocations != nullptr ? allocations() : 0;
+    uint32_t start = hal::cycleCount();
+    for (uint16_t i = 0; i < bench.batchSize; i++) {
+      bench.run(bench.context);
+    }
+    uint32_t elapsed = hal::cycleCount() - start;
+    uint32_t allocationsAfter = allocations != nullptr ? allocations() : 0;
+    hal::feedWatchdog();
+    if (!warmUp) {
+      cycles += elapsed;
+      allocated += allocationsAfter - allocationsBefore;
+      ops += bench.batchSize;
+    }
+  }
+
+  result.name = bench.name;
+  result.ops = ops;
+  result.cyclesPerOp = (float)cycles / ops;
+  result.nsPerOp = result.cyclesPerOp * 1000.0f / hal::cyclesPerMicrosecond();
+  result.allocsPerOp = allocations != nullptr ? (float)allocated / ops : -1;
+}
+
+size_t BenchRunner::headerToJson(char* buffer, size_t size) const {
+  int used = snprintf(buffer, size,
+                      "{\"suite\":\"control\",\"version\":%d,\"build\":\"%s\",\"target\":\"%s\","
+                      "\"cpuMhz\":%lu,\"cases\":%u}",
+                      BENCH_SUITE_VERSION, BENCH_BUILD_ID, target,
+                      (unsigned long)hal::cyclesPerMicrosecond(), count);
+  if (used < 0) {
+    return 0;
+  }
+  return (size_t)used < size ? used : 0;
+}
+
+size_t BenchRunner::resultToJson(const BenchResult& result, char* buffer, size_t size) {
+  char allocs[16];
+  if (result.allocsPerOp < 0) {
+    snprintf(allocs, sizeof(allocs), "null");
+  } else {
+    snprintf(allocs, sizeof(allocs), "%.3f", result.allocsPerOp);
+  }
+  int used = snprintf(buffer, size,
+                      "{\"bench\":\"%s\",\"ops\":%lu,\"nsPerOp\":%.1f,\"cyclesPerOp\":%.1f,"
+                      "\"allocsPerOp\":%s}",
+                      result.name, (unsigned long)result.ops, result.nsPerOp, result.cyclesPerOp,
+                      allocs);
+  if (used < 0) {
+    return 0;
+  }
+  return (size_t)used < size ? used : 0;
+}
+
+namespace {
+
+// Pulses come from the benchmark, not a pin. The threshold is stored but never fires, the
+// pouring cases restart the pour long before the target.
+class BenchPulseCounter : public PulseCounter {
+ private:
+  unsigned long count;
+  SpscQueue<uint32_t, PULSE_TIMESTAMP_BUFFER_SIZE> timestamps;
+
+ public:
+  BenchPulseCounter() : count(0) {}
+  bool begin(uint8_t pin, ThresholdCallback callback, void* callbackArg) override { return true; }
+  unsigned long getCount() override { return count; }
+  void reset() override { count = 0; }
+  void setThreshold(unsigned long count) override {}
+  bool readPulseTimestamp(uint32_t& timestampUs) override { return timestamps.pop(timestampUs); }
+
+  void pulseAt(uint32_t timestampUs) {
+    timestamps.push(timestampUs);
+    count++;
+  }
+};
+
+// One tap, idle or mid-pour at a steady 20ms per pulse (about 110ml/s)
+struct TapBench {
+  BenchPulseCounter counter;
+  PourSystem tap;
+  uint32_t pulseUs;
+};
+
+const int BENCH_POUR_ML = 1000;
+const uint16_t POUR_BATCH = 64;  // Pulses per restarted pour, well short of BENCH_POUR_ML
+const uint32_t PULSE_INTERVAL_US = 20000;
+
+TapBench idleTap;
+TapBench pouringTap;
+
+void initTap(TapBench& bench, uint8_t index) {
+  TapPins pins = {BENCH_RELAY_PIN, BENCH_FLOW_SENSOR_PIN};
+  bench.tap.init(bench.counter, pins, index);
+  bench.pulseUs = hal::micros();
+}
+
+void restartPour(void* context) {
+  TapBench& bench = *static_cast<TapBench*>(context);
+  bench.tap.handleCupSizeChange(0);
+  bench.tap.getRecorder().releaseCompleted();  // Published by the network task on the board
+  bench.tap.handleCupSizeChange(BENCH_POUR_ML);
+  bench.tap.update();  // Opens the (benchmark) valve
+  bench.pulseUs = hal::micros();
+}
+
+void safetyChecks(void* context) {
+  static_cast<TapBench*>(context)->tap.performSafetyChecks(true, true);
+}
+
+void safetyChecksPouring(void* context) {
+  TapBench& bench = *static_cast<TapBench*>(context);
+  bench.pulseUs += PULSE_INTERVAL_US;
+  bench.counter.pulseAt(bench.pulseUs);
+  bench.tap.performSafetyChecks(true, true);
+}
+
+void tapUpdate(void* context) { static_cast<TapBench*>(context)->tap.update(); }
+
+void tapUpdatePouring(void* context) {
+  TapBench& bench = *static_cast<TapBench*>(context);
+  bench.pulseUs += PULSE_INTERVAL_US;
+  bench.counter.pulseAt(bench.pulseUs);
+  bench.tap.update();
+}
+
+// The network task re-asserts its LED state on every pass, a change restarts the pattern
+LEDController benchLed;
+uint8_t ledToggle = 0;
+
+void ledSetState(void* context) { benchLed.setState(STATE_SYSTEM_READY); }
+
+void ledChangeState(void* context) {
+  ledToggle ^= 1;
+  benchLed.setState(ledToggle ? STATE_POURING : STATE_SYSTEM_READY);
+}
+
+// Fills the queue with ids it has to check for duplicates
+OrderQueue benchQueue;
+char orderIds[ORDER_QUEUE_CAPACITY][12];
+uint8_t nextOrder = 0;
+
+void emptyQueue(void* context) {
+  benchQueue.clearWaiting();
+  nextOrder = 0;
+}
+
+void enqueueOrder(void* context) {
+  benchQueue.enqueue(orderIds[nextOrder++ % ORDER_QUEUE_CAPACITY], 330, hal::millis(), 0, false);
+}
+
+// A correctly signed pour with a counter the endpoint has already seen: the HMAC and the whole
+// parse run, and nothing is stored
+LocalEndpoint benchEndpoint;
+char signedRequest[LOCAL_DATAGRAM_MAX + 1];
+size_t signedRequestLength = 0;
+
+void parseLocalRequest(void* context) {
+  LocalCommand command;
+  benchEndpoint.parse(signedRequest, signedRequestLength, command);
+}
+
+// setCalibrationCurve validation and table build for a full five-point curve
+CalibrationPoint curvePoints[] = {
+    {10000, 2222}, {20000, 2250}, {40000, 2300}, {80000, 2400}, {160000, 2600}};
+
+void setCalibrationCurve(void* context) {
+  CalibrationCurve curve;
+  curve.set(curvePoints, sizeof(curvePoints) / sizeof(curvePoints[0]));
+}
+
+// Command drain, pour logic and event reporting of one idle tap
+PourSystem controlTaps[1];
+BenchPulseCounter controlCounter;
+TapController controlTapController(controlTaps, 1);
+ControlLoop benchControl(controlTapController);
+
+void controlTick(void* context) { benchControl.tick(); }
+
+}  // namespace
+
+void addControlBenchmarks(BenchRunner& runner) {
+  initTap(idleTap, 0);
+  initTap(pouringTap, 1);
+  runner.add({"performSafetyChecks/idle", nullptr, safetyChecks, &idleTap, 256});
+  runner.add({"performSafetyChecks/pouring", restartPour, safetyChecksPouring, &pouringTap,
+              POUR_BATCH});
+  runner.add({"PourSystem::update/idle", nullptr, tapUpdate, &idleTap, 256});
+  runner.add({"PourSystem::update/pouring", restartPour, tapUpdatePouring, &pouringTap,
+              POUR_BATCH});
+
+  benchLed.begin();
+  runner.add({"LEDController::setState/same", nullptr, ledSetState, nullptr, 256});
+  runner.add({"LEDController::setState/change", nullptr, ledChangeState, nullptr, 256});
+
+  for (uint8_t i = 0; i < ORDER_QUEUE_CAPACITY; i++) {
+    snprintf(orderIds[i], sizeof(orderIds[i]), "bench-%u", i);
+  }
+  runner.add({"OrderQueue::enqueue", emptyQueue, enqueueOrder, nullptr, ORDER_QUEUE_CAPACITY});
+
+  if (benchEndpoint.begin("benchmark-lan-key-0123")) {
+    signedRequestLength = benchEndpoint.sign("0 pour 0 330 bench-order", signedRequest,
+                                             sizeof(signedRequest));
+    runner.add({"LocalEndpoint::parse", nullptr, parseLocalRequest, nullptr, 64});
+  }
+
+  runner.add({"CalibrationCurve::set", nullptr, setCalibrationCurve, nullptr, 256});
+
+  PulseCounter* counters[] = {&controlCounter};
+  TapPins pins[] = {{BENCH_RELAY_PIN, BENCH_FLOW_SENSOR_PIN}};
+  controlTapController.init(counters, pins);
+  benchControl.begin();
+  runner.add({"ControlLoop::tick/idle", nullptr, controlTick, nullptr, 256});
+}
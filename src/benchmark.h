@@ -0,0 +1,60 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <Arduino.h>
+#include "constants.h"
+
+// One benchmarked operation. run() is timed in batches of batchSize calls; setup(), when set,
+// runs untimed before every batch to put the fixed input back (restart a pour, empty a queue).
+struct BenchCase {
+  const char* name;
+  void (*setup)(void* context);
+  void (*run)(void* context);
+  void* context;
+  uint16_t batchSize;
+};
+
+struct BenchResult {
+  const char* name;
+  uint32_t ops;
+  float nsPerOp;
+  float cyclesPerOp;   // CPU cycles on the device, nanoseconds on the host
+  float allocsPerOp;   // Negative when the target cannot count allocations
+};
+
+// Microbenchmarks of the control hot paths with fixed inputs. The same cases run on Linux
+// (host/pour_bench, which also counts heap allocations) and on the board (BENCHMARK_MODE=1),
+// timed with hal::cycleCount(). Results are JSON lines, one header and one line per case, so
+// runs of different firmware versions can be diffed by a script.
+class BenchRunner {
+ private:
+  BenchCase cases[BENCH_MAX_CASES];
+  uint8_t count;
+  const char* target;
+  uint32_t (*allocations)();
+
+ public:
+  explicit BenchRunner(const char* target);
+
+  bool add(const BenchCase& benchCase);
+  uint8_t getCount() const { return count; }
+  const BenchCase& get(uint8_t index) const { return cases[index]; }
+
+  // Running total of heap allocations, for allocsPerOp
+  void setAllocationCounter(uint32_t (*counter)()) { allocations = counter; }
+
+  // One warm-up batch, then whole batches until at least minOps operations have run
+  void run(uint8_t index, uint32_t minOps, BenchResult& result);
+
+  // {"suite":"control","version":..,"build":"..","target":"..","cpuMhz":..,"cases":..}
+  size_t headerToJson(char* buffer, size_t size) const;
+  // {"bench":"..","ops":..,"nsPerOp":..,"cyclesPerOp":..,"allocsPerOp":..}
+  static size_t resultToJson(const BenchResult& result, char* buffer, size_t size);
+};
+
+// Adds the cases that only need src/: safety checks, pour update, LED state, order admission,
+// a LAN request, calibration validation and an idle control tick. The sketch adds its RPC
+// handlers on top.
+void addControlBenchmarks(BenchRunner& runner);
+
+#endif  // BENCHMARK_H
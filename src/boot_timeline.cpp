@@ -0,0 +1,45 @@
+#include "boot_timeline.h"
+#include "hal.h"
+
+// Global instance
+BootTimeline bootTimeline;
+
+BootTimeline::BootTimeline() : fastConnect(false), resetReason("unknown"), reported(false) {
+  memset(phaseEndMs, 0, sizeof(phaseEndMs));
+}
+
+void BootTimeline::endPhase(BootPhase phase) {
+  if (phaseEndMs[phase] == 0) {
+    unsigned long now = hal::millis();
+    phaseEndMs[phase] = now != 0 ? now : 1;
+  }
+}
+
+bool BootTimeline::takeReport() {
+  if (reported || !isComplete()) {
+    return false;
+  }
+  reported = true;
+  return true;
+}
+
+size_t BootTimeline::toJson(char* buffer, size_t size) const {
+  // A phase lasts from the end of the one before it, the first from application start
+  unsigned long durations[BOOT_PHASE_COUNT];
+  unsigned long previous = 0;
+  for (int i = 0; i < BOOT_PHASE_COUNT; i++) {
+    durations[i] = phaseEndMs[i] >= previous ? phaseEndMs[i] - previous : 0;
+    previous = phaseEndMs[i];
+  }
+
+  int used = snprintf(buffer, size,
+                      "{\"bootHardwareMs\":%lu,\"bootWifiMs\":%lu,\"bootThingsBoardMs\":%lu,"
+                      "\"bootReadyMs\":%lu,\"bootFastConnect\":%s,\"bootResetReason\":\"%s\"}",
+                      durations[BOOT_PHASE_HARDWARE], durations[BOOT_PHASE_WIFI],
+                      durations[BOOT_PHASE_THINGSBOARD], phaseEndMs[BOOT_PHASE_COUNT - 1],
+                      fastConnect ? "true" : "false", resetReason);
+  if (used < 0) {
+    return 0;
+  }
+  return (size_t)used < size ? used : size - 1;
+}
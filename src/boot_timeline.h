@@ -0,0 +1,44 @@
+#ifndef BOOT_TIMELINE_H
+#define BOOT_TIMELINE_H
+
+#include <Arduino.h>
+
+// Boot phases in the order setup() and the network task run them
+enum BootPhase {
+  BOOT_PHASE_HARDWARE,     // Serial, LED, configuration, pour control and ledger
+  BOOT_PHASE_WIFI,         // Association, via the cached AP or WiFiManager
+  BOOT_PHASE_THINGSBOARD,  // First ThingsBoard connection and RPC subscription (pour ready)
+  BOOT_PHASE_COUNT
+};
+
+// Time spent in each boot phase, published once so time-to-pour-ready can be tracked across
+// taps. Times are millis() since the application started.
+class BootTimeline {
+ private:
+  unsigned long phaseEndMs[BOOT_PHASE_COUNT];
+  bool fastConnect;
+  const char* resetReason;
+  bool reported;
+
+ public:
+  BootTimeline();
+
+  // Record the end of a phase; later calls for the same phase are ignored
+  void endPhase(BootPhase phase);
+  bool isComplete() const { return phaseEndMs[BOOT_PHASE_COUNT - 1] != 0; }
+
+  void setFastConnect(bool used) { fastConnect = used; }
+  void setResetReason(const char* reason) { resetReason = reason; }
+
+  // True exactly once, when all phases have ended
+  bool takeReport();
+
+  // {"bootHardwareMs":..,"bootWifiMs":..,"bootThingsBoardMs":..,"bootReadyMs":..,
+  //  "bootFastConnect":..,"bootResetReason":".."}
+  size_t toJson(char* buffer, size_t size) const;
+};
+
+// Global instance
+extern BootTimeline bootTimeline;
+
+#endif  // BOOT_TIMELINE_H
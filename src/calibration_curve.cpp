@@ -0,0 +1,79 @@
+#include "calibration_curve.h"
+
+static constexpr CalibrationPoint DEFAULT_CALIBRATION_TABLE[] = {
+    defaultCalibrationPoint(0), defaultCalibrationPoint(1), defaultCalibrationPoint(2),
+    defaultCalibrationPoint(3), defaultCalibrationPoint(4)};
+static_assert(sizeof(DEFAULT_CALIBRATION_TABLE) / sizeof(DEFAULT_CALIBRATION_TABLE[0]) ==
+                  DEFAULT_CALIBRATION_POINTS,
+              "Default calibration table does not match DEFAULT_CALIBRATION_POINTS");
+static_assert(DEFAULT_CALIBRATION_POINTS <= CALIBRATION_MAX_POINTS,
+              "Default calibration table is larger than CALIBRATION_MAX_POINTS");
+
+CalibrationCurve::CalibrationCurve() { setDefault(); }
+
+void CalibrationCurve::setDefault() {
+  set(DEFAULT_CALIBRATION_TABLE, DEFAULT_CALIBRATION_POINTS);
+}
+
+bool CalibrationCurve::set(const CalibrationPoint* newPoints, size_t newCount) {
+  if (newCount == 0 || newCount > CALIBRATION_MAX_POINTS) {
+    return false;
+  }
+  for (size_t i = 0; i < newCount; i++) {
+    if (newPoints[i].ulPerPulse < microlitresPerPulse(MIN_ML_PER_PULSE) ||
+        newPoints[i].ulPerPulse > microlitresPerPulse(MAX_ML_PER_PULSE)) {
+      return false;
+    }
+    if (i > 0 && newPoints[i].intervalUs <= newPoints[i - 1].intervalUs) {
+      return false;
+    }
+  }
+
+  memcpy(points, newPoints, newCount * sizeof(CalibrationPoint));
+  count = newCount;
+  return true;
+}
+
+void CalibrationCurve::setSinglePoint(MicrolitresPerPulse ulPerPulse) {
+  points[0].intervalUs = 0;
+  points[0].ulPerPulse = ulPerPulse;
+  count = 1;
+}
+
+MicrolitresPerPulse CalibrationCurve::atInterval(uint32_t intervalUs) const {
+  if (intervalUs <= points[0].intervalUs) {
+    return points[0].ulPerPulse;
+  }
+  for (uint8_t i = 1; i < count; i++) {
+    const CalibrationPoint& upper = points[i];
+    if (intervalUs < upper.intervalUs) {
+      const CalibrationPoint& lower = points[i - 1];
+      int64_t delta = (int64_t)upper.ulPerPulse - lower.ulPerPulse;
+      return (MicrolitresPerPulse)(lower.ulPerPulse + delta * (intervalUs - lower.intervalUs) /
+                                                          (upper.intervalUs - lower.intervalUs));
+    }
+  }
+  return points[count - 1].ulPerPulse;
+}
+
+MicrolitresPerPulse CalibrationCurve::getMaxUlPerPulse() const {
+  MicrolitresPerPulse maxUl = points[0].ulPerPulse;
+  for (uint8_t i = 1; i < count; i++) {
+    if (points[i].ulPerPulse > maxUl) {
+      maxUl = points[i].ulPerPulse;
+    }
+  }
+  return maxUl;
+}
+
+size_t CalibrationCurve::toJson(char* buffer, size_t size) const {
+  size_t used = snprintf(buffer, size, "[");
+  for (uint8_t i = 0; i < count && used < size; i++) {
+    used += snprintf(buffer + used, size - used, i > 0 ? ",[%lu,%.3f]" : "[%lu,%.3f]",
+                     (unsigned long)points[i].intervalUs, points[i].ulPerPulse / 1000.0);
+  }
+  if (used < size) {
+    used += snprintf(buffer + used, size - used, "]");
+  }
+  return used < size ? used : size - 1;
+}
@@ -0,0 +1,59 @@
+#ifndef CALIBRATION_CURVE_H
+#define CALIBRATION_CURVE_H
+
+#include <Arduino.h>
+#include "constants.h"
+#include "volume.h"
+
+// One point of the flow sensor calibration: volume per pulse at a given pulse interval
+struct CalibrationPoint {
+  uint32_t intervalUs;  // Time between pulses, shorter = faster flow
+  MicrolitresPerPulse ulPerPulse;
+};
+
+// Default table, generated at compile time from DEFAULT_ML_PER_PULSE. Point i sits at
+// DEFAULT_CALIBRATION_MIN_INTERVAL_US << i and carries DEFAULT_CALIBRATION_SLOW_GAIN times
+// i / (points - 1) more volume per pulse, for the rotor slip of a slow flow.
+constexpr CalibrationPoint defaultCalibrationPoint(int i) {
+  return {(uint32_t)DEFAULT_CALIBRATION_MIN_INTERVAL_US << i,
+          (MicrolitresPerPulse)(DEFAULT_ML_PER_PULSE * 1000.0 *
+                                    (1.0 + DEFAULT_CALIBRATION_SLOW_GAIN * i /
+                                               (DEFAULT_CALIBRATION_POINTS - 1)) +
+                                0.5)};
+}
+
+// Hall-effect sensors deliver a different volume per pulse at a trickle than at full flow.
+// The curve maps the interval before each pulse to the volume that pulse stands for, by
+// linear interpolation between up to CALIBRATION_MAX_POINTS points and clamped at both ends.
+// A single point is the plain ml-per-pulse calibration.
+class CalibrationCurve {
+ private:
+  CalibrationPoint points[CALIBRATION_MAX_POINTS];
+  uint8_t count;
+
+ public:
+  CalibrationCurve();
+
+  // Points must be sorted by strictly increasing interval and within the ml per pulse limits
+  bool set(const CalibrationPoint* newPoints, size_t newCount);
+  void setSinglePoint(MicrolitresPerPulse ulPerPulse);
+  void setDefault();
+
+  // Integer interpolation, bounded by CALIBRATION_MAX_POINTS - cheap enough for every pulse
+  MicrolitresPerPulse atInterval(uint32_t intervalUs) const;
+
+  // Largest volume per pulse anywhere on the curve - turns safety limits into pulse counts
+  // that can never let more than the limit through
+  MicrolitresPerPulse getMaxUlPerPulse() const;
+
+  // Full flow value, reported as mlPerPulse
+  MicrolitresPerPulse getNominalUlPerPulse() const { return points[0].ulPerPulse; }
+
+  size_t getCount() const { return count; }
+  const CalibrationPoint& getPoint(size_t index) const { return points[index]; }
+
+  // [[intervalUs,mlPerPulse],...]
+  size_t toJson(char* buffer, size_t size) const;
+};
+
+#endif  // CALIBRATION_CURVE_H
@@ -0,0 +1,150 @@
+#include "calibration_session.h"
+
+// Global instance
+CalibrationSession calibrationSession;
+
+const char* calibrationStateName(CalibrationState state) {
+  switch (state) {
+    case CALIBRATION_POURING:
+      return "pouring";
+    case CALIBRATION_MEASURING:
+      return "measuring";
+    case CALIBRATION_COMPLETE:
+      return "complete";
+    default:
+      return "idle";
+  }
+}
+
+CalibrationSession::CalibrationSession()
+    : state(CALIBRATION_IDLE), tap(0), volumeMl(0), pours(0), sampleCount(0) {
+  memset(samples, 0, sizeof(samples));
+}
+
+bool CalibrationSession::start(uint8_t tap, int volumeMl, uint8_t pours) {
+  if (volumeMl < MIN_CUP_SIZE || volumeMl > MAX_CUP_SIZE || pours < CALIBRATION_MIN_POURS ||
+      pours > CALIBRATION_MAX_POURS) {
+    return false;
+  }
+  this->tap = tap;
+  this->volumeMl = volumeMl;
+  this->pours = pours;
+  sampleCount = 0;
+  state = CALIBRATION_POURING;
+  return true;
+}
+
+bool CalibrationSession::addPour(uint32_t pulses, uint32_t durationMs) {
+  if (state != CALIBRATION_POURING || pulses == 0) {
+    return false;
+  }
+  CalibrationSample& sample = samples[sampleCount];
+  sample.pulses = pulses;
+  sample.meanIntervalUs = (uint32_t)((uint64_t)durationMs * 1000 / pulses);
+  sample.measuredMl = 0;
+  state = CALIBRATION_MEASURING;
+  return true;
+}
+
+bool CalibrationSession::addMeasurement(float measuredMl) {
+  if (state != CALIBRATION_MEASURING || measuredMl <= 0 || measuredMl > MAX_POUR_VOLUME) {
+    return false;
+  }
+  samples[sampleCount++].measuredMl = measuredMl;
+  state = sampleCount >= pours ? CALIBRATION_COMPLETE : CALIBRATION_POURING;
+  return true;
+}
+
+float CalibrationSession::residualMl(const CalibrationCurve& curve) const {
+  double sum = 0;
+  for (uint8_t i = 0; i < sampleCount; i++) {
+    const CalibrationSample& sample = samples[i];
+    double predictedMl = sample.pulses * (curve.atInterval(sample.meanIntervalUs) / 1000.0);
+    double error = sample.measuredMl - predictedMl;
+    sum += error * error;
+  }
+  return sqrt(sum / sampleCount);
+}
+
+// measured = k * pulses, minimising the squared volume error: k = sum(p * m) / sum(p^2)
+bool CalibrationSession::fitFlat(CalibrationCurve& curve) const {
+  double pm = 0;
+  double pp = 0;
+  for (uint8_t i = 0; i < sampleCount; i++) {
+    pm += (double)samples[i].pulses * samples[i].measuredMl;
+    pp += (double)samples[i].pulses * samples[i].pulses;
+  }
+  double mlPerPulse = pm / pp;
+  if (mlPerPulse < MIN_ML_PER_PULSE || mlPerPulse > MAX_ML_PER_PULSE) {
+    return false;
+  }
+  curve.setSinglePoint(microlitresPerPulse(mlPerPulse));
+  return true;
+}
+
+// ml per pulse = a + b * interval, so measured = a * p + b * (p * t) with t the pour's mean
+// interval. Two unknowns, solved from the 2x2 normal equations and turned into a curve through
+// the fastest and the slowest pour.
+bool CalibrationSession::fitCurve(CalibrationCurve& curve) const {
+  uint32_t minInterval = UINT32_MAX;
+  uint32_t maxInterval = 0;
+  for (uint8_t i = 0; i < sampleCount; i++) {
+    minInterval = samples[i].meanIntervalUs < minInterval ? samples[i].meanIntervalUs : minInterval;
+    maxInterval = samples[i].meanIntervalUs > maxInterval ? samples[i].meanIntervalUs : maxInterval;
+  }
+  if (sampleCount < 3 || minInterval == 0 ||
+      maxInterval < minInterval * CALIBRATION_CURVE_MIN_SPREAD) {
+    return false;  // Pours too alike to tell a flow dependency from noise
+  }
+
+  double s11 = 0, s12 = 0, s22 = 0, r1 = 0, r2 = 0;
+  for (uint8_t i = 0; i < sampleCount; i++) {
+    double x1 = samples[i].pulses;
+    double x2 = x1 * samples[i].meanIntervalUs;
+    s11 += x1 * x1;
+    s12 += x1 * x2;
+    s22 += x2 * x2;
+    r1 += x1 * samples[i].measuredMl;
+    r2 += x2 * samples[i].measuredMl;
+  }
+  double determinant = s11 * s22 - s12 * s12;
+  if (fabs(determinant) <= 1e-9 * s11 * s22) {
+    return false;
+  }
+  double a = (r1 * s22 - r2 * s12) / determinant;
+  double b = (s11 * r2 - s12 * r1) / determinant;
+
+  CalibrationPoint points[2] = {
+      {minInterval, microlitresPerPulse(a + b * minInterval)},
+      {maxInterval, microlitresPerPulse(a + b * maxInterval)}};
+  return curve.set(points, 2);  // Also rejects values outside the ml per pulse limits
+}
+
+bool CalibrationSession::fit(CalibrationFit& result) const {
+  if (state != CALIBRATION_COMPLETE || sampleCount == 0) {
+    return false;
+  }
+  if (!fitFlat(result.curve)) {
+    return false;
+  }
+  result.residualMl = residualMl(result.curve);
+
+  CalibrationCurve curve;
+  if (fitCurve(curve)) {
+    float curveResidualMl = residualMl(curve);
+    if (curveResidualMl < result.residualMl * CALIBRATION_CURVE_MIN_GAIN) {
+      result.curve = curve;
+      result.residualMl = curveResidualMl;
+    }
+  }
+
+  float meanMl = 0;
+  for (uint8_t i = 0; i < sampleCount; i++) {
+    meanMl += samples[i].measuredMl;
+  }
+  meanMl /= sampleCount;
+  result.residualPct = result.residualMl / meanMl * 100;
+  result.pours = sampleCount;
+  result.acceptable = result.residualPct <= CALIBRATION_MAX_RESIDUAL_PCT;
+  return true;
+}
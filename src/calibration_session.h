@@ -0,0 +1,80 @@
+#ifndef CALIBRATION_SESSION_H
+#define CALIBRATION_SESSION_H
+
+#include <Arduino.h>
+#include "calibration_curve.h"
+#include "constants.h"
+
+enum CalibrationState {
+  CALIBRATION_IDLE,
+  CALIBRATION_POURING,    // Waiting for the next calibration pour to finish
+  CALIBRATION_MEASURING,  // Pour done, waiting for the volume measured by hand
+  CALIBRATION_COMPLETE    // Every pour measured, ready to fit
+};
+
+// One calibration pour: what the sensor counted and what ended up in the measuring jug
+struct CalibrationSample {
+  uint32_t pulses;          // Including the pulses after the valve closed
+  uint32_t meanIntervalUs;  // Pour duration over pulses, stands for the pour's flow rate
+  float measuredMl;
+};
+
+// Result of a least-squares fit over the measured pours
+struct CalibrationFit {
+  CalibrationCurve curve;  // Single point, or two points when the flow dependency pays off
+  float residualMl;        // RMS of measured minus predicted volume
+  float residualPct;       // residualMl over the mean measured volume
+  uint8_t pours;
+  bool acceptable;         // residualPct within CALIBRATION_MAX_RESIDUAL_PCT
+};
+
+// Guided sensor calibration on one tap. The tech starts a run with a target volume and a
+// number of pours; the caller pours each one as an order, feeds the pour's pulse count back
+// through addPour() and the volume measured by hand through addMeasurement(). fit() then
+// solves for ml per pulse by least squares through the origin. When the pours were made at
+// clearly different flow rates it also fits ml per pulse as a linear function of the pulse
+// interval, and keeps that two-point curve if it explains the measurements clearly better.
+// Only used from the network task.
+class CalibrationSession {
+ private:
+  CalibrationState state;
+  uint8_t tap;
+  int volumeMl;
+  uint8_t pours;
+  uint8_t sampleCount;
+  CalibrationSample samples[CALIBRATION_MAX_POURS];
+
+  float residualMl(const CalibrationCurve& curve) const;
+  bool fitFlat(CalibrationCurve& curve) const;
+  bool fitCurve(CalibrationCurve& curve) const;
+
+ public:
+  CalibrationSession();
+
+  bool start(uint8_t tap, int volumeMl, uint8_t pours);
+  void cancel() { state = CALIBRATION_IDLE; }
+
+  // The calibration pour finished. Returns false when no pour was expected or nothing was
+  // counted, the caller then pours it again.
+  bool addPour(uint32_t pulses, uint32_t durationMs);
+
+  // Volume measured for the last pour. Returns false when no measurement was expected.
+  bool addMeasurement(float measuredMl);
+
+  // Needs CALIBRATION_COMPLETE. The run stays complete until cancel() or start().
+  bool fit(CalibrationFit& result) const;
+
+  CalibrationState getState() const { return state; }
+  bool isActive(uint8_t onTap) const { return state != CALIBRATION_IDLE && tap == onTap; }
+  uint8_t getTap() const { return tap; }
+  int getVolumeMl() const { return volumeMl; }
+  uint8_t getPours() const { return pours; }
+  uint8_t getSampleCount() const { return sampleCount; }
+};
+
+const char* calibrationStateName(CalibrationState state);
+
+// Global instance - one run at a time per board
+extern CalibrationSession calibrationSession;
+
+#endif  // CALIBRATION_SESSION_H
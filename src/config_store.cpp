@@ -0,0 +1,372 @@
+#include "config_store.h"
+#include <Preferences.h>
+#include "crc32.h"
+#include "hal.h"
+#include "logger.h"
+
+static const char* PREFS_NAMESPACE = "config";
+static const char* PREFS_BLOB_KEY = "blob";
+
+// Where firmware before the ConfigStore kept the overshoot models, imported once
+static const char* LEGACY_OVERSHOOT_NAMESPACE = "overshoot";
+static const uint8_t LEGACY_OVERSHOOT_VERSION = 1;
+struct LegacyOvershootModel {
+  uint8_t version;
+  OvershootRateBin bins[OVERSHOOT_RATE_BINS];
+  float latencyMs;
+  uint32_t totalSamples;
+};
+
+static_assert(sizeof(ConfigData) <= UINT16_MAX, "ConfigData too large for the stored length");
+
+// Global instance
+ConfigStore configStore;
+
+ConfigStore::ConfigStore()
+    : dirty(false),
+      settingsDirty(false),
+      firstChangeMillis(0),
+      lastChangeMillis(0),
+      writtenCrc(0),
+      writes(0),
+      coalesced(0),
+      loadedVersion(0) {
+  spinlock = portMUX_INITIALIZER_UNLOCKED;
+  setDefaults();
+}
+
+void ConfigStore::setDefaults() { memset(&data, 0, sizeof(data)); }
+
+bool ConfigStore::begin() {
+  dirty = false;
+  settingsDirty = false;
+  coalesced = 0;
+  loadedVersion = 0;
+  setDefaults();
+
+  // Header and data in one read; a blob from newer firmware is larger and fails it
+  static uint8_t buffer[sizeof(StoredHeader) + sizeof(ConfigData)];
+  size_t length = 0;
+  Preferences prefs;
+  if (prefs.begin(PREFS_NAMESPACE, true)) {
+    length = prefs.getBytes(PREFS_BLOB_KEY, buffer, sizeof(buffer));
+    prefs.end();
+  }
+
+  StoredHeader header;
+  bool valid = length >= sizeof(header);
+  if (valid) {
+    memcpy(&header, buffer, sizeof(header));
+    valid = header.magic == MAGIC && header.version >= 1 && header.version <= VERSION &&
+            header.length <= sizeof(ConfigData) && length == sizeof(header) + header.length &&
+            header.crc == crc32(buffer + sizeof(header), header.length);
+  }
+  if (!valid) {
+    if (length > 0) {
+      LOG_WARN("⚠️ Stored configuration invalid (%u bytes), using defaults", (unsigned)length);
+    }
+    importLegacy();
+    writtenCrc = 0;
+    return false;
+  }
+
+  // Older versions are a prefix of the current layout, the rest keeps its defaults
+  memcpy(&data, buffer + sizeof(header), header.length);
+  loadedVersion = header.version;
+  writtenCrc = header.length == sizeof(data) ? header.crc : 0;
+  if (header.version < VERSION && migrate(header.version)) {
+    markDirty();
+  }
+  LOG_INFO("✅ Configuration v%u loaded (%u bytes)", header.version, header.length);
+  return true;
+}
+
+// Runs after an older blob was loaded. Each case fixes up what the next version added beyond
+// zero defaults and falls through to the following one. Returns true when the blob should be
+// written back in the current layout.
+bool ConfigStore::migrate(uint16_t fromVersion) {
+  switch (fromVersion) {
+    case 1:
+      // Current version, nothing to do yet. Add "case 2:" and so on here when VERSION grows.
+      break;
+  }
+  LOG_INFO("ℹ️ Configuration migrated from v%u to v%u", fromVersion, VERSION);
+  return true;
+}
+
+void ConfigStore::importLegacy() {
+  Preferences prefs;
+  if (!prefs.begin(LEGACY_OVERSHOOT_NAMESPACE, true)) {
+    return;
+  }
+  bool imported = false;
+  for (uint8_t i = 0; i < TAP_MAX_COUNT; i++) {
+    // Tap 0 used the plain key single-tap boards always had
+    char key[12];
+    if (i == 0) {
+      snprintf(key, sizeof(key), "model");
+    } else {
+      snprintf(key, sizeof(key), "model%u", i);
+    }
+    LegacyOvershootModel legacy;
+    if (prefs.getBytes(key, &legacy, sizeof(legacy)) != sizeof(legacy) ||
+        legacy.version != LEGACY_OVERSHOOT_VERSION) {
+      continue;
+    }
+    TapConfig& config = tap(i);
+    memcpy(config.overshoot.bins, legacy.bins, sizeof(legacy.bins));
+    config.overshoot.latencyMs = legacy.latencyMs;
+    config.overshoot.totalSamples = legacy.totalSamples;
+    config.hasOvershoot = 1;
+    imported = true;
+  }
+  prefs.end();
+  if (imported) {
+    LOG_INFO("ℹ️ Overshoot models imported into the configuration store");
+    markDirty();
+  }
+}
+
+// Caller holds the spinlock, or runs before the tasks start
+void ConfigStore::markDirty(bool modelOnly) {
+  unsigned long now = hal::millis();
+  if (!dirty) {
+    firstChangeMillis = now;
+  }
+  if (!modelOnly) {
+    lastChangeMillis = now;
+    settingsDirty = true;
+  }
+  dirty = true;
+  coalesced++;
+}
+
+void ConfigStore::update(unsigned long nowMillis, bool tapsBusy) {
+  if (!dirty || tapsBusy) {
+    return;
+  }
+  portENTER_CRITICAL(&spinlock);
+  bool settled = settingsDirty ? nowMillis - lastChangeMillis >= CONFIG_WRITE_DEBOUNCE_MS ||
+                                     nowMillis - firstChangeMillis >= CONFIG_WRITE_MAX_DELAY_MS
+                               : nowMillis - firstChangeMillis >= CONFIG_MODEL_WRITE_DELAY_MS;
+  portEXIT_CRITICAL(&spinlock);
+  if (settled) {
+    flush();
+  }
+}
+
+bool ConfigStore::flush() {
+  static uint8_t buffer[sizeof(StoredHeader) + sizeof(ConfigData)];
+  StoredHeader header;
+  header.magic = MAGIC;
+  header.version = VERSION;
+  header.length = sizeof(ConfigData);
+
+  // Snapshot under the lock, so a control task setter never lands half-written
+  portENTER_CRITICAL(&spinlock);
+  memcpy(buffer + sizeof(header), &data, sizeof(data));
+  dirty = false;
+  settingsDirty = false;
+  uint32_t changes = coalesced;
+  coalesced = 0;
+  portEXIT_CRITICAL(&spinlock);
+
+  header.crc = crc32(buffer + sizeof(header), sizeof(data));
+  if (header.crc == writtenCrc) {
+    return true;  // Changed and changed back, flash already holds this
+  }
+  memcpy(buffer, &header, sizeof(header));
+
+  Preferences prefs;
+  if (!prefs.begin(PREFS_NAMESPACE, false) ||
+      prefs.putBytes(PREFS_BLOB_KEY, buffer, sizeof(buffer)) != sizeof(buffer)) {
+    prefs.end();
+    LOG_ERROR("❌ Failed to write configuration");
+    portENTER_CRITICAL(&spinlock);
+    markDirty();  // Retry after another debounce period
+    portEXIT_CRITICAL(&spinlock);
+    return false;
+  }
+  prefs.end();
+  writtenCrc = header.crc;
+  writes++;
+  LOG_DEBUG("💾 Configuration written, %lu changes coalesced", (unsigned long)changes);
+  return true;
+}
+
+bool ConfigStore::getCalibrationCurve(uint8_t tapIndex, CalibrationCurve& curve) {
+  portENTER_CRITICAL(&spinlock);
+  const TapConfig& config = tap(tapIndex);
+  bool stored = config.calibrationPoints > 0 && curve.set(config.calibration,
+                                                           config.calibrationPoints);
+  portEXIT_CRITICAL(&spinlock);
+  return stored;
+}
+
+void ConfigStore::setCalibrationCurve(uint8_t tapIndex, const CalibrationCurve& curve) {
+  CalibrationPoint points[CALIBRATION_MAX_POINTS];
+  memset(points, 0, sizeof(points));
+  for (size_t i = 0; i < curve.getCount(); i++) {
+    points[i] = curve.getPoint(i);
+  }
+
+  portENTER_CRITICAL(&spinlock);
+  TapConfig& config = tap(tapIndex);
+  bool changed = config.calibrationPoints != curve.getCount() ||
+                 memcmp(config.calibration, points, sizeof(points)) != 0;
+  if (changed) {
+    memcpy(config.calibration, points, sizeof(points));
+    config.calibrationPoints = curve.getCount();
+    markDirty();
+  }
+  portEXIT_CRITICAL(&spinlock);
+}
+
+bool ConfigStore::getFlowFaultThresholds(uint8_t tapIndex, FlowFaultThresholds& thresholds) {
+  portENTER_CRITICAL(&spinlock);
+  const TapConfig& config = tap(tapIndex);
+  bool stored = config.hasThresholds != 0;
+  if (stored) {
+    thresholds = config.thresholds;
+  }
+  portEXIT_CRITICAL(&spinlock);
+  return stored;
+}
+
+void ConfigStore::setFlowFaultThresholds(uint8_t tapIndex, const FlowFaultThresholds& thresholds) {
+  portENTER_CRITICAL(&spinlock);
+  TapConfig& config = tap(tapIndex);
+  bool changed =
+      !config.hasThresholds || memcmp(&config.thresholds, &thresholds, sizeof(thresholds)) != 0;
+  config.thresholds = thresholds;
+  config.hasThresholds = 1;
+  if (changed) {
+    markDirty();
+  }
+  portEXIT_CRITICAL(&spinlock);
+}
+
+bool ConfigStore::getPourLimits(uint8_t tapIndex, PourLimits& limits) {
+  portENTER_CRITICAL(&spinlock);
+  const TapConfig& config = tap(tapIndex);
+  bool stored = config.hasLimits != 0;
+  if (stored) {
+    limits = config.limits;
+  }
+  portEXIT_CRITICAL(&spinlock);
+  return stored;
+}
+
+void ConfigStore::setPourLimits(uint8_t tapIndex, const PourLimits& limits) {
+  portENTER_CRITICAL(&spinlock);
+  TapConfig& config = tap(tapIndex);
+  bool changed = !config.hasLimits || config.limits.maxPourTimeMs != limits.maxPourTimeMs ||
+                 config.limits.maxPourVolumeMl != limits.maxPourVolumeMl;
+  config.limits.maxPourTimeMs = limits.maxPourTimeMs;
+  config.limits.maxPourVolumeMl = limits.maxPourVolumeMl;
+  config.hasLimits = 1;
+  if (changed) {
+    markDirty();
+  }
+  portEXIT_CRITICAL(&spinlock);
+}
+
+bool ConfigStore::getOvershootModel(uint8_t tapIndex, OvershootState& state) {
+  portENTER_CRITICAL(&spinlock);
+  const TapConfig& config = tap(tapIndex);
+  bool stored = config.hasOvershoot != 0;
+  if (stored) {
+    state = config.overshoot;
+  }
+  portEXIT_CRITICAL(&spinlock);
+  return stored;
+}
+
+void ConfigStore::setOvershootModel(uint8_t tapIndex, const OvershootState& state) {
+  // Called from the control task after every learned pour, which always changes the model
+  portENTER_CRITICAL(&spinlock);
+  TapConfig& config = tap(tapIndex);
+  config.overshoot = state;
+  config.hasOvershoot = 1;
+  markDirty(true);
+  portEXIT_CRITICAL(&spinlock);
+}
+
+void ConfigStore::addCalibrationHistory(uint8_t tapIndex, const CalibrationHistoryEntry& entry) {
+  portENTER_CRITICAL(&spinlock);
+  TapConfig& config = tap(tapIndex);
+  config.history[config.historyNext] = entry;
+  config.historyNext = (config.historyNext + 1) % CALIBRATION_HISTORY_SIZE;
+  if (config.historyCount < CALIBRATION_HISTORY_SIZE) {
+    config.historyCount++;
+  }
+  markDirty();
+  portEXIT_CRITICAL(&spinlock);
+}
+
+size_t ConfigStore::getCalibrationHistory(uint8_t tapIndex, CalibrationHistoryEntry* entries,
+                                          size_t maxEntries) {
+  portENTER_CRITICAL(&spinlock);
+  const TapConfig& config = tap(tapIndex);
+  size_t count = config.historyCount < maxEntries ? config.historyCount : maxEntries;
+  // Oldest entry sits at historyNext once the ring has wrapped
+  size_t first = (config.historyNext + CALIBRATION_HISTORY_SIZE - config.historyCount) %
+                 CALIBRATION_HISTORY_SIZE;
+  for (size_t i = 0; i < count; i++) {
+    entries[i] = config.history[(first + config.historyCount - count + i) %
+                                CALIBRATION_HISTORY_SIZE];
+  }
+  portEXIT_CRITICAL(&spinlock);
+  return count;
+}
+
+void ConfigStore::getServer(char* buffer, size_t size) {
+  portENTER_CRITICAL(&spinlock);
+  snprintf(buffer, size, "%s", data.tbServer);
+  portEXIT_CRITICAL(&spinlock);
+}
+
+// Ends up in attribute JSON unescaped
+bool ConfigStore::isValidServer(const char* server) {
+  if (strlen(server) > CONFIG_SERVER_MAX_LENGTH) {
+    return false;
+  }
+  for (const char* c = server; *c != '\0'; c++) {
+    if (*c <= 0x20 || *c > 0x7E || *c == '"' || *c == '\\') {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool ConfigStore::setServer(const char* server) {
+  if (!isValidServer(server)) {
+    return false;
+  }
+  portENTER_CRITICAL(&spinlock);
+  bool changed = strcmp(data.tbServer, server) != 0;
+  if (changed) {
+    memset(data.tbServer, 0, sizeof(data.tbServer));
+    memcpy(data.tbServer, server, strlen(server));
+  }
+  if (changed) {
+    markDirty();
+  }
+  portEXIT_CRITICAL(&spinlock);
+  return true;
+}
+
+size_t ConfigStore::historyToJson(uint8_t tapIndex, char* buffer, size_t size) {
+  CalibrationHistoryEntry entries[CALIBRATION_HISTORY_SIZE];
+  size_t count = getCalibrationHistory(tapIndex, entries, CALIBRATION_HISTORY_SIZE);
+  size_t used = snprintf(buffer, size, "[");
+  for (size_t i = 0; i < count && used < size; i++) {
+    used += snprintf(buffer + used, size - used, i > 0 ? ",[%lu,%.3f,%.2f]" : "[%lu,%.3f,%.2f]",
+                     (unsigned long)entries[i].epochSeconds, entries[i].ulPerPulse / 1000.0,
+                     entries[i].residualCentiPct / 100.0);
+  }
+  if (used < size) {
+    used += snprintf(buffer + used, size - used, "]");
+  }
+  return used < size ? used : size - 1;
+}
@@ -0,0 +1,127 @@
+#ifndef CONFIG_STORE_H
+#define CONFIG_STORE_H
+
+#include <Arduino.h>
+#include "calibration_curve.h"
+#include "constants.h"
+#include "flow_fault_detector.h"
+#include "overshoot_model.h"
+#include "pour_system.h"
+
+// One committed calibration run, see CalibrationSession
+struct CalibrationHistoryEntry {
+  uint32_t epochSeconds;  // 0 when the clock was not synced
+  uint16_t ulPerPulse;    // At full flow
+  uint16_t residualCentiPct;  // RMS error of the fit in hundredths of a percent
+  uint8_t pours;
+  uint8_t points;             // 1 = flat, 2 = fitted flow-dependent curve
+  uint8_t reserved[2];
+};
+
+// Everything one tap keeps across a restart. Zero flags mean the firmware default is in use,
+// so a changed default still reaches taps that were never configured.
+struct TapConfig {
+  CalibrationPoint calibration[CALIBRATION_MAX_POINTS];
+  uint8_t calibrationPoints;  // 0 = default curve
+  uint8_t hasThresholds;
+  uint8_t hasLimits;
+  uint8_t hasOvershoot;
+  FlowFaultThresholds thresholds;
+  PourLimits limits;
+  OvershootState overshoot;
+  CalibrationHistoryEntry history[CALIBRATION_HISTORY_SIZE];  // Ring, oldest at historyNext
+  uint8_t historyCount;
+  uint8_t historyNext;
+  uint8_t reserved[2];
+};
+
+// The whole stored configuration. Sized for TAP_MAX_COUNT, so the layout does not depend on
+// the TAP_COUNT a board was built with. Fields are only ever appended; see ConfigStore::migrate.
+struct ConfigData {
+  char tbServer[CONFIG_SERVER_MAX_LENGTH + 1];  // Empty = THINGSBOARD_SERVER from config.h
+  uint8_t reserved[3];
+  TapConfig taps[TAP_MAX_COUNT];
+};
+
+// Typed, persistent device configuration: calibration, flow fault thresholds, pour limits,
+// overshoot models, calibration history and the ThingsBoard server override. All of it is one
+// CRC-checked, versioned blob in NVS, read once by begin(). Setters only change the RAM copy
+// and mark it dirty; update() writes it once nothing has changed for CONFIG_WRITE_DEBOUNCE_MS
+// (or a change has waited CONFIG_WRITE_MAX_DELAY_MS), and a write whose content matches the
+// last one is skipped, so a slider sending RPCs in a burst costs one flash write. Overshoot
+// models change after every pour and only wait for CONFIG_MODEL_WRITE_DELAY_MS, or ride along
+// with the next settings write. Setters may be called from the control task; writes happen on
+// the network task, never while a tap is busy.
+class ConfigStore {
+ private:
+  // Stored in front of the data
+  struct StoredHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t length;  // Bytes of ConfigData that follow
+    uint32_t crc;     // Over those bytes
+  };
+  static const uint32_t MAGIC = 0x42544346;  // "FCTB"
+  static const uint16_t VERSION = 1;
+
+  ConfigData data;
+  portMUX_TYPE spinlock;  // Guards data and the dirty state against the control task
+  bool dirty;
+  bool settingsDirty;  // Dirty with more than learned overshoot models
+  unsigned long firstChangeMillis;
+  unsigned long lastChangeMillis;
+  uint32_t writtenCrc;  // Content of the last successful read or write
+  uint32_t writes;
+  uint32_t coalesced;  // Changes since the last write
+  uint16_t loadedVersion;
+
+  void setDefaults();
+  void markDirty(bool modelOnly = false);  // With the spinlock held
+  bool migrate(uint16_t fromVersion);
+  void importLegacy();
+  TapConfig& tap(uint8_t tap) { return data.taps[tap]; }
+
+ public:
+  ConfigStore();
+
+  // Single NVS read. Falls back to defaults (plus whatever older firmware stored in its own
+  // keys) when nothing valid is found. Returns true when a stored blob was used.
+  bool begin();
+
+  // Network task: writes pending changes once they have settled and the taps are idle. flush()
+  // writes right away, before a restart.
+  void update(unsigned long nowMillis, bool tapsBusy);
+  bool flush();
+
+  // Per-tap values, the getters return false while the firmware default is in use
+  bool getCalibrationCurve(uint8_t tap, CalibrationCurve& curve);
+  void setCalibrationCurve(uint8_t tap, const CalibrationCurve& curve);
+  bool getFlowFaultThresholds(uint8_t tap, FlowFaultThresholds& thresholds);
+  void setFlowFaultThresholds(uint8_t tap, const FlowFaultThresholds& thresholds);
+  bool getPourLimits(uint8_t tap, PourLimits& limits);
+  void setPourLimits(uint8_t tap, const PourLimits& limits);
+  bool getOvershootModel(uint8_t tap, OvershootState& state);
+  void setOvershootModel(uint8_t tap, const OvershootState& state);
+
+  // Calibration runs, oldest first
+  void addCalibrationHistory(uint8_t tap, const CalibrationHistoryEntry& entry);
+  size_t getCalibrationHistory(uint8_t tap, CalibrationHistoryEntry* entries, size_t maxEntries);
+
+  // ThingsBoard server override, "" for the one in config.h
+  void getServer(char* buffer, size_t size);
+  bool setServer(const char* server);
+  static bool isValidServer(const char* server);  // Host name or address, no spaces or quotes
+
+  uint16_t getVersion() const { return VERSION; }
+  uint16_t getLoadedVersion() const { return loadedVersion; }  // 0 = nothing was stored
+  uint32_t getWrites() const { return writes; }
+  bool isDirty() const { return dirty; }
+
+  // [[epochSeconds,mlPerPulse,residualPct],...]
+  size_t historyToJson(uint8_t tap, char* buffer, size_t size);
+};
+
+// Global instance
+extern ConfigStore configStore;
+
+#endif  // CONFIG_STORE_H
@@ -25,6 +25,14 @@ bool ConfigValidator::validateConfiguration() {
     return false;
   }
 
+#ifdef LOCAL_ENDPOINT_KEY
+  // Optional LAN pour endpoint, a placeholder key would let anyone who read the template pour
+  if (containsPlaceholder(String(LOCAL_ENDPOINT_KEY))) {
+    setError("❌ LOCAL_ENDPOINT_KEY contains placeholder text");
+    return false;
+  }
+#endif
+
   Serial.println("✅ Configuration validation passed!");
   return true;
 }
@@ -4,16 +4,76 @@
 // ThingsBoard attribute keys
 #define TB_CUP_SIZE_ATTR "cupSize"
 #define TB_ML_PER_PULSE_ATTR "mlPerPulse"
+#define TB_OVERSHOOT_MODEL_ATTR "overshootModel"
+#define TB_CALIBRATION_CURVE_ATTR "calibrationCurve"
+#define TB_FLOW_FAULT_THRESHOLDS_ATTR "flowFaultThresholds"
+#define TB_POUR_LIMITS_ATTR "pourLimits"
+#define TB_CALIBRATION_HISTORY_ATTR "calibrationHistory"  // Committed calibration runs
+#define TB_SERVER_ATTR "tbServer"                         // Server override, empty = config.h
+#define TB_CONFIG_VERSION_ATTR "configVersion"
+#define TB_KEG_ATTR "keg"  // Settings from setKeg, see KegInventory
+#define TB_KEG_REMAINING_ATTR "kegRemainingMl"  // Sent when it moved by KEG_REPORT_DELTA_ML
+#define TB_KEG_REMAINING_PCT_ATTR "kegRemainingPct"
+#define TB_KEG_POURS_LEFT_ATTR "kegPoursLeft"
+#define TB_KEG_DISPENSED_ATTR "kegDispensedMl"
+
+// ThingsBoard firmware update keys, names fixed by ThingsBoard - see OtaUpdate
+#define TB_FW_TITLE_ATTR "fw_title"  // Shared attributes of the assigned OTA package
+#define TB_FW_VERSION_ATTR "fw_version"
+#define TB_FW_SIZE_ATTR "fw_size"
+#define TB_FW_CHECKSUM_ATTR "fw_checksum"
+#define TB_FW_CHECKSUM_ALGORITHM_ATTR "fw_checksum_algorithm"
+#define TB_FW_STATE_TELEMETRY "fw_state"  // DOWNLOADING .. UPDATED, or FAILED
+#define TB_FW_ERROR_TELEMETRY "fw_error"
+#define TB_CURRENT_FW_TITLE_TELEMETRY "current_fw_title"
+#define TB_CURRENT_FW_VERSION_TELEMETRY "current_fw_version"
+
+// ThingsBoard telemetry keys
+#define TB_OVERSHOOT_ML_TELEMETRY "overshootMl"
+#define TB_VALVE_LATENCY_TELEMETRY "valveLatencyMs"
+#define TB_CONTROL_JITTER_TELEMETRY "controlJitterMaxUs"
+#define TB_CONTROL_OVERRUNS_TELEMETRY "controlOverruns"
+#define TB_ASLEEP_TELEMETRY "asleepMs"  // Time in the idle power mode since the last report
+#define TB_ALERT_TELEMETRY "alert"  // "kegEmpty" or "foam" (FlowFaultDetector), or "kegLow"
+#define TB_ALERT_REASON_TELEMETRY "alertReason"
+#define TB_KEG_LOW_PCT_TELEMETRY "kegLowPct"  // Alert level a "kegLow" alert crossed
+#define TB_FLOW_RATE_TELEMETRY "flowRate"  // Per-pour series in ml/s, see PourTelemetryWriter
+#define TB_RECORDS_DROPPED_TELEMETRY "pourRecordsDropped"  // Finished pours never published
+#define TB_LEDGER_DROPPED_TELEMETRY "ledgerRecordsDropped"  // Ledger records overwritten when full
+#define TB_ORDER_QUEUE_DEPTH_TELEMETRY "orderQueueDepth"
+#define TB_ORDER_OLDEST_WAIT_TELEMETRY "orderOldestWaitMs"
+#define TB_LOCAL_COMMAND_TELEMETRY "localCommand"  // Served by the LAN endpoint, see LocalEndpoint
+#define TB_LOCAL_RESULT_TELEMETRY "localResult"
+#define TB_LOCAL_REJECTED_TELEMETRY "localRejected"
 
 // ThingsBoard RPC commands
+#define TB_POUR_RPC "pour"  // Whole pour in one message, the setters below wrap it
 #define TB_SET_CUP_SIZE_RPC "setCupSize"
 #define TB_SET_ML_PER_PULSE_RPC "setMlPerPulse"
+#define TB_SET_CALIBRATION_CURVE_RPC "setCalibrationCurve"
+#define TB_SET_FLOW_FAULT_THRESHOLDS_RPC "setFlowFaultThresholds"
 #define TB_STOP_POUR_RPC "stopPour"
+#define TB_CONFIRM_CUP_RPC "confirmCup"
+#define TB_GET_PERF_STATS_RPC "getPerfStats"
+#define TB_GET_CONFIG_RPC "getConfig"
+#define TB_SET_CONFIG_RPC "setConfig"  // Pour limits and server override, see ConfigStore
+#define TB_CALIBRATE_RPC "calibrate"   // Guided calibration run, see CalibrationSession
+#define TB_SET_KEG_RPC "setKeg"         // New keg on a tap, see KegInventory
 #define TB_RESET_WIFI_RPC "resetWiFi"
 
 // Hardware pins
-#define RELAY_PIN 13
-#define FLOW_SENSOR_PIN 27
+#define RELAY_PIN 13        // Tap 0
+#define FLOW_SENSOR_PIN 27  // Tap 0
+
+// Taps driven by this board, each with its own valve relay and flow sensor
+#define TAP_MAX_COUNT 8  // One PCNT unit per tap
+#ifndef TAP_COUNT
+#define TAP_COUNT 1
+#endif
+#ifndef TAP_PIN_TABLE
+#define TAP_PIN_TABLE {{RELAY_PIN, FLOW_SENSOR_PIN}}  // {relay, flow sensor} per tap
+#endif
+#define TAP_ALL 0xFF  // Tap index of commands meant for every tap (emergency stop)
 
 // LED status indicator pin
 #define LED_SYSTEM_PIN 2  // Single system status LED
@@ -23,18 +83,192 @@
 #define WIFI_PORTAL_PASSWORD ""     // Open AP for easy access
 #define WIFI_PORTAL_TIMEOUT 180     // 3 minutes timeout for config portal
 #define WIFI_CONNECTION_TIMEOUT 30  // 30 seconds for WiFi connection attempts
+#define WIFI_FAST_CONNECT_TIMEOUT_MS 4000  // Direct association to the cached AP before the scan
+#ifndef WIFI_FAST_CONNECT_STATIC_IP
+#define WIFI_FAST_CONNECT_STATIC_IP 0  // 1 = reuse the last DHCP lease as a static IP
+#endif
 
 // Flow sensor constants
 #define DEFAULT_ML_PER_PULSE 2.222  // 450 pulses/liter ≈ 2.222ml/pulse
 
+// Flow sensor calibration curve - volume per pulse by pulse interval
+#define CALIBRATION_MAX_POINTS 8
+#define DEFAULT_CALIBRATION_POINTS 5               // Default table, see calibration_curve.h
+#define DEFAULT_CALIBRATION_MIN_INTERVAL_US 10000  // First point, doubling per point (to 160ms)
+#define DEFAULT_CALIBRATION_SLOW_GAIN 0.0          // Extra ml/pulse at the slowest point, 0 = flat
+
+// Guided calibration runs - measured pours fitted by least squares, see CalibrationSession
+#define CALIBRATION_MIN_POURS 2
+#define CALIBRATION_MAX_POURS 8
+#define CALIBRATION_DEFAULT_POURS 3
+#define CALIBRATION_MAX_RESIDUAL_PCT 2.0  // RMS error of the fit, above this nothing is committed
+#define CALIBRATION_CURVE_MIN_SPREAD 1.5  // Slowest / fastest pour interval needed to fit a curve
+#define CALIBRATION_CURVE_MIN_GAIN 0.8    // A curve must cut the flat fit's residual to this
+#define CALIBRATION_HISTORY_SIZE 8        // Committed runs kept per tap
+
+// Pulse counting backend: 0 = GPIO interrupt per pulse, 1 = ESP32 PCNT peripheral
+#ifndef USE_PCNT_PULSE_COUNTER
+#define USE_PCNT_PULSE_COUNTER 0
+#endif
+#define PCNT_COUNTER_LIMIT 32767     // 16-bit hardware counter wraps here
+#define PCNT_FILTER_APB_CYCLES 1023  // Glitch filter, 1023 APB cycles ≈ 12.8us at 80MHz
+#define PULSE_TIMESTAMP_BUFFER_SIZE 64  // ISR pulse timestamps, power of two
+#define FLOW_RATE_EWMA_ALPHA 0.2        // Weight of the newest interval in the instant rate
+
+// Overshoot compensation - learns how much flows after the valve is told to close
+#define FLOW_RATE_SAMPLE_MS 250          // Flow rate measurement window during a pour
+#define OVERSHOOT_SETTLE_MS 1500         // Time to count trailing pulses after valve close
+#define OVERSHOOT_RATE_BINS 6            // Number of flow rate bins in the model
+#define OVERSHOOT_BIN_WIDTH_PPS 8.0      // Width of one flow rate bin in pulses per second
+#define OVERSHOOT_EWMA_ALPHA 0.25        // Weight of the newest overshoot sample
+#define OVERSHOOT_MAX_COMPENSATION 0.2   // Never close earlier than 20% of the target
+#define OVERSHOOT_MAX_SAMPLE_PULSES 200  // Discard samples above this as sensor noise
+
+// Flow fault detection - ends a pour early when the keg runs dry or the line foams
+#define FLOW_FAULT_NO_FLOW_MS 2000      // No pulse for this long while the valve is open
+#define FLOW_FAULT_COLLAPSE_RATIO 0.25  // Flow below this fraction of the pour's peak ...
+#define FLOW_FAULT_COLLAPSE_MS 3000     // ... for this long
+#define FLOW_FAULT_FOAM_CV 0.6          // Pulse interval coefficient of variation of foam
+#define FLOW_FAULT_WARMUP_PULSES 20     // Ramp-up pulses ignored by the collapse and foam checks
+#define FLOW_FAULT_EWMA_ALPHA 0.1       // Weight of the newest interval in the foam statistics
+
+// Per-pour flow recording, published once the pour is finished
+#define POUR_SAMPLE_INTERVAL_MS 100  // Initial flow rate sample spacing, doubles on overflow
+#define POUR_SAMPLE_CAPACITY 128     // Samples kept per pour
+#define POUR_RECORD_QUEUE_SIZE 4     // Finished pours per tap awaiting the network task, power of two
+#define NTP_SERVER "pool.ntp.org"    // Wall clock for the timestamps of recorded samples
+#define NTP_MIN_VALID_EPOCH 1700000000UL  // Anything earlier means the clock is not synced yet
+
+// Offline pour ledger on LittleFS
+#define LEDGER_DIR "/ledger"
+#define LEDGER_SEGMENT_RECORDS 128  // 32-byte records, so one segment fills one 4KB flash block
+#define LEDGER_MAX_SEGMENTS 32      // 4096 unreported pours before the oldest are dropped
+#define LEDGER_DRAIN_BATCH 4        // Pours per telemetry message, must fit TELEMETRY_CHUNK_SIZE
+#define LEDGER_RETRY_INTERVAL 10000  // Back-off after a failed ledger publish in ms
+
+// Configuration store - one versioned blob in NVS, see ConfigStore
+#define CONFIG_SERVER_MAX_LENGTH 50      // Same as the WiFiManager tb_server field
+#define CONFIG_WRITE_DEBOUNCE_MS 2000    // Quiet time after the last change before writing
+#define CONFIG_WRITE_MAX_DELAY_MS 30000  // Write anyway once a change has waited this long
+#define CONFIG_MODEL_WRITE_DELAY_MS 600000  // Learned overshoot models alone, 10 minutes
+
+// Keg inventory - volume left per tap and low-keg alerts, see KegInventory
+#define KEG_BEER_ID_MAX_LENGTH 32
+#define KEG_MAX_SIZE_ML 100000          // Largest keg setKeg accepts (100 l)
+#define KEG_ALERT_LEVELS 3              // Remaining-level alerts per keg
+#define KEG_ALERT_DEFAULT_PCT {20, 10}  // When setKeg gives none
+#define KEG_DEFAULT_POUR_ML 500         // Pours-remaining estimate before the first full pour
+#define KEG_POUR_AVERAGE_ALPHA 0.125    // Weight of the newest full pour in that estimate
+#define KEG_REPORT_DELTA_ML 1000        // Change of the remaining volume worth an attribute update
+#define KEG_SAVE_DELAY_MS 60000         // Quiet time after a pour before the level is written
+#define KEG_SAVE_MAX_UNSAVED_ML 5000    // Written anyway once this much was poured since
+
+// Firmware updates - see ota_update.h. ThingsBoard announces a package through the fw_* shared
+// attributes, the image is fetched in chunks from its HTTP device API while the taps are idle.
+#define FIRMWARE_TITLE "beer-tap"  // Title of the OTA packages meant for this firmware
+#ifndef FIRMWARE_VERSION
+#define FIRMWARE_VERSION "1.0.0"
+#endif
+#ifndef OTA_HTTP_PORT
+#define OTA_HTTP_PORT 80  // ThingsBoard HTTP device API, on the MQTT server's host
+#endif
+#define OTA_VERSION_MAX_LENGTH 32
+#define OTA_CHUNK_SIZE 4096           // Bytes per request, one flash sector
+#define OTA_MAX_IMAGE_SIZE 0x1E0000   // Default 1.875MB app partition
+#define OTA_INFLATE_WINDOW_BITS 15    // zlib history, allocated only while a download runs
+#define OTA_CHUNK_RETRIES 5           // Failed requests for one chunk before the update fails
+#define OTA_RETRY_DELAY_MS 5000
+#define OTA_HTTP_TIMEOUT_MS 5000
+#define OTA_POUR_QUIET_MS 3000        // After a pour, while its trailing flow is counted
+#define OTA_HEALTH_TIMEOUT_MS 120000  // A new image must reach ThingsBoard within this
+#define OTA_MAX_BOOT_ATTEMPTS 3       // Boots of an unconfirmed image before it is rolled back
+
+// Client attributes - see attribute_publisher.h. Changes are collected and sent together, a value
+// ThingsBoard already has is not sent again.
+#define ATTRIBUTE_MAX_KEYS (2 + 12 * TAP_MAX_COUNT)  // Device-wide keys and those of every tap
+#define ATTRIBUTE_COALESCE_MS 500           // Changes within this of the first share a message
+#define ATTRIBUTE_MODEL_INTERVAL_MS 30000   // Learned overshoot model, changes with every pour
+
+// MQTT buffers - a telemetry chunk must fit into one publish, the fw_* attributes into one
+// received message
+#define MQTT_RECEIVE_BUFFER_SIZE 512
+#define MQTT_SEND_BUFFER_SIZE 1024
+#define MQTT_MAX_STACK_SIZE 1024
+#define TELEMETRY_CHUNK_SIZE (MQTT_SEND_BUFFER_SIZE - 64)  // Headroom for the topic
+
+// Pour orders - every cup size above 0 is queued, see OrderQueue
+#define ORDER_QUEUE_CAPACITY 8       // Waiting orders per tap
+#define ORDER_ID_MAX_LENGTH 36       // Fits a UUID
+#define ORDER_RECENT_IDS 16          // Finished order ids remembered to reject retries
+#define ORDER_CUP_SWAP_MS 5000       // Pause before the next order, 0 = wait for confirmCup
+#define ORDER_START_TIMEOUT_MS 2000  // An order whose pour has not started by then is dropped
+
 // Safety and monitoring constants
 #define MAX_POUR_TIME 90000     // Maximum pour time in milliseconds (90 seconds)
 #define MAX_POUR_VOLUME 2000    // Maximum pour volume in ml (2 liters)
+                                // Both are ceilings, setConfig can only lower them per tap
 #define MIN_CUP_SIZE 50         // Minimum cup size in ml
 #define MAX_CUP_SIZE 2000       // Maximum cup size in ml
 #define MIN_ML_PER_PULSE 0.5    // Minimum ml per pulse
 #define MAX_ML_PER_PULSE 10.0   // Maximum ml per pulse
-#define WATCHDOG_TIMEOUT 30000  // Watchdog timeout in milliseconds (30 seconds)
+#define WATCHDOG_TIMEOUT 10000  // Control or network task stuck this long resets the board
+
+// Task layout - pour control and networking run on separate cores
+#define CONTROL_TASK_PERIOD_MS 10   // Fixed period of the pour control / safety loop
+#define CONTROL_TASK_PRIORITY 5     // Above the network task, below the WiFi stack
+#define CONTROL_TASK_CORE 1
+#define CONTROL_TASK_STACK 4096
+#define NETWORK_TASK_PERIOD_MS 20   // Idle delay between network loop passes
+#define NETWORK_TASK_PRIORITY 1
+#define NETWORK_TASK_CORE 0
+#define NETWORK_TASK_STACK 8192
+#define COMMAND_QUEUE_SIZE 16       // Network -> control commands, power of two
+#define EVENT_QUEUE_SIZE 32         // Control -> network events, power of two
+#define JITTER_REPORT_INTERVAL 60000  // Jitter and perf counter telemetry period in ms
+
+// Idle power mode - see power_manager.h. While no pour, order or calibration is active the
+// tasks stretch their periods and the chip may light-sleep between wakeups; an RPC then waits at
+// most for the AP's next DTIM beacon (102ms at DTIM 1) before its pour starts.
+#ifndef POWER_IDLE_ENABLED
+#define POWER_IDLE_ENABLED 1
+#endif
+#define POWER_IDLE_ENTER_MS 30000          // Quiet time before the idle mode is entered
+#define POWER_IDLE_CONTROL_PERIOD_MS 1000  // Control task heartbeat, commands wake it at once
+#define POWER_IDLE_NETWORK_WAIT_MS 250     // Longest wait for MQTT data, bounds LAN requests
+
+// LAN pour endpoint - see local_endpoint.h, enabled by LOCAL_ENDPOINT_KEY in config.h
+#define LOCAL_ENDPOINT_PORT 4210   // UDP
+#define LOCAL_DATAGRAM_MAX 160     // Longest request line
+#define LOCAL_KEY_MIN_LENGTH 16    // Shared HMAC key length in characters
+#define LOCAL_KEY_MAX_LENGTH 64
+#define LOCAL_REQUESTS_PER_PASS 4  // Datagrams served per network loop pass
+#define LOCAL_COUNTER_RESERVE 1000  // Counters ahead of the last accepted one reserved in NVS
+
+// Performance counters - see perf_counters.h
+#define PERF_HISTOGRAM_BUCKETS 16  // Power-of-two latency buckets from 1us, the last is open
+#define PERF_STALL_MS 1000         // Network loop pass counted as a stall
+
+// Logging - see logger.h, LOG_LEVEL selects what is compiled in
+#define LOG_QUEUE_SLOTS 32      // Queued log lines, power of two
+#define LOG_LINE_MAX 96         // Longer lines are truncated
+#define LOG_TASK_PRIORITY 0     // Below everything, lines wait in the ring instead
+#define LOG_TASK_CORE 0
+#define LOG_TASK_STACK 3072
+#define LOG_DRAIN_PERIOD_MS 10
+
+// Microbenchmarks - see benchmark.h. BENCHMARK_MODE=1 builds the sketch as the benchmark
+// runner instead of the firmware.
+#ifndef BENCHMARK_MODE
+#define BENCHMARK_MODE 0
+#endif
+#define BENCH_SUITE_VERSION 1  // Bump when a case's input changes, results are not comparable
+#define BENCH_MAX_CASES 24
+#define BENCH_MIN_OPS 20000    // Operations per case, in whole batches
+#define BENCH_RELAY_PIN 33     // Output driven by the benchmark's taps, never wire a valve to it
+#define BENCH_FLOW_SENSOR_PIN 32
+#ifndef BENCH_BUILD_ID
+#define BENCH_BUILD_ID __DATE__ " " __TIME__  // The host Makefile passes git describe
+#endif
 
 // Safety limits
 #define MAX_PULSE_COUNT 1000000  // Sanity check for pulse count
@@ -0,0 +1,235 @@
+#include "control_loop.h"
+#include "hal.h"
+#include "logger.h"
+#include "perf_counters.h"
+
+// Global instance
+ControlLoop controlLoop(tapController);
+
+ControlLoop::ControlLoop(TapController& taps) : taps(taps) {
+  memset(reported, 0, sizeof(reported));
+  commandDropped = false;
+  stopRequests = 0;
+  pendingCurveTap = 0;
+  curvePending = false;
+  pendingThresholdsTap = 0;
+  thresholdsPending = false;
+  for (uint8_t i = 0; i < TAP_MAX_COUNT; i++) {
+    settingsSequence[i] = 0;
+  }
+  lastTickMicros = 0;
+  maxJitterUs = 0;
+  overruns = 0;
+  wakeHandler = nullptr;
+}
+
+void ControlLoop::begin() {
+  // The overshoot models were loaded from NVS, only report samples learned from now on
+  for (uint8_t i = 0; i < taps.getCount(); i++) {
+    reported[i].overshootSamples = taps.getTap(i).getOvershootModel().getTotalSamples();
+    reported[i].pouring = taps.getTap(i).getIsPouring();
+    publishSettings(i);
+  }
+}
+
+bool ControlLoop::submit(uint8_t tap, PourCommandType type, float value, float extra) {
+  if (!taps.isValid(tap)) {
+    return false;  // Callers check the index first, this only guards the array
+  }
+  PourCommand command = {type, tap, value, extra};
+  if (!commands.push(command)) {
+    commandDropped = true;  // Reported from the control task, the event queue is its to fill
+    return false;
+  }
+  if (wakeHandler != nullptr) {
+    wakeHandler();
+  }
+  return true;
+}
+
+bool ControlLoop::requestStop(uint8_t tap) {
+  if (tap != TAP_ALL && !taps.isValid(tap)) {
+    return false;
+  }
+  stopRequests.fetch_or(tap == TAP_ALL ? 0xFFFFFFFFUL : 1UL << tap);
+  if (wakeHandler != nullptr) {
+    wakeHandler();
+  }
+  return true;
+}
+
+bool ControlLoop::submitCalibrationCurve(uint8_t tap, const CalibrationCurve& curve) {
+  if (!taps.isValid(tap) || curvePending.load()) {
+    return false;  // Previous curve not applied yet
+  }
+  pendingCurve = curve;
+  pendingCurveTap = tap;
+  curvePending.store(true);
+  if (!submit(tap, CMD_SET_CALIBRATION_CURVE)) {
+    curvePending.store(false);
+    return false;
+  }
+  return true;
+}
+
+bool ControlLoop::submitFlowFaultThresholds(uint8_t tap, const FlowFaultThresholds& thresholds) {
+  if (!taps.isValid(tap) || thresholdsPending.load()) {
+    return false;
+  }
+  pendingThresholds = thresholds;
+  pendingThresholdsTap = tap;
+  thresholdsPending.store(true);
+  if (!submit(tap, CMD_SET_FLOW_FAULT_THRESHOLDS)) {
+    thresholdsPending.store(false);
+    return false;
+  }
+  return true;
+}
+
+bool ControlLoop::pollEvent(PourEvent& event) { return events.pop(event); }
+
+void ControlLoop::publishSettings(uint8_t tap) {
+  const PourSystem& pourSystem = taps.getTap(tap);
+  uint32_t sequence = settingsSequence[tap].load(std::memory_order_relaxed);
+  settingsSequence[tap].store(sequence + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  settings[tap].calibration = pourSystem.getCalibrationCurve();
+  settings[tap].flowFaultThresholds = pourSystem.getFlowFaultDetector().getThresholds();
+  settings[tap].limits = pourSystem.getPourLimits();
+  settings[tap].overshoot = pourSystem.getOvershootModel().getState();
+  settingsSequence[tap].store(sequence + 2, std::memory_order_release);
+}
+
+void ControlLoop::readSettings(uint8_t tap, TapSettings& copy) const {
+  // Settings change a few times a day, a retry is rare and never waits for more than one copy
+  uint32_t before;
+  uint32_t after;
+  do {
+    before = settingsSequence[tap].load(std::memory_order_acquire);
+    copy = settings[tap];
+    std::atomic_thread_fence(std::memory_order_acquire);
+    after = settingsSequence[tap].load(std::memory_order_relaxed);
+  } while ((before & 1) != 0 || before != after);
+}
+
+void ControlLoop::publishEvent(PourEventType type, uint8_t tap, float value, float extra) {
+  PourEvent event = {type, tap, value, extra};
+  if (!events.push(event)) {
+    LOG_WARN("⚠️ Pour event queue full, event dropped");
+  }
+}
+
+void ControlLoop::applyCommand(const PourCommand& command) {
+  PourSystem& pourSystem = taps.getTap(command.tap);
+  switch (command.type) {
+    case CMD_SET_CUP_SIZE:
+      pourSystem.handleCupSizeChange((int)command.value, command.extra);
+      break;
+    case CMD_SET_ML_PER_PULSE:
+      pourSystem.handleMlPerPulseChange(command.value);
+      publishSettings(command.tap);
+      publishEvent(EVENT_CALIBRATION_CHANGED, command.tap, pourSystem.getMlPerPulse());
+      break;
+    case CMD_SET_CALIBRATION_CURVE:
+      if (curvePending.load()) {
+        taps.getTap(pendingCurveTap).setCalibrationCurve(pendingCurve);
+        curvePending.store(false);
+        publishSettings(pendingCurveTap);
+        publishEvent(EVENT_CALIBRATION_CHANGED, pendingCurveTap,
+                     taps.getTap(pendingCurveTap).getMlPerPulse());
+      }
+      break;
+    case CMD_SET_FLOW_FAULT_THRESHOLDS:
+      if (thresholdsPending.load()) {
+        taps.getTap(pendingThresholdsTap).setFlowFaultThresholds(pendingThresholds);
+        thresholdsPending.store(false);
+        publishSettings(pendingThresholdsTap);
+        publishEvent(EVENT_FLOW_FAULT_THRESHOLDS_CHANGED, pendingThresholdsTap);
+      }
+      break;
+    case CMD_SET_POUR_LIMITS: {
+      PourLimits limits = {(uint32_t)command.value, (uint16_t)command.extra};
+      if (pourSystem.setPourLimits(limits)) {
+        publishSettings(command.tap);
+        publishEvent(EVENT_POUR_LIMITS_CHANGED, command.tap);
+      }
+      break;
+    }
+  }
+}
+
+void ControlLoop::recordJitter() {
+  unsigned long now = hal::micros();
+  if (lastTickMicros != 0) {
+    unsigned long period = now - lastTickMicros;
+    unsigned long expected = CONTROL_TASK_PERIOD_MS * 1000UL;
+    uint32_t jitter = period > expected ? period - expected : expected - period;
+    if (period >= 2 * expected) {
+      overruns++;
+    }
+
+    uint32_t currentMax = maxJitterUs.load();
+    while (jitter > currentMax && !maxJitterUs.compare_exchange_weak(currentMax, jitter)) {
+    }
+  }
+  lastTickMicros = now;
+}
+
+void ControlLoop::updateTap(uint8_t tap) {
+  PourSystem& pourSystem = taps.getTap(tap);
+  TapReport& report = reported[tap];
+
+  // Run pour logic (includes safety checks)
+  float volumeBeforeUpdate = pourSystem.getTotalVolume();
+  {
+    PerfTimer timer(PERF_TAP_UPDATE);
+    pourSystem.update();
+  }
+
+  bool currentPourState = pourSystem.getIsPouring();
+  if (currentPourState && !report.pouring) {
+    publishEvent(EVENT_POUR_STARTED, tap);
+  } else if (!currentPourState && report.pouring) {
+    publishEvent(EVENT_POUR_COMPLETE, tap, volumeBeforeUpdate, pourSystem.getLastStopReason());
+  }
+  report.pouring = currentPourState;
+
+  const OvershootModel& model = pourSystem.getOvershootModel();
+  if (model.getTotalSamples() != report.overshootSamples) {
+    publishSettings(tap);
+    publishEvent(EVENT_OVERSHOOT_MEASURED, tap,
+                 model.getLastOvershootPulses() * pourSystem.getMlPerPulse(), model.getLatencyMs());
+    report.overshootSamples = model.getTotalSamples();
+  }
+}
+
+void ControlLoop::tick() {
+  PerfTimer timer(PERF_CONTROL_TICK);
+  recordJitter();
+  hal::feedWatchdog();  // The task watchdog resets the board if ticks stop
+
+  PourCommand command;
+  while (commands.pop(command)) {
+    applyCommand(command);
+  }
+  if (commandDropped.exchange(false)) {
+    publishEvent(EVENT_COMMAND_QUEUE_FULL, 0);
+  }
+  uint32_t stops = stopRequests.exchange(0);
+  for (uint8_t i = 0; stops != 0 && i < taps.getCount(); i++) {
+    if (stops & (1UL << i)) {
+      PourSystem& pourSystem = taps.getTap(i);
+      bool pending = pourSystem.getCurrentCupSize() > 0 && !pourSystem.getIsPouring();
+      pourSystem.emergencyStop();
+      if (pending) {
+        // Never started, so updateTap() sees no pour end - report it here
+        publishEvent(EVENT_POUR_COMPLETE, i, 0, STOP_EMERGENCY);
+      }
+    }
+  }
+
+  // Every tap in one pass, in array order
+  for (uint8_t i = 0; i < taps.getCount(); i++) {
+    updateTap(i);
+  }
+}
@@ -0,0 +1,138 @@
+#ifndef CONTROL_LOOP_H
+#define CONTROL_LOOP_H
+
+#include <Arduino.h>
+#include <atomic>
+#include "constants.h"
+#include "spsc_queue.h"
+#include "tap_controller.h"
+
+// Commands from the network task to the control task
+enum PourCommandType {
+  CMD_SET_CUP_SIZE,  // value = cup size (ml), extra = ml per pulse for this pour only, 0 = none
+  CMD_SET_ML_PER_PULSE,
+  CMD_SET_CALIBRATION_CURVE,  // Curve is passed through submitCalibrationCurve()
+  CMD_SET_FLOW_FAULT_THRESHOLDS,  // Passed through submitFlowFaultThresholds()
+  CMD_SET_POUR_LIMITS             // value = max pour time (ms), extra = max pour volume (ml)
+};
+
+struct PourCommand {
+  PourCommandType type;
+  uint8_t tap;
+  float value;
+  float extra;
+};
+
+// Status changes from the control task back to the network task
+enum PourEventType {
+  EVENT_POUR_STARTED,
+  EVENT_POUR_COMPLETE,        // value = volume at valve close (ml), extra = StopReason
+  EVENT_OVERSHOOT_MEASURED,   // value = overshoot (ml), extra = learned valve latency (ms)
+  EVENT_CALIBRATION_CHANGED,  // value = ml per pulse at full flow
+  EVENT_FLOW_FAULT_THRESHOLDS_CHANGED,
+  EVENT_POUR_LIMITS_CHANGED,
+  EVENT_COMMAND_QUEUE_FULL    // A command was dropped
+};
+
+struct PourEvent {
+  PourEventType type;
+  uint8_t tap;
+  float value;
+  float extra;
+};
+
+// A tap's settings as the network task sees them, republished by the control task whenever
+// one of them changes
+struct TapSettings {
+  CalibrationCurve calibration;
+  FlowFaultThresholds flowFaultThresholds;
+  PourLimits limits;
+  OvershootState overshoot;
+};
+
+// Pour control and safety checks for every tap, run at a fixed period by the control task.
+// Commands and events carry the tap index. The network task talks to it only through the two
+// lock-free queues, so a stalled MQTT or WiFi call can never delay a valve stop. Emergency stops
+// bypass the command queue: a full queue must not be able to drop one. The taps themselves
+// belong to the control task; the network task reads their settings through readSettings().
+class ControlLoop {
+ public:
+  typedef void (*WakeHandler)();
+
+ private:
+  TapController& taps;
+  SpscQueue<PourCommand, COMMAND_QUEUE_SIZE> commands;
+  SpscQueue<PourEvent, EVENT_QUEUE_SIZE> events;
+
+  // What each tap last reported, to turn state changes into events
+  struct TapReport {
+    bool pouring;
+    uint32_t overshootSamples;
+  };
+  TapReport reported[TAP_MAX_COUNT];
+  std::atomic<bool> commandDropped;
+  std::atomic<uint32_t> stopRequests;  // Bit per tap, taken by every tick
+
+  // Too big for a queue slot - handed over in a single buffer each, owned by the network
+  // task until the pending flag is set and by the control task until it clears it again
+  CalibrationCurve pendingCurve;
+  uint8_t pendingCurveTap;
+  std::atomic<bool> curvePending;
+  FlowFaultThresholds pendingThresholds;
+  uint8_t pendingThresholdsTap;
+  std::atomic<bool> thresholdsPending;
+
+  // Seqlock per tap - the sequence is odd while the control task copies, readers retry
+  TapSettings settings[TAP_MAX_COUNT];
+  std::atomic<uint32_t> settingsSequence[TAP_MAX_COUNT];
+
+  // Period jitter, measured at the start of every tick
+  unsigned long lastTickMicros;
+  std::atomic<uint32_t> maxJitterUs;
+  std::atomic<uint32_t> overruns;
+
+  WakeHandler wakeHandler;
+
+  void applyCommand(const PourCommand& command);
+  void updateTap(uint8_t tap);
+  void publishEvent(PourEventType type, uint8_t tap, float value = 0, float extra = 0);
+  void publishSettings(uint8_t tap);
+  void recordJitter();
+
+ public:
+  explicit ControlLoop(TapController& taps);
+
+  // Control task side
+  void begin();
+  void tick();
+
+  // After a wait longer than one period (the idle power mode), so it is not counted as jitter
+  void resetPeriod() { lastTickMicros = 0; }
+
+  // Called after every submitted command, lets an idle control task sleep until there is work
+  void setWakeHandler(WakeHandler handler) { wakeHandler = handler; }
+
+  // Network task side
+  bool submit(uint8_t tap, PourCommandType type, float value = 0, float extra = 0);
+  bool submitCalibrationCurve(uint8_t tap, const CalibrationCurve& curve);
+  bool submitFlowFaultThresholds(uint8_t tap, const FlowFaultThresholds& thresholds);
+
+  // Emergency stop of tap, TAP_ALL for every tap. Applied by the next tick after the commands
+  // already queued, so a pour submitted before the stop is stopped too. Cannot be lost; false
+  // only for an invalid tap.
+  bool requestStop(uint8_t tap);
+
+  bool pollEvent(PourEvent& event);
+
+  // Copy of a tap's settings as the control task last applied them
+  void readSettings(uint8_t tap, TapSettings& copy) const;
+
+  // Worst deviation from CONTROL_TASK_PERIOD_MS since the last call, then restarts the window
+  uint32_t takeMaxJitterUs() { return maxJitterUs.exchange(0); }
+  uint32_t getOverruns() const { return overruns.load(); }
+};
+
+// Global instance
+extern ControlLoop controlLoop;
+
+#endif  // CONTROL_LOOP_H
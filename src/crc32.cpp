@@ -0,0 +1,15 @@
+#include "crc32.h"
+
+uint32_t crc32(const void* data, size_t length, uint32_t crc) {
+  // Bitwise rather than table driven - only small records are checksummed, and this
+  // keeps 1KB of table out of RAM
+  const uint8_t* bytes = static_cast<const uint8_t*>(data);
+  crc = ~crc;
+  while (length--) {
+    crc ^= *bytes++;
+    for (int bit = 0; bit < 8; bit++) {
+      crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+    }
+  }
+  return ~crc;
+}
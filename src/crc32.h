@@ -0,0 +1,10 @@
+#ifndef CRC32_H
+#define CRC32_H
+
+#include <Arduino.h>
+
+// Standard CRC-32 (IEEE 802.3, as used by zlib). Pass the previous result as crc to
+// continue a running checksum over several buffers.
+uint32_t crc32(const void* data, size_t length, uint32_t crc = 0);
+
+#endif  // CRC32_H
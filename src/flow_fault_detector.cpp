@@ -0,0 +1,101 @@
+#include "flow_fault_detector.h"
+
+const char* flowFaultName(FlowFault fault) {
+  switch (fault) {
+    case FLOW_FAULT_NO_FLOW:
+      return "noFlow";
+    case FLOW_FAULT_COLLAPSED:
+      return "flowCollapsed";
+    case FLOW_FAULT_FOAM:
+      return "foam";
+    default:
+      return "none";
+  }
+}
+
+FlowFaultDetector::FlowFaultDetector() {
+  thresholds.noFlowMs = FLOW_FAULT_NO_FLOW_MS;
+  thresholds.collapseRatio = FLOW_FAULT_COLLAPSE_RATIO;
+  thresholds.collapseMs = FLOW_FAULT_COLLAPSE_MS;
+  thresholds.foamCv = FLOW_FAULT_FOAM_CV;
+  start(0);
+}
+
+void FlowFaultDetector::start(unsigned long nowMillis) {
+  lastPulseMillis = nowMillis;
+  lastPulseCount = 0;
+  peakRatePps = 0;
+  collapsedSince = 0;
+  intervals = 0;
+  lastIntervalUs = 0;
+  meanIntervalUs = 0;
+  intervalVariance = 0;
+}
+
+void FlowFaultDetector::addInterval(uint32_t intervalUs) {
+  // The ramp-up after the valve opens would dominate the statistics, skip it
+  intervals++;
+  if (intervals <= FLOW_FAULT_WARMUP_PULSES) {
+    lastIntervalUs = intervalUs;
+    meanIntervalUs = intervalUs;
+    return;
+  }
+
+  // Exponentially weighted, so the check follows the last few dozen pulses only. The
+  // variance comes from successive differences, which ignores a slow change in flow rate
+  // and only picks up pulse-to-pulse scatter.
+  float step = (float)intervalUs - lastIntervalUs;
+  meanIntervalUs += FLOW_FAULT_EWMA_ALPHA * (intervalUs - meanIntervalUs);
+  intervalVariance += FLOW_FAULT_EWMA_ALPHA * (step * step / 2 - intervalVariance);
+  lastIntervalUs = intervalUs;
+}
+
+float FlowFaultDetector::getIntervalCv() const {
+  return meanIntervalUs > 0 ? sqrtf(intervalVariance) / meanIntervalUs : 0;
+}
+
+FlowFault FlowFaultDetector::check(unsigned long nowMillis, unsigned long pulseCount,
+                                   float ratePps) {
+  if (pulseCount != lastPulseCount) {
+    lastPulseCount = pulseCount;
+    lastPulseMillis = nowMillis;
+  }
+
+  if (thresholds.noFlowMs > 0 && nowMillis - lastPulseMillis >= thresholds.noFlowMs) {
+    return FLOW_FAULT_NO_FLOW;
+  }
+
+  // The ramp-up after the valve opens looks like both a collapse and foam, wait for it
+  if (pulseCount < FLOW_FAULT_WARMUP_PULSES) {
+    return FLOW_FAULT_NONE;
+  }
+
+  if (ratePps > peakRatePps) {
+    peakRatePps = ratePps;
+  }
+  if (thresholds.collapseMs > 0 && ratePps < peakRatePps * thresholds.collapseRatio) {
+    if (collapsedSince == 0) {
+      collapsedSince = nowMillis ? nowMillis : 1;
+    } else if (nowMillis - collapsedSince >= thresholds.collapseMs) {
+      return FLOW_FAULT_COLLAPSED;
+    }
+  } else {
+    collapsedSince = 0;
+  }
+
+  if (thresholds.foamCv > 0 && intervals >= 2 * FLOW_FAULT_WARMUP_PULSES &&
+      getIntervalCv() > thresholds.foamCv) {
+    return FLOW_FAULT_FOAM;
+  }
+  return FLOW_FAULT_NONE;
+}
+
+size_t FlowFaultDetector::toJson(const FlowFaultThresholds& thresholds, char* buffer,
+                                 size_t size) {
+  int written = snprintf(buffer, size,
+                         "{\"noFlowMs\":%lu,\"collapseRatio\":%.2f,\"collapseMs\":%lu,"
+                         "\"foamCv\":%.2f}",
+                         (unsigned long)thresholds.noFlowMs, thresholds.collapseRatio,
+                         (unsigned long)thresholds.collapseMs, thresholds.foamCv);
+  return written > 0 && (size_t)written < size ? written : 0;
+}
@@ -0,0 +1,58 @@
+#ifndef FLOW_FAULT_DETECTOR_H
+#define FLOW_FAULT_DETECTOR_H
+
+#include <Arduino.h>
+#include "constants.h"
+
+enum FlowFault {
+  FLOW_FAULT_NONE,
+  FLOW_FAULT_NO_FLOW,    // No pulse for noFlowMs - keg empty or line blocked
+  FLOW_FAULT_COLLAPSED,  // Flow stayed far below the pour's peak - keg running dry
+  FLOW_FAULT_FOAM        // Erratic pulse intervals - foam or gas in the line
+};
+
+// Tunable at runtime, 0 disables a check
+struct FlowFaultThresholds {
+  uint32_t noFlowMs;
+  float collapseRatio;  // Fraction of the peak flow rate below which the flow has collapsed
+  uint32_t collapseMs;  // How long the flow has to stay collapsed
+  float foamCv;         // Coefficient of variation of the pulse interval that means foam
+};
+
+// Watches a running pour for flow that should not be waited out until MAX_POUR_TIME.
+// Fed with every pulse interval (when the counter provides timestamps) and polled once per
+// control tick, both in constant time.
+class FlowFaultDetector {
+ private:
+  FlowFaultThresholds thresholds;
+
+  unsigned long lastPulseMillis;  // Valve open time until the first pulse arrives
+  unsigned long lastPulseCount;
+  float peakRatePps;
+  unsigned long collapsedSince;  // 0 = flow not collapsed
+
+  // EWMA mean and variance of the pulse interval, for the foam check
+  uint32_t intervals;
+  uint32_t lastIntervalUs;
+  float meanIntervalUs;
+  float intervalVariance;
+
+ public:
+  FlowFaultDetector();
+
+  void start(unsigned long nowMillis);
+  void addInterval(uint32_t intervalUs);
+  FlowFault check(unsigned long nowMillis, unsigned long pulseCount, float ratePps);
+
+  void setThresholds(const FlowFaultThresholds& newThresholds) { thresholds = newThresholds; }
+  const FlowFaultThresholds& getThresholds() const { return thresholds; }
+  float getIntervalCv() const;
+
+  // {"noFlowMs":..,"collapseRatio":..,"collapseMs":..,"foamCv":..}
+  size_t toJson(char* buffer, size_t size) const { return toJson(thresholds, buffer, size); }
+  static size_t toJson(const FlowFaultThresholds& thresholds, char* buffer, size_t size);
+};
+
+const char* flowFaultName(FlowFault fault);
+
+#endif  // FLOW_FAULT_DETECTOR_H
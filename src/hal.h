@@ -0,0 +1,84 @@
+#ifndef HAL_H
+#define HAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Thin hardware abstraction layer.
+// Modules in src/ reach GPIO, interrupts, time, timers, restart, firmware updates, watchdog,
+// heap statistics, network status and power modes only through these calls. hal_arduino.cpp
+// maps them onto the ESP32 Arduino core; the Linux simulator in host/ links the same modules
+// against a simulated implementation.
+namespace hal {
+
+// GPIO (digitalWrite must be callable from interrupt context)
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+
+// Interrupts
+typedef void (*InterruptHandler)(void* arg);
+void attachInterrupt(uint8_t pin, InterruptHandler handler, void* arg, int mode);
+void detachInterrupt(uint8_t pin);
+
+// Time
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+
+// CPU cycle counter for timing short sections. Wraps every 2^32 cycles (about 17 s at 240 MHz).
+uint32_t cycleCount();
+uint32_t cyclesPerMicrosecond();
+
+// One-shot timers. The handler runs in the timer service task, not from an interrupt, and may
+// re-arm its own timer. Starting a timer that is already armed re-arms it with the new delay.
+typedef void (*TimerHandler)(void* arg);
+typedef void* TimerHandle;
+TimerHandle createTimer(TimerHandler handler, void* arg, const char* name);
+void startTimer(TimerHandle timer, unsigned long delayUs);
+void stopTimer(TimerHandle timer);
+
+// System
+void restart();
+
+// Firmware update into the app partition the running image did not boot from. otaBegin()
+// takes the image size, 0 when it is not known up front; otaEnd() checks the written image
+// and selects it for the next boot, otaAbort() drops a partly written one.
+bool otaBegin(uint32_t size);
+bool otaWrite(const uint8_t* data, size_t length);
+bool otaEnd();
+void otaAbort();
+
+// A new image runs unconfirmed until otaMarkValid(). otaRollback() restarts into the previous
+// image; it returns false when there is none to go back to.
+void otaMarkValid();
+bool otaRollback();
+
+// Task watchdog. watchTask() subscribes the calling task, which must then call feedWatchdog()
+// at least every timeoutMs or the board resets. One timeout applies to all watched tasks.
+void watchTask(unsigned long timeoutMs);
+void feedWatchdog();
+
+// Heap statistics in bytes
+uint32_t freeHeap();
+uint32_t minFreeHeap();       // Lowest free heap since boot
+uint32_t largestFreeBlock();  // Largest single allocation that would succeed now
+
+// Network status
+bool isNetworkConnected();
+void reconnectNetwork();
+
+// Blocks until the socket has data to read or timeoutMs has passed. Returns true on data.
+bool waitForSocketData(int socket, unsigned long timeoutMs);
+
+// Low-power mode: the chip may enter automatic light sleep whenever every task is blocked and
+// the WiFi modem sleeps between DTIM beacons; off, the modem stays awake for the lowest RPC
+// latency. While it is on, a level change on any of wakePins wakes the chip and is reported
+// once by takeWakePinActivity(). Returns whether light sleep is available in this build, the
+// modem sleeps either way.
+bool setLowPowerMode(bool enabled, const uint8_t* wakePins, uint8_t count);
+bool takeWakePinActivity();
+
+}  // namespace hal
+
+#endif  // HAL_H
@@ -0,0 +1,242 @@
+#include <Arduino.h>
+#include <Update.h>
+#include <WiFi.h>
+#include <driver/gpio.h>
+#include <esp_ota_ops.h>
+#include <esp_pm.h>
+#include <esp_sleep.h>
+#include <esp_task_wdt.h>
+#include <esp_timer.h>
+#include <hal/gpio_ll.h>
+#include <lwip/sockets.h>
+#include "hal.h"
+
+namespace {
+
+// Pin interrupts go through onPinInterrupt() so the first one after a light-sleep wake can
+// put the pin back from the wake level to its edge
+struct PinInterrupt {
+  hal::InterruptHandler handler;
+  void* arg;
+  gpio_int_type_t type;    // Arduino's RISING / FALLING / CHANGE match the IDF values
+  volatile bool wakeArmed;  // Pin is a level wake source, see setLowPowerMode()
+};
+PinInterrupt pinInterrupts[GPIO_NUM_MAX];
+
+// Wake pins without an interrupt (the PCNT backend) are polled for their wake level instead
+struct PolledWakePin {
+  gpio_num_t gpio;
+  int level;
+};
+PolledWakePin polledWakePins[GPIO_NUM_MAX];
+uint8_t polledWakePinCount = 0;
+volatile bool wakePinActivity = false;
+uint32_t fullSpeedMhz = 0;
+
+void IRAM_ATTR onPinInterrupt(void* arg) {
+  PinInterrupt* pin = static_cast<PinInterrupt*>(arg);
+  if (pin->wakeArmed) {
+    // A level interrupt would fire again as soon as this returns
+    gpio_num_t gpio = (gpio_num_t)(pin - pinInterrupts);
+    gpio_ll_set_intr_type(&GPIO, gpio, pin->type);
+    gpio_ll_wakeup_disable(&GPIO, gpio);
+    pin->wakeArmed = false;
+    wakePinActivity = true;
+  }
+  pin->handler(pin->arg);
+}
+
+}  // namespace
+
+namespace hal {
+
+void pinMode(uint8_t pin, uint8_t mode) { ::pinMode(pin, mode); }
+
+void IRAM_ATTR digitalWrite(uint8_t pin, uint8_t value) { ::digitalWrite(pin, value); }
+
+int digitalRead(uint8_t pin) { return ::digitalRead(pin); }
+
+void attachInterrupt(uint8_t pin, InterruptHandler handler, void* arg, int mode) {
+  PinInterrupt& entry = pinInterrupts[pin];
+  entry.handler = handler;
+  entry.arg = arg;
+  entry.type = (gpio_int_type_t)mode;
+  entry.wakeArmed = false;
+  ::attachInterruptArg(digitalPinToInterrupt(pin), onPinInterrupt, &entry, mode);
+}
+
+void detachInterrupt(uint8_t pin) {
+  ::detachInterrupt(digitalPinToInterrupt(pin));
+  pinInterrupts[pin].handler = nullptr;
+}
+
+unsigned long IRAM_ATTR millis() { return ::millis(); }
+
+unsigned long IRAM_ATTR micros() { return ::micros(); }
+
+void delay(unsigned long ms) { ::delay(ms); }
+
+uint32_t IRAM_ATTR cycleCount() { return ESP.getCycleCount(); }
+
+uint32_t cyclesPerMicrosecond() { return ESP.getCpuFreqMHz(); }
+
+TimerHandle createTimer(TimerHandler handler, void* arg, const char* name) {
+  esp_timer_create_args_t args = {};
+  args.callback = handler;
+  args.arg = arg;
+  args.dispatch_method = ESP_TIMER_TASK;
+  args.name = name;
+  esp_timer_handle_t timer = nullptr;
+  if (esp_timer_create(&args, &timer) != ESP_OK) {
+    return nullptr;
+  }
+  return timer;
+}
+
+void startTimer(TimerHandle timer, unsigned long delayUs) {
+  esp_timer_handle_t handle = static_cast<esp_timer_handle_t>(timer);
+  esp_timer_stop(handle);  // Fails harmlessly when the timer is not armed
+  esp_timer_start_once(handle, delayUs);
+}
+
+void stopTimer(TimerHandle timer) { esp_timer_stop(static_cast<esp_timer_handle_t>(timer)); }
+
+void restart() { ESP.restart(); }
+
+// The Update library erases each sector just before writing it, so otaBegin() returns at once
+bool otaBegin(uint32_t size) {
+  return Update.begin(size > 0 ? size : UPDATE_SIZE_UNKNOWN, U_FLASH);
+}
+
+bool otaWrite(const uint8_t* data, size_t length) {
+  return Update.write(const_cast<uint8_t*>(data), length) == length;
+}
+
+// true: an image of unknown size ends where the writes ended
+bool otaEnd() { return Update.end(true); }
+
+void otaAbort() { Update.abort(); }
+
+void otaMarkValid() { esp_ota_mark_app_valid_cancel_rollback(); }
+
+bool otaRollback() {
+  // Restarts when the bootloader supports rollback, otherwise the boot partition is switched
+  // back by hand
+  esp_ota_mark_app_invalid_rollback_and_reboot();
+  if (Update.canRollBack() && Update.rollBack()) {
+    ESP.restart();
+  }
+  return false;
+}
+
+void watchTask(unsigned long timeoutMs) {
+  // The Arduino core has already started the task watchdog, this only changes its timeout
+#if ESP_IDF_VERSION_MAJOR >= 5
+  // Keeps watching the idle tasks the sdkconfig asked for, as the IDF 4 call did
+  esp_task_wdt_config_t config = {};
+  config.timeout_ms = timeoutMs;
+#if CONFIG_ESP_TASK_WDT_CHECK_IDLE_TASK_CPU0
+  config.idle_core_mask |= 1 << 0;
+#endif
+#if CONFIG_ESP_TASK_WDT_CHECK_IDLE_TASK_CPU1
+  config.idle_core_mask |= 1 << 1;
+#endif
+  config.trigger_panic = true;
+  if (esp_task_wdt_reconfigure(&config) == ESP_ERR_INVALID_STATE) {
+    esp_task_wdt_init(&config);  // Core built without CONFIG_ESP_TASK_WDT_INIT
+  }
+#else
+  esp_task_wdt_init((timeoutMs + 999) / 1000, true);
+#endif
+  esp_task_wdt_add(nullptr);
+}
+
+void feedWatchdog() { esp_task_wdt_reset(); }
+
+uint32_t freeHeap() { return ESP.getFreeHeap(); }
+
+uint32_t minFreeHeap() { return ESP.getMinFreeHeap(); }
+
+uint32_t largestFreeBlock() { return ESP.getMaxAllocHeap(); }
+
+bool isNetworkConnected() { return WiFi.status() == WL_CONNECTED; }
+
+void reconnectNetwork() { WiFi.reconnect(); }
+
+bool waitForSocketData(int socket, unsigned long timeoutMs) {
+  if (socket < 0) {
+    ::delay(timeoutMs);
+    return false;
+  }
+  fd_set readable;
+  FD_ZERO(&readable);
+  FD_SET(socket, &readable);
+  struct timeval timeout;
+  timeout.tv_sec = timeoutMs / 1000;
+  timeout.tv_usec = (timeoutMs % 1000) * 1000;
+  return lwip_select(socket + 1, &readable, nullptr, nullptr, &timeout) > 0;
+}
+
+bool setLowPowerMode(bool enabled, const uint8_t* wakePins, uint8_t count) {
+  if (fullSpeedMhz == 0) {
+    fullSpeedMhz = ESP.getCpuFreqMHz();  // Before frequency scaling can lower it
+  }
+
+  polledWakePinCount = 0;
+  for (uint8_t i = 0; i < count; i++) {
+    gpio_num_t gpio = (gpio_num_t)wakePins[i];
+    PinInterrupt& pin = pinInterrupts[gpio];
+    if (enabled) {
+      // Light sleep only wakes on a level, so wait for the one the idle sensor is not at
+      int wakeLevel = ::digitalRead(gpio) ? LOW : HIGH;
+      pin.wakeArmed = pin.handler != nullptr;
+      if (pin.handler == nullptr) {
+        polledWakePins[polledWakePinCount++] = {gpio, wakeLevel};
+      }
+      gpio_wakeup_enable(gpio, wakeLevel == LOW ? GPIO_INTR_LOW_LEVEL : GPIO_INTR_HIGH_LEVEL);
+    } else {
+      gpio_wakeup_disable(gpio);
+      if (pin.handler != nullptr) {
+        pin.wakeArmed = false;
+        gpio_set_intr_type(gpio, pin.type);
+      }
+    }
+  }
+  if (enabled) {
+    esp_sleep_enable_gpio_wakeup();
+  }
+
+  // Modem sleep keeps the association, buffered frames are fetched at every DTIM beacon
+  WiFi.setSleep(enabled ? WIFI_PS_MIN_MODEM : WIFI_PS_NONE);
+
+  // Automatic light sleep needs power management and a tickless FreeRTOS idle in the build
+  bool lightSleep = false;
+#if CONFIG_PM_ENABLE && CONFIG_FREERTOS_USE_TICKLESS_IDLE
+#if ESP_IDF_VERSION_MAJOR >= 5
+  esp_pm_config_t config = {};
+#else
+  esp_pm_config_esp32_t config = {};
+#endif
+  config.max_freq_mhz = fullSpeedMhz;
+  config.min_freq_mhz = enabled ? 80 : fullSpeedMhz;  // WiFi needs the 80MHz APB clock
+  config.light_sleep_enable = enabled;
+  lightSleep = esp_pm_configure(&config) == ESP_OK && enabled;
+#endif
+  return lightSleep;
+}
+
+bool takeWakePinActivity() {
+  bool activity = wakePinActivity;
+  wakePinActivity = false;
+  for (uint8_t i = 0; i < polledWakePinCount; i++) {
+    if (::digitalRead(polledWakePins[i].gpio) == polledWakePins[i].level) {
+      gpio_wakeup_disable(polledWakePins[i].gpio);  // Would keep the chip from sleeping
+      polledWakePins[i] = polledWakePins[--polledWakePinCount];
+      activity = true;
+      break;
+    }
+  }
+  return activity;
+}
+
+}  // namespace hal
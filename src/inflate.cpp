@@ -0,0 +1,450 @@
+#include "inflate.h"
+
+// Worst cases, in bits, that must be buffered before a step is decoded
+static const size_t BLOCK_LOOKAHEAD_BITS = 3 + 14 + 19 * 3 + (286 + 30) * 7;  // Dynamic header
+static const size_t SYMBOL_LOOKAHEAD_BITS = 15 + 5 + 15 + 13;  // Length and distance pair
+
+static const uint16_t LENGTH_BASE[29] = {3,  4,  5,  6,  7,  8,  9,  10, 11,  13,
+                                         15, 17, 19, 23, 27, 31, 35, 43, 51,  59,
+                                         67, 83, 99, 115, 131, 163, 195, 227, 258};
+static const uint8_t LENGTH_EXTRA[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2,
+                                         2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+static const uint16_t DISTANCE_BASE[30] = {1,    2,    3,    4,    5,    7,     9,     13,
+                                           17,   25,   33,   49,   65,   97,    129,   193,
+                                           257,  385,  513,  769,  1025, 1537,  2049,  3073,
+                                           4097, 6145, 8193, 12289, 16385, 24577};
+static const uint8_t DISTANCE_EXTRA[30] = {0, 0, 0, 0, 1, 1, 2, 2,  3,  3,  4,  4,  5,  5,  6,
+                                           6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+// Order of the code length code lengths in a dynamic block header
+static const uint8_t CODE_LENGTH_ORDER[19] = {16, 17, 18, 0, 8,  7, 9,  6, 10, 5,
+                                              11, 4,  12, 3, 13, 2, 14, 1, 15};
+
+static const uint32_t ADLER_MOD = 65521;
+
+Inflater::Inflater()
+    : inputStart(0),
+      inputEnd(0),
+      bitBuffer(0),
+      bitCount(0),
+      final(false),
+      stage(STAGE_ERROR),
+      lastBlock(false),
+      storedRemaining(0),
+      window(nullptr),
+      windowMask(0),
+      windowPos(0),
+      flushStart(0),
+      maxWindowBits(0),
+      totalOut(0),
+      flushedOut(0),
+      adler(1),
+      sink(nullptr),
+      sinkContext(nullptr),
+      error("not started") {}
+
+void Inflater::begin(uint8_t* window, uint8_t windowBits, InflateSink sink, void* context) {
+  inputStart = inputEnd = 0;
+  bitBuffer = 0;
+  bitCount = 0;
+  final = false;
+  stage = STAGE_HEADER;
+  lastBlock = false;
+  storedRemaining = 0;
+  this->window = window;
+  windowMask = ((size_t)1 << windowBits) - 1;
+  windowPos = 0;
+  flushStart = 0;
+  maxWindowBits = windowBits;
+  totalOut = 0;
+  flushedOut = 0;
+  adler = 1;
+  this->sink = sink;
+  sinkContext = context;
+  error = nullptr;
+}
+
+void Inflater::fail(const char* message) {
+  if (stage != STAGE_ERROR) {
+    error = message;
+    stage = STAGE_ERROR;
+  }
+}
+
+// At most 16 bits at a time. Running out is only possible after finish(), and means the stream
+// was cut short.
+uint32_t Inflater::bits(uint8_t count) {
+  if (availableBits() < count) {
+    fail("truncated");
+    return 0;
+  }
+  uint32_t value = bitBuffer;
+  while (bitCount < count) {
+    value |= (uint32_t)input[inputStart++] << bitCount;
+    bitCount += 8;
+  }
+  bitBuffer = value >> count;
+  bitCount -= count;
+  return value & ((1UL << count) - 1);
+}
+
+void Inflater::alignToByte() {
+  bitBuffer = 0;
+  bitCount = 0;
+}
+
+// Canonical code, one bit at a time: codes of each length are consecutive integers
+int Inflater::decode(const Huffman& huffman) {
+  int code = 0;
+  int first = 0;
+  int index = 0;
+  for (int length = 1; length <= 15; length++) {
+    code |= bits(1);
+    int count = huffman.count[length];
+    if (code - count < first) {
+      return huffman.symbol[index + (code - first)];
+    }
+    index += count;
+    first = (first + count) << 1;
+    code <<= 1;
+  }
+  return -1;
+}
+
+// Returns 0 for a complete code, > 0 for an incomplete one and < 0 for an over-subscribed one
+int Inflater::build(Huffman& huffman, const uint8_t* lengths, int count) {
+  memset(huffman.count, 0, sizeof(huffman.count));
+  for (int symbol = 0; symbol < count; symbol++) {
+    huffman.count[lengths[symbol]]++;
+  }
+  if (huffman.count[0] == count) {
+    return 0;
+  }
+  int left = 1;
+  for (int length = 1; length <= 15; length++) {
+    left = (left << 1) - huffman.count[length];
+    if (left < 0) {
+      return left;
+    }
+  }
+  uint16_t offsets[16];
+  offsets[1] = 0;
+  for (int length = 1; length < 15; length++) {
+    offsets[length + 1] = offsets[length] + huffman.count[length];
+  }
+  for (int symbol = 0; symbol < count; symbol++) {
+    if (lengths[symbol] != 0) {
+      huffman.symbol[offsets[lengths[symbol]]++] = symbol;
+    }
+  }
+  return left;
+}
+
+void Inflater::buildFixedTables() {
+  uint8_t lengths[288];
+  memset(lengths, 8, 144);
+  memset(lengths + 144, 9, 112);
+  memset(lengths + 256, 7, 24);
+  memset(lengths + 280, 8, 8);
+  build(lengthCode, lengths, 288);
+  memset(lengths, 5, 30);
+  build(distanceCode, lengths, 30);
+}
+
+bool Inflater::readDynamicTables() {
+  uint8_t lengths[286 + 30];
+  int lengthCount = bits(5) + 257;
+  int distanceCount = bits(5) + 1;
+  int codeLengthCount = bits(4) + 4;
+  if (lengthCount > 286 || distanceCount > 30) {
+    fail("bad table counts");
+    return false;
+  }
+
+  memset(lengths, 0, 19);
+  for (int i = 0; i < codeLengthCount; i++) {
+    lengths[CODE_LENGTH_ORDER[i]] = bits(3);
+  }
+  if (build(lengthCode, lengths, 19) != 0) {
+    fail("bad code length code");
+    return false;
+  }
+
+  int index = 0;
+  while (index < lengthCount + distanceCount && stage != STAGE_ERROR) {
+    int symbol = decode(lengthCode);
+    if (symbol < 16) {
+      if (symbol < 0) {
+        fail("bad code length");
+        return false;
+      }
+      lengths[index++] = symbol;
+      continue;
+    }
+    uint8_t value = 0;
+    int repeat;
+    if (symbol == 16) {
+      if (index == 0) {
+        fail("repeat with no first length");
+        return false;
+      }
+      value = lengths[index - 1];
+      repeat = 3 + bits(2);
+    } else if (symbol == 17) {
+      repeat = 3 + bits(3);
+    } else {
+      repeat = 11 + bits(7);
+    }
+    if (index + repeat > lengthCount + distanceCount) {
+      fail("too many lengths");
+      return false;
+    }
+    while (repeat-- > 0) {
+      lengths[index++] = value;
+    }
+  }
+  if (stage == STAGE_ERROR) {
+    return false;
+  }
+  if (lengths[256] == 0) {
+    fail("no end-of-block code");
+    return false;
+  }
+
+  // Only a code with a single symbol may be incomplete
+  int left = build(lengthCode, lengths, lengthCount);
+  if (left < 0 || (left > 0 && lengthCount - lengthCode.count[0] != 1)) {
+    fail("bad literal/length code");
+    return false;
+  }
+  left = build(distanceCode, lengths + lengthCount, distanceCount);
+  if (left < 0 || (left > 0 && distanceCount - distanceCode.count[0] != 1)) {
+    fail("bad distance code");
+    return false;
+  }
+  return true;
+}
+
+void Inflater::put(uint8_t value) {
+  window[windowPos] = value;
+  windowPos = (windowPos + 1) & windowMask;
+  totalOut++;
+  if (windowPos == 0) {
+    flush();
+  }
+}
+
+// Hands everything decoded since the last flush to the sink
+void Inflater::flush() {
+  // put() flushes on every wrap, so the pending bytes never wrap themselves
+  size_t length = (size_t)(totalOut - flushedOut);
+  if (length == 0) {
+    return;
+  }
+  const uint8_t* data = window + flushStart;
+  flushStart = windowPos;
+  flushedOut = totalOut;
+
+  uint32_t a = adler & 0xFFFF;
+  uint32_t b = adler >> 16;
+  for (size_t i = 0; i < length; i++) {
+    a += data[i];
+    if (a >= ADLER_MOD) {
+      a -= ADLER_MOD;
+    }
+    b += a;
+    if (b >= ADLER_MOD) {
+      b -= ADLER_MOD;
+    }
+  }
+  adler = (b << 16) | a;
+  if (!sink(data, length, sinkContext)) {
+    fail("output rejected");
+  }
+}
+
+// One literal, one length/distance copy or the end of the block
+bool Inflater::decodeSymbol() {
+  int symbol = decode(lengthCode);
+  if (symbol < 0 || stage == STAGE_ERROR) {
+    fail("bad literal/length");
+    return false;
+  }
+  if (symbol < 256) {
+    put(symbol);
+    return true;
+  }
+  if (symbol == 256) {
+    stage = lastBlock ? STAGE_TRAILER : STAGE_BLOCK;
+    return true;
+  }
+
+  symbol -= 257;
+  if (symbol >= 29) {
+    fail("bad length");
+    return false;
+  }
+  uint32_t length = LENGTH_BASE[symbol] + bits(LENGTH_EXTRA[symbol]);
+  int distanceSymbol = decode(distanceCode);
+  if (distanceSymbol < 0 || distanceSymbol >= 30) {
+    fail("bad distance");
+    return false;
+  }
+  uint32_t distance = DISTANCE_BASE[distanceSymbol] + bits(DISTANCE_EXTRA[distanceSymbol]);
+  if (distance > totalOut || distance > windowMask + 1) {
+    fail("distance too far back");
+    return false;
+  }
+  while (length-- > 0 && stage != STAGE_ERROR) {
+    put(window[(windowPos - distance) & windowMask]);
+  }
+  return stage != STAGE_ERROR;
+}
+
+void Inflater::run() {
+  for (;;) {
+    switch (stage) {
+      case STAGE_HEADER: {
+        if (!has(16)) {
+          return;
+        }
+        uint32_t cmf = bits(8);
+        uint32_t flg = bits(8);
+        if (stage == STAGE_ERROR || ((cmf << 8) | flg) % 31 != 0 || (cmf & 0x0F) != 8) {
+          fail("not a zlib stream");
+        } else if ((cmf >> 4) + 8 > maxWindowBits) {
+          fail("window too large");
+        } else if (flg & 0x20) {
+          fail("preset dictionary");
+        } else {
+          stage = STAGE_BLOCK;
+        }
+        break;
+      }
+
+      case STAGE_BLOCK: {
+        if (!has(BLOCK_LOOKAHEAD_BITS)) {
+          return;
+        }
+        lastBlock = bits(1);
+        uint32_t type = bits(2);
+        if (stage == STAGE_ERROR) {
+          return;
+        }
+        if (type == 0) {
+          alignToByte();
+          stage = STAGE_STORED_LENGTH;
+        } else if (type == 1) {
+          buildFixedTables();
+          stage = STAGE_CODES;
+        } else if (type == 2) {
+          if (readDynamicTables()) {
+            stage = STAGE_CODES;
+          }
+        } else {
+          fail("bad block type");
+        }
+        break;
+      }
+
+      case STAGE_STORED_LENGTH: {
+        if (!has(32)) {
+          return;
+        }
+        uint32_t length = bits(16);
+        uint32_t complement = bits(16);
+        if (stage == STAGE_ERROR) {
+          return;
+        }
+        if (length != (~complement & 0xFFFF)) {
+          fail("bad stored length");
+          return;
+        }
+        storedRemaining = length;
+        stage = STAGE_STORED;
+        break;
+      }
+
+      case STAGE_STORED:
+        while (storedRemaining > 0 && inputStart < inputEnd && stage != STAGE_ERROR) {
+          put(input[inputStart++]);
+          storedRemaining--;
+        }
+        if (storedRemaining > 0) {
+          if (final) {
+            fail("truncated");
+          }
+          return;
+        }
+        stage = lastBlock ? STAGE_TRAILER : STAGE_BLOCK;
+        break;
+
+      case STAGE_CODES:
+        while (stage == STAGE_CODES && has(SYMBOL_LOOKAHEAD_BITS)) {
+          decodeSymbol();
+        }
+        if (stage == STAGE_CODES) {
+          return;
+        }
+        break;
+
+      case STAGE_TRAILER: {
+        alignToByte();
+        if (!has(32)) {
+          return;
+        }
+        uint32_t expected = bits(8) << 24;
+        expected |= bits(8) << 16;
+        expected |= bits(8) << 8;
+        expected |= bits(8);
+        if (stage == STAGE_ERROR) {
+          return;
+        }
+        flush();
+        if (expected != adler) {
+          fail("adler-32 mismatch");
+          return;
+        }
+        stage = STAGE_DONE;
+        return;
+      }
+
+      case STAGE_DONE:
+      case STAGE_ERROR:
+        return;
+    }
+  }
+}
+
+InflateStatus Inflater::write(const uint8_t* data, size_t length) {
+  while (length > 0 && stage != STAGE_ERROR && stage != STAGE_DONE) {
+    if (inputStart > 0) {
+      memmove(input, input + inputStart, inputEnd - inputStart);
+      inputEnd -= inputStart;
+      inputStart = 0;
+    }
+    size_t copied = length < sizeof(input) - inputEnd ? length : sizeof(input) - inputEnd;
+    memcpy(input + inputEnd, data, copied);
+    inputEnd += copied;
+    data += copied;
+    length -= copied;
+    run();
+  }
+  if (length > 0 && stage == STAGE_DONE) {
+    fail("data after the end of the stream");
+  }
+  if (stage != STAGE_ERROR) {
+    flush();
+  }
+  return stage == STAGE_ERROR ? INFLATE_ERROR : stage == STAGE_DONE ? INFLATE_DONE : INFLATE_OK;
+}
+
+InflateStatus Inflater::finish() {
+  final = true;
+  run();
+  if (stage != STAGE_DONE) {
+    fail("truncated");
+  } else if (inputStart < inputEnd) {
+    fail("data after the end of the stream");
+  }
+  return stage == STAGE_DONE ? INFLATE_DONE : INFLATE_ERROR;
+}
@@ -0,0 +1,89 @@
+#ifndef INFLATE_H
+#define INFLATE_H
+
+#include <Arduino.h>
+
+#define INFLATE_INPUT_SIZE 1024  // Compressed bytes buffered between write() calls
+
+enum InflateStatus { INFLATE_OK, INFLATE_DONE, INFLATE_ERROR };
+
+// Receives decompressed bytes in order. Returning false stops the stream with an error.
+typedef bool (*InflateSink)(const uint8_t* data, size_t length, void* context);
+
+// Streaming zlib (RFC 1950 / 1951) decompressor fed in pieces of any size, for images that
+// arrive a chunk at a time. The caller provides the history window (2^windowBits bytes); a
+// stream whose header asks for a larger window is refused. Input is only decoded once enough of
+// it is buffered for the next step (a dynamic block header, or one length/distance pair), so
+// decoding never has to back out halfway through a symbol; finish() decodes the rest. The
+// Adler-32 trailer is checked. Huffman codes are decoded a bit at a time, which needs no lookup
+// tables and is fast enough for a stream that arrives over WiFi.
+class Inflater {
+ private:
+  struct Huffman {
+    uint16_t count[16];    // Codes of each length
+    uint16_t symbol[288];  // Symbols ordered by code
+  };
+
+  enum Stage {
+    STAGE_HEADER,
+    STAGE_BLOCK,
+    STAGE_STORED_LENGTH,
+    STAGE_STORED,
+    STAGE_CODES,
+    STAGE_TRAILER,
+    STAGE_DONE,
+    STAGE_ERROR
+  };
+
+  uint8_t input[INFLATE_INPUT_SIZE];
+  size_t inputStart;
+  size_t inputEnd;
+  uint32_t bitBuffer;
+  uint8_t bitCount;
+  bool final;
+
+  Stage stage;
+  bool lastBlock;
+  uint16_t storedRemaining;
+  Huffman lengthCode;
+  Huffman distanceCode;
+
+  uint8_t* window;
+  size_t windowMask;
+  size_t windowPos;
+  size_t flushStart;
+  uint8_t maxWindowBits;
+  uint64_t totalOut;
+  uint64_t flushedOut;  // totalOut at the last flush
+  uint32_t adler;
+
+  InflateSink sink;
+  void* sinkContext;
+  const char* error;
+
+  size_t availableBits() const { return bitCount + 8 * (inputEnd - inputStart); }
+  bool has(size_t bits) const { return final || availableBits() >= bits; }
+  uint32_t bits(uint8_t count);
+  void alignToByte();
+  int decode(const Huffman& huffman);
+  static int build(Huffman& huffman, const uint8_t* lengths, int count);
+  bool readDynamicTables();
+  void buildFixedTables();
+  bool decodeSymbol();
+  void put(uint8_t value);
+  void flush();
+  void fail(const char* message);
+  void run();
+
+ public:
+  Inflater();
+
+  void begin(uint8_t* window, uint8_t windowBits, InflateSink sink, void* context);
+  InflateStatus write(const uint8_t* data, size_t length);
+  InflateStatus finish();  // No more input: decodes what is left, the stream must be complete
+
+  uint64_t getTotalOut() const { return totalOut; }
+  const char* getError() const { return error; }
+};
+
+#endif  // INFLATE_H
@@ -0,0 +1,86 @@
+#include "isr_pulse_counter.h"
+#include "hal.h"
+
+IsrPulseCounter::IsrPulseCounter() {
+  count = 0;
+  threshold = 0;
+  thresholdFired = false;
+  spinlock = portMUX_INITIALIZER_UNLOCKED;
+  droppedTimestamps = 0;
+  callback = nullptr;
+  callbackArg = nullptr;
+}
+
+bool IsrPulseCounter::begin(uint8_t pin, ThresholdCallback callback, void* callbackArg) {
+  this->callback = callback;
+  this->callbackArg = callbackArg;
+  hal::pinMode(pin, INPUT_PULLUP);
+  hal::attachInterrupt(pin, onPulse, this, RISING);
+  return true;
+}
+
+void IRAM_ATTR IsrPulseCounter::onPulse(void* arg) {
+  IsrPulseCounter* self = static_cast<IsrPulseCounter*>(arg);
+  bool fire = false;
+
+  if (!self->timestamps.push((uint32_t)hal::micros())) {
+    self->droppedTimestamps++;
+  }
+
+  portENTER_CRITICAL_ISR(&self->spinlock);
+  self->count++;
+  if (self->threshold > 0 && !self->thresholdFired && self->count >= self->threshold) {
+    self->thresholdFired = true;
+    fire = true;
+  }
+  portEXIT_CRITICAL_ISR(&self->spinlock);
+
+  if (fire && self->callback != nullptr) {
+    self->callback(self->callbackArg);
+  }
+}
+
+unsigned long IsrPulseCounter::getCount() {
+  portENTER_CRITICAL(&spinlock);
+  unsigned long value = count;
+  portEXIT_CRITICAL(&spinlock);
+  return value;
+}
+
+bool IsrPulseCounter::readPulseTimestamp(uint32_t& timestampUs) {
+  return timestamps.pop(timestampUs);
+}
+
+void IsrPulseCounter::reset() {
+  portENTER_CRITICAL(&spinlock);
+  count = 0;
+  threshold = 0;
+  thresholdFired = false;
+  portEXIT_CRITICAL(&spinlock);
+}
+
+void IsrPulseCounter::setThreshold(unsigned long count) {
+  bool fire = false;
+
+  portENTER_CRITICAL(&spinlock);
+  threshold = count;
+  thresholdFired = false;
+  // Already past the new threshold - fire right away instead of waiting for another pulse
+  if (threshold > 0 && this->count >= threshold) {
+    thresholdFired = true;
+    fire = true;
+  }
+  portEXIT_CRITICAL(&spinlock);
+
+  if (fire && callback != nullptr) {
+    callback(callbackArg);
+  }
+}
+
+#if !USE_PCNT_PULSE_COUNTER
+PulseCounter& pulseCounterForTap(uint8_t tap) {
+  // Each counter is its interrupt's argument, so a pulse never has to look up its tap
+  static IsrPulseCounter counters[TAP_COUNT];
+  return counters[tap];
+}
+#endif
@@ -0,0 +1,35 @@
+#ifndef ISR_PULSE_COUNTER_H
+#define ISR_PULSE_COUNTER_H
+
+#include "pulse_counter.h"
+#include "spsc_queue.h"
+
+// Counts pulses with a GPIO interrupt on every rising edge.
+// Works on any pin and any board, at the cost of one interrupt per pulse.
+class IsrPulseCounter : public PulseCounter {
+ private:
+  volatile unsigned long count;
+  volatile unsigned long threshold;
+  volatile bool thresholdFired;
+  portMUX_TYPE spinlock;
+
+  // Filled by the ISR, drained by PourSystem - no lock needed on either side
+  SpscQueue<uint32_t, PULSE_TIMESTAMP_BUFFER_SIZE> timestamps;
+  volatile uint32_t droppedTimestamps;
+
+  ThresholdCallback callback;
+  void* callbackArg;
+
+  static void IRAM_ATTR onPulse(void* arg);
+
+ public:
+  IsrPulseCounter();
+  bool begin(uint8_t pin, ThresholdCallback callback, void* callbackArg) override;
+  unsigned long getCount() override;
+  void reset() override;
+  void setThreshold(unsigned long count) override;
+  bool readPulseTimestamp(uint32_t& timestampUs) override;
+  uint32_t getDroppedTimestamps() const override { return droppedTimestamps; }
+};
+
+#endif  // ISR_PULSE_COUNTER_H
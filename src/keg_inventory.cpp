@@ -0,0 +1,260 @@
+#include "keg_inventory.h"
+#include <Preferences.h>
+#include "logger.h"
+
+static const char* PREFS_NAMESPACE = "keg";
+static const uint8_t DEFAULT_ALERT_PCT[] = KEG_ALERT_DEFAULT_PCT;
+static_assert(sizeof(DEFAULT_ALERT_PCT) <= KEG_ALERT_LEVELS, "Too many default keg alerts");
+static_assert(sizeof(KegLevel) == 16, "KegLevel is stored as is");
+
+// Global instance
+KegInventory kegInventory;
+
+// "s<tap>" holds the settings, "l<tap>" the level
+static const char* prefsKey(char type, uint8_t tap, char* buffer, size_t size) {
+  snprintf(buffer, size, "%c%u", type, tap);
+  return buffer;
+}
+
+KegInventory::KegInventory() : count(0), writes(0) { memset(kegs, 0, sizeof(kegs)); }
+
+void KegInventory::begin(uint8_t tapCount) {
+  count = tapCount;
+  memset(kegs, 0, sizeof(kegs));
+  Preferences prefs;
+  bool opened = prefs.begin(PREFS_NAMESPACE, true);
+  for (uint8_t tap = 0; tap < count; tap++) {
+    Keg& keg = kegs[tap];
+    keg.reportedMl = -1;
+    char key[8];
+    if (!opened ||
+        prefs.getBytes(prefsKey('s', tap, key, sizeof(key)), &keg.settings,
+                       sizeof(keg.settings)) != sizeof(keg.settings)) {
+      memset(&keg.settings, 0, sizeof(keg.settings));
+      continue;
+    }
+    if (prefs.getBytes(prefsKey('l', tap, key, sizeof(key)), &keg.level, sizeof(keg.level)) !=
+        sizeof(keg.level)) {
+      memset(&keg.level, 0, sizeof(keg.level));
+      keg.level.averagePourMl = KEG_DEFAULT_POUR_ML;
+    }
+    keg.settings.beerId[KEG_BEER_ID_MAX_LENGTH] = '\0';
+    keg.savedUl = keg.level.dispensedUl;
+    LOG_INFO("🛢️ Tap %u keg '%s': %lu of %lu ml left", tap, keg.settings.beerId,
+             (unsigned long)getRemainingMl(tap), (unsigned long)keg.settings.sizeMl);
+  }
+  if (opened) {
+    prefs.end();
+  }
+}
+
+bool KegInventory::isValidBeerId(const char* beerId) {
+  size_t length = strlen(beerId);
+  if (length > KEG_BEER_ID_MAX_LENGTH) {
+    return false;
+  }
+  for (size_t i = 0; i < length; i++) {
+    if (beerId[i] < 0x20 || beerId[i] > 0x7E || beerId[i] == '"' || beerId[i] == '\\') {
+      return false;
+    }
+  }
+  return true;
+}
+
+const char* KegInventory::setKeg(uint8_t tap, uint32_t sizeMl, const char* beerId,
+                                 uint32_t dispensedMl, const uint8_t* alertPct,
+                                 uint8_t alertCount, uint32_t epochSeconds) {
+  if (tap >= count) {
+    return "tap";
+  }
+  if (sizeMl < MIN_CUP_SIZE || sizeMl > KEG_MAX_SIZE_ML) {
+    return "sizeMl";
+  }
+  if (beerId == nullptr || !isValidBeerId(beerId)) {
+    return "beerId";
+  }
+  if (dispensedMl > sizeMl) {
+    return "dispensedMl";
+  }
+  if (alertCount > KEG_ALERT_LEVELS) {
+    return "alertPct";
+  }
+  for (uint8_t i = 0; i < alertCount; i++) {
+    if (alertPct[i] < 1 || alertPct[i] > 99) {
+      return "alertPct";
+    }
+  }
+
+  Keg& keg = kegs[tap];
+  memset(&keg.settings, 0, sizeof(keg.settings));
+  keg.settings.sizeMl = sizeMl;
+  memcpy(keg.settings.beerId, beerId, strlen(beerId));
+  keg.settings.installedEpoch = epochSeconds;
+  if (alertCount == 0) {
+    alertPct = DEFAULT_ALERT_PCT;
+    alertCount = sizeof(DEFAULT_ALERT_PCT);
+  }
+  // Highest first, so the last level a pour crosses is the lowest
+  for (uint8_t i = 0; i < alertCount; i++) {
+    uint8_t level = alertPct[i];
+    uint8_t position = i;
+    while (position > 0 && keg.settings.alertPct[position - 1] < level) {
+      keg.settings.alertPct[position] = keg.settings.alertPct[position - 1];
+      position--;
+    }
+    keg.settings.alertPct[position] = level;
+  }
+
+  // The pour size estimate carries over, the bar's glasses did not change with the keg
+  uint16_t averagePourMl = keg.level.averagePourMl > 0 ? keg.level.averagePourMl
+                                                       : KEG_DEFAULT_POUR_ML;
+  memset(&keg.level, 0, sizeof(keg.level));
+  keg.level.dispensedUl = (Microlitres)dispensedMl * 1000;
+  keg.level.averagePourMl = averagePourMl;
+  // A part-used keg that is already low has no news to report
+  uint8_t remainingPct = getRemainingPct(tap);
+  for (uint8_t i = 0; i < KEG_ALERT_LEVELS; i++) {
+    if (keg.settings.alertPct[i] > 0 && remainingPct <= keg.settings.alertPct[i]) {
+      keg.level.alertsFired |= 1 << i;
+    }
+  }
+  keg.reportedMl = -1;
+
+  Preferences prefs;
+  char key[8];
+  if (!prefs.begin(PREFS_NAMESPACE, false) ||
+      prefs.putBytes(prefsKey('s', tap, key, sizeof(key)), &keg.settings,
+                     sizeof(keg.settings)) != sizeof(keg.settings)) {
+    prefs.end();
+    LOG_ERROR("❌ Failed to store tap %u keg", tap);
+    return "storage";
+  }
+  prefs.end();
+  saveLevel(tap);
+  LOG_INFO("🛢️ Tap %u keg '%s' set: %lu ml, %lu ml drawn", tap, keg.settings.beerId,
+           (unsigned long)sizeMl, (unsigned long)dispensedMl);
+  return nullptr;
+}
+
+uint8_t KegInventory::recordPour(uint8_t tap, float actualMl, unsigned long nowMillis) {
+  if (tap >= count || !isSet(tap) || actualMl <= 0) {
+    return 0;
+  }
+  Keg& keg = kegs[tap];
+  keg.level.dispensedUl += (Microlitres)(actualMl * 1000.0f + 0.5f);
+  keg.lastPourMillis = nowMillis;
+  // Short draws (a cancelled pour, foam cleared by hand) would drag the estimate down
+  if (actualMl >= MIN_CUP_SIZE) {
+    float average = keg.level.averagePourMl;
+    average += (actualMl - average) * KEG_POUR_AVERAGE_ALPHA;
+    keg.level.averagePourMl = (uint16_t)(average + 0.5f);
+  }
+
+  uint8_t crossed = 0;
+  uint8_t remainingPct = getRemainingPct(tap);
+  for (uint8_t i = 0; i < KEG_ALERT_LEVELS; i++) {
+    uint8_t level = keg.settings.alertPct[i];
+    if (level > 0 && remainingPct <= level && (keg.level.alertsFired & (1 << i)) == 0) {
+      keg.level.alertsFired |= 1 << i;
+      crossed = level;
+    }
+  }
+  return crossed;
+}
+
+bool KegInventory::saveLevel(uint8_t tap) {
+  Keg& keg = kegs[tap];
+  Preferences prefs;
+  char key[8];
+  if (!prefs.begin(PREFS_NAMESPACE, false) ||
+      prefs.putBytes(prefsKey('l', tap, key, sizeof(key)), &keg.level, sizeof(keg.level)) !=
+          sizeof(keg.level)) {
+    prefs.end();
+    LOG_ERROR("❌ Failed to store tap %u keg level", tap);
+    return false;
+  }
+  prefs.end();
+  keg.savedUl = keg.level.dispensedUl;
+  writes++;
+  return true;
+}
+
+void KegInventory::update(unsigned long nowMillis) {
+  for (uint8_t tap = 0; tap < count; tap++) {
+    const Keg& keg = kegs[tap];
+    Microlitres unsaved = keg.level.dispensedUl - keg.savedUl;
+    if (unsaved == 0) {
+      continue;
+    }
+    bool due = nowMillis - keg.lastPourMillis >= KEG_SAVE_DELAY_MS ||
+               unsaved >= (Microlitres)KEG_SAVE_MAX_UNSAVED_ML * 1000;
+    // A failed write is retried once per KEG_SAVE_DELAY_MS
+    if (due && (keg.failedMillis == 0 || nowMillis - keg.failedMillis >= KEG_SAVE_DELAY_MS)) {
+      kegs[tap].failedMillis = saveLevel(tap) ? 0 : (nowMillis != 0 ? nowMillis : 1);
+    }
+  }
+}
+
+void KegInventory::flush() {
+  for (uint8_t tap = 0; tap < count; tap++) {
+    if (kegs[tap].level.dispensedUl != kegs[tap].savedUl) {
+      saveLevel(tap);
+    }
+  }
+}
+
+bool KegInventory::needsReport(uint8_t tap) const {
+  if (tap >= count || !isSet(tap)) {
+    return false;
+  }
+  const Keg& keg = kegs[tap];
+  int32_t remaining = getRemainingMl(tap);
+  return keg.reportedMl < 0 || abs(remaining - keg.reportedMl) >= KEG_REPORT_DELTA_ML ||
+         (remaining == 0 && keg.reportedMl != 0);
+}
+
+void KegInventory::markReported(uint8_t tap) {
+  if (tap < count) {
+    kegs[tap].reportedMl = getRemainingMl(tap);
+  }
+}
+
+float KegInventory::getDispensedMl(uint8_t tap) const {
+  return microlitresToMl(kegs[tap].level.dispensedUl);
+}
+
+uint32_t KegInventory::getRemainingMl(uint8_t tap) const {
+  const Keg& keg = kegs[tap];
+  Microlitres remaining = (Microlitres)keg.settings.sizeMl * 1000 - keg.level.dispensedUl;
+  return remaining > 0 ? (uint32_t)(remaining / 1000) : 0;
+}
+
+uint8_t KegInventory::getRemainingPct(uint8_t tap) const {
+  uint32_t sizeMl = kegs[tap].settings.sizeMl;
+  return sizeMl > 0 ? (uint8_t)((uint64_t)getRemainingMl(tap) * 100 / sizeMl) : 0;
+}
+
+uint32_t KegInventory::getPoursRemaining(uint8_t tap) const {
+  uint16_t averagePourMl = kegs[tap].level.averagePourMl;
+  return averagePourMl > 0 ? getRemainingMl(tap) / averagePourMl : 0;
+}
+
+size_t KegInventory::settingsToJson(uint8_t tap, char* buffer, size_t size) const {
+  const KegSettings& settings = kegs[tap].settings;
+  char levels[KEG_ALERT_LEVELS * 4 + 3] = "[";
+  for (uint8_t i = 0; i < KEG_ALERT_LEVELS && settings.alertPct[i] > 0; i++) {
+    size_t used = strlen(levels);
+    snprintf(levels + used, sizeof(levels) - used, "%s%u", i > 0 ? "," : "",
+             settings.alertPct[i]);
+  }
+  strncat(levels, "]", sizeof(levels) - strlen(levels) - 1);
+
+  int used = snprintf(buffer, size,
+                      "{\"beerId\":\"%s\",\"sizeMl\":%lu,\"alertPct\":%s,\"installed\":%lu}",
+                      settings.beerId, (unsigned long)settings.sizeMl, levels,
+                      (unsigned long)settings.installedEpoch);
+  if (used < 0) {
+    return 0;
+  }
+  return (size_t)used < size ? used : 0;
+}
@@ -0,0 +1,94 @@
+#ifndef KEG_INVENTORY_H
+#define KEG_INVENTORY_H
+
+#include <Arduino.h>
+#include "constants.h"
+#include "volume.h"
+
+// What is connected to a tap, set by the setKeg RPC
+struct KegSettings {
+  uint32_t sizeMl;  // 0 = no keg set, nothing is tracked
+  char beerId[KEG_BEER_ID_MAX_LENGTH + 1];
+  uint8_t alertPct[KEG_ALERT_LEVELS];  // Remaining-level alerts, highest first, 0 = unused
+  uint8_t reserved[1];
+  uint32_t installedEpoch;  // 0 when the clock was not synced
+};
+
+// What has been drawn from it, the part that changes with every pour
+struct KegLevel {
+  Microlitres dispensedUl;
+  uint16_t averagePourMl;  // Running average of full pours, for the pours-remaining estimate
+  uint8_t alertsFired;     // Bit i = alertPct[i] has been reported for this keg
+  uint8_t reserved[5];
+};
+
+// Per-tap keg accounting. Every finished pour adds its measured volume (including what flowed
+// after the valve closed) to the keg's dispensed total, from which the remaining volume, an
+// estimate of the pours left and the low-keg alerts follow.
+//
+// The settings are written to NVS by setKeg() only. The level is a separate 16-byte record,
+// written by update() once the tap has been quiet for KEG_SAVE_DELAY_MS or KEG_SAVE_MAX_UNSAVED_ML
+// has been poured since the last write, so a busy bar costs one small write per lull rather
+// than one per pour; a power cut loses at most that much of the count. Only used from the
+// network task.
+class KegInventory {
+ private:
+  struct Keg {
+    KegSettings settings;
+    KegLevel level;
+    Microlitres savedUl;  // dispensedUl as last written
+    unsigned long lastPourMillis;
+    unsigned long failedMillis;  // Last failed level write, 0 = none pending
+    int32_t reportedMl;  // Remaining volume last reported, -1 = not reported yet
+  };
+
+  Keg kegs[TAP_MAX_COUNT];
+  uint8_t count;
+  uint32_t writes;
+
+  bool saveLevel(uint8_t tap);
+
+ public:
+  KegInventory();
+
+  // Reads the stored kegs of the first tapCount taps
+  void begin(uint8_t tapCount);
+
+  // Connects a new keg, or a part-used one with dispensedMl already drawn. alertPct lists up to
+  // KEG_ALERT_LEVELS remaining percentages in any order, alertCount 0 keeps the defaults.
+  // Returns the first invalid field, "storage" when it could not be written, or nullptr.
+  const char* setKeg(uint8_t tap, uint32_t sizeMl, const char* beerId, uint32_t dispensedMl,
+                     const uint8_t* alertPct, uint8_t alertCount, uint32_t epochSeconds);
+
+  // Adds a finished pour. Returns the alert level this pour crossed (the lowest, when it
+  // crossed several), or 0.
+  uint8_t recordPour(uint8_t tap, float actualMl, unsigned long nowMillis);
+
+  // Writes the levels that have settled. flush() writes every unsaved level, before a restart.
+  void update(unsigned long nowMillis);
+  void flush();
+
+  // True when the remaining volume moved by KEG_REPORT_DELTA_ML or more since the last
+  // markReported(), or was never reported
+  bool needsReport(uint8_t tap) const;
+  void markReported(uint8_t tap);
+
+  bool isSet(uint8_t tap) const { return kegs[tap].settings.sizeMl > 0; }
+  const KegSettings& getSettings(uint8_t tap) const { return kegs[tap].settings; }
+  float getDispensedMl(uint8_t tap) const;
+  uint32_t getRemainingMl(uint8_t tap) const;
+  uint8_t getRemainingPct(uint8_t tap) const;
+  uint32_t getPoursRemaining(uint8_t tap) const;
+
+  uint32_t getWrites() const { return writes; }
+
+  static bool isValidBeerId(const char* beerId);
+
+  // {"beerId":"..","sizeMl":..,"alertPct":[..],"installed":..}
+  size_t settingsToJson(uint8_t tap, char* buffer, size_t size) const;
+};
+
+// Global instance
+extern KegInventory kegInventory;
+
+#endif  // KEG_INVENTORY_H
@@ -1,230 +1,185 @@
 #include "led_controller.h"
+#include "logger.h"
 
-LEDController::LEDController() {
-  // Initialize single LED state
-  led = {LED_SYSTEM_PIN, LED_OFF, false, 0, 0, 0, false};
-  currentState = STATE_BOOTING;
-  priorityState = STATE_BOOTING;
-  priorityStateEnd = 0;
+struct LEDPatternTable {
+  const LEDStep* steps;
+  uint8_t count;
+};
+
+template <size_t N>
+static constexpr LEDPatternTable patternTable(const LEDStep (&steps)[N]) {
+  return {steps, N};
+}
+
+static constexpr uint32_t patternLengthMs(const LEDStep* steps, size_t count) {
+  return count == 0 ? 0 : steps[0].durationMs + patternLengthMs(steps + 1, count - 1);
 }
 
+// Step tables. A pattern starts over after its last step.
+static constexpr LEDStep OFF_STEPS[] = {{LOW, 0}};
+static constexpr LEDStep SOLID_STEPS[] = {{HIGH, 0}};
+static constexpr LEDStep BLINK_SLOW_STEPS[] = {{HIGH, 1000}, {LOW, 1000}};
+static constexpr LEDStep BLINK_FAST_STEPS[] = {{HIGH, 250}, {LOW, 250}};
+static constexpr LEDStep DOUBLE_BLINK_STEPS[] = {{HIGH, 150}, {LOW, 150}, {HIGH, 150}, {LOW, 1000}};
+static constexpr LEDStep TRIPLE_BLINK_STEPS[] = {{HIGH, 150}, {LOW, 150}, {HIGH, 150},
+                                                 {LOW, 150},  {HIGH, 150}, {LOW, 1000}};
+static constexpr LEDStep QUADRUPLE_BLINK_STEPS[] = {{HIGH, 150}, {LOW, 150}, {HIGH, 150},
+                                                    {LOW, 150},  {HIGH, 150}, {LOW, 150},
+                                                    {HIGH, 150}, {LOW, 1000}};
+static constexpr LEDStep PULSE_SLOW_STEPS[] = {{HIGH, 500}, {LOW, 500}};
+static constexpr LEDStep PULSE_FAST_STEPS[] = {{HIGH, 100}, {LOW, 100}};
+static constexpr LEDStep HEARTBEAT_STEPS[] = {{HIGH, 100}, {LOW, 100}, {HIGH, 100}, {LOW, 1500}};
+static constexpr LEDStep SELF_TEST_STEPS[] = {{HIGH, 200}, {LOW, 100}, {HIGH, 200},
+                                              {LOW, 100},  {HIGH, 500}, {LOW, 0}};
+
+static constexpr uint32_t SELF_TEST_DURATION_MS =
+    patternLengthMs(SELF_TEST_STEPS, sizeof(SELF_TEST_STEPS) / sizeof(SELF_TEST_STEPS[0]));
+
+// Indexed by LEDPattern
+static constexpr LEDPatternTable PATTERNS[] = {
+    patternTable(OFF_STEPS),
+    patternTable(SOLID_STEPS),
+    patternTable(BLINK_SLOW_STEPS),
+    patternTable(BLINK_FAST_STEPS),
+    patternTable(DOUBLE_BLINK_STEPS),
+    patternTable(TRIPLE_BLINK_STEPS),
+    patternTable(QUADRUPLE_BLINK_STEPS),
+    patternTable(PULSE_SLOW_STEPS),
+    patternTable(PULSE_FAST_STEPS),
+    patternTable(HEARTBEAT_STEPS),
+    patternTable(SELF_TEST_STEPS),
+};
+static_assert(sizeof(PATTERNS) / sizeof(PATTERNS[0]) == LED_PATTERN_COUNT,
+              "Every LEDPattern needs a step table");
+
+// Indexed by SystemState
+static constexpr LEDPattern STATE_PATTERNS[] = {
+    LED_BLINK_FAST,       // STATE_BOOTING
+    LED_DOUBLE_BLINK,     // STATE_WIFI_PORTAL_ACTIVE - Portal waiting for connection
+    LED_TRIPLE_BLINK,     // STATE_WIFI_PORTAL_CONFIG - User actively configuring
+    LED_BLINK_FAST,       // STATE_WIFI_CONNECTING
+    LED_HEARTBEAT,        // STATE_WIFI_CONNECTED
+    LED_BLINK_SLOW,       // STATE_WIFI_FAILED
+    LED_TRIPLE_BLINK,     // STATE_TB_CONNECTING
+    LED_SOLID,            // STATE_TB_CONNECTED - Solid when fully connected
+    LED_QUADRUPLE_BLINK,  // STATE_TB_FAILED
+    LED_SOLID,            // STATE_SYSTEM_READY
+    LED_PULSE_SLOW,       // STATE_POURING
+    LED_PULSE_FAST,       // STATE_POUR_COMPLETE
+    LED_BLINK_SLOW,       // STATE_ERROR
+    LED_TRIPLE_BLINK,     // STATE_CONFIG_ERROR
+    LED_SELF_TEST,        // STATE_SELF_TEST
+    LED_OFF,              // STATE_OFF
+};
+static_assert(sizeof(STATE_PATTERNS) / sizeof(STATE_PATTERNS[0]) == STATE_COUNT,
+              "Every SystemState needs a pattern");
+
+LEDController::LEDController()
+    : pin(LED_SYSTEM_PIN),
+      timer(nullptr),
+      currentState(STATE_BOOTING),
+      priorityState(STATE_BOOTING),
+      priorityStateEnd(0),
+      generation(0),
+      playedGeneration(0),
+      playedState(STATE_COUNT),
+      step(0),
+      level(false) {}
+
 void LEDController::begin() {
   // Initialize LED pin as output
-  pinMode(led.pin, OUTPUT);
-  digitalWrite(led.pin, LOW);
+  hal::pinMode(pin, OUTPUT);
+  hal::digitalWrite(pin, LOW);
+
+  timer = hal::createTimer(onTimer, this, "led");
+  if (timer == nullptr) {
+    LOG_ERROR("❌ LED timer could not be created - status LED disabled");
+    return;
+  }
 
   // Test pattern on startup
   testPattern();
 }
 
-void LEDController::update() {
-  unsigned long currentTime = millis();
+void LEDController::onTimer(void* arg) { static_cast<LEDController*>(arg)->advance(); }
 
-  // Check if priority state has expired
-  if (priorityStateEnd > 0 && currentTime > priorityStateEnd) {
-    priorityStateEnd = 0;
-    priorityState = currentState;
-  }
+void LEDController::advance() {
+  uint32_t gen = generation.load();
+  unsigned long now = hal::millis();
+  SystemState state = getActiveState(now);
+  const LEDPatternTable& pattern = PATTERNS[STATE_PATTERNS[state]];
 
-  // Use priority state if active, otherwise use current state
-  SystemState activeState = (priorityStateEnd > 0) ? priorityState : currentState;
-  led.pattern = getPatternForState(activeState);
+  if (gen != playedGeneration || state != playedState) {
+    playedGeneration = gen;
+    playedState = state;
+    step = 0;
+  } else {
+    step = (step + 1) % pattern.count;
+  }
+  const LEDStep& current = pattern.steps[step];
+  setLEDState(current.level != LOW);
+
+  // Wake up for the next step or when a temporary state runs out, whichever is first.
+  // A held step with no temporary state leaves the timer idle.
+  unsigned long delayMs = current.durationMs;
+  uint32_t end = priorityStateEnd.load();
+  if (end != 0) {
+    int32_t remaining = (int32_t)(end - (uint32_t)now);
+    unsigned long untilEnd = remaining > 0 ? (unsigned long)remaining : 1;
+    if (delayMs == 0 || untilEnd < delayMs) {
+      delayMs = untilEnd;
+    }
+  }
+  if (delayMs > 0) {
+    hal::startTimer(timer, delayMs * 1000UL);
+  }
 
-  // Update LED pattern
-  updateLEDPattern();
+  // A state change that raced with this callback may have had its restart overwritten above
+  if (generation.load() != gen) {
+    hal::startTimer(timer, 0);
+  }
 }
 
-void LEDController::updateLEDPattern() {
-  unsigned long currentTime = millis();
-
-  switch (led.pattern) {
-    case LED_OFF:
-      setLEDState(false);
-      break;
-
-    case LED_SOLID:
-      setLEDState(true);
-      break;
-
-    case LED_BLINK_SLOW:
-      if (currentTime - led.lastUpdate >= 1000) {
-        led.isOn = !led.isOn;
-        setLEDState(led.isOn);
-        led.lastUpdate = currentTime;
-      }
-      break;
-
-    case LED_BLINK_FAST:
-      if (currentTime - led.lastUpdate >= 250) {
-        led.isOn = !led.isOn;
-        setLEDState(led.isOn);
-        led.lastUpdate = currentTime;
-      }
-      break;
-
-    case LED_DOUBLE_BLINK:
-      if (currentTime - led.lastUpdate >= 150) {
-        if (led.blinkCount < 4) {  // 2 blinks = 4 state changes
-          led.isOn = !led.isOn;
-          setLEDState(led.isOn);
-          led.blinkCount++;
-        } else {
-          // Pause between double blinks
-          if (currentTime - led.lastUpdate >= 1000) {
-            led.blinkCount = 0;
-            led.isOn = false;
-            setLEDState(false);
-          }
-        }
-        led.lastUpdate = currentTime;
-      }
-      break;
-
-    case LED_TRIPLE_BLINK:
-      if (currentTime - led.lastUpdate >= 150) {
-        if (led.blinkCount < 6) {  // 3 blinks = 6 state changes
-          led.isOn = !led.isOn;
-          setLEDState(led.isOn);
-          led.blinkCount++;
-        } else {
-          // Pause between triple blinks
-          if (currentTime - led.lastUpdate >= 1000) {
-            led.blinkCount = 0;
-            led.isOn = false;
-            setLEDState(false);
-          }
-        }
-        led.lastUpdate = currentTime;
-      }
-      break;
-
-    case LED_QUADRUPLE_BLINK:
-      if (currentTime - led.lastUpdate >= 150) {
-        if (led.blinkCount < 8) {  // 4 blinks = 8 state changes
-          led.isOn = !led.isOn;
-          setLEDState(led.isOn);
-          led.blinkCount++;
-        } else {
-          // Pause between quadruple blinks
-          if (currentTime - led.lastUpdate >= 1000) {
-            led.blinkCount = 0;
-            led.isOn = false;
-            setLEDState(false);
-          }
-        }
-        led.lastUpdate = currentTime;
-      }
-      break;
-
-    case LED_PULSE_SLOW:
-      if (currentTime - led.lastUpdate >= 500) {
-        led.isOn = !led.isOn;
-        setLEDState(led.isOn);
-        led.lastUpdate = currentTime;
-      }
-      break;
-
-    case LED_PULSE_FAST:
-      if (currentTime - led.lastUpdate >= 100) {
-        led.isOn = !led.isOn;
-        setLEDState(led.isOn);
-        led.lastUpdate = currentTime;
-      }
-      break;
-
-    case LED_HEARTBEAT:
-      // Heartbeat pattern: quick double pulse then pause
-      if (currentTime - led.lastUpdate >= 100) {
-        if (led.blinkCount < 4) {  // 2 quick pulses
-          led.isOn = !led.isOn;
-          setLEDState(led.isOn);
-          led.blinkCount++;
-        } else {
-          // Long pause between heartbeats
-          if (currentTime - led.lastUpdate >= 1500) {
-            led.blinkCount = 0;
-            led.isOn = false;
-            setLEDState(false);
-          }
-        }
-        led.lastUpdate = currentTime;
-      }
-      break;
+SystemState LEDController::getActiveState(unsigned long now) {
+  uint32_t end = priorityStateEnd.load();
+  if (end != 0) {
+    if ((int32_t)(end - (uint32_t)now) > 0) {
+      return (SystemState)priorityState.load();
+    }
+    // Expired. Leaves a temporary state set since the load above in place.
+    priorityStateEnd.compare_exchange_strong(end, 0);
   }
+  return (SystemState)currentState.load();
 }
 
-void LEDController::setLEDState(bool on) {
-  if (led.state != on) {
-    led.state = on;
-    digitalWrite(led.pin, on ? HIGH : LOW);
+void LEDController::restartPattern() {
+  generation.fetch_add(1);
+  if (timer != nullptr) {
+    hal::startTimer(timer, 0);
   }
 }
 
-LEDPattern LEDController::getPatternForState(SystemState state) {
-  switch (state) {
-    case STATE_BOOTING:
-      return LED_BLINK_FAST;
-    case STATE_WIFI_PORTAL_ACTIVE:
-      return LED_DOUBLE_BLINK;  // Portal waiting for connection
-    case STATE_WIFI_PORTAL_CONFIG:
-      return LED_TRIPLE_BLINK;  // User actively configuring
-    case STATE_WIFI_CONNECTING:
-      return LED_BLINK_FAST;  // Fast blink during connection
-    case STATE_WIFI_CONNECTED:
-      return LED_HEARTBEAT;  // Heartbeat when connected
-    case STATE_WIFI_FAILED:
-      return LED_BLINK_SLOW;  // Slow blink for failed connection
-    case STATE_TB_CONNECTING:
-      return LED_TRIPLE_BLINK;  // ThingsBoard connecting
-    case STATE_TB_CONNECTED:
-      return LED_SOLID;  // Solid when fully connected
-    case STATE_TB_FAILED:
-      return LED_QUADRUPLE_BLINK;  // 4 blinks for TB failure
-    case STATE_SYSTEM_READY:
-      return LED_SOLID;  // Solid when ready
-    case STATE_POURING:
-      return LED_PULSE_SLOW;  // Slow pulse during pour
-    case STATE_POUR_COMPLETE:
-      return LED_PULSE_FAST;  // Fast pulse when complete
-    case STATE_ERROR:
-      return LED_BLINK_SLOW;  // Slow blink for errors
-    case STATE_CONFIG_ERROR:
-      return LED_TRIPLE_BLINK;  // Triple blink for config errors
-    default:
-      return LED_OFF;
+void LEDController::setLEDState(bool on) {
+  if (level != on) {
+    level = on;
+    hal::digitalWrite(pin, on ? HIGH : LOW);
   }
 }
 
 void LEDController::setState(SystemState state) {
-  currentState = state;
-  led.lastUpdate = millis();
-  led.blinkCount = 0;
+  // Callers re-assert their state every loop; only a change restarts the pattern
+  if (currentState.exchange(state) != state) {
+    restartPattern();
+  }
 }
 
 void LEDController::setTemporaryState(SystemState state, unsigned long durationMs) {
-  priorityState = state;
-  priorityStateEnd = millis() + durationMs;
-  led.lastUpdate = millis();
-  led.blinkCount = 0;
+  priorityState.store(state);
+  uint32_t end = (uint32_t)(hal::millis() + durationMs);
+  priorityStateEnd.store(end != 0 ? end : 1);  // 0 means no temporary state
+  restartPattern();
 }
 
-void LEDController::setOff() {
-  setState(STATE_BOOTING);  // Will result in LED_OFF pattern
-  led.pattern = LED_OFF;
-  setLEDState(false);
-}
+void LEDController::setOff() { setState(STATE_OFF); }
 
-void LEDController::testPattern() {
-  // Quick test pattern on startup
-  setLEDState(true);
-  delay(200);
-  setLEDState(false);
-  delay(100);
-  setLEDState(true);
-  delay(200);
-  setLEDState(false);
-  delay(100);
-  setLEDState(true);
-  delay(500);
-  setLEDState(false);
-}
\ No newline at end of file
+void LEDController::testPattern() { setTemporaryState(STATE_SELF_TEST, SELF_TEST_DURATION_MS); }
@@ -2,7 +2,9 @@
 #define LED_CONTROLLER_H
 
 #include <Arduino.h>
+#include <atomic>
 #include "constants.h"
+#include "hal.h"
 
 // LED patterns for different system states
 enum LEDPattern {
@@ -15,7 +17,9 @@ enum LEDPattern {
   LED_QUADRUPLE_BLINK,  // Quadruple blink pattern - ThingsBoard issues
   LED_PULSE_SLOW,       // Slow pulse - Pour in progress
   LED_PULSE_FAST,       // Fast pulse - Pour complete
-  LED_HEARTBEAT         // Heartbeat pattern - Normal operation
+  LED_HEARTBEAT,        // Heartbeat pattern - Normal operation
+  LED_SELF_TEST,        // Two short flashes and a long one - Startup LED test
+  LED_PATTERN_COUNT
 };
 
 // System states for LED indication
@@ -33,38 +37,51 @@ enum SystemState {
   STATE_POURING,             // Pour in progress
   STATE_POUR_COMPLETE,       // Pour completed
   STATE_ERROR,               // System error
-  STATE_CONFIG_ERROR         // Configuration error
+  STATE_CONFIG_ERROR,        // Configuration error
+  STATE_SELF_TEST,           // Startup LED test
+  STATE_OFF,                 // LED switched off
+  STATE_COUNT
 };
 
+// One step of a pattern: hold the LED at level for durationMs. A duration of 0 holds the
+// level until the state changes.
+struct LEDStep {
+  uint8_t level;
+  uint16_t durationMs;
+};
+
+// Plays the pattern of the active state from a one-shot HAL timer. Each timer callback
+// writes one step and arms the timer for the next, so patterns keep their timing however
+// long the network task blocks and nothing has to be polled from a loop. setState() and
+// setTemporaryState() may be called from any task.
 class LEDController {
  private:
-  struct LEDState {
-    uint8_t pin;
-    LEDPattern pattern;
-    bool state;
-    unsigned long lastUpdate;
-    uint8_t blinkCount;
-    uint8_t maxBlinks;
-    bool isOn;
-  };
+  uint8_t pin;
+  hal::TimerHandle timer;
+  std::atomic<uint8_t> currentState;
+  std::atomic<uint8_t> priorityState;      // For temporary high-priority states
+  std::atomic<uint32_t> priorityStateEnd;  // millis() when it expires, 0 when none is active
+  std::atomic<uint32_t> generation;        // Bumped on every state change to restart a pattern
 
-  LEDState led;  // Single LED
-  SystemState currentState;
-  SystemState priorityState;  // For temporary high-priority states
-  unsigned long priorityStateEnd;
+  // Only touched from the timer callback
+  uint32_t playedGeneration;
+  uint8_t playedState;
+  uint8_t step;
+  bool level;
 
-  void updateLEDPattern();
+  static void onTimer(void* arg);
+  void advance();
+  SystemState getActiveState(unsigned long now);
+  void restartPattern();
   void setLEDState(bool on);
-  LEDPattern getPatternForState(SystemState state);
 
  public:
   LEDController();
   void begin();
-  void update();
   void setState(SystemState state);
   void setTemporaryState(SystemState state, unsigned long durationMs);
   void setOff();
-  void testPattern();  // Test LED
+  void testPattern();  // Play the startup test pattern without blocking
 };
 
-#endif  // LED_CONTROLLER_H
\ No newline at end of file
+#endif  // LED_CONTROLLER_H
@@ -0,0 +1,192 @@
+#include "local_endpoint.h"
+#include <Preferences.h>
+#include "logger.h"
+
+static const char* PREFS_NAMESPACE = "local";
+static const char* PREFS_COUNTER_KEY = "counter";
+static const char* HEX_DIGITS = "0123456789abcdef";
+
+// Global instance
+LocalEndpoint localEndpoint;
+
+LocalEndpoint::LocalEndpoint() : keyLength(0), lastCounter(0), savedCounter(0) {
+  memset(key, 0, sizeof(key));
+}
+
+bool LocalEndpoint::begin(const char* secret) {
+  size_t length = strlen(secret);
+  if (length < LOCAL_KEY_MIN_LENGTH || length > LOCAL_KEY_MAX_LENGTH) {
+    LOG_WARN("⚠️ LAN pour endpoint disabled: key must be %d-%d characters", LOCAL_KEY_MIN_LENGTH,
+             LOCAL_KEY_MAX_LENGTH);
+    keyLength = 0;
+    return false;
+  }
+  memcpy(key, secret, length);
+  keyLength = length;
+
+  lastCounter = 0;
+  Preferences prefs;
+  if (prefs.begin(PREFS_NAMESPACE, true)) {
+    uint64_t stored = 0;
+    if (prefs.getBytes(PREFS_COUNTER_KEY, &stored, sizeof(stored)) == sizeof(stored)) {
+      lastCounter = stored;
+    }
+    prefs.end();
+  }
+  savedCounter = lastCounter;
+  return true;
+}
+
+void LocalEndpoint::saveCounter() {
+  Preferences prefs;
+  if (!prefs.begin(PREFS_NAMESPACE, false)) {
+    LOG_ERROR("❌ Failed to store LAN request counter");
+    return;
+  }
+  prefs.putBytes(PREFS_COUNTER_KEY, &savedCounter, sizeof(savedCounter));
+  prefs.end();
+}
+
+static int hexValue(char c) {
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  }
+  if (c >= 'a' && c <= 'f') {
+    return c - 'a' + 10;
+  }
+  return -1;
+}
+
+static bool parseCommandType(const char* name, LocalCommandType& type) {
+  for (int i = LOCAL_POUR; i <= LOCAL_CALIBRATE; i++) {
+    if (strcmp(name, localCommandName((LocalCommandType)i)) == 0) {
+      type = (LocalCommandType)i;
+      return true;
+    }
+  }
+  return false;
+}
+
+LocalRequestStatus LocalEndpoint::parse(const char* datagram, size_t length,
+                                        LocalCommand& command) {
+  while (length > 0 && (datagram[length - 1] == '\n' || datagram[length - 1] == '\r')) {
+    length--;
+  }
+  if (!isEnabled() || length == 0 || length > LOCAL_DATAGRAM_MAX) {
+    return LOCAL_MALFORMED;
+  }
+  char text[LOCAL_DATAGRAM_MAX + 1];
+  memcpy(text, datagram, length);
+  text[length] = '\0';
+
+  // Authenticate before looking at anything else
+  char* macText = strrchr(text, ' ');
+  if (macText == nullptr || strlen(macText + 1) != SHA256_DIGEST_SIZE * 2) {
+    return LOCAL_MALFORMED;
+  }
+  *macText++ = '\0';
+  uint8_t expected[SHA256_DIGEST_SIZE];
+  hmacSha256(key, keyLength, text, strlen(text), expected);
+  uint8_t difference = 0;  // Compared in constant time
+  for (int i = 0; i < SHA256_DIGEST_SIZE; i++) {
+    int high = hexValue(macText[i * 2]);
+    int low = hexValue(macText[i * 2 + 1]);
+    if (high < 0 || low < 0) {
+      return LOCAL_MALFORMED;
+    }
+    difference |= expected[i] ^ (uint8_t)((high << 4) | low);
+  }
+  if (difference != 0) {
+    return LOCAL_BAD_MAC;
+  }
+
+  char* tokens[5];
+  size_t count = 0;
+  char* rest = nullptr;
+  for (char* token = strtok_r(text, " ", &rest); token != nullptr;
+       token = strtok_r(nullptr, " ", &rest)) {
+    if (count == 5) {
+      return LOCAL_MALFORMED;
+    }
+    tokens[count++] = token;
+  }
+  if (count < 4) {
+    return LOCAL_MALFORMED;
+  }
+
+  char* end;
+  command.counter = strtoull(tokens[0], &end, 10);
+  if (*end != '\0' || !parseCommandType(tokens[1], command.type)) {
+    return LOCAL_MALFORMED;
+  }
+  unsigned long tap = strtoul(tokens[2], &end, 10);
+  if (*end != '\0' || tap > 0xFF) {
+    return LOCAL_MALFORMED;
+  }
+  command.tap = (uint8_t)tap;
+  command.value = strtof(tokens[3], &end);
+  if (*end != '\0') {
+    return LOCAL_MALFORMED;
+  }
+  command.orderId[0] = '\0';
+  if (count == 5) {
+    if (strlen(tokens[4]) > ORDER_ID_MAX_LENGTH) {
+      return LOCAL_MALFORMED;
+    }
+    snprintf(command.orderId, sizeof(command.orderId), "%s", tokens[4]);
+  }
+
+  if (command.counter <= lastCounter) {
+    return LOCAL_REPLAYED;
+  }
+  lastCounter = command.counter;
+  if (lastCounter >= savedCounter) {
+    // One NVS write per LOCAL_COUNTER_RESERVE counters, not per request
+    savedCounter = lastCounter + LOCAL_COUNTER_RESERVE;
+    saveCounter();
+  }
+  return LOCAL_ACCEPTED;
+}
+
+size_t LocalEndpoint::sign(const char* message, char* buffer, size_t size) const {
+  size_t length = strlen(message);
+  if (length + 1 + SHA256_DIGEST_SIZE * 2 >= size) {
+    return 0;
+  }
+  uint8_t mac[SHA256_DIGEST_SIZE];
+  hmacSha256(key, keyLength, message, length, mac);
+
+  memmove(buffer, message, length);
+  char* out = buffer + length;
+  *out++ = ' ';
+  for (int i = 0; i < SHA256_DIGEST_SIZE; i++) {
+    *out++ = HEX_DIGITS[mac[i] >> 4];
+    *out++ = HEX_DIGITS[mac[i] & 0x0F];
+  }
+  *out = '\0';
+  return out - buffer;
+}
+
+const char* localCommandName(LocalCommandType type) {
+  switch (type) {
+    case LOCAL_POUR:
+      return "pour";
+    case LOCAL_STOP:
+      return "stop";
+    default:
+      return "calibrate";
+  }
+}
+
+const char* localRequestStatusName(LocalRequestStatus status) {
+  switch (status) {
+    case LOCAL_ACCEPTED:
+      return "accepted";
+    case LOCAL_MALFORMED:
+      return "malformed";
+    case LOCAL_BAD_MAC:
+      return "badMac";
+    default:
+      return "replayed";
+  }
+}
@@ -0,0 +1,71 @@
+#ifndef LOCAL_ENDPOINT_H
+#define LOCAL_ENDPOINT_H
+
+#include <Arduino.h>
+#include "constants.h"
+#include "sha256.h"
+
+enum LocalCommandType {
+  LOCAL_POUR,       // value = cup size in ml, like setCupSize
+  LOCAL_STOP,       // Like stopPour
+  LOCAL_CALIBRATE   // value = ml per pulse, like setMlPerPulse
+};
+
+enum LocalRequestStatus {
+  LOCAL_ACCEPTED,
+  LOCAL_MALFORMED,  // Not "<counter> <command> <tap> <value> [orderId] <mac>"
+  LOCAL_BAD_MAC,    // Wrong key or altered in transit
+  LOCAL_REPLAYED    // Counter not above the last accepted one
+};
+
+struct LocalCommand {
+  uint64_t counter;
+  LocalCommandType type;
+  uint8_t tap;
+  float value;
+  char orderId[ORDER_ID_MAX_LENGTH + 1];  // Empty when not given
+};
+
+// Authenticates pour commands sent over the LAN, so a kiosk on the same network can start a pour
+// without the ThingsBoard round-trip and keeps pouring while the internet is down. A request is
+// one line of text:
+//
+//   <counter> <command> <tap> <value> [orderId] <mac>
+//
+// command is pour, stop or calibrate, and mac is the lowercase hex HMAC-SHA256 of everything
+// before the last space, keyed with LOCAL_ENDPOINT_KEY from config.h. The counter must increase
+// with every request (Unix time in ms works). It is checked in RAM; NVS holds a high-water mark
+// LOCAL_COUNTER_RESERVE above an accepted counter and is only rewritten once a counter reaches
+// it. After a restart everything up to the mark counts as used, so a captured request cannot be
+// replayed, and a kiosk counting in ms only has to wait a second. Replies are signed the same
+// way. This class only parses and checks, the sketch owns the UDP socket and runs accepted
+// commands through the RPC handlers.
+class LocalEndpoint {
+ private:
+  uint8_t key[LOCAL_KEY_MAX_LENGTH];
+  size_t keyLength;
+  uint64_t lastCounter;
+  uint64_t savedCounter;  // High-water mark in NVS, lastCounter never passes it unsaved
+
+  void saveCounter();
+
+ public:
+  LocalEndpoint();
+
+  // A key shorter than LOCAL_KEY_MIN_LENGTH leaves the endpoint disabled
+  bool begin(const char* key);
+  bool isEnabled() const { return keyLength > 0; }
+
+  LocalRequestStatus parse(const char* datagram, size_t length, LocalCommand& command);
+
+  // Writes "<message> <mac>" to buffer, returns its length or 0 if it did not fit
+  size_t sign(const char* message, char* buffer, size_t size) const;
+};
+
+const char* localCommandName(LocalCommandType type);
+const char* localRequestStatusName(LocalRequestStatus status);
+
+// Global instance
+extern LocalEndpoint localEndpoint;
+
+#endif  // LOCAL_ENDPOINT_H
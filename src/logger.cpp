@@ -0,0 +1,117 @@
+#include "logger.h"
+#include "hal.h"
+
+static_assert((LOG_QUEUE_SLOTS & (LOG_QUEUE_SLOTS - 1)) == 0,
+              "LOG_QUEUE_SLOTS must be a power of two");
+
+// Global instance
+Logger logger;
+
+Logger::Logger() : writeIndex(0), readIndex(0), dropped(0) {
+  for (uint32_t i = 0; i < LOG_QUEUE_SLOTS; i++) {
+    slots[i].sequence.store(i);
+    slots[i].isrFormat = nullptr;
+  }
+}
+
+// Bounded MPMC ring (one sequence number per slot): a slot whose sequence equals the write
+// index is free for that index, index + 1 means written and ready to drain. Draining hands it
+// back as index + LOG_QUEUE_SLOTS for the next lap.
+IRAM_ATTR Logger::Slot* Logger::claim() {
+  uint32_t index = writeIndex.load(std::memory_order_relaxed);
+  for (;;) {
+    Slot* slot = &slots[index & (LOG_QUEUE_SLOTS - 1)];
+    int32_t lag = (int32_t)(slot->sequence.load(std::memory_order_acquire) - index);
+    if (lag == 0) {
+      if (writeIndex.compare_exchange_weak(index, index + 1, std::memory_order_relaxed)) {
+        return slot;
+      }
+      // Lost the race, index now holds the current write index
+    } else if (lag < 0) {
+      dropped.fetch_add(1, std::memory_order_relaxed);  // Full, the drain task is behind
+      return nullptr;
+    } else {
+      index = writeIndex.load(std::memory_order_relaxed);
+    }
+  }
+}
+
+IRAM_ATTR void Logger::publish(Slot* slot) {
+  uint32_t index = slot->sequence.load(std::memory_order_relaxed);
+  slot->sequence.store(index + 1, std::memory_order_release);
+}
+
+void Logger::write(uint8_t level, const char* format, ...) {
+  va_list args;
+  va_start(args, format);
+  vwrite(level, format, args);
+  va_end(args);
+}
+
+void Logger::vwrite(uint8_t level, const char* format, va_list args) {
+  Slot* slot = claim();
+  if (slot == nullptr) {
+    return;
+  }
+  slot->millis = hal::millis();
+  slot->level = level;
+  slot->isrFormat = nullptr;
+  vsnprintf(slot->text, sizeof(slot->text), format, args);
+  publish(slot);
+}
+
+void IRAM_ATTR Logger::writeFromIsr(uint8_t level, const char* format, uint32_t value) {
+  Slot* slot = claim();
+  if (slot == nullptr) {
+    return;
+  }
+  slot->millis = hal::millis();
+  slot->level = level;
+  slot->isrFormat = format;
+  slot->isrValue = value;
+  publish(slot);
+}
+
+static char levelLetter(uint8_t level) {
+  switch (level) {
+    case LOG_LEVEL_ERROR:
+      return 'E';
+    case LOG_LEVEL_WARN:
+      return 'W';
+    case LOG_LEVEL_INFO:
+      return 'I';
+    default:
+      return 'D';
+  }
+}
+
+size_t Logger::drain(size_t maxLines) {
+  size_t lines = 0;
+  char line[LOG_LINE_MAX + 24];
+  while (lines < maxLines) {
+    Slot& slot = slots[readIndex & (LOG_QUEUE_SLOTS - 1)];
+    if (slot.sequence.load(std::memory_order_acquire) != readIndex + 1) {
+      break;  // Next line not written yet
+    }
+
+    int prefix = snprintf(line, sizeof(line), "[%lu.%03lu] %c ", (unsigned long)slot.millis / 1000,
+                          (unsigned long)slot.millis % 1000, levelLetter(slot.level));
+    if (slot.isrFormat != nullptr) {
+      snprintf(line + prefix, sizeof(line) - prefix, slot.isrFormat, (unsigned long)slot.isrValue);
+    } else {
+      snprintf(line + prefix, sizeof(line) - prefix, "%s", slot.text);
+    }
+    slot.sequence.store(readIndex + LOG_QUEUE_SLOTS, std::memory_order_release);
+    readIndex++;
+
+    Serial.println(line);
+    lines++;
+  }
+
+  uint32_t lost = dropped.exchange(0);
+  if (lost > 0) {
+    snprintf(line, sizeof(line), "⚠️ %lu log lines dropped", (unsigned long)lost);
+    Serial.println(line);
+  }
+  return lines;
+}
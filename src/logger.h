@@ -0,0 +1,82 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <Arduino.h>
+#include <stdarg.h>
+#include <atomic>
+#include "constants.h"
+
+// Log levels, lower is more severe
+#define LOG_LEVEL_NONE 0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_INFO 3
+#define LOG_LEVEL_DEBUG 4
+
+// Calls above LOG_LEVEL compile to nothing, arguments included
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+#define LOG_AT(level, ...)              \
+  do {                                  \
+    if ((level) <= LOG_LEVEL) {         \
+      logger.write(level, __VA_ARGS__); \
+    }                                   \
+  } while (0)
+
+#define LOG_ERROR(...) LOG_AT(LOG_LEVEL_ERROR, __VA_ARGS__)
+#define LOG_WARN(...) LOG_AT(LOG_LEVEL_WARN, __VA_ARGS__)
+#define LOG_INFO(...) LOG_AT(LOG_LEVEL_INFO, __VA_ARGS__)
+#define LOG_DEBUG(...) LOG_AT(LOG_LEVEL_DEBUG, __VA_ARGS__)
+
+// From interrupt context: format must be a string literal with at most one %lu conversion.
+// Nothing is formatted in the ISR, the drain task does that.
+#define LOG_ISR(level, format, value)                        \
+  do {                                                       \
+    if ((level) <= LOG_LEVEL) {                              \
+      logger.writeFromIsr(level, format, (uint32_t)(value)); \
+    }                                                        \
+  } while (0)
+
+// Log lines from any task or ISR, queued in a fixed ring of LOG_QUEUE_SLOTS lines and written
+// to Serial by a low-priority task that calls drain(). A log call formats into its own slot
+// and never allocates or waits for the UART; when the ring is full the line is dropped and
+// counted. Producers claim slots with a compare-and-swap, so any number of tasks and ISRs may
+// log at once while one task drains.
+class Logger {
+ private:
+  struct Slot {
+    std::atomic<uint32_t> sequence;  // Slot state, see Logger::write()
+    uint32_t millis;
+    uint8_t level;
+    const char* isrFormat;  // Set for lines from writeFromIsr(), text is formatted on drain
+    uint32_t isrValue;
+    char text[LOG_LINE_MAX];
+  };
+
+  Slot slots[LOG_QUEUE_SLOTS];
+  std::atomic<uint32_t> writeIndex;
+  uint32_t readIndex;  // Only touched by the draining task
+  std::atomic<uint32_t> dropped;
+
+  Slot* claim();
+  void publish(Slot* slot);
+
+ public:
+  Logger();
+
+  void write(uint8_t level, const char* format, ...) __attribute__((format(printf, 3, 4)));
+  void vwrite(uint8_t level, const char* format, va_list args);
+  void IRAM_ATTR writeFromIsr(uint8_t level, const char* format, uint32_t value);
+
+  // Drain task side. Writes queued lines to Serial, at most maxLines, and returns how many.
+  size_t drain(size_t maxLines = LOG_QUEUE_SLOTS);
+
+  uint32_t getDropped() const { return dropped.load(); }
+};
+
+// Global instance
+extern Logger logger;
+
+#endif  // LOGGER_H
@@ -1,4 +1,6 @@
 #include "network_manager.h"
+#include "hal.h"
+#include "logger.h"
 
 // ThingsBoard functions will be called from main file
 
@@ -8,18 +10,18 @@ ThingsBoardNetworkManager networkManager;
 ThingsBoardNetworkManager::ThingsBoardNetworkManager() { lastWifiConnected = false; }
 
 void ThingsBoardNetworkManager::init() {
-  Serial.println("Status: Connecting to WiFi");
+  LOG_INFO("Status: Connecting to WiFi");
   // ThingsBoard.connect will be called from main file
 }
 
 void ThingsBoardNetworkManager::handleWifiStatusChange() {
-  bool wifiConnected = (WiFi.status() == WL_CONNECTED);
+  bool wifiConnected = hal::isNetworkConnected();
   if (wifiConnected != lastWifiConnected) {
     if (wifiConnected) {
-      Serial.println("WiFi connection established");
+      LOG_INFO("WiFi connection established");
     } else {
-      Serial.println("WiFi connection failed - attempting reconnect");
-      WiFi.reconnect();
+      LOG_WARN("WiFi connection failed - attempting reconnect");
+      hal::reconnectNetwork();
     }
     lastWifiConnected = wifiConnected;
   }
@@ -2,7 +2,6 @@
 #define NETWORK_MANAGER_H
 
 #include <Arduino.h>
-#include <WiFi.h>
 #include "constants.h"
 
 // Forward declarations for ThingsBoard - actual includes will be in main file
@@ -0,0 +1,211 @@
+#include "order_queue.h"
+#include "tap_controller.h"
+
+// Global instances, one per tap
+OrderQueue orderQueues[TAP_COUNT];
+
+OrderQueue::OrderQueue()
+    : head(0),
+      count(0),
+      hasActive(false),
+      activeStarted(false),
+      dispatchedMillis(0),
+      cupPending(false),
+      confirmRequired(false),
+      cupConfirmed(false),
+      finishedMillis(0),
+      recentNext(0) {
+  memset(orders, 0, sizeof(orders));
+  memset(&active, 0, sizeof(active));
+  memset(recentIds, 0, sizeof(recentIds));
+}
+
+// Ids end up in telemetry JSON unescaped, so only plain printable characters are accepted
+bool OrderQueue::isValidId(const char* id) {
+  size_t length = strlen(id);
+  if (length > ORDER_ID_MAX_LENGTH) {
+    return false;
+  }
+  for (size_t i = 0; i < length; i++) {
+    if (id[i] < 0x20 || id[i] > 0x7E || id[i] == '"' || id[i] == '\\') {
+      return false;
+    }
+  }
+  return true;
+}
+
+const PourOrder& OrderQueue::at(uint8_t position) const {
+  return orders[(head + position) % ORDER_QUEUE_CAPACITY];
+}
+
+bool OrderQueue::isRecent(const char* id) const {
+  for (uint8_t i = 0; i < ORDER_RECENT_IDS; i++) {
+    if (strcmp(recentIds[i], id) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void OrderQueue::remember(const char* id) {
+  if (id[0] == '\0') {
+    return;
+  }
+  snprintf(recentIds[recentNext], sizeof(recentIds[recentNext]), "%s", id);
+  recentNext = (recentNext + 1) % ORDER_RECENT_IDS;
+}
+
+OrderAdmission OrderQueue::enqueue(const char* id, int cupSizeMl, unsigned long now,
+                                   float mlPerPulse, bool waitForCup) {
+  if (cupSizeMl < MIN_CUP_SIZE || cupSizeMl > MAX_CUP_SIZE || !isValidId(id)) {
+    return ORDER_INVALID;
+  }
+  if (mlPerPulse != 0 && (mlPerPulse < MIN_ML_PER_PULSE || mlPerPulse > MAX_ML_PER_PULSE)) {
+    return ORDER_INVALID;
+  }
+  uint8_t position;
+  if (id[0] != '\0' && getStatus(id, position) != ORDER_STATUS_UNKNOWN) {
+    return ORDER_DUPLICATE;
+  }
+  if (count >= ORDER_QUEUE_CAPACITY) {
+    return ORDER_QUEUE_FULL;
+  }
+
+  PourOrder& order = orders[(head + count) % ORDER_QUEUE_CAPACITY];
+  snprintf(order.id, sizeof(order.id), "%s", id);
+  order.cupSizeMl = cupSizeMl;
+  order.mlPerPulse = mlPerPulse;
+  order.waitForCup = waitForCup;
+  order.queuedMillis = now;
+  count++;
+  return ORDER_ACCEPTED;
+}
+
+OrderStatus OrderQueue::getStatus(const char* id, uint8_t& position) const {
+  position = 0;
+  if (hasActive && strcmp(active.id, id) == 0) {
+    return ORDER_STATUS_POURING;
+  }
+  for (uint8_t i = 0; i < count; i++) {
+    if (strcmp(at(i).id, id) == 0) {
+      position = i + 1;
+      return ORDER_STATUS_QUEUED;
+    }
+  }
+  return isRecent(id) ? ORDER_STATUS_DONE : ORDER_STATUS_UNKNOWN;
+}
+
+const PourOrder* OrderQueue::getDue(unsigned long now) const {
+  if (hasActive || count == 0) {
+    return nullptr;
+  }
+  if (cupPending &&
+      (confirmRequired || ORDER_CUP_SWAP_MS == 0 || now - finishedMillis < ORDER_CUP_SWAP_MS)) {
+    return nullptr;
+  }
+  if (orders[head].waitForCup && !cupConfirmed) {
+    return nullptr;
+  }
+  return &orders[head];
+}
+
+void OrderQueue::markDispatched(unsigned long now) {
+  if (getDue(now) == nullptr) {
+    return;
+  }
+  active = orders[head];
+  head = (head + 1) % ORDER_QUEUE_CAPACITY;
+  count--;
+  hasActive = true;
+  activeStarted = false;
+  cupPending = false;
+  cupConfirmed = false;
+  dispatchedMillis = now;
+}
+
+void OrderQueue::onPourStarted() {
+  if (hasActive) {
+    activeStarted = true;
+  }
+}
+
+void OrderQueue::complete(float actualMl, StopReason reason, unsigned long now,
+                          OrderCompletion& completion) {
+  completion.order = active;
+  completion.actualMl = actualMl;
+  completion.reason = reason;
+  completion.waitMs = dispatchedMillis - active.queuedMillis;
+  completion.totalMs = now - active.queuedMillis;
+
+  remember(active.id);
+  hasActive = false;
+  activeStarted = false;
+  cupPending = true;
+  cupConfirmed = false;
+  confirmRequired = reason != STOP_TARGET_REACHED;
+  finishedMillis = now;
+}
+
+bool OrderQueue::onPourComplete(float actualMl, StopReason reason, unsigned long now,
+                                OrderCompletion& completion) {
+  if (!hasActive || (!activeStarted && reason != STOP_EMERGENCY)) {
+    return false;
+  }
+  complete(actualMl, reason, now, completion);
+  return true;
+}
+
+bool OrderQueue::checkStartTimeout(unsigned long now, OrderCompletion& completion) {
+  if (!hasActive || activeStarted || now - dispatchedMillis < ORDER_START_TIMEOUT_MS) {
+    return false;
+  }
+  complete(0, STOP_NONE, now, completion);
+  return true;
+}
+
+void OrderQueue::confirmCup() {
+  if (!hasActive) {
+    cupPending = false;
+    cupConfirmed = true;
+  }
+}
+
+uint8_t OrderQueue::clearWaiting() {
+  uint8_t dropped = count;
+  head = 0;
+  count = 0;
+  return dropped;
+}
+
+unsigned long OrderQueue::getOldestWaitMs(unsigned long now) const {
+  return count > 0 ? now - at(0).queuedMillis : 0;
+}
+
+size_t OrderQueue::completionToJson(const OrderCompletion& completion, uint8_t tap, char* buffer,
+                                    size_t size) {
+  char suffix[8];
+  const char* s = tapKeySuffix(tap, suffix, sizeof(suffix));
+  int used = snprintf(buffer, size,
+                      "{\"orderId%s\":\"%s\",\"orderCupMl%s\":%d,\"orderActualMl%s\":%.1f,"
+                      "\"orderStopReason%s\":\"%s\",\"orderWaitMs%s\":%lu,\"orderTotalMs%s\":%lu}",
+                      s, completion.order.id, s, completion.order.cupSizeMl, s,
+                      completion.actualMl, s, stopReasonName(completion.reason), s,
+                      completion.waitMs, s, completion.totalMs);
+  if (used < 0) {
+    return 0;
+  }
+  return (size_t)used < size ? used : 0;
+}
+
+const char* orderStatusName(OrderStatus status) {
+  switch (status) {
+    case ORDER_STATUS_QUEUED:
+      return "queued";
+    case ORDER_STATUS_POURING:
+      return "pouring";
+    case ORDER_STATUS_DONE:
+      return "done";
+    default:
+      return "unknown";
+  }
+}
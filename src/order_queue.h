@@ -0,0 +1,120 @@
+#ifndef ORDER_QUEUE_H
+#define ORDER_QUEUE_H
+
+#include <Arduino.h>
+#include "constants.h"
+#include "pour_recorder.h"
+
+// One paid cup
+struct PourOrder {
+  char id[ORDER_ID_MAX_LENGTH + 1];  // Empty for an order sent without an id
+  int cupSizeMl;
+  float mlPerPulse;  // Calibration for this pour only, 0 keeps the tap's own
+  bool waitForCup;   // Starts only once confirmCup() reports a cup under the tap
+  unsigned long queuedMillis;
+};
+
+enum OrderAdmission {
+  ORDER_ACCEPTED,
+  ORDER_DUPLICATE,   // Id already queued, pouring or recently finished - not poured again
+  ORDER_QUEUE_FULL,  // ORDER_QUEUE_CAPACITY orders waiting
+  ORDER_INVALID      // Cup size or calibration out of range, or unusable id
+};
+
+enum OrderStatus {
+  ORDER_STATUS_QUEUED,
+  ORDER_STATUS_POURING,  // Handed to the tap, pour running or about to start
+  ORDER_STATUS_DONE,     // Among the last ORDER_RECENT_IDS finished orders
+  ORDER_STATUS_UNKNOWN
+};
+
+// A finished order, for telemetry
+struct OrderCompletion {
+  PourOrder order;
+  float actualMl;
+  StopReason reason;      // STOP_NONE when the pour never started
+  unsigned long waitMs;   // Queued until handed to the tap
+  unsigned long totalMs;  // Queued until the pour finished
+};
+
+// Pour orders waiting for one tap, served first in first out with one pour each. The next
+// order is handed out once the previous pour has finished and the cup has been swapped:
+// ORDER_CUP_SWAP_MS after a pour that reached its target, or when confirmCup() is called. A
+// pour ended by a safety check or by hand always waits for confirmCup(), so nobody pours into
+// a cup that was never put back, and so does an order placed with waitForCup. Ids that are
+// queued, pouring or among the last ORDER_RECENT_IDS finished orders are rejected, which makes
+// webhook retries harmless. Only used from the network task.
+class OrderQueue {
+ private:
+  PourOrder orders[ORDER_QUEUE_CAPACITY];  // Ring buffer
+  uint8_t head;
+  uint8_t count;
+
+  // Order handed to the tap
+  PourOrder active;
+  bool hasActive;
+  bool activeStarted;
+  unsigned long dispatchedMillis;
+
+  // Between two pours
+  bool cupPending;       // Last pour finished, cup not swapped yet
+  bool confirmRequired;  // Only confirmCup() releases the next order
+  bool cupConfirmed;     // confirmCup() since the last pour, releases a waitForCup order
+  unsigned long finishedMillis;
+
+  char recentIds[ORDER_RECENT_IDS][ORDER_ID_MAX_LENGTH + 1];
+  uint8_t recentNext;
+
+  const PourOrder& at(uint8_t position) const;
+  bool isRecent(const char* id) const;
+  void remember(const char* id);
+  void complete(float actualMl, StopReason reason, unsigned long now,
+                OrderCompletion& completion);
+
+ public:
+  OrderQueue();
+
+  OrderAdmission enqueue(const char* id, int cupSizeMl, unsigned long now, float mlPerPulse = 0,
+                         bool waitForCup = false);
+  OrderStatus getStatus(const char* id, uint8_t& position) const;  // position 1 = next
+
+  // The order whose pour should start now, nullptr if none. Once its cup size has been handed
+  // to the control task, markDispatched() makes it the active order until its pour completes.
+  const PourOrder* getDue(unsigned long now) const;
+  void markDispatched(unsigned long now);
+
+  // Pour events of this tap. A pour the queue did not start completes no order, except an
+  // emergency stop, which also cancels a dispatched pour before its valve opens.
+  void onPourStarted();
+  bool onPourComplete(float actualMl, StopReason reason, unsigned long now,
+                      OrderCompletion& completion);
+
+  // Closes an active order whose pour did not start within ORDER_START_TIMEOUT_MS
+  bool checkStartTimeout(unsigned long now, OrderCompletion& completion);
+
+  // A fresh cup is under the tap: releases the next order after a pour, or one that waits for
+  // its cup. Ignored while a pour is running.
+  void confirmCup();
+
+  // Drops every order not yet handed to the tap, returns how many
+  uint8_t clearWaiting();
+
+  uint8_t getDepth() const { return count; }
+  bool isBusy() const { return hasActive; }
+  unsigned long getOldestWaitMs(unsigned long now) const;
+
+  // Printable ASCII up to ORDER_ID_MAX_LENGTH, without quotes or backslashes
+  static bool isValidId(const char* id);
+
+  // {"orderId<tap>":"..","orderCupMl<tap>":..,"orderActualMl<tap>":..,
+  //  "orderStopReason<tap>":"..","orderWaitMs<tap>":..,"orderTotalMs<tap>":..}
+  static size_t completionToJson(const OrderCompletion& completion, uint8_t tap, char* buffer,
+                                 size_t size);
+};
+
+const char* orderStatusName(OrderStatus status);
+
+// Global instances, one per tap
+extern OrderQueue orderQueues[TAP_COUNT];
+
+#endif  // ORDER_QUEUE_H
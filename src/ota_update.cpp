@@ -0,0 +1,328 @@
+#include "ota_update.h"
+#include <Preferences.h>
+#include "hal.h"
+#include "logger.h"
+
+static const char* PREFS_NAMESPACE = "ota";
+static const char* PREFS_RECORD_KEY = "record";
+static const uint8_t IMAGE_MAGIC = 0xE9;  // First byte of every ESP32 app image
+static const char* FW_STATE_NAMES[FW_STATE_COUNT] = {"DOWNLOADING", "DOWNLOADED", "VERIFIED",
+                                                     "UPDATING",    "UPDATED",    "FAILED"};
+
+// Global instance
+OtaUpdate otaUpdate;
+
+static int hexValue(char c) {
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  }
+  if (c >= 'a' && c <= 'f') {
+    return c - 'a' + 10;
+  }
+  if (c >= 'A' && c <= 'F') {
+    return c - 'A' + 10;
+  }
+  return -1;
+}
+
+static bool parseDigest(const char* hex, uint8_t digest[SHA256_DIGEST_SIZE]) {
+  if (hex == nullptr || strlen(hex) != 2 * SHA256_DIGEST_SIZE) {
+    return false;
+  }
+  for (size_t i = 0; i < SHA256_DIGEST_SIZE; i++) {
+    int high = hexValue(hex[2 * i]);
+    int low = hexValue(hex[2 * i + 1]);
+    if (high < 0 || low < 0) {
+      return false;
+    }
+    digest[i] = (high << 4) | low;
+  }
+  return true;
+}
+
+static void copyVersion(char* destination, const char* source) {
+  snprintf(destination, OTA_VERSION_MAX_LENGTH + 1, "%s", source);
+}
+
+OtaUpdate::OtaUpdate()
+    : state(OTA_IDLE),
+      bootMillis(0),
+      size(0),
+      received(0),
+      compressed(false),
+      writing(false),
+      window(nullptr),
+      failures(0),
+      lastFailureMillis(0),
+      pendingReports(0),
+      error(nullptr) {
+  runningVersion[0] = '\0';
+  version[0] = '\0';
+  memset(&record, 0, sizeof(record));
+  memset(expectedDigest, 0, sizeof(expectedDigest));
+}
+
+void OtaUpdate::begin(const char* running, unsigned long nowMillis) {
+  release();
+  state = OTA_IDLE;
+  pendingReports = 0;
+  error = nullptr;
+  version[0] = '\0';
+  copyVersion(runningVersion, running);
+  bootMillis = nowMillis;
+
+  Preferences prefs;
+  memset(&record, 0, sizeof(record));
+  if (prefs.begin(PREFS_NAMESPACE, true)) {
+    if (prefs.getBytes(PREFS_RECORD_KEY, &record, sizeof(record)) != sizeof(record)) {
+      memset(&record, 0, sizeof(record));
+    }
+    prefs.end();
+  }
+  record.target[OTA_VERSION_MAX_LENGTH] = '\0';
+  record.failed[OTA_VERSION_MAX_LENGTH] = '\0';
+  if (record.target[0] == '\0') {
+    return;
+  }
+
+  copyVersion(version, record.target);
+  if (strcmp(record.target, runningVersion) != 0) {
+    // The previous image is back, rolled back by us or by the bootloader
+    LOG_ERROR("❌ Firmware %s was rolled back, running %s", record.target, runningVersion);
+    copyVersion(record.failed, record.target);
+    record.target[0] = '\0';
+    record.bootAttempts = 0;
+    saveRecord();
+    fail("rolled back");
+    return;
+  }
+
+  record.bootAttempts++;
+  saveRecord();
+  if (record.bootAttempts > OTA_MAX_BOOT_ATTEMPTS) {
+    rollback("restarts before the health check");
+    return;
+  }
+  state = OTA_VERIFYING;
+  LOG_INFO("🆕 Firmware %s running unconfirmed, boot %u", runningVersion, record.bootAttempts);
+}
+
+void OtaUpdate::offer(const char* title, const char* offered, uint32_t offeredSize,
+                      const char* checksum, const char* algorithm) {
+  if (title == nullptr || strcmp(title, FIRMWARE_TITLE) != 0 || offered == nullptr ||
+      offered[0] == '\0') {
+    return;
+  }
+  if (strlen(offered) > OTA_VERSION_MAX_LENGTH || strcmp(offered, runningVersion) == 0 ||
+      state == OTA_INSTALLED || state == OTA_VERIFYING) {
+    return;
+  }
+  if (strcmp(offered, record.failed) == 0) {
+    LOG_WARN("⚠️ Firmware %s was rolled back before, not installing it again", offered);
+    return;
+  }
+  if (state == OTA_DOWNLOADING && strcmp(offered, version) == 0) {
+    return;  // Same package announced again
+  }
+
+  release();
+  state = OTA_IDLE;
+  copyVersion(version, offered);
+  if (algorithm == nullptr || strcasecmp(algorithm, "SHA256") != 0) {
+    fail("unsupported checksum algorithm");
+    return;
+  }
+  if (!parseDigest(checksum, expectedDigest)) {
+    fail("bad checksum");
+    return;
+  }
+  if (offeredSize == 0 || offeredSize > OTA_MAX_IMAGE_SIZE) {
+    fail("bad size");
+    return;
+  }
+
+  size = offeredSize;
+  received = 0;
+  sha.begin();
+  failures = 0;
+  error = nullptr;
+  state = OTA_DOWNLOADING;
+  pendingReports &= ~(1 << FW_FAILED);
+  report(FW_DOWNLOADING);
+  LOG_INFO("📦 Firmware %s offered, %lu bytes", version, (unsigned long)size);
+}
+
+bool OtaUpdate::nextChunk(bool busy, unsigned long nowMillis, uint32_t& index,
+                          uint32_t& length) {
+  if (state != OTA_DOWNLOADING || busy ||
+      (failures > 0 && nowMillis - lastFailureMillis < OTA_RETRY_DELAY_MS)) {
+    return false;
+  }
+  index = received / OTA_CHUNK_SIZE;
+  length = size - received < OTA_CHUNK_SIZE ? size - received : OTA_CHUNK_SIZE;
+  return true;
+}
+
+void OtaUpdate::onChunkFailed(unsigned long nowMillis) {
+  if (state != OTA_DOWNLOADING) {
+    return;
+  }
+  lastFailureMillis = nowMillis;
+  if (++failures > OTA_CHUNK_RETRIES) {
+    fail("download failed");
+    return;
+  }
+  LOG_WARN("⚠️ Firmware chunk %lu failed, retry %u", (unsigned long)(received / OTA_CHUNK_SIZE),
+           failures);
+}
+
+bool OtaUpdate::writeImage(const uint8_t* data, size_t length, void* context) {
+  return hal::otaWrite(data, length);
+}
+
+void OtaUpdate::onChunk(const uint8_t* data, size_t length, unsigned long nowMillis) {
+  if (state != OTA_DOWNLOADING) {
+    return;
+  }
+  uint32_t expected = size - received < OTA_CHUNK_SIZE ? size - received : OTA_CHUNK_SIZE;
+  if (length != expected) {
+    onChunkFailed(nowMillis);
+    return;
+  }
+
+  if (received == 0) {
+    compressed = data[0] != IMAGE_MAGIC;
+    if (!hal::otaBegin(compressed ? 0 : size)) {
+      fail("no update partition");
+      return;
+    }
+    writing = true;
+    if (compressed) {
+      window = (uint8_t*)malloc(1 << OTA_INFLATE_WINDOW_BITS);
+      if (window == nullptr) {
+        fail("out of memory");
+        return;
+      }
+      inflater.begin(window, OTA_INFLATE_WINDOW_BITS, writeImage, nullptr);
+    }
+  }
+
+  sha.update(data, length);
+  received += length;
+  failures = 0;
+  if (compressed) {
+    if (inflater.write(data, length) == INFLATE_ERROR) {
+      fail(inflater.getError());
+      return;
+    }
+  } else if (!hal::otaWrite(data, length)) {
+    fail("flash write failed");
+    return;
+  }
+  if (received == size) {
+    finishDownload();
+  }
+}
+
+void OtaUpdate::finishDownload() {
+  if (compressed && inflater.finish() != INFLATE_DONE) {
+    fail(inflater.getError());
+    return;
+  }
+  report(FW_DOWNLOADED);
+
+  uint8_t digest[SHA256_DIGEST_SIZE];
+  sha.finish(digest);
+  if (memcmp(digest, expectedDigest, SHA256_DIGEST_SIZE) != 0) {
+    fail("checksum mismatch");
+    return;
+  }
+  report(FW_VERIFIED);
+
+  writing = false;
+  if (!hal::otaEnd()) {
+    fail("image rejected");
+    return;
+  }
+  release();
+  copyVersion(record.target, version);
+  record.bootAttempts = 0;
+  saveRecord();
+  state = OTA_INSTALLED;
+  report(FW_UPDATING);
+  LOG_INFO("✅ Firmware %s installed, restarting once the taps are idle", version);
+}
+
+void OtaUpdate::checkHealth(bool healthy, unsigned long nowMillis) {
+  if (state != OTA_VERIFYING) {
+    return;
+  }
+  if (healthy) {
+    hal::otaMarkValid();
+    record.target[0] = '\0';
+    record.failed[0] = '\0';
+    record.bootAttempts = 0;
+    saveRecord();
+    state = OTA_IDLE;
+    report(FW_UPDATED);
+    LOG_INFO("✅ Firmware %s confirmed", runningVersion);
+  } else if (nowMillis - bootMillis >= OTA_HEALTH_TIMEOUT_MS) {
+    rollback("no connection to ThingsBoard");
+  }
+}
+
+// The previous image reports the failure once it is running again
+void OtaUpdate::rollback(const char* reason) {
+  LOG_ERROR("❌ Firmware %s failed its health check (%s), rolling back", runningVersion, reason);
+  state = OTA_IDLE;
+  if (!hal::otaRollback()) {
+    // Nothing to go back to, this image has to do
+    hal::otaMarkValid();
+    record.target[0] = '\0';
+    record.bootAttempts = 0;
+    saveRecord();
+    fail("rollback failed");
+  }
+}
+
+FwState OtaUpdate::getReportState() const {
+  for (uint8_t fwState = 0; fwState < FW_STATE_COUNT; fwState++) {
+    if (pendingReports & (1 << fwState)) {
+      return (FwState)fwState;
+    }
+  }
+  return FW_FAILED;
+}
+
+const char* OtaUpdate::fwStateName(FwState fwState) {
+  return fwState < FW_STATE_COUNT ? FW_STATE_NAMES[fwState] : "UNKNOWN";
+}
+
+void OtaUpdate::report(FwState fwState) { pendingReports |= 1 << fwState; }
+
+void OtaUpdate::fail(const char* message) {
+  LOG_ERROR("❌ Firmware %s update failed: %s", version, message);
+  release();
+  state = OTA_IDLE;
+  error = message;
+  report(FW_FAILED);
+}
+
+// Frees what only a download needs and drops a partly written image
+void OtaUpdate::release() {
+  if (writing) {
+    hal::otaAbort();
+    writing = false;
+  }
+  free(window);
+  window = nullptr;
+}
+
+void OtaUpdate::saveRecord() {
+  Preferences prefs;
+  if (!prefs.begin(PREFS_NAMESPACE, false) ||
+      prefs.putBytes(PREFS_RECORD_KEY, &record, sizeof(record)) != sizeof(record)) {
+    LOG_ERROR("❌ Failed to store the firmware update record");
+  }
+  prefs.end();
+}
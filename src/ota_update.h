@@ -0,0 +1,122 @@
+#ifndef OTA_UPDATE_H
+#define OTA_UPDATE_H
+
+#include <Arduino.h>
+#include "constants.h"
+#include "inflate.h"
+#include "sha256.h"
+
+enum OtaState {
+  OTA_IDLE,
+  OTA_DOWNLOADING,  // Fetching chunks whenever the taps are idle
+  OTA_INSTALLED,    // Verified and selected for the next boot, restarts once the taps are idle
+  OTA_VERIFYING     // Running a new image that has not passed its health check yet
+};
+
+// Progress as reported to ThingsBoard in fw_state, in the order an update goes through them
+enum FwState {
+  FW_DOWNLOADING,
+  FW_DOWNLOADED,
+  FW_VERIFIED,
+  FW_UPDATING,
+  FW_UPDATED,
+  FW_FAILED,
+  FW_STATE_COUNT
+};
+
+// Firmware update from a ThingsBoard OTA package. offer() takes the fw_* shared attributes; the
+// caller then fetches the chunks nextChunk() asks for and hands them to onChunk(). Nothing is
+// fetched or written while busy (a pour, an order or a calibration run): flash writes stall the
+// control task's core, so the download pauses between chunks and resumes once the taps are idle.
+//
+// The package may be a plain ESP32 image or a zlib stream of one (images start with 0xE9, zlib
+// streams never do). Compressed images are inflated on the fly into the inactive app partition.
+// fw_checksum is the SHA-256 of the package as uploaded; a mismatch drops the written image
+// before it can be selected for boot.
+//
+// A new image runs unconfirmed until checkHealth() sees it reach ThingsBoard. If it does not
+// within OTA_HEALTH_TIMEOUT_MS, or keeps restarting before it can, the previous image is booted
+// again, which reports the update FAILED and will not take the same version again. Only used
+// from the network task.
+class OtaUpdate {
+ private:
+  // Survives the restart into the new image, "ota" namespace in NVS
+  struct Record {
+    char target[OTA_VERSION_MAX_LENGTH + 1];  // Installed, not confirmed yet, empty = none
+    char failed[OTA_VERSION_MAX_LENGTH + 1];  // Rolled back, not taken again
+    uint8_t bootAttempts;
+    uint8_t reserved[3];
+  };
+
+  OtaState state;
+  char runningVersion[OTA_VERSION_MAX_LENGTH + 1];
+  Record record;
+  unsigned long bootMillis;
+
+  char version[OTA_VERSION_MAX_LENGTH + 1];  // Being downloaded
+  uint32_t size;
+  uint32_t received;
+  uint8_t expectedDigest[SHA256_DIGEST_SIZE];
+  Sha256 sha;
+  bool compressed;
+  bool writing;  // hal::otaBegin() called
+  uint8_t* window;
+  Inflater inflater;
+  uint8_t failures;  // Failed requests for the current chunk
+  unsigned long lastFailureMillis;
+
+  uint8_t pendingReports;  // Bit per FwState
+  const char* error;
+
+  static bool writeImage(const uint8_t* data, size_t length, void* context);
+  void saveRecord();
+  void report(FwState fwState);
+  void fail(const char* message);
+  void release();
+  void finishDownload();
+  void rollback(const char* reason);
+
+ public:
+  OtaUpdate();
+
+  // Checks how the last update went: the first boots of a new image start its health check, a
+  // previous image running in its place reports the update FAILED
+  void begin(const char* runningVersion, unsigned long nowMillis);
+
+  // The fw_* attributes. A package for another title, the running version or a version that
+  // was rolled back is ignored; a new one replaces a download in progress.
+  void offer(const char* title, const char* version, uint32_t size, const char* checksum,
+             const char* algorithm);
+
+  // The chunk to fetch now, false when none: nothing to download, busy, or waiting before a
+  // retry. Chunks are OTA_CHUNK_SIZE bytes, the last one shorter.
+  bool nextChunk(bool busy, unsigned long nowMillis, uint32_t& index, uint32_t& length);
+  void onChunk(const uint8_t* data, size_t length, unsigned long nowMillis);
+  void onChunkFailed(unsigned long nowMillis);
+
+  // The installed image is waiting for the restart, which is up to the caller
+  bool shouldRestart(bool busy) const { return state == OTA_INSTALLED && !busy; }
+
+  // While verifying, healthy = connected to ThingsBoard: keeps the image, or rolls back once
+  // OTA_HEALTH_TIMEOUT_MS has passed without it
+  void checkHealth(bool healthy, unsigned long nowMillis);
+
+  // fw_state reports still to send, oldest first
+  bool needsReport() const { return pendingReports != 0; }
+  FwState getReportState() const;
+  void markReported(FwState fwState) { pendingReports &= ~(1 << fwState); }
+
+  OtaState getState() const { return state; }
+  const char* getRunningVersion() const { return runningVersion; }
+  const char* getVersion() const { return version; }
+  uint32_t getSize() const { return size; }
+  uint32_t getReceived() const { return received; }
+  const char* getError() const { return error; }  // Of the last FAILED, nullptr before
+
+  static const char* fwStateName(FwState fwState);
+};
+
+// Global instance
+extern OtaUpdate otaUpdate;
+
+#endif  // OTA_UPDATE_H
@@ -0,0 +1,107 @@
+#include "overshoot_model.h"
+#include "config_store.h"
+#include "logger.h"
+
+OvershootModel::OvershootModel() : tap(0) { reset(); }
+
+void OvershootModel::begin(uint8_t tap) {
+  this->tap = tap;
+  load();
+}
+
+void OvershootModel::reset() {
+  for (int i = 0; i < OVERSHOOT_RATE_BINS; i++) {
+    bins[i].pulses = 0;
+    bins[i].samples = 0;
+  }
+  latencyMs = 0;
+  totalSamples = 0;
+  lastOvershootPulses = 0;
+}
+
+int OvershootModel::binForRate(float ratePps) const {
+  if (ratePps <= 0) {
+    return 0;
+  }
+  int bin = (int)(ratePps / OVERSHOOT_BIN_WIDTH_PPS);
+  return bin >= OVERSHOOT_RATE_BINS ? OVERSHOOT_RATE_BINS - 1 : bin;
+}
+
+float OvershootModel::predictPulses(float ratePps) const {
+  const OvershootRateBin& bin = bins[binForRate(ratePps)];
+  if (bin.samples > 0) {
+    return bin.pulses;
+  }
+
+  // No pour at this flow rate yet - fall back to the learned latency, which scales
+  // with flow rate and is shared by all bins
+  return ratePps * latencyMs / 1000.0;
+}
+
+void OvershootModel::record(float ratePps, unsigned long overshootPulses) {
+  if (overshootPulses > OVERSHOOT_MAX_SAMPLE_PULSES) {
+    LOG_WARN("⚠️ Overshoot sample ignored: %lu pulses", overshootPulses);
+    return;
+  }
+
+  lastOvershootPulses = overshootPulses;
+
+  // First sample seeds the average so the model converges from the first pour
+  OvershootRateBin& bin = bins[binForRate(ratePps)];
+  if (bin.samples == 0) {
+    bin.pulses = overshootPulses;
+  } else {
+    bin.pulses += OVERSHOOT_EWMA_ALPHA * (overshootPulses - bin.pulses);
+  }
+  if (bin.samples < UINT16_MAX) {
+    bin.samples++;
+  }
+
+  if (ratePps > 0) {
+    float sampleLatencyMs = overshootPulses * 1000.0 / ratePps;
+    if (totalSamples == 0) {
+      latencyMs = sampleLatencyMs;
+    } else {
+      latencyMs += OVERSHOOT_EWMA_ALPHA * (sampleLatencyMs - latencyMs);
+    }
+  }
+  totalSamples++;
+
+  save();
+}
+
+void OvershootModel::load() {
+  OvershootState state;
+  if (!configStore.getOvershootModel(tap, state)) {
+    LOG_INFO("ℹ️ No stored overshoot model for tap %u, starting fresh", tap);
+    return;
+  }
+
+  memcpy(bins, state.bins, sizeof(bins));
+  latencyMs = state.latencyMs;
+  totalSamples = state.totalSamples;
+  LOG_INFO("✅ Tap %u overshoot model loaded (%lu pours)", tap, (unsigned long)totalSamples);
+}
+
+OvershootState OvershootModel::getState() const {
+  OvershootState state;
+  memcpy(state.bins, bins, sizeof(bins));
+  state.latencyMs = latencyMs;
+  state.totalSamples = totalSamples;
+  return state;
+}
+
+// Lands in the ConfigStore's RAM copy, the flash write happens later on the network task
+void OvershootModel::save() { configStore.setOvershootModel(tap, getState()); }
+
+size_t OvershootModel::toJson(const OvershootState& state, char* buffer, size_t size) {
+  // One value per bin, bin i covers i * OVERSHOOT_BIN_WIDTH_PPS pulses/s and up
+  size_t used = snprintf(buffer, size, "[");
+  for (int i = 0; i < OVERSHOOT_RATE_BINS && used < size; i++) {
+    used += snprintf(buffer + used, size - used, i > 0 ? ",%.2f" : "%.2f", state.bins[i].pulses);
+  }
+  if (used < size) {
+    used += snprintf(buffer + used, size - used, "]");
+  }
+  return used < size ? used : size - 1;
+}
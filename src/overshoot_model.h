@@ -0,0 +1,53 @@
+#ifndef OVERSHOOT_MODEL_H
+#define OVERSHOOT_MODEL_H
+
+#include <Arduino.h>
+#include "constants.h"
+
+struct OvershootRateBin {
+  float pulses;      // EWMA of overshoot pulses at this flow rate
+  uint16_t samples;  // Number of pours that fed this bin
+};
+
+// What a model has learned, kept in the ConfigStore
+struct OvershootState {
+  OvershootRateBin bins[OVERSHOOT_RATE_BINS];
+  float latencyMs;
+  uint32_t totalSamples;
+};
+
+// Learns how many pulses still arrive after the valve is told to close (solenoid latency
+// plus line drain), keyed by the flow rate right before the close. PourSystem subtracts
+// the prediction from the stop threshold so the pour lands on the target.
+class OvershootModel {
+ private:
+  OvershootRateBin bins[OVERSHOOT_RATE_BINS];
+  float latencyMs;  // EWMA of overshoot / flow rate - the effective valve close latency
+  uint32_t totalSamples;
+  unsigned long lastOvershootPulses;
+  uint8_t tap;  // One model per tap in the ConfigStore
+
+  int binForRate(float ratePps) const;
+  void load();
+  void save();
+
+ public:
+  OvershootModel();
+  void begin(uint8_t tap = 0);
+  void reset();
+
+  // Expected trailing pulses for a pour closing at the given flow rate
+  float predictPulses(float ratePps) const;
+  void record(float ratePps, unsigned long overshootPulses);
+
+  float getLatencyMs() const { return latencyMs; }
+  uint32_t getTotalSamples() const { return totalSamples; }
+  unsigned long getLastOvershootPulses() const { return lastOvershootPulses; }
+  OvershootState getState() const;
+
+  // Writes the per-bin overshoot pulses as a compact JSON array for the ThingsBoard attribute
+  size_t toJson(char* buffer, size_t size) const { return toJson(getState(), buffer, size); }
+  static size_t toJson(const OvershootState& state, char* buffer, size_t size);
+};
+
+#endif  // OVERSHOOT_MODEL_H
@@ -0,0 +1,176 @@
+#include "pcnt_pulse_counter.h"
+#include "hal.h"
+#include "logger.h"
+
+#if USE_PCNT_PULSE_COUNTER
+
+PcntPulseCounter::PcntPulseCounter(pcnt_unit_t unit) {
+  this->unit = unit;
+  overflowCount = 0;
+  threshold = 0;
+  thresholdFired = false;
+  lastCount = 0;
+  spinlock = portMUX_INITIALIZER_UNLOCKED;
+  callback = nullptr;
+  callbackArg = nullptr;
+}
+
+bool PcntPulseCounter::begin(uint8_t pin, ThresholdCallback callback, void* callbackArg) {
+  this->callback = callback;
+  this->callbackArg = callbackArg;
+
+  hal::pinMode(pin, INPUT_PULLUP);
+
+  pcnt_config_t config = {};
+  config.pulse_gpio_num = pin;
+  config.ctrl_gpio_num = PCNT_PIN_NOT_USED;
+  config.lctrl_mode = PCNT_MODE_KEEP;
+  config.hctrl_mode = PCNT_MODE_KEEP;
+  config.pos_mode = PCNT_COUNT_INC;  // Count rising edges, same as the ISR backend
+  config.neg_mode = PCNT_COUNT_DIS;
+  config.counter_h_lim = PCNT_COUNTER_LIMIT;
+  config.counter_l_lim = 0;
+  config.unit = unit;
+  config.channel = PCNT_CHANNEL_0;
+
+  if (pcnt_unit_config(&config) != ESP_OK) {
+    LOG_ERROR("❌ PCNT unit %d configuration failed", (int)unit);
+    return false;
+  }
+
+  // Reject contact bounce and EMI spikes from the valve solenoid in hardware
+  pcnt_set_filter_value(unit, PCNT_FILTER_APB_CYCLES);
+  pcnt_filter_enable(unit);
+
+  // The counter resets to 0 on reaching h_lim, the ISR carries the wrap into overflowCount
+  pcnt_event_enable(unit, PCNT_EVT_H_LIM);
+
+  pcnt_counter_pause(unit);
+  pcnt_counter_clear(unit);
+
+  // The ISR service may already be installed by another unit
+  esp_err_t err = pcnt_isr_service_install(0);
+  if (err != ESP_OK && err != ESP_ERR_INVALID_STATE) {
+    LOG_ERROR("❌ PCNT ISR service install failed");
+    return false;
+  }
+  pcnt_isr_handler_add(unit, onEvent, this);
+
+  pcnt_counter_resume(unit);
+  return true;
+}
+
+int16_t PcntPulseCounter::readHardwareCount() {
+  int16_t value = 0;
+  pcnt_get_counter_value(unit, &value);
+  return value;
+}
+
+bool PcntPulseCounter::armThreshold() {
+  if (threshold == 0 || thresholdFired) {
+    pcnt_event_disable(unit, PCNT_EVT_THRES_0);
+    return false;
+  }
+
+  if (threshold <= overflowCount) {
+    return true;
+  }
+
+  unsigned long remaining = threshold - overflowCount;
+  if (remaining >= PCNT_COUNTER_LIMIT) {
+    // Out of range of the 16-bit counter, re-armed from the ISR after the next wrap
+    pcnt_event_disable(unit, PCNT_EVT_THRES_0);
+    return false;
+  }
+
+  pcnt_set_event_value(unit, PCNT_EVT_THRES_0, (int16_t)remaining);
+  pcnt_event_enable(unit, PCNT_EVT_THRES_0);
+
+  // The counter may have passed the threshold before the event was enabled
+  int16_t current = 0;
+  pcnt_get_counter_value(unit, &current);
+  return (unsigned long)current >= remaining;
+}
+
+void IRAM_ATTR PcntPulseCounter::onEvent(void* arg) {
+  PcntPulseCounter* self = static_cast<PcntPulseCounter*>(arg);
+  uint32_t status = 0;
+  bool fire = false;
+
+  pcnt_get_event_status(self->unit, &status);
+
+  portENTER_CRITICAL_ISR(&self->spinlock);
+  if (status & PCNT_EVT_H_LIM) {
+    self->overflowCount += PCNT_COUNTER_LIMIT;
+    fire = self->armThreshold();
+  }
+  if ((status & PCNT_EVT_THRES_0) && self->threshold > 0) {
+    fire = true;
+  }
+  if (fire) {
+    if (self->thresholdFired) {
+      fire = false;
+    } else {
+      self->thresholdFired = true;
+      pcnt_event_disable(self->unit, PCNT_EVT_THRES_0);
+    }
+  }
+  portEXIT_CRITICAL_ISR(&self->spinlock);
+
+  if (fire && self->callback != nullptr) {
+    self->callback(self->callbackArg);
+  }
+}
+
+unsigned long PcntPulseCounter::getCount() {
+  portENTER_CRITICAL(&spinlock);
+  unsigned long total = overflowCount + (unsigned long)readHardwareCount();
+  // A wrap whose interrupt is still pending reads as a small count - counts never go
+  // backwards between resets, so hold the previous value until the ISR catches up
+  if (total < lastCount) {
+    total = lastCount;
+  }
+  lastCount = total;
+  portEXIT_CRITICAL(&spinlock);
+  return total;
+}
+
+void PcntPulseCounter::reset() {
+  portENTER_CRITICAL(&spinlock);
+  pcnt_counter_pause(unit);
+  pcnt_counter_clear(unit);
+  overflowCount = 0;
+  lastCount = 0;
+  threshold = 0;
+  thresholdFired = false;
+  pcnt_event_disable(unit, PCNT_EVT_THRES_0);
+  pcnt_counter_resume(unit);
+  portEXIT_CRITICAL(&spinlock);
+}
+
+void PcntPulseCounter::setThreshold(unsigned long count) {
+  bool fire = false;
+
+  portENTER_CRITICAL(&spinlock);
+  threshold = count;
+  thresholdFired = false;
+  if (armThreshold()) {
+    thresholdFired = true;
+    pcnt_event_disable(unit, PCNT_EVT_THRES_0);
+    fire = true;
+  }
+  portEXIT_CRITICAL(&spinlock);
+
+  if (fire && callback != nullptr) {
+    callback(callbackArg);
+  }
+}
+
+PulseCounter& pulseCounterForTap(uint8_t tap) {
+  static_assert(TAP_COUNT <= PCNT_UNIT_MAX, "One PCNT unit per tap");
+  static PcntPulseCounter counters[TAP_COUNT];
+  counters[tap].setUnit((pcnt_unit_t)(PCNT_UNIT_0 + tap));
+  return counters[tap];
+}
+
+#endif  // USE_PCNT_PULSE_COUNTER
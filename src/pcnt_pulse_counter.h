@@ -0,0 +1,42 @@
+#ifndef PCNT_PULSE_COUNTER_H
+#define PCNT_PULSE_COUNTER_H
+
+#include "pulse_counter.h"
+
+#if USE_PCNT_PULSE_COUNTER
+
+#include <driver/pcnt.h>
+
+// Counts pulses in the ESP32 pulse counter (PCNT) peripheral.
+// Edges are counted and glitch-filtered in hardware; the CPU is only interrupted when the
+// 16-bit counter wraps or when the armed threshold is reached.
+class PcntPulseCounter : public PulseCounter {
+ private:
+  pcnt_unit_t unit;
+
+  // Pulses accumulated from counter wraps, the hardware counter holds the remainder
+  volatile unsigned long overflowCount;
+  volatile unsigned long threshold;
+  volatile bool thresholdFired;
+  unsigned long lastCount;
+  portMUX_TYPE spinlock;
+
+  ThresholdCallback callback;
+  void* callbackArg;
+
+  bool armThreshold();  // Call with spinlock held, returns true if the threshold is already hit
+  int16_t readHardwareCount();
+  static void IRAM_ATTR onEvent(void* arg);
+
+ public:
+  explicit PcntPulseCounter(pcnt_unit_t unit = PCNT_UNIT_0);
+  void setUnit(pcnt_unit_t unit) { this->unit = unit; }  // Before begin()
+  bool begin(uint8_t pin, ThresholdCallback callback, void* callbackArg) override;
+  unsigned long getCount() override;
+  void reset() override;
+  void setThreshold(unsigned long count) override;
+};
+
+#endif  // USE_PCNT_PULSE_COUNTER
+
+#endif  // PCNT_PULSE_COUNTER_H
@@ -0,0 +1,131 @@
+#include "perf_counters.h"
+#include "logger.h"
+
+// Global instance
+PerfCounters perfCounters;
+
+PerfHistogram::PerfHistogram() { reset(); }
+
+void PerfHistogram::record(uint32_t us) {
+  uint8_t bucket = us < 2 ? 0 : 31 - __builtin_clz(us);
+  if (bucket >= PERF_HISTOGRAM_BUCKETS) {
+    bucket = PERF_HISTOGRAM_BUCKETS - 1;
+  }
+  buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+  count.fetch_add(1, std::memory_order_relaxed);
+  totalUs.fetch_add(us, std::memory_order_relaxed);
+
+  uint32_t currentMax = maxUs.load();
+  while (us > currentMax && !maxUs.compare_exchange_weak(currentMax, us)) {
+  }
+}
+
+void PerfHistogram::reset() {
+  for (uint8_t i = 0; i < PERF_HISTOGRAM_BUCKETS; i++) {
+    buckets[i].store(0);
+  }
+  count.store(0);
+  totalUs.store(0);
+  maxUs.store(0);
+}
+
+uint32_t PerfHistogram::getMeanUs() const {
+  uint32_t samples = count.load();
+  return samples > 0 ? totalUs.load() / samples : 0;
+}
+
+uint32_t PerfHistogram::getPercentileUs(uint8_t percent) const {
+  uint32_t samples = count.load();
+  uint32_t max = maxUs.load();
+  if (samples == 0) {
+    return 0;
+  }
+  uint32_t rank = (uint32_t)(((uint64_t)samples * percent + 99) / 100);  // Rounded up
+  uint32_t seen = 0;
+  for (uint8_t i = 0; i < PERF_HISTOGRAM_BUCKETS - 1; i++) {
+    seen += buckets[i].load();
+    if (seen >= rank) {
+      uint32_t upperUs = 2UL << i;
+      return upperUs < max ? upperUs : max;
+    }
+  }
+  return max;
+}
+
+PerfCounters::PerfCounters() : stalls(0) {}
+
+void PerfCounters::record(PerfSection section, uint32_t startCycles) {
+  uint32_t us = (hal::cycleCount() - startCycles) / hal::cyclesPerMicrosecond();
+  sections[section].record(us);
+
+  if (section == PERF_NETWORK_LOOP && us >= PERF_STALL_MS * 1000UL) {
+    stalls.fetch_add(1, std::memory_order_relaxed);
+    LOG_WARN("⚠️ Network loop stalled for %lums", (unsigned long)(us / 1000));
+  }
+}
+
+void PerfCounters::reset() {
+  for (uint8_t i = 0; i < PERF_SECTION_COUNT; i++) {
+    sections[i].reset();
+  }
+  stalls.store(0);
+}
+
+size_t PerfCounters::toJson(char* buffer, size_t size) const {
+  size_t used = 0;
+  for (uint8_t i = 0; i < PERF_SECTION_COUNT; i++) {
+    const char* name = sectionName((PerfSection)i);
+    const PerfHistogram& histogram = sections[i];
+    int written = snprintf(buffer + used, size - used,
+                           "%c\"%sCount\":%lu,\"%sMeanUs\":%lu,\"%sP99Us\":%lu,\"%sMaxUs\":%lu",
+                           i == 0 ? '{' : ',', name, (unsigned long)histogram.getCount(), name,
+                           (unsigned long)histogram.getMeanUs(), name,
+                           (unsigned long)histogram.getPercentileUs(99), name,
+                           (unsigned long)histogram.getMaxUs());
+    if (written < 0 || (size_t)written >= size - used) {
+      return 0;
+    }
+    used += written;
+  }
+
+  int written = snprintf(buffer + used, size - used,
+                         ",\"networkStalls\":%lu,\"heapFree\":%lu,\"heapMinFree\":%lu,"
+                         "\"heapLargestBlock\":%lu}",
+                         (unsigned long)getStalls(), (unsigned long)hal::freeHeap(),
+                         (unsigned long)hal::minFreeHeap(), (unsigned long)hal::largestFreeBlock());
+  if (written < 0 || (size_t)written >= size - used) {
+    return 0;
+  }
+  return used + written;
+}
+
+const char* PerfCounters::sectionName(PerfSection section) {
+  switch (section) {
+    case PERF_CONTROL_TICK:
+      return "controlTick";
+    case PERF_TAP_UPDATE:
+      return "tapUpdate";
+    case PERF_NETWORK_LOOP:
+      return "networkLoop";
+    case PERF_TB_LOOP:
+      return "tbLoop";
+    case PERF_RPC:
+      return "rpc";
+    default:
+      return "unknown";
+  }
+}
+
+bool PerfCounters::parseSection(const char* name, PerfSection& section) {
+  for (uint8_t i = 0; i < PERF_SECTION_COUNT; i++) {
+    if (strcmp(name, sectionName((PerfSection)i)) == 0) {
+      section = (PerfSection)i;
+      return true;
+    }
+  }
+  return false;
+}
+
+PerfTimer::PerfTimer(PerfSection section) : section(section), startCycles(hal::cycleCount()) {}
+
+PerfTimer::~PerfTimer() { perfCounters.record(section, startCycles); }
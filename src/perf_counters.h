@@ -0,0 +1,88 @@
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#include <Arduino.h>
+#include <atomic>
+#include "constants.h"
+#include "hal.h"
+
+// Timed code sections
+enum PerfSection {
+  PERF_CONTROL_TICK,  // ControlLoop::tick(), every tap
+  PERF_TAP_UPDATE,    // Pour logic and safety checks of one tap
+  PERF_NETWORK_LOOP,  // One pass of the network task
+  PERF_TB_LOOP,       // tb.loop(), MQTT receive and RPC dispatch
+  PERF_RPC,           // One RPC handler
+  PERF_SECTION_COUNT
+};
+
+// Latency histogram with power-of-two buckets: bucket 0 counts durations under 2us, bucket i
+// those in [2^i, 2^(i+1)) us and the last bucket everything longer. Each section is recorded
+// from a single task; readers in other tasks may see a sample half counted, which is fine for
+// statistics.
+class PerfHistogram {
+ private:
+  std::atomic<uint32_t> buckets[PERF_HISTOGRAM_BUCKETS];
+  std::atomic<uint32_t> count;
+  std::atomic<uint32_t> totalUs;
+  std::atomic<uint32_t> maxUs;
+
+ public:
+  PerfHistogram();
+
+  void record(uint32_t us);
+  void reset();
+
+  uint32_t getCount() const { return count.load(); }
+  uint32_t getMaxUs() const { return maxUs.load(); }
+  uint32_t getMeanUs() const;
+  uint32_t getBucket(uint8_t bucket) const { return buckets[bucket].load(); }
+
+  // Upper edge of the bucket holding the given percentile, never above the maximum
+  uint32_t getPercentileUs(uint8_t percent) const;
+};
+
+// Section latencies, network loop stalls and heap statistics since the last reset(). The
+// network task publishes them every JITTER_REPORT_INTERVAL and starts a new window, and the
+// getPerfStats RPC returns the current window. Sections are timed with the CPU cycle counter,
+// which costs a register read instead of an esp_timer call; hangs longer than the cycle counter
+// can measure are left to the task watchdog.
+class PerfCounters {
+ private:
+  PerfHistogram sections[PERF_SECTION_COUNT];
+  std::atomic<uint32_t> stalls;
+
+ public:
+  PerfCounters();
+
+  // Ends a section that started at startCycles (hal::cycleCount())
+  void record(PerfSection section, uint32_t startCycles);
+  void reset();
+
+  const PerfHistogram& get(PerfSection section) const { return sections[section]; }
+  uint32_t getStalls() const { return stalls.load(); }
+
+  // Flat telemetry object: <section>Count, <section>MeanUs, <section>P99Us and <section>MaxUs
+  // for every section, plus networkStalls, heapFree, heapMinFree and heapLargestBlock.
+  // Returns the length, 0 if it did not fit.
+  size_t toJson(char* buffer, size_t size) const;
+
+  static const char* sectionName(PerfSection section);
+  static bool parseSection(const char* name, PerfSection& section);
+};
+
+// Times the enclosing scope
+class PerfTimer {
+ private:
+  PerfSection section;
+  uint32_t startCycles;
+
+ public:
+  explicit PerfTimer(PerfSection section);
+  ~PerfTimer();
+};
+
+// Global instance
+extern PerfCounters perfCounters;
+
+#endif  // PERF_COUNTERS_H
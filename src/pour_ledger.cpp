@@ -0,0 +1,354 @@
+#include "pour_ledger.h"
+#include <LittleFS.h>
+#include "crc32.h"
+#include "logger.h"
+#include "tap_controller.h"
+
+static const char* CURSOR_PATH = LEDGER_DIR "/cursor";
+static const char* CURSOR_TMP_PATH = LEDGER_DIR "/cursor.tmp";
+
+// Global instance
+PourLedger pourLedger;
+
+PourLedger::PourLedger() {
+  mounted = false;
+  head.segment = 1;
+  head.index = 0;
+  tailSegment = 1;
+  tailCount = 0;
+  tailTorn = false;
+  nextSequence = 1;
+  droppedRecords = 0;
+}
+
+void PourLedger::segmentPath(uint32_t segment, char* path, size_t size) {
+  snprintf(path, size, "%s/%08lu.bin", LEDGER_DIR, (unsigned long)segment);
+}
+
+bool PourLedger::isValid(const LedgerEntry& entry) {
+  return (entry.version == 1 || entry.version == ENTRY_VERSION) &&
+         entry.crc == crc32(&entry, offsetof(LedgerEntry, crc));
+}
+
+void PourLedger::upgrade(LedgerEntry& entry) {
+  // Version 1 kept the calibration as a float in ml where ulPerPulse, tap and reserved are
+  static_assert(offsetof(LedgerEntry, crc) - offsetof(LedgerEntry, ulPerPulse) == sizeof(float),
+                "Version 1 layout");
+  if (entry.version == 1) {
+    float mlPerPulse;
+    memcpy(&mlPerPulse, &entry.ulPerPulse, sizeof(mlPerPulse));
+    entry.ulPerPulse = microlitresPerPulse(mlPerPulse);
+    entry.tap = 0;
+    entry.reserved = 0;
+    entry.version = ENTRY_VERSION;
+  }
+}
+
+bool PourLedger::begin() {
+  if (!LittleFS.begin(true)) {  // Formats on first use
+    LOG_ERROR("❌ LittleFS mount failed, pours will not survive an outage");
+    return false;
+  }
+  if (!LittleFS.exists(LEDGER_DIR)) {
+    LittleFS.mkdir(LEDGER_DIR);
+  }
+  mounted = true;
+
+  if (!loadCursor()) {
+    recoverCursor();
+  }
+  scanTail();
+
+  LOG_INFO("✅ Pour ledger ready: %lu unreported pours, next id %lu",
+           (unsigned long)getPendingCount(), (unsigned long)nextSequence);
+  return true;
+}
+
+bool PourLedger::readCursor(const char* path, StoredCursor& stored) {
+  File file = LittleFS.open(path, "r");
+  if (!file) {
+    return false;
+  }
+  size_t length = file.read(reinterpret_cast<uint8_t*>(&stored), sizeof(stored));
+  file.close();
+  return length == sizeof(stored) && stored.version == CURSOR_VERSION &&
+         stored.crc == crc32(&stored, offsetof(StoredCursor, crc));
+}
+
+bool PourLedger::loadCursor() {
+  // The copy is newer than the cursor if a save stopped short of the rename
+  StoredCursor stored;
+  if (!readCursor(CURSOR_PATH, stored)) {
+    if (!readCursor(CURSOR_TMP_PATH, stored)) {
+      return false;
+    }
+    LOG_WARN("⚠️ Pour ledger cursor is missing or corrupt, using its copy");
+  }
+  head.segment = stored.segment;
+  head.index = stored.index;
+  nextSequence = stored.nextSequence;
+  droppedRecords = stored.droppedRecords;
+  return true;
+}
+
+bool PourLedger::saveCursor() {
+  StoredCursor stored = {};
+  stored.version = CURSOR_VERSION;
+  stored.segment = head.segment;
+  stored.index = head.index;
+  stored.nextSequence = nextSequence;
+  stored.droppedRecords = droppedRecords;
+  stored.crc = crc32(&stored, offsetof(StoredCursor, crc));
+
+  // Write a copy and rename it over the old one, so power loss leaves either cursor intact
+  File file = LittleFS.open(CURSOR_TMP_PATH, "w");
+  if (!file) {
+    LOG_ERROR("❌ Failed to write pour ledger cursor");
+    return false;
+  }
+  size_t written = file.write(reinterpret_cast<const uint8_t*>(&stored), sizeof(stored));
+  file.close();
+  if (written != sizeof(stored)) {
+    LOG_ERROR("❌ Failed to write pour ledger cursor");
+    return false;
+  }
+  return LittleFS.rename(CURSOR_TMP_PATH, CURSOR_PATH);  // Replaces the old cursor atomically
+}
+
+// Without a cursor the head goes back to the oldest segment present, which may report
+// acknowledged pours again under their old pourId but never skips one, and the sequence goes on
+// after the highest one stored
+void PourLedger::recoverCursor() {
+  head.segment = 1;
+  head.index = 0;
+  nextSequence = 1;
+  uint32_t segments = 0;
+  File dir = LittleFS.open(LEDGER_DIR);
+  for (File file = dir ? dir.openNextFile() : File(); file; file = dir.openNextFile()) {
+    // Some cores name entries by their full path
+    const char* name = file.name();
+    const char* slash = strrchr(name, '/');
+    name = slash != nullptr ? slash + 1 : name;
+    char* end = nullptr;
+    unsigned long segment = strtoul(name, &end, 10);
+    if (segment == 0 || end != name + 8 || strcmp(end, ".bin") != 0) {
+      continue;  // The cursor files
+    }
+    if (segments == 0 || segment < head.segment) {
+      head.segment = segment;
+    }
+    segments++;
+
+    LedgerEntry entry;
+    while (file.read(reinterpret_cast<uint8_t*>(&entry), sizeof(entry)) == sizeof(entry)) {
+      if (isValid(entry) && entry.sequence >= nextSequence) {
+        nextSequence = entry.sequence + 1;
+      }
+    }
+  }
+
+  if (segments == 0) {
+    LOG_INFO("ℹ️ No pour ledger cursor, starting a new ledger");
+    return;
+  }
+  LOG_WARN("⚠️ Pour ledger cursor lost, rebuilt from %lu segment(s)", (unsigned long)segments);
+  saveCursor();
+}
+
+void PourLedger::scanTail() {
+  // Segments are numbered consecutively from the head, so the tail is the last one present
+  char path[32];
+  tailSegment = head.segment;
+  for (;;) {
+    segmentPath(tailSegment + 1, path, sizeof(path));
+    if (!LittleFS.exists(path)) {
+      break;
+    }
+    tailSegment++;
+  }
+
+  tailCount = 0;
+  tailTorn = false;
+  segmentPath(tailSegment, path, sizeof(path));
+  File file = LittleFS.open(path, "r");
+  if (!file) {
+    return;  // Created by the first append
+  }
+  size_t size = file.size();
+  tailCount = size / sizeof(LedgerEntry);
+  if (size % sizeof(LedgerEntry) != 0) {
+    LOG_WARN("⚠️ Pour ledger ends in a partial record (power loss during a write)");
+    tailTorn = true;
+  }
+
+  // The newest intact record carries the last sequence number handed out
+  for (int i = tailCount - 1; i >= 0; i--) {
+    LedgerEntry entry;
+    file.seek(i * sizeof(LedgerEntry));
+    if (file.read(reinterpret_cast<uint8_t*>(&entry), sizeof(entry)) == sizeof(entry) &&
+        isValid(entry)) {
+      if (entry.sequence >= nextSequence) {
+        nextSequence = entry.sequence + 1;
+      }
+      break;
+    }
+  }
+  file.close();
+}
+
+void PourLedger::dropOldestSegment() {
+  char path[32];
+  segmentPath(head.segment, path, sizeof(path));
+  LittleFS.remove(path);
+  droppedRecords += LEDGER_SEGMENT_RECORDS - head.index;
+  head.segment++;
+  head.index = 0;
+  saveCursor();
+  LOG_WARN("⚠️ Pour ledger full, dropped the oldest unreported pours");
+}
+
+LedgerEntry PourLedger::makeEntry(const PourRecord& record, uint64_t endEpochMs,
+                                  MicrolitresPerPulse ulPerPulse, uint8_t tap) {
+  LedgerEntry entry = {};
+  entry.timestampMs = endEpochMs;
+  entry.sequence = nextSequence++;
+  entry.durationMs = record.durationMs;
+  entry.targetMl = record.targetMl;
+  entry.stopReason = record.stopReason;
+  entry.version = ENTRY_VERSION;
+  entry.actualMl = record.actualMl;
+  entry.ulPerPulse = ulPerPulse < 0xFFFF ? ulPerPulse : 0xFFFF;
+  entry.tap = tap;
+  entry.crc = crc32(&entry, offsetof(LedgerEntry, crc));
+  return entry;
+}
+
+bool PourLedger::append(const LedgerEntry& entry) {
+  if (!mounted) {
+    return false;
+  }
+
+  if (tailCount >= LEDGER_SEGMENT_RECORDS || tailTorn) {
+    tailSegment++;
+    tailCount = 0;
+    tailTorn = false;
+    if (tailSegment - head.segment >= LEDGER_MAX_SEGMENTS) {
+      dropOldestSegment();
+    }
+  }
+
+  // Each append is one whole record written and closed, which LittleFS commits atomically
+  char path[32];
+  segmentPath(tailSegment, path, sizeof(path));
+  File file = LittleFS.open(path, "a");
+  if (!file) {
+    LOG_ERROR("❌ Failed to open pour ledger segment %lu", (unsigned long)tailSegment);
+    return false;
+  }
+  size_t written = file.write(reinterpret_cast<const uint8_t*>(&entry), sizeof(entry));
+  file.close();
+
+  if (written != sizeof(entry)) {
+    LOG_ERROR("❌ Pour ledger write failed");
+    tailTorn = written > 0;
+    return false;
+  }
+  tailCount++;
+  return true;
+}
+
+size_t PourLedger::readPending(LedgerEntry* entries, size_t maxEntries, LedgerPosition& next) {
+  next = head;
+  if (!mounted) {
+    return 0;
+  }
+
+  size_t count = 0;
+  char path[32];
+  File file;
+  size_t fileRecords = 0;
+  uint32_t openSegment = 0;
+
+  while (count < maxEntries) {
+    if (openSegment != next.segment) {
+      file.close();
+      segmentPath(next.segment, path, sizeof(path));
+      file = LittleFS.open(path, "r");
+      fileRecords = file ? file.size() / sizeof(LedgerEntry) : 0;
+      openSegment = next.segment;
+    }
+
+    if (next.index >= fileRecords) {
+      if (next.segment >= tailSegment) {
+        break;  // Caught up with the tail
+      }
+      next.segment++;
+      next.index = 0;
+      continue;
+    }
+
+    LedgerEntry& entry = entries[count];
+    file.seek(next.index * sizeof(LedgerEntry));
+    size_t length = file.read(reinterpret_cast<uint8_t*>(&entry), sizeof(entry));
+    next.index++;
+    if (length == sizeof(entry) && isValid(entry)) {
+      upgrade(entry);
+      count++;
+    } else {
+      LOG_WARN("⚠️ Skipping corrupt pour ledger record %lu:%lu", (unsigned long)next.segment,
+               (unsigned long)(next.index - 1));
+    }
+  }
+  file.close();
+  return count;
+}
+
+bool PourLedger::acknowledge(const LedgerPosition& next) {
+  if (!mounted || (next.segment == head.segment && next.index == head.index)) {
+    return true;
+  }
+
+  // Whole segments behind the cursor are done with - delete rather than rewrite
+  char path[32];
+  for (uint32_t segment = head.segment; segment < next.segment; segment++) {
+    segmentPath(segment, path, sizeof(path));
+    LittleFS.remove(path);
+  }
+  head = next;
+  return saveCursor();
+}
+
+uint32_t PourLedger::getPendingCount() const {
+  return (tailSegment - head.segment) * LEDGER_SEGMENT_RECORDS + tailCount - head.index;
+}
+
+size_t PourLedger::toTelemetryJson(const LedgerEntry* entries, size_t count, char* buffer,
+                                   size_t size) {
+  size_t used = snprintf(buffer, size, "[");
+  for (size_t i = 0; i < count && used < size; i++) {
+    const LedgerEntry& entry = entries[i];
+    char tap[8];
+    const char* s = tapKeySuffix(entry.tap, tap, sizeof(tap));
+    char values[256];
+    snprintf(values, sizeof(values),
+             "{\"pourId%s\":%lu,\"pourTargetMl%s\":%u,\"pourActualMl%s\":%.1f,"
+             "\"pourErrorMl%s\":%.1f,\"pourDurationMs%s\":%lu,\"pourStopReason%s\":\"%s\","
+             "\"pourMlPerPulse%s\":%.3f}",
+             s, (unsigned long)entry.sequence, s, entry.targetMl, s, entry.actualMl, s,
+             entry.actualMl - entry.targetMl, s, (unsigned long)entry.durationMs, s,
+             stopReasonName((StopReason)entry.stopReason), s, entry.ulPerPulse / 1000.0);
+
+    // Without a synced clock the server timestamps the pour on arrival
+    const char* separator = i > 0 ? "," : "";
+    if (entry.timestampMs == 0) {
+      used += snprintf(buffer + used, size - used, "%s%s", separator, values);
+    } else {
+      used += snprintf(buffer + used, size - used, "%s{\"ts\":%llu,\"values\":%s}", separator,
+                       (unsigned long long)entry.timestampMs, values);
+    }
+  }
+  if (used < size) {
+    used += snprintf(buffer + used, size - used, "]");
+  }
+  return used < size ? used : 0;
+}
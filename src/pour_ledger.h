@@ -0,0 +1,95 @@
+#ifndef POUR_LEDGER_H
+#define POUR_LEDGER_H
+
+#include <Arduino.h>
+#include "constants.h"
+#include "pour_recorder.h"
+#include "volume.h"
+
+// One pour as stored on flash. Fixed size, so records are addressed by index and a
+// torn write can only ever damage the last one.
+struct LedgerEntry {
+  uint64_t timestampMs;  // Epoch ms at valve close, 0 when the clock was not synced
+  uint32_t sequence;     // Durable pour id, keeps increasing across reboots
+  uint32_t durationMs;
+  uint16_t targetMl;
+  uint8_t stopReason;    // StopReason
+  uint8_t version;
+  float actualMl;
+  uint16_t ulPerPulse;   // Calibration the pour was measured with, at full flow
+  uint8_t tap;
+  uint8_t reserved;
+  uint32_t crc;          // Over all preceding bytes
+};
+
+struct LedgerPosition {
+  uint32_t segment;
+  uint16_t index;
+};
+
+// Append-only pour ledger on LittleFS, so pours made while ThingsBoard is unreachable are
+// still reported for reconciliation. Records go into numbered segment files of
+// LEDGER_SEGMENT_RECORDS each; a small cursor file remembers the first record the server has
+// not acknowledged yet, and segments behind it are deleted whole. Nothing is ever rewritten
+// in place.
+class PourLedger {
+ private:
+  bool mounted;
+  LedgerPosition head;   // First unacknowledged record
+  uint32_t tailSegment;  // Segment new records are appended to
+  uint16_t tailCount;    // Record slots used in the tail segment
+  bool tailTorn;         // Tail ends in a partial record - continue in a fresh segment
+  uint32_t nextSequence;
+  uint32_t droppedRecords;  // Oldest records discarded because the ledger was full
+
+  // Persisted layout of the cursor file, bump the version when it changes
+  struct StoredCursor {
+    uint8_t version;
+    uint8_t reserved[3];
+    uint32_t segment;
+    uint32_t index;
+    uint32_t nextSequence;
+    uint32_t droppedRecords;
+    uint32_t crc;
+  };
+  static const uint8_t CURSOR_VERSION = 1;
+  static const uint8_t ENTRY_VERSION = 2;  // 1 had a float mlPerPulse and no tap
+
+  static void segmentPath(uint32_t segment, char* path, size_t size);
+  static bool isValid(const LedgerEntry& entry);
+  static void upgrade(LedgerEntry& entry);
+  static bool readCursor(const char* path, StoredCursor& stored);
+  bool loadCursor();
+  bool saveCursor();
+  void recoverCursor();
+  void scanTail();
+  void dropOldestSegment();
+
+ public:
+  PourLedger();
+  bool begin();
+
+  // Network task only. makeEntry() assigns the next sequence number; append() returns
+  // once the entry is on flash.
+  LedgerEntry makeEntry(const PourRecord& record, uint64_t endEpochMs,
+                        MicrolitresPerPulse ulPerPulse, uint8_t tap);
+  bool append(const LedgerEntry& entry);
+
+  // Reads up to maxEntries unacknowledged records, skipping corrupt ones. Pass next to
+  // acknowledge() once the server has them.
+  size_t readPending(LedgerEntry* entries, size_t maxEntries, LedgerPosition& next);
+  bool acknowledge(const LedgerPosition& next);
+
+  uint32_t getPendingCount() const;
+  uint32_t getDroppedRecords() const { return droppedRecords; }
+  bool isMounted() const { return mounted; }
+
+  // ThingsBoard telemetry array with one element per entry, keys per tap (see tapKey())
+  static size_t toTelemetryJson(const LedgerEntry* entries, size_t count, char* buffer,
+                                size_t size);
+};
+
+// Global instance
+extern PourLedger pourLedger;
+
+#endif  // POUR_LEDGER_H
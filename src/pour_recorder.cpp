@@ -0,0 +1,140 @@
+#include "pour_recorder.h"
+
+const char* stopReasonName(StopReason reason) {
+  switch (reason) {
+    case STOP_TARGET_REACHED:
+      return "target";
+    case STOP_EMERGENCY:
+      return "emergency";
+    case STOP_CANCELLED:
+      return "cancelled";
+    case STOP_TIMEOUT:
+      return "timeout";
+    case STOP_MAX_VOLUME:
+      return "maxVolume";
+    case STOP_SENSOR_FAULT:
+      return "sensorFault";
+    case STOP_WATCHDOG:
+      return "watchdog";
+    case STOP_NO_FLOW:
+      return "noFlow";
+    case STOP_FLOW_COLLAPSED:
+      return "flowCollapsed";
+    case STOP_FOAM:
+      return "foam";
+    default:
+      return "none";
+  }
+}
+
+PourRecorder::PourRecorder() {
+  recording = false;
+  stopped = false;
+  nextSampleMillis = 0;
+  droppedRecords = 0;
+  active.sampleCount = 0;
+}
+
+void PourRecorder::begin(int targetMl, MicrolitresPerPulse ulPerPulse, unsigned long nowMillis) {
+  active.startMillis = nowMillis;
+  active.durationMs = 0;
+  active.targetMl = targetMl;
+  active.actualMl = 0;
+  active.pulses = 0;
+  active.ulPerPulse = ulPerPulse;
+  active.stopReason = STOP_NONE;
+  active.sampleIntervalMs = POUR_SAMPLE_INTERVAL_MS;
+  active.sampleCount = 0;
+  nextSampleMillis = nowMillis;
+  recording = true;
+  stopped = false;
+}
+
+void PourRecorder::decimate() {
+  // Keep samples 0, 2, 4, ... so the series stays evenly spaced at twice the interval
+  uint16_t kept = 0;
+  for (uint16_t i = 0; i < active.sampleCount; i += 2) {
+    active.samples[kept++] = active.samples[i];
+  }
+  active.sampleCount = kept;
+  active.sampleIntervalMs *= 2;
+}
+
+void PourRecorder::sample(unsigned long nowMillis, float flowMlPerSec) {
+  if (!recording || stopped || (long)(nowMillis - nextSampleMillis) < 0) {
+    return;
+  }
+
+  if (active.sampleCount >= POUR_SAMPLE_CAPACITY) {
+    decimate();
+  }
+
+  uint32_t offsetMs = nowMillis - active.startMillis;
+  if (active.sampleCount > 0 &&
+      offsetMs < active.samples[active.sampleCount - 1].offsetMs + active.sampleIntervalMs) {
+    return;  // Falls between two samples of the decimated series
+  }
+
+  FlowSample& flowSample = active.samples[active.sampleCount++];
+  flowSample.offsetMs = offsetMs;
+  flowSample.flowMlPerSec = flowMlPerSec;
+  nextSampleMillis = nowMillis + active.sampleIntervalMs;
+}
+
+void PourRecorder::stop(unsigned long nowMillis, StopReason reason) {
+  if (!recording || stopped) {
+    return;
+  }
+  active.durationMs = nowMillis - active.startMillis;
+  active.stopReason = reason;
+  stopped = true;
+}
+
+void PourRecorder::finish(float actualMl, uint32_t pulses) {
+  if (!recording) {
+    return;
+  }
+  recording = false;
+  active.actualMl = actualMl;
+  active.pulses = pulses;
+
+  // The network task is POUR_RECORD_QUEUE_SIZE pours behind - drop this one rather than block
+  if (!completed.push(active)) {
+    droppedRecords++;
+  }
+}
+
+PourTelemetryWriter::PourTelemetryWriter(const PourRecord& record, uint64_t startEpochMs,
+                                         const char* key)
+    : record(record), startEpochMs(startEpochMs), key(key), nextSample(0) {}
+
+size_t PourTelemetryWriter::nextChunk(char* buffer, size_t size) {
+  if (size < 2 || startEpochMs == 0 || nextSample >= record.sampleCount) {
+    return 0;
+  }
+
+  size_t used = 0;
+  buffer[used++] = '[';
+  while (nextSample < record.sampleCount) {
+    const FlowSample& flowSample = record.samples[nextSample];
+    char entry[80];
+    int length = snprintf(entry, sizeof(entry), "%s{\"ts\":%llu,\"values\":{\"%s\":%.2f}}",
+                          used > 1 ? "," : "",
+                          (unsigned long long)(startEpochMs + flowSample.offsetMs),
+                          key, flowSample.flowMlPerSec);
+    // Leave room for the closing bracket and terminator
+    if (length <= 0 || used + length + 2 > size) {
+      break;
+    }
+    memcpy(buffer + used, entry, length);
+    used += length;
+    nextSample++;
+  }
+
+  if (used == 1) {
+    return 0;  // Buffer too small for even one sample
+  }
+  buffer[used++] = ']';
+  buffer[used] = '\0';
+  return used;
+}
@@ -0,0 +1,94 @@
+#ifndef POUR_RECORDER_H
+#define POUR_RECORDER_H
+
+#include <Arduino.h>
+#include <atomic>
+#include "constants.h"
+#include "spsc_queue.h"
+#include "volume.h"
+
+// Why a pour ended
+enum StopReason {
+  STOP_NONE,
+  STOP_TARGET_REACHED,
+  STOP_EMERGENCY,       // stopPour RPC
+  STOP_CANCELLED,       // Cup size reset to 0 mid-pour
+  STOP_TIMEOUT,         // MAX_POUR_TIME exceeded
+  STOP_MAX_VOLUME,      // MAX_POUR_VOLUME exceeded
+  STOP_SENSOR_FAULT,    // Pulse count or volume failed a sanity check
+  STOP_WATCHDOG,        // No longer produced, kept so stored ledger records decode
+  STOP_NO_FLOW,         // No pulses with the valve open - keg empty
+  STOP_FLOW_COLLAPSED,  // Flow rate collapsed mid-pour - keg running dry
+  STOP_FOAM             // Erratic pulse intervals - foam in the line
+};
+
+const char* stopReasonName(StopReason reason);
+
+struct FlowSample {
+  uint32_t offsetMs;  // Since the valve opened
+  float flowMlPerSec;
+};
+
+// Everything published about one pour
+struct PourRecord {
+  unsigned long startMillis;
+  uint32_t durationMs;  // Valve open to valve close
+  int targetMl;
+  float actualMl;       // Including what flowed after the close
+  uint32_t pulses;      // Sensor pulses behind actualMl, for calibration runs
+  MicrolitresPerPulse ulPerPulse;  // Calibration the pour was measured with, at full flow
+  StopReason stopReason;
+  uint16_t sampleIntervalMs;
+  uint16_t sampleCount;
+  FlowSample samples[POUR_SAMPLE_CAPACITY];
+};
+
+// Samples the flow rate into a fixed buffer while a pour runs and hands the finished
+// record to the network task. When the buffer fills up every other sample is dropped and
+// the interval doubles, so a pour of any length fits without allocating.
+class PourRecorder {
+ private:
+  PourRecord active;
+  // Finished pours, so back-to-back pours survive a network task that is busy reconnecting
+  SpscQueue<PourRecord, POUR_RECORD_QUEUE_SIZE> completed;
+
+  bool recording;
+  bool stopped;
+  unsigned long nextSampleMillis;
+  std::atomic<uint32_t> droppedRecords;  // Finished while the queue was full
+
+  void decimate();
+
+ public:
+  PourRecorder();
+
+  // Control task side
+  void begin(int targetMl, MicrolitresPerPulse ulPerPulse, unsigned long nowMillis);
+  void sample(unsigned long nowMillis, float flowMlPerSec);
+  void stop(unsigned long nowMillis, StopReason reason);
+  void finish(float actualMl, uint32_t pulses);
+  bool isRecording() const { return recording; }
+
+  // Network task side - publish the oldest record, then release it for the next one
+  const PourRecord* getCompleted() const { return completed.peek(); }
+  void releaseCompleted() { completed.drop(); }
+  uint32_t getDroppedRecords() const { return droppedRecords.load(); }
+};
+
+// Serialises the flow rate series of a record into ThingsBoard telemetry arrays
+// ([{"ts":..,"values":{..}},..]), each one small enough for a single MQTT publish. Call
+// nextChunk() until it returns 0. The pour summary goes through the PourLedger instead.
+class PourTelemetryWriter {
+ private:
+  const PourRecord& record;
+  uint64_t startEpochMs;  // 0 when the clock is not synced - nothing is written
+  const char* key;        // Telemetry key of the series, per tap on multi-tap boards
+  uint16_t nextSample;
+
+ public:
+  PourTelemetryWriter(const PourRecord& record, uint64_t startEpochMs,
+                      const char* key = TB_FLOW_RATE_TELEMETRY);
+  size_t nextChunk(char* buffer, size_t size);
+};
+
+#endif  // POUR_RECORDER_H
@@ -1,152 +1,390 @@
 #include "pour_system.h"
+#include "hal.h"
+#include "logger.h"
 
 // ThingsBoard RPC functions will be called from main file
 
-// Global instance
-PourSystem pourSystem;
-
-// Static member definitions
-portMUX_TYPE PourSystem::spinlock = portMUX_INITIALIZER_UNLOCKED;
-
 PourSystem::PourSystem() {
-  pulseCount = 0;
-  mlPerPulse = DEFAULT_ML_PER_PULSE;
-  totalVolume = 0;
+  counter = nullptr;
+  index = 0;
+  relayPin = RELAY_PIN;
+  targetPulseCount = 0;
+  armedPulseThreshold = 0;
+  targetReached = false;
+  limits.maxPourTimeMs = MAX_POUR_TIME;
+  limits.maxPourVolumeMl = MAX_POUR_VOLUME;
+  maxPourPulses = pulsesForMl(MAX_POUR_VOLUME, calibration.getMaxUlPerPulse());
+  sanityPulseLimit = pulsesForMl(MAX_VOLUME_SANITY, calibration.getMaxUlPerPulse());
+  targetUl = 0;
+  pouredUl = 0;
+  integratedPulses = 0;
+  lastPulseUs = 0;
+  currentUlPerPulse = calibration.getNominalUlPerPulse();
+  hasOrderCalibration = false;
+  flowRatePps = 0;
+  rateSampleTime = 0;
+  rateSampleCount = 0;
+  isSettling = false;
+  settleStartTime = 0;
+  stopPulseCount = 0;
+  stopFlowRate = 0;
+  lastStopReason = STOP_NONE;
+  pouredPulses = 0;
   pourStartTime = 0;
   isPouring = false;
   currentCupSize = 0;
-  lastWatchdogTime = 0;
 }
 
-void PourSystem::init() {
-  pinMode(FLOW_SENSOR_PIN, INPUT_PULLUP);
-  pinMode(RELAY_PIN, OUTPUT);
+void PourSystem::init(PulseCounter& counter, const TapPins& pins, uint8_t index) {
+  this->counter = &counter;
+  this->index = index;
+  relayPin = pins.relayPin;
+
+  hal::pinMode(relayPin, OUTPUT);
   setRelay(true);  // Ensure relay starts in safe state (closed)
 
-  attachInterrupt(digitalPinToInterrupt(FLOW_SENSOR_PIN), pulseCounter, RISING);
+  // The counter hands this channel back to onTargetReached, no lookup by pin or index
+  if (!counter.begin(pins.flowSensorPin, onTargetReached, this)) {
+    LOG_ERROR("❌ Tap %u: flow sensor pulse counter failed to start", index);
+  }
 
-  lastWatchdogTime = millis();
+  overshootModel.begin(index);
 }
 
-void PourSystem::setRelay(bool state) { digitalWrite(RELAY_PIN, state); }
+void PourSystem::setRelay(bool state) { hal::digitalWrite(relayPin, state); }
 
 void PourSystem::resetCounters() {
-  portENTER_CRITICAL_ISR(&spinlock);
-  pulseCount = 0;
-  portEXIT_CRITICAL_ISR(&spinlock);
-  totalVolume = 0;
+  if (isSettling) {
+    // Settling cut short - publish what has been counted so far, but don't learn from it
+    recorder.finish(getTotalVolume(), counter->getCount());
+  }
+  counter->reset();  // Also disarms the stop threshold
+  armedPulseThreshold = 0;
+  targetReached = false;
+  isSettling = false;  // A pending overshoot measurement is meaningless after a reset
+  pouredPulses = 0;
+  pouredUl = 0;
+  integratedPulses = 0;
+  hasOrderCalibration = false;  // The pour it was set for is over
+}
+
+float PourSystem::pulsesToMl(unsigned long pulses) const {
+  return microlitresToMl(pulsesToMicrolitres(pulses, currentUlPerPulse));
+}
+
+void PourSystem::updatePulseLimits() {
+  // Convert every volume limit into pulses once, so the control loop and the ISR only
+  // have to compare integers. The safety limits use the largest volume per pulse on the
+  // curve, so they trip at the limit at the latest whatever the flow rate.
+  targetUl = currentCupSize > 0 ? (Microlitres)currentCupSize * 1000 : 0;
+  maxPourPulses = pulsesForMl(limits.maxPourVolumeMl, pourCalibration().getMaxUlPerPulse());
+  sanityPulseLimit = pulsesForMl(MAX_VOLUME_SANITY, pourCalibration().getMaxUlPerPulse());
+  updateTargetPulseCount();
+  if (isPouring) {
+    armStopThreshold();
+  }
+}
+
+void PourSystem::updateTargetPulseCount() {
+  // Pulses so far plus the rest of the target at the latest volume per pulse. With a flat
+  // curve this is the same every time; otherwise it follows the flow rate.
+  if (targetUl == 0) {
+    targetPulseCount = 0;
+    return;
+  }
+  Microlitres remainingUl = targetUl - pouredUl;
+  unsigned long remainingPulses =
+      remainingUl > 0 ? (remainingUl + currentUlPerPulse - 1) / currentUlPerPulse : 0;
+  targetPulseCount = integratedPulses + remainingPulses;
+}
+
+void PourSystem::integrateVolume(unsigned long currentPulseCount) {
+  // Pulses with a timestamp get the volume for the interval before them, O(1) each
+  uint32_t timestampUs;
+  while (integratedPulses < currentPulseCount && counter->readPulseTimestamp(timestampUs)) {
+    pulseStats.addPulse(timestampUs);
+    if (isPouring) {
+      faultDetector.addInterval(timestampUs - lastPulseUs);
+    }
+    currentUlPerPulse = pourCalibration().atInterval(timestampUs - lastPulseUs);
+    lastPulseUs = timestampUs;
+    pouredUl += currentUlPerPulse;
+    integratedPulses++;
+  }
+
+  // The rest (PCNT backend, or timestamps dropped on overflow) at the measured flow rate
+  if (integratedPulses < currentPulseCount) {
+    if (flowRatePps > 0) {
+      currentUlPerPulse = pourCalibration().atInterval((uint32_t)(1000000.0 / flowRatePps));
+    }
+    pouredUl += pulsesToMicrolitres(currentPulseCount - integratedPulses, currentUlPerPulse);
+    integratedPulses = currentPulseCount;
+  }
+}
+
+unsigned long PourSystem::compensatedThreshold() const {
+  if (targetPulseCount == 0) {
+    return 0;
+  }
+
+  // Close early by the overshoot expected at the current flow rate, bounded so a bad
+  // model can never cut a pour short by more than OVERSHOOT_MAX_COMPENSATION
+  float predicted = overshootModel.predictPulses(flowRatePps);
+  float maxCompensation = targetPulseCount * OVERSHOOT_MAX_COMPENSATION;
+  if (predicted > maxCompensation) {
+    predicted = maxCompensation;
+  }
+  unsigned long compensation = (unsigned long)(predicted + 0.5);
+  return targetPulseCount > compensation ? targetPulseCount - compensation : 1;
+}
+
+void PourSystem::armStopThreshold() {
+  if (targetReached) {
+    return;  // Already closed at armedPulseThreshold
+  }
+  unsigned long threshold = compensatedThreshold();
+  if (threshold != armedPulseThreshold) {
+    armedPulseThreshold = threshold;
+    counter->setThreshold(threshold);
+  }
+}
+
+void PourSystem::updateFlowRate(unsigned long currentPulseCount) {
+  unsigned long now = hal::millis();
+  unsigned long elapsed = now - rateSampleTime;
+  if (elapsed < FLOW_RATE_SAMPLE_MS) {
+    return;
+  }
+
+  float rate = (currentPulseCount - rateSampleCount) * 1000.0 / elapsed;
+  flowRatePps = (flowRatePps == 0) ? rate : (flowRatePps + rate) / 2;
+  rateSampleTime = now;
+  rateSampleCount = currentPulseCount;
+
+  // Predicted overshoot depends on the flow rate, move the stop threshold with it
+  armStopThreshold();
+}
+
+void PourSystem::finishSettling(unsigned long currentPulseCount) {
+  unsigned long overshoot =
+      currentPulseCount > stopPulseCount ? currentPulseCount - stopPulseCount : 0;
+  overshootModel.record(stopFlowRate, overshoot);
+
+  LOG_INFO("📏 Tap %u overshoot: %lu pulses (%.2fml) at %.2f pulses/s, final volume %.2fml",
+           index, overshoot, pulsesToMl(overshoot), stopFlowRate, getTotalVolume());
+  recorder.finish(getTotalVolume(), currentPulseCount);
+  isSettling = false;
+  resetCounters();
+}
+
+void PourSystem::processPulseTimestamps(unsigned long currentPulseCount) {
+  if (isPouring || isSettling) {
+    integrateVolume(currentPulseCount);
+    return;
+  }
+
+  // Lock-free drain of the ISR ring buffer, bounded by its size
+  uint32_t timestampUs;
+  while (counter->readPulseTimestamp(timestampUs)) {
+  }
+}
+
+float PourSystem::getInstantFlowRate() const {
+  return pulseStats.getInstantFlowRate(currentUlPerPulse / 1000.0f, hal::micros());
 }
 
 void PourSystem::startPour() {
+  processPulseTimestamps(0);  // Discard anything counted before the valve opened
+  pulseStats.reset();
+  lastPulseUs = hal::micros();  // The first pulse's interval runs from the valve opening
+  currentUlPerPulse = pourCalibration().getNominalUlPerPulse();
+  updateTargetPulseCount();
   isPouring = true;
+  flowRatePps = 0;
+  rateSampleTime = hal::millis();
+  rateSampleCount = 0;
+  armStopThreshold();  // Arm the hard stop before opening the valve
   setRelay(false);
-  pourStartTime = millis();
-  Serial.println("Pour started");
+  pourStartTime = hal::millis();
+  faultDetector.start(pourStartTime);
+  recorder.begin(currentCupSize, pourCalibration().getNominalUlPerPulse(), pourStartTime);
+  LOG_INFO("Tap %u: pour started", index);
 }
 
-void PourSystem::stopPour() {
+void PourSystem::stopPour(StopReason reason) {
   setRelay(true);
-  Serial.println("Pour complete - " + String(totalVolume) + "ml poured");
-  resetCounters();
+  bool wasPouring = isPouring;
+  if (wasPouring) {
+    lastStopReason = reason;
+    recorder.stop(hal::millis(), reason);
+  }
+  LOG_INFO("Tap %u: pour complete - %.2fml poured (%s)", index, getTotalVolume(),
+           stopReasonName(reason));
+  if (pulseStats.getPulses() > 2) {
+    LOG_DEBUG("📈 Tap %u flow: %lums, interval %.0fus ± %.0fus", index,
+              (unsigned long)pulseStats.getDurationMs(), pulseStats.getMeanIntervalUs(),
+              sqrtf(pulseStats.getIntervalVarianceUs2()));
+  }
+  if (reason == STOP_TARGET_REACHED && wasPouring) {
+    // Keep counting - every pulse from here on is overshoot
+    stopPulseCount = targetReached ? armedPulseThreshold : counter->getCount();
+    stopFlowRate = flowRatePps;
+    counter->setThreshold(0);
+    armedPulseThreshold = 0;
+    targetReached = false;
+    settleStartTime = hal::millis();
+    isSettling = true;
+  } else {
+    if (wasPouring) {
+      recorder.finish(getTotalVolume(), counter->getCount());
+    }
+    resetCounters();
+  }
   isPouring = false;
   currentCupSize = 0;  // Reset cup size
+  updatePulseLimits();
   // ThingsBoard attribute update will be called from main file
 }
 
 void PourSystem::emergencyStop() {
   if (isPouring) {
-    setRelay(true);  // Close valve immediately
-    Serial.println("🛑 EMERGENCY STOP - Pour halted by user");
-
-    // Reset system state
+    LOG_WARN("🛑 Tap %u: EMERGENCY STOP - Pour halted by user", index);
+    stopPour(STOP_EMERGENCY);
+  } else if (currentCupSize > 0) {
+    // A cup size applied earlier in the same tick, the valve has not opened yet
+    LOG_WARN("🛑 Tap %u: EMERGENCY STOP - pending pour cancelled", index);
+    lastStopReason = STOP_EMERGENCY;
+    setRelay(true);
     resetCounters();
-    isPouring = false;
-    currentCupSize = 0;  // Reset cup size
+    currentCupSize = 0;
+    updatePulseLimits();
   } else {
-    Serial.println("ℹ️ Stop button pressed, but no pour in progress");
+    LOG_INFO("ℹ️ Tap %u: stop button pressed, but no pour in progress", index);
   }
 }
 
-void IRAM_ATTR PourSystem::pulseCounter() {
-  portENTER_CRITICAL_ISR(&spinlock);
-  pourSystem.pulseCount++;
-  portEXIT_CRITICAL_ISR(&spinlock);
-  // LED toggling removed from ISR to prevent race conditions
+void IRAM_ATTR PourSystem::onTargetReached(void* arg) {
+  PourSystem* self = static_cast<PourSystem*>(arg);
+
+  // Close the valve right here instead of waiting for the next loop() pass,
+  // which can be delayed by up to CONNECTION_TIMEOUT during a reconnect
+  hal::digitalWrite(self->relayPin, HIGH);  // Same as setRelay(true) - valve closed
+  self->targetReached = true;
+  LOG_ISR(LOG_LEVEL_DEBUG, "Tap %lu: valve closed from ISR", self->index);
 }
 
-void PourSystem::handleCupSizeChange(int value) {
+void PourSystem::handleCupSizeChange(int value, float mlPerPulse) {
   if (value == 0) {
+    if (isPouring) {
+      stopPour(STOP_CANCELLED);
+    }
     resetCounters();
     setRelay(true);
     isPouring = false;
+    currentCupSize = 0;
+    updatePulseLimits();
   } else {
     // Input validation
     if (value < MIN_CUP_SIZE || value > MAX_CUP_SIZE) {
-      Serial.println("❌ Invalid cup size: " + String(value) + "ml");
+      LOG_ERROR("❌ Tap %u: invalid cup size: %dml", index, value);
+      return;
+    }
+    if (mlPerPulse != 0 && (mlPerPulse < MIN_ML_PER_PULSE || mlPerPulse > MAX_ML_PER_PULSE)) {
+      LOG_ERROR("❌ Tap %u: invalid ml per pulse: %.2f", index, mlPerPulse);
       return;
     }
     currentCupSize = value;
     isPouring = false;  // Reset pouring state
     resetCounters();    // Reset counters for new pour
-    Serial.println("✅ Cup size set to " + String(currentCupSize) + "ml");
+    if (mlPerPulse != 0) {
+      orderCalibration.setSinglePoint(microlitresPerPulse(mlPerPulse));
+      hasOrderCalibration = true;
+    }
+    updatePulseLimits();
+    if (hasOrderCalibration) {
+      LOG_INFO("✅ Tap %u: cup size set to %dml at %.3fml/pulse for this pour", index,
+               currentCupSize, mlPerPulse);
+    } else {
+      LOG_INFO("✅ Tap %u: cup size set to %dml", index, currentCupSize);
+    }
   }
 }
 
 void PourSystem::handleMlPerPulseChange(float value) {
   // Input validation
   if (value < MIN_ML_PER_PULSE || value > MAX_ML_PER_PULSE) {
-    Serial.println("❌ Invalid ml per pulse: " + String(value));
+    LOG_ERROR("❌ Tap %u: invalid ml per pulse: %.2f", index, value);
     return;
   }
-  mlPerPulse = value;
-  Serial.println("✅ ML per pulse updated: " + String(mlPerPulse));
+  calibration.setSinglePoint(microlitresPerPulse(value));
+  updatePulseLimits();  // Keep a pending pour's target in step with the new calibration
+  LOG_INFO("✅ Tap %u: ml per pulse updated: %.3f", index, getMlPerPulse());
 }
 
-void PourSystem::checkWatchdog() {
-  // Simple software watchdog - reset if system becomes unresponsive
-  if (millis() - lastWatchdogTime > WATCHDOG_TIMEOUT) {
-    Serial.println("Watchdog timeout - forcing system reset");
-    stopPour();     // Emergency stop
-    ESP.restart();  // Restart the system
+void PourSystem::setCalibrationCurve(const CalibrationCurve& curve) {
+  calibration = curve;
+  updatePulseLimits();
+  LOG_INFO("✅ Tap %u: calibration curve updated: %u points, %.3fml/pulse at full flow", index,
+           (unsigned)calibration.getCount(), getMlPerPulse());
+}
+
+void PourSystem::setFlowFaultThresholds(const FlowFaultThresholds& thresholds) {
+  faultDetector.setThresholds(thresholds);
+  LOG_INFO("✅ Tap %u: flow fault thresholds: no flow %lums, collapse %.2f for %lums, "
+           "foam CV %.2f", index, (unsigned long)thresholds.noFlowMs, thresholds.collapseRatio,
+           (unsigned long)thresholds.collapseMs, thresholds.foamCv);
+}
+
+bool PourSystem::isValidPourLimits(const PourLimits& limits) {
+  return limits.maxPourTimeMs >= 1000 && limits.maxPourTimeMs <= MAX_POUR_TIME &&
+         limits.maxPourVolumeMl >= MIN_CUP_SIZE && limits.maxPourVolumeMl <= MAX_POUR_VOLUME;
+}
+
+bool PourSystem::setPourLimits(const PourLimits& newLimits) {
+  if (!isValidPourLimits(newLimits)) {
+    LOG_ERROR("❌ Tap %u: invalid pour limits: %lums, %uml", index,
+              (unsigned long)newLimits.maxPourTimeMs, newLimits.maxPourVolumeMl);
+    return false;
   }
-  lastWatchdogTime = millis();
+  limits = newLimits;
+  updatePulseLimits();
+  LOG_INFO("✅ Tap %u: pour limits: %lums, %uml", index, (unsigned long)limits.maxPourTimeMs,
+           limits.maxPourVolumeMl);
+  return true;
 }
 
 bool PourSystem::performSafetyChecks(bool wifiConnected, bool thingsBoardConnected) {
-  // Get current pulse count safely
-  portENTER_CRITICAL_ISR(&spinlock);
-  unsigned long currentPulseCount = pulseCount;
-  portEXIT_CRITICAL_ISR(&spinlock);
+  unsigned long currentPulseCount = counter->getCount();
 
   // Bounds checking for calculations
   if (currentPulseCount > MAX_PULSE_COUNT) {
-    Serial.println("Error: Pulse count overflow detected");
-    stopPour();
+    LOG_ERROR("Tap %u: pulse count overflow detected", index);
+    stopPour(STOP_SENSOR_FAULT);
     return false;
   }
 
-  totalVolume = currentPulseCount * mlPerPulse;
+  pouredPulses = currentPulseCount;
 
-  // Check for calculation overflow
-  if (totalVolume > MAX_VOLUME_SANITY) {
-    Serial.println("Error: Volume calculation overflow");
-    stopPour();
+  // Volume sanity limit, precomputed as a pulse count
+  if (currentPulseCount > sanityPulseLimit) {
+    LOG_ERROR("Tap %u: volume calculation overflow", index);
+    stopPour(STOP_SENSOR_FAULT);
     return false;
   }
 
   // Safety checks during pouring
   if (isPouring) {
     // Check for timeout
-    if (millis() - pourStartTime > MAX_POUR_TIME) {
-      Serial.println("Pour timeout reached!");
-      stopPour();
+    if (hal::millis() - pourStartTime > limits.maxPourTimeMs) {
+      LOG_WARN("Tap %u: pour timeout reached!", index);
+      stopPour(STOP_TIMEOUT);
       return false;
     }
 
     // Check for maximum volume
-    if (totalVolume > MAX_POUR_VOLUME) {
-      Serial.println("Maximum pour volume reached!");
-      stopPour();
+    if (currentPulseCount > maxPourPulses) {
+      LOG_WARN("Tap %u: maximum pour volume reached!", index);
+      stopPour(STOP_MAX_VOLUME);
       return false;
     }
   }
@@ -156,32 +394,68 @@ bool PourSystem::performSafetyChecks(bool wifiConnected, bool thingsBoardConnect
 
 void PourSystem::update() {
   // Perform safety checks first
-  bool wifiConnected = (WiFi.status() == WL_CONNECTED);
+  bool wifiConnected = hal::isNetworkConnected();
   bool thingsBoardConnected = true;  // Will be set by main file
 
   if (!performSafetyChecks(wifiConnected, thingsBoardConnected)) {
     return;  // Safety check failed, exit early
   }
 
+  processPulseTimestamps(pouredPulses);
+
+  // Count trailing pulses after a target stop, then feed them to the overshoot model
+  if (isSettling && hal::millis() - settleStartTime >= OVERSHOOT_SETTLE_MS) {
+    finishSettling(counter->getCount());
+  }
+
+  if (isPouring) {
+    updateFlowRate(pouredPulses);
+    updateTargetPulseCount();
+    armStopThreshold();
+
+    // Per-pulse timestamps give a finer rate when the counter has them
+    float flowMlPerSec =
+        pulseStats.getPulses() > 1 ? getInstantFlowRate() : flowRatePps * currentUlPerPulse / 1000;
+    recorder.sample(hal::millis(), flowMlPerSec);
+
+    // Don't hold the valve open until MAX_POUR_TIME on an empty keg or a foaming line
+    FlowFault fault = targetReached ? FLOW_FAULT_NONE
+                                    : faultDetector.check(hal::millis(), pouredPulses, flowRatePps);
+    if (fault != FLOW_FAULT_NONE) {
+      LOG_WARN("⚠️ Tap %u flow fault: %s after %.2fml, stopping pour", index,
+               flowFaultName(fault), getTotalVolume());
+      stopPour(fault == FLOW_FAULT_FOAM        ? STOP_FOAM
+               : fault == FLOW_FAULT_COLLAPSED ? STOP_FLOW_COLLAPSED
+                                               : STOP_NO_FLOW);
+      return;
+    }
+  }
+
   // Enhanced pour start logic with error handling
-  if (isPouring == false && totalVolume == 0 && currentCupSize > 0) {
+  if (isPouring == false && pouredPulses == 0 && currentCupSize > 0) {
     // Additional safety checks before starting pour
     if (currentCupSize <= 0) {
-      Serial.println("Error: Invalid cup size for pour start");
+      LOG_ERROR("Tap %u: invalid cup size for pour start", index);
       return;
     }
 
     if (!wifiConnected || !thingsBoardConnected) {
-      Serial.println("Warning: Starting pour without network connection");
+      LOG_WARN("Tap %u: starting pour without network connection", index);
     }
 
     startPour();
   }
 
-  // Check if target volume reached
-  if (isPouring && totalVolume >= currentCupSize) {
-    Serial.print(currentCupSize);
-    Serial.println("ml reached! Stopping pour...");
-    stopPour();
+  // Valve was already closed by the ISR, finish the pour bookkeeping
+  if (isPouring && targetReached) {
+    LOG_INFO("Tap %u: %dml reached (stopped from ISR)", index, currentCupSize);
+    stopPour(STOP_TARGET_REACHED);
+    return;
+  }
+
+  // Fallback in case the pulse target was not armed
+  if (isPouring && targetUl > 0 && pouredUl >= targetUl) {
+    LOG_INFO("Tap %u: %dml reached! Stopping pour...", index, currentCupSize);
+    stopPour(STOP_TARGET_REACHED);
   }
 }
@@ -2,36 +2,105 @@
 #define POUR_SYSTEM_H
 
 #include <Arduino.h>
-#include <WiFi.h>
+#include "calibration_curve.h"
 #include "constants.h"
+#include "flow_fault_detector.h"
+#include "overshoot_model.h"
+#include "pour_recorder.h"
+#include "pulse_counter.h"
+#include "pulse_statistics.h"
+#include "volume.h"
 
+// Pins of one tap channel
+struct TapPins {
+  uint8_t relayPin;
+  uint8_t flowSensorPin;
+};
+
+// Per-tap safety limits, at most MAX_POUR_TIME and MAX_POUR_VOLUME
+struct PourLimits {
+  uint32_t maxPourTimeMs;
+  uint16_t maxPourVolumeMl;
+};
+
+// One tap channel: valve, flow sensor, calibration, limits and pour state. TapController
+// keeps one per tap in a single array.
 class PourSystem {
  private:
-  // Flow sensor variables
-  volatile unsigned long pulseCount;
-  float mlPerPulse;
-  static portMUX_TYPE spinlock;
+  // Channel wiring, set by init()
+  PulseCounter* counter;
+  uint8_t index;
+  uint8_t relayPin;
+  CalibrationCurve calibration;
+  CalibrationCurve orderCalibration;  // Set by an order for its own pour, over calibration
+  bool hasOrderCalibration;
+
+  // Hard stop target - the counter closes the valve from interrupt context once it is reached
+  unsigned long targetPulseCount;
+  unsigned long armedPulseThreshold;  // Target minus the predicted overshoot
+  volatile bool targetReached;
+
+  // Volume limits as pulse counts, recomputed only when the cup size or calibration changes
+  PourLimits limits;
+  unsigned long maxPourPulses;     // limits.maxPourVolumeMl
+  unsigned long sanityPulseLimit;  // MAX_VOLUME_SANITY
+
+  // Overshoot learning - pulses that still arrive after the valve closes
+  OvershootModel overshootModel;
+  float flowRatePps;
+  unsigned long rateSampleTime;
+  unsigned long rateSampleCount;
+  bool isSettling;
+  unsigned long settleStartTime;
+  unsigned long stopPulseCount;
+  float stopFlowRate;
+
+  // Flow analytics from the counter's per-pulse timestamps
+  PulseStatistics pulseStats;
+
+  // Keg-empty and foam detection while the valve is open
+  FlowFaultDetector faultDetector;
+
+  // Flow rate series and summary of the current pour, for telemetry
+  PourRecorder recorder;
+  StopReason lastStopReason;
+
+  // Volume integral - every pulse adds the calibrated volume for the interval before it
+  Microlitres targetUl;
+  Microlitres pouredUl;
+  unsigned long integratedPulses;
+  uint32_t lastPulseUs;
+  MicrolitresPerPulse currentUlPerPulse;  // Calibration at the latest pulse interval
 
   // Pour tracking variables
-  float totalVolume;
+  unsigned long pouredPulses;  // Count seen by the last safety check
   unsigned long pourStartTime;
 
   // System state flags
   bool isPouring;
   int currentCupSize;
 
-  // Timing variables
-  unsigned long lastWatchdogTime;
+  const CalibrationCurve& pourCalibration() const {
+    return hasOrderCalibration ? orderCalibration : calibration;
+  }
+  void updatePulseLimits();
+  void updateTargetPulseCount();
+  void integrateVolume(unsigned long currentPulseCount);
+  float pulsesToMl(unsigned long pulses) const;
+  unsigned long compensatedThreshold() const;
+  void armStopThreshold();
+  void updateFlowRate(unsigned long currentPulseCount);
+  void finishSettling(unsigned long currentPulseCount);
+  void processPulseTimestamps(unsigned long currentPulseCount);
 
  public:
   PourSystem();
-  void init();
+  void init(PulseCounter& counter, const TapPins& pins, uint8_t index);
   void update();
-  void checkWatchdog();
 
   // Pour control
   void startPour();
-  void stopPour();
+  void stopPour(StopReason reason);
   void emergencyStop();
   void resetCounters();
 
@@ -39,24 +108,43 @@ class PourSystem {
   void setRelay(bool state);
 
   // ThingsBoard RPC handlers
-  void handleCupSizeChange(int value);
+  // A non-zero mlPerPulse measures this pour only, the stored calibration is back once it ends
+  void handleCupSizeChange(int value, float mlPerPulse = 0);
   void handleMlPerPulseChange(float value);
+  void setCalibrationCurve(const CalibrationCurve& curve);
+  void setFlowFaultThresholds(const FlowFaultThresholds& thresholds);
+  bool setPourLimits(const PourLimits& newLimits);
+  static bool isValidPourLimits(const PourLimits& limits);
 
-  // Flow sensor
-  static void IRAM_ATTR pulseCounter();
+  // Flow sensor threshold callback
+  static void IRAM_ATTR onTargetReached(void* arg);
 
   // Getters for status
+  uint8_t getIndex() const { return index; }
+  uint8_t getRelayPin() const { return relayPin; }
   bool getIsReady() const { return !isPouring; }
   bool getIsPouring() const { return isPouring; }
-  float getTotalVolume() const { return totalVolume; }
+  float getTotalVolume() const { return microlitresToMl(pouredUl); }
+  unsigned long getPouredPulses() const { return pouredPulses; }
   int getCurrentCupSize() const { return currentCupSize; }
-  float getMlPerPulse() const { return mlPerPulse; }
+  float getMlPerPulse() const { return calibration.getNominalUlPerPulse() / 1000.0f; }
+  const CalibrationCurve& getCalibrationCurve() const { return calibration; }
+  const FlowFaultDetector& getFlowFaultDetector() const { return faultDetector; }
+  const PourLimits& getPourLimits() const { return limits; }
+  unsigned long getTargetPulseCount() const { return targetPulseCount; }
+  unsigned long getArmedPulseThreshold() const { return armedPulseThreshold; }
+  float getFlowRate() const { return flowRatePps; }
+  bool getIsSettling() const { return isSettling; }
+  const OvershootModel& getOvershootModel() const { return overshootModel; }
+  StopReason getLastStopReason() const { return lastStopReason; }
+  PourRecorder& getRecorder() { return recorder; }
+
+  // Flow analytics for the current pour (empty with counters that have no timestamps)
+  const PulseStatistics& getPulseStatistics() const { return pulseStats; }
+  float getInstantFlowRate() const;
 
   // Safety checks
   bool performSafetyChecks(bool wifiConnected, bool thingsBoardConnected);
 };
 
-// Global instance
-extern PourSystem pourSystem;
-
 #endif  // POUR_SYSTEM_H
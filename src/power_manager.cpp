@@ -0,0 +1,77 @@
+#include "power_manager.h"
+#include "hal.h"
+#include "logger.h"
+
+// Global instance
+PowerManager powerManager;
+
+PowerManager::PowerManager()
+    : enabled(false),
+      idle(false),
+      lightSleep(false),
+      wakePinCount(0),
+      lastBusyMillis(0),
+      idleSinceMillis(0),
+      countedMillis(0),
+      asleepMs(0),
+      idleEntries(0) {
+  memset(wakePins, 0, sizeof(wakePins));
+}
+
+void PowerManager::begin(const uint8_t* flowSensorPins, uint8_t count, bool enabled) {
+  this->enabled = enabled;
+  wakePinCount = count < TAP_MAX_COUNT ? count : TAP_MAX_COUNT;
+  memcpy(wakePins, flowSensorPins, wakePinCount);
+  lastBusyMillis = hal::millis();
+  if (idle.load()) {
+    leaveIdle(lastBusyMillis, "restart");
+  }
+  asleepMs = 0;
+  idleEntries = 0;
+}
+
+void PowerManager::enterIdle(unsigned long nowMillis) {
+  hal::takeWakePinActivity();  // Pulses from before the pins were armed
+  lightSleep = hal::setLowPowerMode(true, wakePins, wakePinCount);
+  idleSinceMillis = nowMillis;
+  countedMillis = nowMillis;
+  idleEntries++;
+  idle.store(true);
+  LOG_INFO("🌙 Idle power mode (%s)", lightSleep ? "light sleep" : "modem sleep only");
+}
+
+void PowerManager::leaveIdle(unsigned long nowMillis, const char* reason) {
+  idle.store(false);
+  hal::setLowPowerMode(false, wakePins, wakePinCount);
+  asleepMs += nowMillis - countedMillis;
+  LOG_INFO("☀️ Full power mode: %s after %lus idle", reason,
+           (nowMillis - idleSinceMillis) / 1000);
+}
+
+void PowerManager::update(bool busy, unsigned long nowMillis) {
+  if (idle.load()) {
+    if (hal::takeWakePinActivity()) {
+      leaveIdle(nowMillis, "flow sensor");
+      lastBusyMillis = nowMillis;
+    } else if (busy) {
+      leaveIdle(nowMillis, "busy");
+    }
+  }
+  if (busy) {
+    lastBusyMillis = nowMillis;
+    return;
+  }
+  if (enabled && !idle.load() && nowMillis - lastBusyMillis >= POWER_IDLE_ENTER_MS) {
+    enterIdle(nowMillis);
+  }
+}
+
+uint32_t PowerManager::takeAsleepMs(unsigned long nowMillis) {
+  uint32_t total = asleepMs;
+  asleepMs = 0;
+  if (idle.load()) {
+    total += nowMillis - countedMillis;
+    countedMillis = nowMillis;
+  }
+  return total;
+}
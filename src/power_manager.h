@@ -0,0 +1,50 @@
+#ifndef POWER_MANAGER_H
+#define POWER_MANAGER_H
+
+#include <Arduino.h>
+#include <atomic>
+#include "constants.h"
+
+// Idle power mode. The network task reports each pass whether anything needs full-rate
+// polling (a pour, an order, a calibration run, no ThingsBoard connection); after
+// POWER_IDLE_ENTER_MS without any it switches the hardware to low-power mode and the tasks
+// stretch their waits: the control task to POWER_IDLE_CONTROL_PERIOD_MS unless a command wakes
+// it, the network task until MQTT data arrives. The chip then light-sleeps between wakeups.
+// Busy again, or flow on a sensor pin, and full power is back on the next pass.
+class PowerManager {
+ private:
+  bool enabled;
+  std::atomic<bool> idle;  // Read by the control and log tasks
+  bool lightSleep;         // Reported by the HAL on the last entry
+  uint8_t wakePins[TAP_MAX_COUNT];
+  uint8_t wakePinCount;
+  unsigned long lastBusyMillis;
+  unsigned long idleSinceMillis;
+  unsigned long countedMillis;  // Idle time up to here is in asleepMs
+  uint32_t asleepMs;            // Idle time not yet taken
+  uint32_t idleEntries;
+
+  void enterIdle(unsigned long nowMillis);
+  void leaveIdle(unsigned long nowMillis, const char* reason);
+
+ public:
+  PowerManager();
+
+  // Flow sensor pins that end the idle mode. disabled keeps full power at all times.
+  void begin(const uint8_t* flowSensorPins, uint8_t count, bool enabled);
+
+  // Network task, once per pass
+  void update(bool busy, unsigned long nowMillis);
+
+  bool isIdle() const { return idle.load(); }
+  bool hasLightSleep() const { return lightSleep; }
+  uint32_t getIdleEntries() const { return idleEntries; }
+
+  // Time spent in the idle mode since the last call, including the current idle period
+  uint32_t takeAsleepMs(unsigned long nowMillis);
+};
+
+// Global instance
+extern PowerManager powerManager;
+
+#endif  // POWER_MANAGER_H
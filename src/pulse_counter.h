@@ -0,0 +1,34 @@
+#ifndef PULSE_COUNTER_H
+#define PULSE_COUNTER_H
+
+#include <Arduino.h>
+#include "constants.h"
+
+// Flow sensor pulse counting backend used by PourSystem.
+// The backend is picked at compile time with USE_PCNT_PULSE_COUNTER (see constants.h).
+class PulseCounter {
+ public:
+  // Runs in interrupt context once the armed threshold is reached - keep it short and in IRAM
+  typedef void (*ThresholdCallback)(void* arg);
+
+  virtual ~PulseCounter() {}
+
+  virtual bool begin(uint8_t pin, ThresholdCallback callback, void* callbackArg) = 0;
+  virtual unsigned long getCount() = 0;
+
+  // Clears the count and disarms the threshold
+  virtual void reset() = 0;
+
+  // Arms the threshold callback for the given absolute count, 0 disarms it
+  virtual void setThreshold(unsigned long count) = 0;
+
+  // Per-pulse hal::micros() timestamps, oldest first. Backends that count in hardware
+  // have no per-pulse timing and never return any.
+  virtual bool readPulseTimestamp(uint32_t& timestampUs) { return false; }
+  virtual uint32_t getDroppedTimestamps() const { return 0; }
+};
+
+// Returns the counter of a tap (0 to TAP_COUNT - 1) from the backend selected at compile time
+PulseCounter& pulseCounterForTap(uint8_t tap);
+
+#endif  // PULSE_COUNTER_H
@@ -0,0 +1,56 @@
+#include "pulse_statistics.h"
+
+PulseStatistics::PulseStatistics() { reset(); }
+
+void PulseStatistics::reset() {
+  firstTimestampUs = 0;
+  lastTimestampUs = 0;
+  pulses = 0;
+  smoothedIntervalUs = 0;
+  meanIntervalUs = 0;
+  sumSquaredDeviations = 0;
+}
+
+void PulseStatistics::addPulse(uint32_t timestampUs) {
+  if (pulses == 0) {
+    firstTimestampUs = timestampUs;
+  } else {
+    // Unsigned subtraction stays correct across the 32-bit micros() wrap
+    uint32_t intervalUs = timestampUs - lastTimestampUs;
+    uint32_t intervals = pulses;  // Intervals seen including this one
+
+    if (intervals == 1) {
+      smoothedIntervalUs = intervalUs;
+    } else {
+      smoothedIntervalUs += FLOW_RATE_EWMA_ALPHA * (intervalUs - smoothedIntervalUs);
+    }
+
+    double delta = intervalUs - meanIntervalUs;
+    meanIntervalUs += delta / intervals;
+    sumSquaredDeviations += delta * (intervalUs - meanIntervalUs);
+  }
+  lastTimestampUs = timestampUs;
+  pulses++;
+}
+
+float PulseStatistics::getInstantFlowRate(float mlPerPulse, uint32_t nowUs) const {
+  if (pulses < 2 || smoothedIntervalUs <= 0) {
+    return 0;
+  }
+
+  // A gap longer than the smoothed interval means the flow is slowing down right now
+  float intervalUs = smoothedIntervalUs;
+  uint32_t sinceLastUs = nowUs - lastTimestampUs;
+  if (sinceLastUs > intervalUs) {
+    intervalUs = sinceLastUs;
+  }
+  return mlPerPulse * 1000000.0 / intervalUs;
+}
+
+float PulseStatistics::getIntervalVarianceUs2() const {
+  return pulses > 2 ? (float)(sumSquaredDeviations / (pulses - 2)) : 0;
+}
+
+unsigned long PulseStatistics::getDurationMs() const {
+  return pulses > 1 ? (lastTimestampUs - firstTimestampUs) / 1000 : 0;
+}
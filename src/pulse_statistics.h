@@ -0,0 +1,37 @@
+#ifndef PULSE_STATISTICS_H
+#define PULSE_STATISTICS_H
+
+#include <Arduino.h>
+#include "constants.h"
+
+// Flow analytics derived from per-pulse timestamps, updated in O(1) per pulse.
+// Keeps a smoothed inter-pulse interval for the instantaneous flow rate and a running
+// (Welford) mean and variance of all intervals in the current pour.
+class PulseStatistics {
+ private:
+  uint32_t firstTimestampUs;
+  uint32_t lastTimestampUs;
+  uint32_t pulses;
+
+  float smoothedIntervalUs;
+  double meanIntervalUs;
+  double sumSquaredDeviations;
+
+ public:
+  PulseStatistics();
+  void reset();
+  void addPulse(uint32_t timestampUs);
+
+  uint32_t getPulses() const { return pulses; }
+  uint32_t getLastTimestampUs() const { return lastTimestampUs; }
+
+  // Flow rate from the smoothed interval; decays once pulses stop arriving
+  float getInstantFlowRate(float mlPerPulse, uint32_t nowUs) const;
+  float getMeanIntervalUs() const { return (float)meanIntervalUs; }
+  float getIntervalVarianceUs2() const;
+
+  // First to last pulse of the current pour
+  unsigned long getDurationMs() const;
+};
+
+#endif  // PULSE_STATISTICS_H
@@ -0,0 +1,31 @@
+#ifndef SHA256_H
+#define SHA256_H
+
+#include <Arduino.h>
+
+#define SHA256_DIGEST_SIZE 32
+#define SHA256_BLOCK_SIZE 64
+
+// SHA-256 (FIPS 180-4), fed in pieces with update()
+class Sha256 {
+ private:
+  uint32_t state[8];
+  uint8_t block[SHA256_BLOCK_SIZE];
+  size_t blockLength;
+  uint64_t totalLength;
+
+  void compress();
+
+ public:
+  Sha256();
+
+  void begin();
+  void update(const void* data, size_t length);
+  void finish(uint8_t digest[SHA256_DIGEST_SIZE]);
+};
+
+// HMAC-SHA256 (RFC 2104)
+void hmacSha256(const uint8_t* key, size_t keyLength, const void* data, size_t length,
+                uint8_t mac[SHA256_DIGEST_SIZE]);
+
+#endif  // SHA256_H
@@ -0,0 +1,68 @@
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+
+// Lock-free single-producer / single-consumer ring buffer.
+// One task (or ISR) pushes, one other task pops; neither side ever blocks or takes a lock.
+// Capacity must be a power of two so the free-running indices can wrap with a mask.
+template <typename T, size_t Capacity>
+class SpscQueue {
+  static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0,
+                "SpscQueue capacity must be a power of two");
+
+ private:
+  T items[Capacity];
+  std::atomic<uint32_t> head;  // Next slot to write, only advanced by the producer
+  std::atomic<uint32_t> tail;  // Next slot to read, only advanced by the consumer
+
+ public:
+  SpscQueue() : head(0), tail(0) {}
+
+  // Producer side - returns false when full, the item is dropped
+  bool push(const T& item) {
+    uint32_t currentHead = head.load(std::memory_order_relaxed);
+    if (currentHead - tail.load(std::memory_order_acquire) >= Capacity) {
+      return false;
+    }
+    items[currentHead & (Capacity - 1)] = item;
+    head.store(currentHead + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer side - returns false when empty
+  bool pop(T& item) {
+    uint32_t currentTail = tail.load(std::memory_order_relaxed);
+    if (currentTail == head.load(std::memory_order_acquire)) {
+      return false;
+    }
+    item = items[currentTail & (Capacity - 1)];
+    tail.store(currentTail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer side, in place - the oldest item stays in its slot until drop()
+  const T* peek() const {
+    uint32_t currentTail = tail.load(std::memory_order_relaxed);
+    if (currentTail == head.load(std::memory_order_acquire)) {
+      return nullptr;
+    }
+    return &items[currentTail & (Capacity - 1)];
+  }
+  void drop() {
+    uint32_t currentTail = tail.load(std::memory_order_relaxed);
+    if (currentTail != head.load(std::memory_order_acquire)) {
+      tail.store(currentTail + 1, std::memory_order_release);
+    }
+  }
+
+  size_t size() const {
+    return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+  }
+  bool isEmpty() const { return size() == 0; }
+  static size_t capacity() { return Capacity; }
+};
+
+#endif  // SPSC_QUEUE_H
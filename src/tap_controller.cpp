@@ -0,0 +1,44 @@
+#include "tap_controller.h"
+#include "logger.h"
+
+static const TapPins TAP_PINS[] = TAP_PIN_TABLE;
+static_assert(TAP_COUNT >= 1 && TAP_COUNT <= TAP_MAX_COUNT, "TAP_COUNT must be 1 to 8");
+static_assert(sizeof(TAP_PINS) / sizeof(TAP_PINS[0]) == TAP_COUNT,
+              "TAP_PIN_TABLE needs one {relay, flow sensor} pair per tap");
+
+static PourSystem taps[TAP_COUNT];
+
+// Global instance
+TapController tapController(taps, TAP_COUNT);
+
+TapController::TapController(PourSystem* taps, uint8_t count) : taps(taps), count(count) {}
+
+void TapController::init(PulseCounter* const* counters, const TapPins* pins) {
+  for (uint8_t i = 0; i < count; i++) {
+    taps[i].init(*counters[i], pins[i], i);
+  }
+  LOG_INFO("✅ %u %s initialized", count, count == 1 ? "tap" : "taps");
+}
+
+void TapController::init() {
+  PulseCounter* counters[TAP_COUNT];
+  for (uint8_t i = 0; i < TAP_COUNT; i++) {
+    counters[i] = &pulseCounterForTap(i);
+  }
+  init(counters, TAP_PINS);
+}
+
+const char* tapKeySuffix(uint8_t tap, char* buffer, size_t size) {
+  if (TAP_COUNT == 1) {
+    buffer[0] = '\0';
+  } else {
+    snprintf(buffer, size, "_%u", tap);
+  }
+  return buffer;
+}
+
+const char* tapKey(const char* key, uint8_t tap, char* buffer, size_t size) {
+  char suffix[8];
+  snprintf(buffer, size, "%s%s", key, tapKeySuffix(tap, suffix, sizeof(suffix)));
+  return buffer;
+}
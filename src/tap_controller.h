@@ -0,0 +1,40 @@
+#ifndef TAP_CONTROLLER_H
+#define TAP_CONTROLLER_H
+
+#include <Arduino.h>
+#include "constants.h"
+#include "pour_system.h"
+#include "pulse_counter.h"
+
+// The tap channels of one board. Channels sit in one contiguous array and the control task
+// updates all of them in index order in a single pass per tick. Each channel's pulse counter
+// calls back into its own channel, so interrupts never search for the tap they belong to.
+class TapController {
+ private:
+  PourSystem* taps;
+  uint8_t count;
+
+ public:
+  TapController(PourSystem* taps, uint8_t count);
+
+  // Wires channel i to counters[i] and pins[i]
+  void init(PulseCounter* const* counters, const TapPins* pins);
+
+  // Firmware wiring: pulseCounterForTap() and TAP_PIN_TABLE
+  void init();
+
+  uint8_t getCount() const { return count; }
+  bool isValid(uint8_t tap) const { return tap < count; }
+  PourSystem& getTap(uint8_t tap) { return taps[tap]; }
+  const PourSystem& getTap(uint8_t tap) const { return taps[tap]; }
+};
+
+// Telemetry and attribute keys of a tap. Single-tap boards keep the plain keys; with more
+// taps every per-tap key gets a "_<tap>" suffix. Both return buffer.
+const char* tapKeySuffix(uint8_t tap, char* buffer, size_t size);
+const char* tapKey(const char* key, uint8_t tap, char* buffer, size_t size);
+
+// Global instance, TAP_COUNT channels
+extern TapController tapController;
+
+#endif  // TAP_CONTROLLER_H
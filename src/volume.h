@@ -0,0 +1,38 @@
+#ifndef VOLUME_H
+#define VOLUME_H
+
+#include <Arduino.h>
+
+// Fixed-point volumes for the pour path. Pouring itself only compares pulse counts; these
+// helpers convert limits to pulses once when they change, and pulses back to volume when
+// something is reported.
+//
+// Calibration is held in microlitres per pulse (2.222 ml/pulse = 2222 ul), volumes in
+// microlitres. Rounding:
+//   - ml/pulse -> ul/pulse    to nearest, at most 0.5 ul per pulse (0.1% at 0.5 ml/pulse)
+//   - ml -> pulse threshold   up, so a limit is never reached early because of rounding
+//   - pulses -> ul            exact
+//   - ul -> reported ml       to nearest 0.1 ml, halves away from zero
+typedef uint32_t MicrolitresPerPulse;
+typedef int64_t Microlitres;
+
+inline MicrolitresPerPulse microlitresPerPulse(float mlPerPulse) {
+  return (MicrolitresPerPulse)(mlPerPulse * 1000.0f + 0.5f);
+}
+
+inline uint32_t pulsesForMl(uint32_t ml, MicrolitresPerPulse ulPerPulse) {
+  return (uint32_t)(((uint64_t)ml * 1000 + ulPerPulse - 1) / ulPerPulse);
+}
+
+inline Microlitres pulsesToMicrolitres(uint32_t pulses, MicrolitresPerPulse ulPerPulse) {
+  return (Microlitres)pulses * ulPerPulse;
+}
+
+// Reporting only - tenths of a ml as an integer, and as a float for JSON and Serial
+inline int32_t microlitresToTenthsMl(Microlitres ul) {
+  return (int32_t)(ul >= 0 ? (ul + 50) / 100 : (ul - 50) / 100);
+}
+
+inline float microlitresToMl(Microlitres ul) { return microlitresToTenthsMl(ul) / 10.0f; }
+
+#endif  // VOLUME_H
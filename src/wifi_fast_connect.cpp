@@ -0,0 +1,117 @@
+#include "wifi_fast_connect.h"
+#include <Preferences.h>
+#include <WiFi.h>
+#include "crc32.h"
+
+static const char* PREFS_NAMESPACE = "wifiFast";
+static const char* PREFS_CONNECTION_KEY = "ap";
+static const uint8_t STORAGE_VERSION = 1;
+
+// Global instance
+WiFiFastConnect wifiFastConnect;
+
+WiFiFastConnect::WiFiFastConnect() : cacheValid(false), usedCache(false) {
+  memset(&cached, 0, sizeof(cached));
+}
+
+uint32_t WiFiFastConnect::checksum(const StoredConnection& stored) {
+  return crc32(&stored, offsetof(StoredConnection, crc));
+}
+
+bool WiFiFastConnect::load() {
+  cacheValid = false;
+  Preferences prefs;
+  if (!prefs.begin(PREFS_NAMESPACE, true)) {
+    return false;  // Nothing stored yet
+  }
+  size_t length = prefs.getBytes(PREFS_CONNECTION_KEY, &cached, sizeof(cached));
+  prefs.end();
+
+  cacheValid = length == sizeof(cached) && cached.version == STORAGE_VERSION &&
+               cached.crc == checksum(cached) && cached.ssid[0] != '\0';
+  return cacheValid;
+}
+
+bool WiFiFastConnect::connect(unsigned long timeoutMs) {
+  usedCache = false;
+  if (!load()) {
+    Serial.println("ℹ️ No cached access point, using WiFiManager");
+    return false;
+  }
+
+  Serial.print("⚡ Fast connect to ");
+  Serial.print(cached.ssid);
+  Serial.print(" on channel ");
+  Serial.println(cached.channel);
+
+  WiFi.mode(WIFI_STA);
+  bool staticIp = WIFI_FAST_CONNECT_STATIC_IP && cached.ip != 0;
+  if (staticIp) {
+    // Skips DHCP; the lease is only reused when the network is known to allow it
+    WiFi.config(IPAddress(cached.ip), IPAddress(cached.gateway), IPAddress(cached.subnet),
+                IPAddress(cached.dns));
+  }
+  WiFi.begin(cached.ssid, cached.psk, cached.channel, cached.bssid);
+
+  unsigned long start = millis();
+  while (WiFi.status() != WL_CONNECTED && millis() - start < timeoutMs) {
+    delay(10);
+  }
+  if (WiFi.status() == WL_CONNECTED) {
+    usedCache = true;
+    return true;
+  }
+
+  Serial.println("⚠️ Fast connect failed, falling back to WiFiManager");
+  WiFi.disconnect();
+  if (staticIp) {
+    WiFi.config(IPAddress((uint32_t)0), IPAddress((uint32_t)0), IPAddress((uint32_t)0));
+  }
+  return false;
+}
+
+void WiFiFastConnect::save() {
+  if (WiFi.status() != WL_CONNECTED) {
+    return;
+  }
+
+  StoredConnection current;
+  memset(&current, 0, sizeof(current));
+  current.version = STORAGE_VERSION;
+  current.channel = WiFi.channel();
+  const uint8_t* bssid = WiFi.BSSID();
+  if (bssid != nullptr) {
+    memcpy(current.bssid, bssid, sizeof(current.bssid));
+  }
+  strncpy(current.ssid, WiFi.SSID().c_str(), sizeof(current.ssid) - 1);
+  strncpy(current.psk, WiFi.psk().c_str(), sizeof(current.psk) - 1);
+  current.ip = (uint32_t)WiFi.localIP();
+  current.gateway = (uint32_t)WiFi.gatewayIP();
+  current.subnet = (uint32_t)WiFi.subnetMask();
+  current.dns = (uint32_t)WiFi.dnsIP();
+  current.crc = checksum(current);
+
+  // Unchanged on almost every boot; skip the flash write then
+  if (cacheValid && memcmp(&current, &cached, sizeof(current)) == 0) {
+    return;
+  }
+
+  Preferences prefs;
+  if (!prefs.begin(PREFS_NAMESPACE, false)) {
+    Serial.println("❌ Failed to open WiFi fast connect storage");
+    return;
+  }
+  prefs.putBytes(PREFS_CONNECTION_KEY, &current, sizeof(current));
+  prefs.end();
+  cached = current;
+  cacheValid = true;
+}
+
+void WiFiFastConnect::clear() {
+  Preferences prefs;
+  if (prefs.begin(PREFS_NAMESPACE, false)) {
+    prefs.clear();
+    prefs.end();
+  }
+  cacheValid = false;
+}
@@ -0,0 +1,51 @@
+#ifndef WIFI_FAST_CONNECT_H
+#define WIFI_FAST_CONNECT_H
+
+#include <Arduino.h>
+#include "constants.h"
+
+// Remembers the access point of the last good connection (SSID, passphrase, channel, BSSID
+// and the IP lease) in NVS. After a restart connect() associates with that AP directly,
+// skipping the channel scan WiFiManager runs on every boot; WiFiManager is only needed when
+// that fails.
+class WiFiFastConnect {
+ private:
+  struct StoredConnection {
+    uint8_t version;
+    uint8_t channel;
+    uint8_t bssid[6];
+    char ssid[33];
+    char psk[65];
+    uint32_t ip;  // Last lease, only reused with WIFI_FAST_CONNECT_STATIC_IP
+    uint32_t gateway;
+    uint32_t subnet;
+    uint32_t dns;
+    uint32_t crc;
+  };
+
+  StoredConnection cached;
+  bool cacheValid;
+  bool usedCache;
+
+  bool load();
+  static uint32_t checksum(const StoredConnection& stored);
+
+ public:
+  WiFiFastConnect();
+
+  // Try the cached access point. Returns true once connected within timeoutMs.
+  bool connect(unsigned long timeoutMs);
+
+  // Store the current connection, only writing NVS when it differs from the cache
+  void save();
+
+  // Forget the cached access point (WiFi reset)
+  void clear();
+
+  bool wasUsed() const { return usedCache; }
+};
+
+// Global instance
+extern WiFiFastConnect wifiFastConnect;
+
+#endif  // WIFI_FAST_CONNECT_H